@@ -77,6 +77,9 @@ typedef struct
     char*         qc_args;                             /**< Arguments for the query classifier */
     int           query_retries;                       /**< Number of times a interrupted query is retried */
     time_t        query_retry_timeout;                 /**< Timeout for query retries */
+    uint64_t      writeq_high_water;                   /**< High water mark of network write queues */
+    uint64_t      writeq_low_water;                    /**< Low water mark of network write queues */
+    bool          listener_sharding;                   /**< Give each thread its own listener sockets */
 } MXS_CONFIG;
 
 /**
@@ -23,6 +23,7 @@
 #include <maxscale/authenticator.h>
 #include <maxscale/ssl.h>
 #include <maxscale/modinfo.h>
+#include <maxscale/timer.h>
 #include <netinet/in.h>
 
 MXS_BEGIN_DECLS
@@ -76,6 +77,10 @@ typedef struct dcbstats
     int     n_buffered;     /*< Number of buffered writes */
     int     n_high_water;   /*< Number of crosses of high water mark */
     int     n_low_water;    /*< Number of crosses of low water mark */
+    int     n_read_paused;  /*< Number of times reading was paused */
+    int     n_write_calls;  /*< Number of write system calls */
+    uint64_t n_bytes_written; /*< Number of bytes written to the socket */
+    uint64_t n_bytes_read;  /*< Number of bytes read from the socket */
 } DCBSTATS;
 
 #define DCBSTATS_INIT {0}
@@ -192,6 +197,7 @@ typedef struct dcb
     dcb_role_t      dcb_role;
     DCBEVENTQ       evq;            /**< The event queue for this DCB */
     int             fd;             /**< The descriptor */
+    int             *listener_fds;  /**< Per-thread listener sockets, NULL if not sharded */
     dcb_state_t     state;          /**< Current descriptor state */
     SSL_STATE       ssl_state;      /**< Current state of SSL if in use */
     int             flags;          /**< DCB flags */
@@ -211,9 +217,11 @@ typedef struct dcb
     GWBUF           *delayq;        /**< Delay Backend Write Data Queue */
     GWBUF           *dcb_readqueue; /**< read queue for storing incomplete reads */
     GWBUF           *dcb_fakequeue; /**< Fake event queue for generated events */
+    int             read_size;      /**< Size of the next read buffer, 0 for the minimum */
 
     DCBSTATS        stats;          /**< DCB related statistics */
     struct dcb      *nextpersistent;   /**< Next DCB in the persistent pool for SERVER */
+    struct dcb      *session_next;  /**< Next backend DCB of the same session */
     time_t          persistentstart;   /**< Time when DCB placed in persistent pool */
     struct service  *service;       /**< The related service */
     void            *data;          /**< Specific client data, shared between DCBs of this session */
@@ -230,6 +238,9 @@ typedef struct dcb
     bool            ssl_write_want_read;    /*< Flag */
     bool            ssl_write_want_write;    /*< Flag */
     bool            was_persistent;  /**< Whether this DCB was in the persistent pool */
+    MXS_TIMER       idle_timer;     /**< Timer for closing idle client connections */
+    uint64_t        connect_start;  /**< When the backend connection was initiated, in microseconds */
+    uint64_t        request_start;  /**< When the oldest unanswered backend request was written */
     struct
     {
         int id; /**< The owning thread's ID */
@@ -244,7 +255,7 @@ typedef struct dcb
     .stats = {0}, .memdata = DCBMM_INIT, \
     .fd = DCBFD_CLOSED, .stats = DCBSTATS_INIT, .ssl_state = SSL_HANDSHAKE_UNKNOWN, \
     .state = DCB_STATE_ALLOC, .dcb_chk_tail = CHK_NUM_DCB, \
-    .authenticator_data = NULL, .thread = {0}}
+    .authenticator_data = NULL, .thread = {0}, .idle_timer = MXS_TIMER_INIT}
 
 /**
  * The DCB usage filer used for returning DCB's in use for a certain reason
@@ -265,7 +276,7 @@ typedef enum
 #define DCB_ISZOMBIE(x)                 ((x)->state == DCB_STATE_ZOMBIE)
 #define DCB_WRITEQLEN(x)                (x)->writeqlen
 #define DCB_SET_LOW_WATER(x, lo)        (x)->low_water = (lo);
-#define DCB_SET_HIGH_WATER(x, hi)       (x)->low_water = (hi);
+#define DCB_SET_HIGH_WATER(x, hi)       (x)->high_water = (hi);
 #define DCB_BELOW_LOW_WATER(x)          ((x)->low_water && (x)->writeqlen < (x)->low_water)
 #define DCB_ABOVE_HIGH_WATER(x)         ((x)->high_water && (x)->writeqlen > (x)->high_water)
 
@@ -299,6 +310,19 @@ void dcb_close(DCB *);
  */
 void dcb_process_zombies(int threadid);
 
+/**
+ * @brief Start deferring the draining of write queues
+ *
+ * Writes to the DCBs of the calling thread are queued until dcb_end_batch
+ * is called so that several small writes to one socket go out together.
+ */
+void dcb_start_batch();
+
+/**
+ * @brief Drain the write queues deferred since dcb_start_batch
+ */
+void dcb_end_batch();
+
 /**
  * Add a DCB to the owner's list
  *
@@ -330,7 +354,38 @@ int dcb_connect_SSL(DCB* dcb);
 int dcb_listen(DCB *listener, const char *config, const char *protocol_name);
 void dcb_append_readqueue(DCB *dcb, GWBUF *buffer);
 void dcb_enable_session_timeouts();
-void dcb_process_idle_sessions(int thr);
+
+/**
+ * @brief Start the idle timeout timer of a client DCB
+ *
+ * The timer is only started if the service of the DCB has a connection
+ * idle timeout. This must be called by the thread that owns the DCB.
+ *
+ * @param dcb Client DCB
+ */
+void dcb_start_idle_timer(DCB *dcb);
+
+/**
+ * @brief Stop reading from a DCB
+ *
+ * Read events of the DCB are ignored and the data is left in the socket
+ * until dcb_resume_reading() is called. This is used to stop reading from a
+ * server while the client is slower at consuming the data. This must be
+ * called by the thread that owns the DCB.
+ *
+ * @param dcb DCB to pause
+ */
+void dcb_pause_reading(DCB *dcb);
+
+/**
+ * @brief Continue reading from a paused DCB
+ *
+ * A read event is generated for the DCB as the data that arrived while
+ * reading was paused does not generate a new event.
+ *
+ * @param dcb DCB to resume
+ */
+void dcb_resume_reading(DCB *dcb);
 
 /**
  * @brief Call a function for each connected DCB
@@ -365,6 +420,10 @@ DCB* dcb_get_current();
 #define DCBF_CLONE              0x0001  /*< DCB is a clone */
 #define DCBF_HUNG               0x0002  /*< Hangup has been dispatched */
 #define DCBF_REPLIED    0x0004  /*< DCB was written to */
+#define DCBF_READ_PAUSED        0x0008  /*< Read events are ignored */
+#define DCBF_THROTTLING         0x0010  /*< Reading from the other side of the session is paused */
+#define DCBF_WARMUP             0x0020  /*< Connection goes to the persistent pool once authenticated */
+#define DCBF_DRAIN_DEFERRED     0x0040  /*< Write queue is drained at the end of the event batch */
 
 #define DCB_IS_CLONE(d) ((d)->flags & DCBF_CLONE)
 #define DCB_REPLIED(d) ((d)->flags & DCBF_REPLIED)
@@ -0,0 +1,156 @@
+#pragma once
+/*
+ * Copyright (c) 2016 MariaDB Corporation Ab
+ *
+ * Use of this software is governed by the Business Source License included
+ * in the LICENSE.TXT file and at www.mariadb.com/bsl11.
+ *
+ * Change Date: 2019-07-01
+ *
+ * On the date above, in accordance with the Business Source License, use
+ * of this software will be governed by version 2 or later of the General
+ * Public License.
+ */
+
+/**
+ * @file histogram.h  Per-thread latency histograms
+ *
+ * The histograms store values, typically latencies in microseconds, in
+ * log-linear buckets: each power of two is split into eight equally wide
+ * buckets which keeps the relative error of a recorded value below 12.5%.
+ *
+ * Each thread records into its own copy of the histogram so recording a
+ * value requires neither locks nor atomic operations. The copies are only
+ * added together when the histogram is read.
+ */
+
+#include <maxscale/cdefs.h>
+#include <stdint.h>
+
+MXS_BEGIN_DECLS
+
+struct dcb;
+
+/** Number of sub-buckets per power of two, as a power of two */
+#define MXS_HISTOGRAM_SUB_BITS 3
+#define MXS_HISTOGRAM_SUB_BUCKETS (1 << MXS_HISTOGRAM_SUB_BITS)
+
+/** Values at or above 2^MXS_HISTOGRAM_MAX_BITS are stored in the last bucket */
+#define MXS_HISTOGRAM_MAX_BITS 36
+
+#define MXS_HISTOGRAM_BUCKETS ((MXS_HISTOGRAM_MAX_BITS - MXS_HISTOGRAM_SUB_BITS + 1) * \
+                               MXS_HISTOGRAM_SUB_BUCKETS)
+
+typedef struct mxs_histogram MXS_HISTOGRAM;
+
+/**
+ * The combined values of all threads
+ */
+typedef struct mxs_histogram_snapshot
+{
+    uint64_t count;                          /**< Number of recorded values */
+    uint64_t sum;                            /**< Sum of recorded values */
+    uint64_t max;                            /**< Largest recorded value */
+    uint64_t buckets[MXS_HISTOGRAM_BUCKETS]; /**< Number of values in each bucket */
+} MXS_HISTOGRAM_SNAPSHOT;
+
+/**
+ * @brief Allocate a new histogram
+ *
+ * The histogram has one copy for each polling thread.
+ *
+ * @return New histogram or NULL if memory allocation failed
+ */
+MXS_HISTOGRAM* mxs_histogram_alloc();
+
+/**
+ * @brief Free a histogram
+ *
+ * @param histogram Histogram to free, may be NULL
+ */
+void mxs_histogram_free(MXS_HISTOGRAM *histogram);
+
+/**
+ * @brief Record a value
+ *
+ * @param histogram Histogram to record to, may be NULL
+ * @param value     The value to record
+ * @param thread_id The ID of the calling polling thread
+ */
+void mxs_histogram_record(MXS_HISTOGRAM *histogram, uint64_t value, int thread_id);
+
+/**
+ * @brief Combine the values of all threads
+ *
+ * The values are read without locking which means that values that are
+ * recorded while the snapshot is being taken may or may not be included.
+ *
+ * @param histogram Histogram to read
+ * @param snapshot  Where the combined values are stored
+ */
+void mxs_histogram_snapshot(const MXS_HISTOGRAM *histogram, MXS_HISTOGRAM_SNAPSHOT *snapshot);
+
+/**
+ * @brief Calculate a percentile
+ *
+ * @param snapshot   Snapshot of the histogram
+ * @param percentile The percentile to calculate, between 0 and 100
+ *
+ * @return The upper bound of the bucket that contains the percentile or 0
+ *         if no values have been recorded
+ */
+uint64_t mxs_histogram_percentile(const MXS_HISTOGRAM_SNAPSHOT *snapshot, double percentile);
+
+/**
+ * @brief Find the bucket of a value
+ *
+ * @param value Value to look up
+ *
+ * @return The index of the bucket where @c value is stored
+ */
+int mxs_histogram_bucket(uint64_t value);
+
+/**
+ * @brief The lower bound of a bucket
+ *
+ * @param bucket Bucket index
+ *
+ * @return The smallest value stored in the bucket
+ */
+uint64_t mxs_histogram_bucket_lower(int bucket);
+
+/**
+ * @brief Print a histogram in the Prometheus text exposition format
+ *
+ * The values are assumed to be microseconds and are printed in seconds with
+ * a bucket for each power of two from 16 microseconds to 16 seconds. The
+ * metric type and help texts are not printed.
+ *
+ * @param dcb       DCB to print to
+ * @param histogram Histogram to print
+ * @param name      Metric name
+ * @param labels    Label pairs without the braces, e.g. @c service="RW", or
+ *                  an empty string
+ */
+void mxs_histogram_print_prometheus(struct dcb *dcb, const MXS_HISTOGRAM *histogram,
+                                    const char *name, const char *labels);
+
+/**
+ * @brief Print the median, the 99th percentile and the maximum of a histogram
+ *
+ * The output is formatted for the maxadmin @c show commands.
+ *
+ * @param dcb       DCB to print to
+ * @param histogram Histogram to print
+ * @param title     Title of the line, e.g. "Query latency:"
+ */
+void mxs_histogram_dprint(struct dcb *dcb, const MXS_HISTOGRAM *histogram, const char *title);
+
+/**
+ * @brief Get the current monotonic time
+ *
+ * @return Monotonic time in microseconds
+ */
+uint64_t mxs_histogram_now();
+
+MXS_END_DECLS
@@ -61,6 +61,14 @@ MXS_BEGIN_DECLS
  */
 #define MXS_MAX_NW_READ_BUFFER_SIZE (32 * 1024)
 
+/**
+ * MXS_MIN_NW_READ_BUFFER_SIZE
+ *
+ * The size of the first buffer a DCB reads into. The size grows up to
+ * MXS_MAX_NW_READ_BUFFER_SIZE when the reads fill the whole buffer.
+ */
+#define MXS_MIN_NW_READ_BUFFER_SIZE 1024
+
 /**
  * MXS_MAX_THREADS
  *
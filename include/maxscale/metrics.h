@@ -0,0 +1,49 @@
+#pragma once
+/*
+ * Copyright (c) 2016 MariaDB Corporation Ab
+ *
+ * Use of this software is governed by the Business Source License included
+ * in the LICENSE.TXT file and at www.mariadb.com/bsl11.
+ *
+ * Change Date: 2019-07-01
+ *
+ * On the date above, in accordance with the Business Source License, use
+ * of this software will be governed by version 2 or later of the General
+ * Public License.
+ */
+
+/**
+ * @file metrics.h  Export of the MaxScale metrics
+ */
+
+#include <maxscale/cdefs.h>
+#include <maxscale/dcb.h>
+
+MXS_BEGIN_DECLS
+
+/** The content type of the Prometheus text exposition format */
+#define MXS_METRICS_CONTENT_TYPE "text/plain; version=0.0.4"
+
+/**
+ * @brief Print all metrics in the Prometheus text exposition format
+ *
+ * The output contains the latency histograms and the main counters of
+ * the services, the servers and the polling system.
+ *
+ * @param dcb DCB to print to
+ */
+void mxs_metrics_print_prometheus(DCB *dcb);
+
+/**
+ * @brief Escape a label value for the Prometheus text exposition format
+ *
+ * Backslashes, double quotes and newlines are escaped with a backslash.
+ *
+ * @param dest  Buffer of at least 2 * strlen(value) + 1 bytes
+ * @param value The label value
+ *
+ * @return @c dest
+ */
+char* mxs_metrics_escape_label(char *dest, const char *value);
+
+MXS_END_DECLS
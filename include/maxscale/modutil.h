@@ -76,6 +76,115 @@ mxs_pcre2_result_t modutil_mysql_wildcard_match(const char* pattern, const char*
  */
 char* modutil_MySQL_bypass_whitespace(char* sql, size_t len);
 
+/** A substitution done by modutil_rewrite_SQL() */
+typedef struct mxs_rewrite_rule
+{
+    pcre2_code *re;      /**< Pattern compiled with mxs_pcre2_compile() */
+    const char *replace; /**< Replacement text, may refer to captured substrings */
+} MXS_REWRITE_RULE;
+
+/**
+ * @brief Rewrite the SQL of a COM_QUERY packet
+ *
+ * The rules are applied in order, each rule to the result of the previous
+ * one, and all occurrences of a pattern are replaced. The SQL is read directly
+ * from the packet and the intermediate results are kept in buffers owned by
+ * the calling thread. Only the result is copied into a new buffer that has
+ * exactly the size of the rewritten packet.
+ *
+ * The hint, the properties and the type of @c buffer are moved to the new
+ * buffer. The caller still owns @c buffer and should free it if a new buffer
+ * is returned.
+ *
+ * @param buffer  Contiguous buffer with a COM_QUERY packet
+ * @param rules   The rules to apply
+ * @param n_rules Number of rules
+ * @param matched If not NULL, an array of @c n_rules elements where each
+ *                element is set to true if the rule matched
+ *
+ * @return A buffer with the rewritten packet or NULL if none of the rules
+ *         matched, if @c buffer is not a complete COM_QUERY packet or if
+ *         the rewriting failed
+ */
+GWBUF* modutil_rewrite_SQL(GWBUF *buffer, const MXS_REWRITE_RULE *rules, int n_rules, bool *matched);
+
+/** How many bytes of each reply packet the reply tracker inspects */
+#define MXS_REPLY_TRACKER_PREFIX 32
+
+/**
+ * Tracks the reply to one command as it arrives in arbitrarily split
+ * buffers. Only the start of each packet is copied, the rest is skipped.
+ */
+typedef struct mxs_reply_tracker
+{
+    uint8_t  command;      /**< The command the reply is for */
+    int      state;        /**< Reply parsing state */
+    int      n_eof;        /**< EOF packets left in a prepared statement reply */
+    uint8_t  packet[MXS_REPLY_TRACKER_PREFIX]; /**< Start of the current packet */
+    size_t   packet_have;  /**< Bytes of the packet start collected so far */
+    size_t   packet_skip;  /**< Bytes of the current packet left to skip */
+    bool     large_packet; /**< The previous packet had the maximum length */
+    uint64_t rows;         /**< Number of rows in the result sets */
+    bool     error;        /**< The reply contained an error */
+    bool     local_infile; /**< The server requested a file from the client */
+} MXS_REPLY_TRACKER;
+
+/**
+ * @brief Start tracking the reply to a command
+ *
+ * @param tracker Tracker to initialize
+ * @param command The MySQL command byte of the request
+ */
+void modutil_reply_tracker_init(MXS_REPLY_TRACKER *tracker, uint8_t command);
+
+/**
+ * @brief Process a part of a reply
+ *
+ * The buffer must only contain data that belongs to the reply that is
+ * being tracked.
+ *
+ * @param tracker Tracker to update
+ * @param reply   The next part of the reply
+ *
+ * @return True if the reply is complete
+ */
+bool modutil_reply_tracker_process(MXS_REPLY_TRACKER *tracker, GWBUF *reply);
+
+/**
+ * @brief Process a reply from a buffer that may contain the following replies
+ *
+ * This is used when more than one command is sent before the replies are
+ * read. Processing stops at the end of the tracked reply.
+ *
+ * @param tracker Tracker to update
+ * @param reply   Buffer with replies
+ * @param offset  Offset where processing starts, updated to the offset where
+ *                the next reply starts
+ *
+ * @return True if the reply is complete
+ */
+bool modutil_reply_tracker_consume(MXS_REPLY_TRACKER *tracker, GWBUF *reply, size_t *offset);
+
+/**
+ * @brief Start tracking the reply to the next pipelined command
+ *
+ * Unlike modutil_reply_tracker_init(), this skips the part of the last packet
+ * of the previous reply that was not yet processed.
+ *
+ * @param tracker Tracker of the previous reply
+ * @param command The MySQL command byte of the next request
+ */
+void modutil_reply_tracker_next(MXS_REPLY_TRACKER *tracker, uint8_t command);
+
+/**
+ * @brief Check whether a command is answered by the server
+ *
+ * @param command MySQL command byte
+ *
+ * @return False for commands that the server does not reply to
+ */
+bool modutil_command_has_reply(uint8_t command);
+
 /** Character and token searching functions */
 char* strnchr_esc(char* ptr, char c, int len);
 char* strnchr_esc_mysql(char* ptr, char c, int len);
@@ -19,6 +19,7 @@
  */
 
 #include <maxscale/cdefs.h>
+#include <stdint.h>
 
 MXS_BEGIN_DECLS
 
@@ -37,9 +38,74 @@ typedef enum
     MXS_PCRE2_ERROR
 } mxs_pcre2_result_t;
 
+/** Initial and maximum size of the per-thread JIT stacks */
+#define MXS_PCRE2_JIT_STACK_MIN (32 * 1024)
+#define MXS_PCRE2_JIT_STACK_MAX (512 * 1024)
+
 mxs_pcre2_result_t mxs_pcre2_substitute(pcre2_code *re, const char *subject,
                                         const char *replace, char** dest, size_t* size);
 mxs_pcre2_result_t mxs_pcre2_simple_match(const char* pattern, const char* subject,
                                           int options, int* error);
 
+/**
+ * @brief Compile a pattern
+ *
+ * The pattern is JIT compiled if JIT is supported. Patterns are shared: if the
+ * same pattern has already been compiled with the same options, the existing
+ * compiled pattern is returned. A compiled pattern can be used by all threads
+ * at the same time and it must be freed with mxs_pcre2_release().
+ *
+ * @param pattern The pattern to compile
+ * @param options PCRE2 compilation options
+ *
+ * @return The compiled pattern or NULL if the compilation failed. The errors
+ *         are logged.
+ */
+pcre2_code* mxs_pcre2_compile(const char *pattern, uint32_t options);
+
+/**
+ * @brief Release a pattern compiled with mxs_pcre2_compile()
+ *
+ * @param code The compiled pattern, can be NULL
+ */
+void mxs_pcre2_release(pcre2_code *code);
+
+/**
+ * @brief Match a subject against a compiled pattern
+ *
+ * The match data and the JIT stack of the calling thread are used so no
+ * memory is allocated for the match.
+ *
+ * @param code    Compiled pattern
+ * @param subject The subject string
+ * @param length  Length of @c subject or PCRE2_ZERO_TERMINATED
+ *
+ * @return MXS_PCRE2_MATCH if the subject matches, MXS_PCRE2_NOMATCH if it does
+ *         not and MXS_PCRE2_ERROR if the matching failed
+ */
+mxs_pcre2_result_t mxs_pcre2_match(const pcre2_code *code, const char *subject, size_t length);
+
+/**
+ * @brief Get the match data of the calling thread
+ *
+ * The match data is large enough to hold all captured substrings of @c code.
+ * It stays valid until the next call to a function that uses the match data
+ * of the thread, e.g. mxs_pcre2_match() or mxs_pcre2_substitute().
+ *
+ * @param code Compiled pattern the match data is used with
+ *
+ * @return The match data or NULL if memory allocation failed
+ */
+pcre2_match_data* mxs_pcre2_thread_match_data(const pcre2_code *code);
+
+/**
+ * @brief Get the match context of the calling thread
+ *
+ * The context uses a JIT stack that belongs to the calling thread.
+ *
+ * @return The match context or NULL if memory allocation failed. NULL can be
+ *         passed to the PCRE2 functions in which case the defaults are used.
+ */
+pcre2_match_context* mxs_pcre2_thread_match_context(void);
+
 MXS_END_DECLS
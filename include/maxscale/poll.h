@@ -62,6 +62,16 @@ void poll_fake_write_event(DCB *dcb);
  */
 void poll_fake_read_event(DCB *dcb);
 
+/**
+ * @brief Get the ID of the calling polling thread
+ *
+ * The IDs run from zero to one less than the number of polling threads
+ * and can be used to index per-thread data.
+ *
+ * @return The thread ID or -1 if the calling thread is not a polling thread
+ */
+int poll_get_thread_id();
+
 /**
  * Add a DCB to the set of descriptors within the polling
  * environment.
@@ -20,6 +20,7 @@
 
 #include <maxscale/cdefs.h>
 #include <maxscale/dcb.h>
+#include <maxscale/histogram.h>
 #include <maxscale/resultset.h>
 
 MXS_BEGIN_DECLS
@@ -51,6 +52,10 @@ typedef struct
     int n_persistent;     /**< Current persistent pool */
     uint64_t n_new_conn;  /**< Times the current pool was empty */
     uint64_t n_from_pool; /**< Times when a connection was available from the pool */
+    int n_warming;        /**< Connections being opened for the persistent pool */
+    uint64_t n_warm_conn; /**< Connections opened for the persistent pool */
+    MXS_HISTOGRAM *response_time; /**< Time until the first byte of a response, in microseconds */
+    MXS_HISTOGRAM *connect_time;  /**< Time until the server handshake arrives, in microseconds */
 } SERVER_STATS;
 
 /**
@@ -92,6 +97,7 @@ typedef struct server
     DCB            **persistent;    /**< List of unused persistent connections to the server */
     long           persistpoolmax; /**< Maximum size of persistent connections pool */
     long           persistmaxtime; /**< Maximum number of seconds connection can live */
+    long           persistpoolwarm; /**< Pooled connections kept ready per user and thread */
     int            persistmax;     /**< Maximum pool size actually achieved since startup */
     uint8_t        charset;        /**< Default server character set */
     bool           is_active;      /**< Server is active and has not been "destroyed" */
@@ -284,6 +290,7 @@ extern void server_add_mon_user(SERVER *server, const char *user, const char *pa
 extern const char *server_get_parameter(const SERVER *server, char *name);
 extern void server_update_credentials(SERVER *server, const char *user, const char *passwd);
 extern DCB  *server_get_persistent(SERVER *server, const char *user, const char *protocol, int id);
+extern void server_clean_persistent(int id);
 extern void server_update_address(SERVER *server, const char *address);
 extern void server_update_port(SERVER *server,  unsigned short port);
 extern unsigned int server_map_status(const char *str);
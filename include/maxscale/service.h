@@ -51,6 +51,8 @@ typedef struct
     int    n_failed_starts; /**< Number of times this service has failed to start */
     int    n_sessions;      /**< Number of sessions created on service since start */
     int    n_current;       /**< Current number of sessions */
+    MXS_HISTOGRAM *query_latency; /**< Time from a client request to the first byte
+                                   *   of the reply, in microseconds */
 } SERVICE_STATS;
 
 /**
@@ -143,6 +145,8 @@ typedef struct service
                                         * when querying them from the server. MySQL Workbench seems
                                         * to escape at least the underscore character. */
     SERVICE_REFRESH_RATE rate_limit;   /**< The refresh rate limit for users table */
+    uint64_t users_refresh_requested;  /**< Number of background user refreshes requested */
+    uint64_t users_refresh_served;     /**< Requests covered by the last completed refresh */
     MXS_FILTER_DEF **filters;          /**< Ordered list of filters */
     int n_filters;                     /**< Number of filters */
     uint64_t conn_idle_timeout;            /**< Session timeout in seconds */
@@ -263,6 +267,30 @@ int   serviceStripDbEsc(SERVICE* service, int action);
 int   serviceAuthAllServers(SERVICE *service, int action);
 int   service_refresh_users(SERVICE *service);
 
+/**
+ * @brief Request a background refresh of the users of a service
+ *
+ * The users are loaded by a dedicated thread so the calling thread is never
+ * blocked by the backend queries. Requests made while a refresh is queued or
+ * in progress are merged into the next refresh. The refresh rate limit of
+ * service_refresh_users() still applies.
+ *
+ * @param service Service whose users are refreshed
+ *
+ * @return Ticket that can be passed to service_users_refreshed()
+ */
+uint64_t service_refresh_users_async(SERVICE *service);
+
+/**
+ * @brief Check whether a background user refresh has completed
+ *
+ * @param service Service to check
+ * @param ticket  Ticket returned by service_refresh_users_async()
+ *
+ * @return True if a refresh that covers the request has completed
+ */
+bool service_users_refreshed(SERVICE *service, uint64_t ticket);
+
 /**
  * Diagnostics
  */
@@ -77,6 +77,8 @@ typedef enum
 typedef struct
 {
     time_t          connect;        /**< Time when the session was started */
+    uint64_t        query_start;    /**< When the unanswered client request was
+                                     *   received, in microseconds */
 } MXS_SESSION_STATS;
 
 /**
@@ -129,6 +131,7 @@ typedef struct session
     mxs_session_state_t     state;            /*< Current descriptor state */
     size_t                  ses_id;           /*< Unique session identifier */
     struct dcb              *client_dcb;      /*< The client connection */
+    struct dcb              *backends;        /*< The backend connections */
     void                    *router_session;  /*< The router instance data */
     MXS_SESSION_STATS       stats;            /*< Session statistics */
     struct service          *service;         /*< The service this session is using */
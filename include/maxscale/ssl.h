@@ -20,6 +20,7 @@
 
 #include <maxscale/cdefs.h>
 #include <maxscale/protocol.h>
+#include <maxscale/spinlock.h>
 #include <openssl/crypto.h>
 #include <openssl/ssl.h>
 #include <openssl/err.h>
@@ -66,10 +67,20 @@ typedef struct ssl_listener
     char *ssl_ca_cert;                  /*< SSL CA certificate */
     bool ssl_init_done;                 /*< If SSL has already been initialized for this service */
     bool ssl_verify_peer_certificate;   /*< Enable peer certificate verification */
+    bool ssl_session_cache;             /*< Enable session resumption */
+    SSL_SESSION *session;               /*< Session resumed by new connections to a server */
+    SPINLOCK session_lock;              /*< Protects session */
+    uint64_t n_handshakes;              /*< Number of completed handshakes */
+    uint64_t n_resumed;                 /*< Number of handshakes that resumed a session */
+    uint64_t n_records;                 /*< Number of records written */
+    uint64_t n_bytes;                   /*< Number of bytes written */
     struct ssl_listener
         *next;          /*< Next SSL configuration, currently used to store obsolete configurations */
 } SSL_LISTENER;
 
+/** The largest amount of data in one TLS record */
+#define MXS_SSL_RECORD_SIZE (16 * 1024)
+
 int ssl_authenticate_client(struct dcb *dcb, bool is_capable);
 bool ssl_is_connection_healthy(struct dcb *dcb);
 bool ssl_check_data_to_process(struct dcb *dcb);
@@ -77,5 +88,6 @@ bool ssl_required_by_dcb(struct dcb *dcb);
 bool ssl_required_but_not_negotiated(struct dcb *dcb);
 const char* ssl_method_type_to_string(ssl_method_type_t method_type);
 void write_ssl_config(int fd, SSL_LISTENER* ssl);
+void ssl_print_stats(struct dcb *dcb, SSL_LISTENER* ssl);
 
 MXS_END_DECLS
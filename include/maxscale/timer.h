@@ -0,0 +1,117 @@
+#pragma once
+/*
+ * Copyright (c) 2016 MariaDB Corporation Ab
+ *
+ * Use of this software is governed by the Business Source License included
+ * in the LICENSE.TXT file and at www.mariadb.com/bsl11.
+ *
+ * Change Date: 2019-07-01
+ *
+ * On the date above, in accordance with the Business Source License, use
+ * of this software will be governed by version 2 or later of the General
+ * Public License.
+ */
+
+/**
+ * @file timer.h  Per-thread timers with millisecond resolution
+ *
+ * Each polling thread owns a hierarchical timer wheel. A timer is always
+ * started, stopped and fired on the thread that owns it which means that
+ * no locking is needed. This makes the timers suitable for per-session or
+ * per-connection timeouts where the housekeeper's one second resolution and
+ * global task list are not adequate.
+ *
+ * The timer structure is owned by the caller and is typically embedded in
+ * the object it relates to, e.g. a DCB.
+ */
+
+#include <maxscale/cdefs.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+MXS_BEGIN_DECLS
+
+struct mxs_timer;
+
+/**
+ * Timer callback
+ *
+ * @param timer The timer that expired
+ * @param data  The user data given to mxs_timer_init()
+ */
+typedef void (*mxs_timer_cb_t)(struct mxs_timer *timer, void *data);
+
+typedef struct mxs_timer
+{
+    struct mxs_timer *next;     /*< Next timer in the wheel slot */
+    struct mxs_timer *prev;     /*< Previous timer in the wheel slot */
+    uint64_t          expires;  /*< When the timer expires, in milliseconds */
+    uint32_t          interval; /*< Repeat interval in milliseconds, 0 for one-shot timers */
+    int               thread_id;/*< The owning thread or -1 if the timer is not active */
+    mxs_timer_cb_t    cb;       /*< Function called when the timer expires */
+    void             *data;     /*< User data passed to the callback */
+} MXS_TIMER;
+
+#define MXS_TIMER_INIT {NULL, NULL, 0, 0, -1, NULL, NULL}
+
+/**
+ * @brief Initialize a timer
+ *
+ * This must be called once before the timer is started for the first time.
+ *
+ * @param timer Timer to initialize
+ * @param cb    Function to call when the timer expires
+ * @param data  User data passed to @c cb
+ */
+void mxs_timer_init(MXS_TIMER *timer, mxs_timer_cb_t cb, void *data);
+
+/**
+ * @brief Start a timer on the calling thread
+ *
+ * The timer will fire on the calling thread after @c delay milliseconds. If
+ * @c interval is non-zero, the timer is re-armed after each expiry and fires
+ * every @c interval milliseconds until it is stopped. Starting an already
+ * active timer restarts it with the new values.
+ *
+ * The timer can only be started from a polling thread.
+ *
+ * @param timer    Timer to start
+ * @param delay    Milliseconds until the first expiry
+ * @param interval Milliseconds between subsequent expiries, 0 for a one-shot timer
+ *
+ * @return True if the timer was started, false if the calling thread is
+ *         not a polling thread
+ */
+bool mxs_timer_start(MXS_TIMER *timer, uint32_t delay, uint32_t interval);
+
+/**
+ * @brief Stop a timer
+ *
+ * Stopping a timer that is not active is a no-op. An active timer must be
+ * stopped by the thread that started it. A timer can be stopped from its
+ * own callback.
+ *
+ * @param timer Timer to stop
+ */
+void mxs_timer_stop(MXS_TIMER *timer);
+
+/**
+ * @brief Check whether a timer is active
+ *
+ * @param timer Timer to check
+ *
+ * @return True if the timer is started and has not yet expired
+ */
+static inline bool mxs_timer_is_active(const MXS_TIMER *timer)
+{
+    return timer->thread_id != -1;
+}
+
+/**
+ * @brief Get the current monotonic time
+ *
+ * @return Monotonic time in milliseconds
+ */
+uint64_t mxs_timer_now();
+
+MXS_END_DECLS
@@ -28,6 +28,7 @@
 #include <maxscale/protocol/mysql.h>
 #include <maxscale/query_classifier.h>
 #include "testreader.hh"
+#include "../../server/core/maxscale/query_classifier.h"
 using std::cerr;
 using std::cin;
 using std::cout;
@@ -44,7 +45,7 @@ namespace
 
 char USAGE[] =
     "usage: compare [-r count] [-d] [-1 classfier1] [-2 classifier2] "
-        "[-A args] [-B args] [-v [0..2]] [-s statement]|[file]]\n\n"
+        "[-A args] [-B args] [-F] [-v [0..2]] [-s statement]|[file]]\n\n"
     "-r    redo the test the specified number of times; 0 means forever, default is 1\n"
     "-d    don't stop after first failed query\n"
     "-1    the first classifier, default qc_mysqlembedded\n"
@@ -53,6 +54,8 @@ char USAGE[] =
     "-B    arguments for the second classifier\n"
     "-s    compare single statement\n"
     "-S    strict, also require that the parse result is identical\n"
+    "-F    compare the core fast path, instead of the first classifier, with the second\n"
+    "      classifier for the statements the fast path handles\n"
     "-v 0, only return code\n"
     "   1, query and result for failed cases\n"
     "   2, all queries, and result for failed cases\n"
@@ -75,6 +78,7 @@ struct State
     bool result_printed;
     bool stop_at_error;
     bool strict;
+    bool fast_path;
     size_t line;
     size_t n_statements;
     size_t n_errors;
@@ -87,6 +91,7 @@ struct State
              false,            // result_printed
              true,             // stop_at_error
              false,            // strict
+             false,            // fast_path
              0,                // line
              0,                // n_statements
              0,                // n_errors
@@ -1214,8 +1219,109 @@ bool compare(QUERY_CLASSIFIER* pClassifier1, GWBUF* pBuf1,
     return success;
 }
 
+bool compare_fast_path(QUERY_CLASSIFIER* pClassifier, const string& s, bool full)
+{
+    bool success = false;
+    const char* HEADING;
+
+    if (full)
+    {
+        HEADING = "fast path(full)          : ";
+    }
+    else
+    {
+        HEADING = "fast path                : ";
+    }
+
+    GWBUF* pCopy1 = create_gwbuf(s);
+    GWBUF* pCopy2 = create_gwbuf(s);
+
+    struct timespec start;
+    struct timespec finish;
+
+    clock_gettime(CLOCK_MONOTONIC_RAW, &start);
+    uint32_t type_mask1;
+    qc_query_op_t op1;
+    char** names1 = NULL;
+    int n1 = 0;
+    bool handled = qc_get_fast_path_info(pCopy1, &type_mask1, &op1, full, &names1, &n1);
+    clock_gettime(CLOCK_MONOTONIC_RAW, &finish);
+    update_time(&global.time1, start, finish);
+
+    stringstream ss;
+    ss << HEADING;
+
+    if (handled)
+    {
+        clock_gettime(CLOCK_MONOTONIC_RAW, &start);
+        int32_t rv;
+        pClassifier->qc_parse(pCopy2, QC_COLLECT_ESSENTIALS, &rv);
+        uint32_t type_mask2;
+        pClassifier->qc_get_type_mask(pCopy2, &type_mask2);
+        int32_t op2;
+        pClassifier->qc_get_operation(pCopy2, &op2);
+        char** names2 = NULL;
+        int n2 = 0;
+        pClassifier->qc_get_table_names(pCopy2, full, &names2, &n2);
+        clock_gettime(CLOCK_MONOTONIC_RAW, &finish);
+        update_time(&global.time2, start, finish);
+
+        char* types1 = qc_typemask_to_string(type_mask1);
+        char* types2 = qc_typemask_to_string(type_mask2);
+
+        if ((type_mask1 == type_mask2) &&
+            (op1 == op2) &&
+            (n1 == n2) &&
+            compare_strings(names1, names2, n1))
+        {
+            ss << "Ok : " << types1 << ", " << qc_op_to_string(op1) << ", ";
+            print_names(ss, names1, n1);
+            success = true;
+        }
+        else
+        {
+            ss << "ERR: " << types1 << ", " << qc_op_to_string(op1) << ", ";
+            print_names(ss, names1, n1);
+            ss << " != " << types2 << ", " << qc_op_to_string(static_cast<qc_query_op_t>(op2)) << ", ";
+            print_names(ss, names2, n2);
+        }
+
+        free(types1);
+        free(types2);
+        free_strings(names1, n1);
+        free_strings(names2, n2);
+    }
+    else
+    {
+        ss << "Ok : Not handled";
+        success = true;
+    }
+
+    report(success, ss.str());
+
+    gwbuf_free(pCopy1);
+    gwbuf_free(pCopy2);
+
+    return success;
+}
+
 bool compare(QUERY_CLASSIFIER* pClassifier1, QUERY_CLASSIFIER* pClassifier2, const string& s)
 {
+    if (global.fast_path)
+    {
+        int errors = 0;
+
+        errors += !compare_fast_path(pClassifier2, s, false);
+        errors += !compare_fast_path(pClassifier2, s, true);
+
+        if (global.result_printed)
+        {
+            cout << endl;
+        }
+
+        return errors == 0;
+    }
+
     GWBUF* pCopy1 = create_gwbuf(s);
     GWBUF* pCopy2 = create_gwbuf(s);
 
@@ -1317,7 +1423,7 @@ int main(int argc, char* argv[])
     size_t rounds = 1;
     int v = VERBOSITY_NORMAL;
     int c;
-    while ((c = getopt(argc, argv, "r:d1:2:v:A:B:s:S")) != -1)
+    while ((c = getopt(argc, argv, "r:d1:2:v:A:B:s:SF")) != -1)
     {
         switch (c)
         {
@@ -1357,6 +1463,10 @@ int main(int argc, char* argv[])
             global.strict = true;
             break;
 
+        case 'F':
+            global.fast_path = true;
+            break;
+
         default:
             rc = EXIT_FAILURE;
             break;
@@ -1378,11 +1488,23 @@ int main(int argc, char* argv[])
 
             if (mxs_log_init(NULL, ".", MXS_LOG_TARGET_DEFAULT))
             {
-                QUERY_CLASSIFIER* pClassifier1;
-                QUERY_CLASSIFIER* pClassifier2;
+                QUERY_CLASSIFIER* pClassifier1 = NULL;
+                QUERY_CLASSIFIER* pClassifier2 = NULL;
+                bool loaded;
+
+                if (global.fast_path)
+                {
+                    // The fast path is compared with the second classifier only.
+                    pClassifier2 = get_classifier(zClassifier2, zClassifier2Args);
+                    loaded = (pClassifier2 != NULL);
+                }
+                else
+                {
+                    loaded = get_classifiers(zClassifier1, zClassifier1Args, &pClassifier1,
+                                             zClassifier2, zClassifier2Args, &pClassifier2);
+                }
 
-                if (get_classifiers(zClassifier1, zClassifier1Args, &pClassifier1,
-                                    zClassifier2, zClassifier2Args, &pClassifier2))
+                if (loaded)
                 {
                     size_t round = 0;
                     bool terminate = false;
@@ -1435,7 +1557,7 @@ int main(int argc, char* argv[])
                     put_classifiers(pClassifier1, pClassifier2);
 
                     cout << "\n";
-                    cout << "1st classifier: "
+                    cout << (global.fast_path ? "fast path     : " : "1st classifier: ")
                          << global.time1.tv_sec << "."
                          << global.time1.tv_nsec
                          << endl;
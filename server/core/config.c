@@ -50,6 +50,7 @@
 #include <ftw.h>
 #include <fcntl.h>
 #include <glob.h>
+#include <limits.h>
 #include <net/if.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -89,6 +90,7 @@ static char *config_get_value(MXS_CONFIG_PARAMETER *, const char *);
 static char *config_get_password(MXS_CONFIG_PARAMETER *);
 static const char* config_get_value_string(const MXS_CONFIG_PARAMETER *params, const char *name);
 static int handle_global_item(const char *, const char *);
+static uint64_t get_suffixed_size(const char *value);
 static int handle_feedback_item(const char *, const char *);
 static void global_defaults();
 static void feedback_defaults();
@@ -155,6 +157,7 @@ static const char *listener_params[] =
     "ssl_version",
     "ssl_cert_verify_depth",
     "ssl_verify_peer_certificate",
+    "ssl_session_cache",
     NULL
 };
 
@@ -194,6 +197,7 @@ static const char *server_params[] =
     "monitorpw",
     "persistpoolmax",
     "persistmaxtime",
+    "persistpoolwarm",
     "ssl_cert",
     "ssl_ca_cert",
     "ssl",
@@ -201,6 +205,7 @@ static const char *server_params[] =
     "ssl_version",
     "ssl_cert_verify_depth",
     "ssl_verify_peer_certificate",
+    "ssl_session_cache",
     NULL
 };
 
@@ -679,6 +684,17 @@ config_load_and_process(const char* filename, bool (*process_config)(CONFIG_CONT
                 is_persisted_config = false;
             }
 
+            if (gateway.writeq_high_water && gateway.writeq_low_water == 0)
+            {
+                gateway.writeq_low_water = gateway.writeq_high_water / 2;
+            }
+            else if (gateway.writeq_high_water && gateway.writeq_low_water >= gateway.writeq_high_water)
+            {
+                MXS_WARNING("The value of 'writeq_low_water' must be lower than the value of "
+                            "'writeq_high_water', using half of 'writeq_high_water'.");
+                gateway.writeq_low_water = gateway.writeq_high_water / 2;
+            }
+
             if (rval)
             {
                 if (!check_config_objects(ccontext.next) || !process_config(ccontext.next))
@@ -956,7 +972,21 @@ int config_get_integer(const MXS_CONFIG_PARAMETER *params, const char *key)
 
 uint64_t config_get_size(const MXS_CONFIG_PARAMETER *params, const char *key)
 {
-    const char *value = config_get_value_string(params, key);
+    return get_suffixed_size(config_get_value_string(params, key));
+}
+
+/**
+ * @brief Convert a size with an optional suffix into bytes
+ *
+ * The decimal suffixes K, M, G and T and the binary suffixes Ki, Mi, Gi and
+ * Ti are accepted.
+ *
+ * @param value The size as a string
+ *
+ * @return The size in bytes
+ */
+static uint64_t get_suffixed_size(const char *value)
+{
     char *end;
     uint64_t size = strtoll(value, &end, 10);
 
@@ -1248,6 +1278,10 @@ handle_global_item(const char *name, const char *value)
     {
         gateway.skip_permission_checks = config_truth_value((char*)value);
     }
+    else if (strcmp(name, "listener_sharding") == 0)
+    {
+        gateway.listener_sharding = config_truth_value((char*)value);
+    }
     else if (strcmp(name, "auth_connect_timeout") == 0)
     {
         char* endptr;
@@ -1335,6 +1369,20 @@ handle_global_item(const char *name, const char *value)
             return 0;
         }
     }
+    else if (strcmp(name, "writeq_high_water") == 0)
+    {
+        gateway.writeq_high_water = get_suffixed_size(value);
+
+        if (gateway.writeq_high_water > INT_MAX)
+        {
+            MXS_WARNING("The value of 'writeq_high_water' is too large, using %d.", INT_MAX);
+            gateway.writeq_high_water = INT_MAX;
+        }
+    }
+    else if (strcmp(name, "writeq_low_water") == 0)
+    {
+        gateway.writeq_low_water = get_suffixed_size(value);
+    }
     else if (strcmp(name, "log_throttling") == 0)
     {
         if (*value == 0)
@@ -1431,6 +1479,10 @@ free_ssl_structure(SSL_LISTENER *ssl)
 {
     if (ssl)
     {
+        if (ssl->session)
+        {
+            SSL_SESSION_free(ssl->session);
+        }
         SSL_CTX_free(ssl->ctx);
         MXS_FREE(ssl->ssl_key);
         MXS_FREE(ssl->ssl_cert);
@@ -1469,10 +1521,13 @@ SSL_LISTENER* make_ssl_structure (CONFIG_CONTEXT *obj, bool require_cert, int *e
             ssl_ca_cert = config_get_value(obj->parameters, "ssl_ca_cert");
             ssl_version = config_get_value(obj->parameters, "ssl_version");
             char* ssl_verify_peer_certificate = config_get_value(obj->parameters, "ssl_verify_peer_certificate");
+            char* ssl_session_cache = config_get_value(obj->parameters, "ssl_session_cache");
             ssl_cert_verify_depth = config_get_value(obj->parameters, "ssl_cert_verify_depth");
             new_ssl->ssl_init_done = false;
             new_ssl->ssl_cert_verify_depth = 9; // Default of 9 as per Linux man page
             new_ssl->ssl_verify_peer_certificate = true;
+            new_ssl->ssl_session_cache = true;
+            spinlock_init(&new_ssl->session_lock);
 
             if (ssl_version)
             {
@@ -1511,6 +1566,21 @@ SSL_LISTENER* make_ssl_structure (CONFIG_CONTEXT *obj, bool require_cert, int *e
                 }
             }
 
+            if (ssl_session_cache)
+            {
+                int rv = config_truth_value(ssl_session_cache);
+                if (rv == -1)
+                {
+                    MXS_ERROR("Invalid parameter value for 'ssl_session_cache"
+                              " for service '%s': %s", obj->object, ssl_session_cache);
+                    local_errors++;
+                }
+                else
+                {
+                    new_ssl->ssl_session_cache = rv;
+                }
+            }
+
             listener_set_certificates(new_ssl, ssl_cert, ssl_key, ssl_ca_cert);
 
             if (require_cert && new_ssl->ssl_cert == NULL)
@@ -1634,6 +1704,9 @@ global_defaults()
     gateway.skip_permission_checks = false;
     gateway.query_retries = DEFAULT_QUERY_RETRIES;
     gateway.query_retry_timeout = DEFAULT_QUERY_RETRY_TIMEOUT;
+    gateway.writeq_high_water = DEFAULT_WRITEQ_HIGH_WATER;
+    gateway.writeq_low_water = DEFAULT_WRITEQ_LOW_WATER;
+    gateway.listener_sharding = false;
 
     if (version_string != NULL)
     {
@@ -2818,6 +2891,22 @@ int create_new_server(CONFIG_CONTEXT *obj)
             }
         }
 
+        const char *poolwarm = config_get_value_string(obj->parameters, "persistpoolwarm");
+        if (poolwarm)
+        {
+            long int persistpoolwarm = strtol(poolwarm, &endptr, 0);
+            if (*endptr != '\0' || persistpoolwarm < 0)
+            {
+                MXS_ERROR("Invalid value for 'persistpoolwarm' for server %s: %s",
+                          server->unique_name, poolwarm);
+                error_count++;
+            }
+            else
+            {
+                server->persistpoolwarm = persistpoolwarm;
+            }
+        }
+
         MXS_CONFIG_PARAMETER *params = obj->parameters;
 
         server->server_ssl = make_ssl_structure(obj, false, &error_count);
@@ -3251,6 +3340,7 @@ bool config_is_ssl_parameter(const char *key)
         "ssl_key",
         "ssl_version",
         "ssl_cert_verify_depth",
+        "ssl_session_cache",
         NULL
     };
 
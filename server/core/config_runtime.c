@@ -326,6 +326,17 @@ bool runtime_alter_server(SERVER *server, char *key, char *value)
             valid = false;
         }
     }
+    else if (strcmp(key, "persistpoolwarm") == 0)
+    {
+        if (is_valid_integer(value))
+        {
+            server->persistpoolwarm = atoi(value);
+        }
+        else
+        {
+            valid = false;
+        }
+    }
     else
     {
         if (!server_remove_parameter(server, key) && !value[0])
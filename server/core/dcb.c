@@ -66,12 +66,15 @@
 #include <maxscale/dcb.h>
 
 #include <errno.h>
+#include <inttypes.h>
+#include <limits.h>
 #include <stdarg.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <signal.h>
 #include <time.h>
+#include <sys/uio.h>
 
 #include <maxscale/spinlock.h>
 #include <maxscale/server.h>
@@ -86,7 +89,6 @@
 #include <maxscale/hk_heartbeat.h>
 #include <netinet/tcp.h>
 #include <arpa/inet.h>
-#include <sys/ioctl.h>
 #include <sys/stat.h>
 #include <sys/socket.h>
 #include <sys/un.h>
@@ -96,6 +98,7 @@
 
 #include "maxscale/session.h"
 #include "maxscale/modules.h"
+#include "maxscale/poll.h"
 #include "maxscale/queuemanager.h"
 
 /* A DCB with null values, used for initialization */
@@ -108,9 +111,20 @@ static  int            *nzombies;
 static  int             maxzombies = 0;
 static  SPINLOCK        zombiespin = SPINLOCK_INIT;
 
+/** The largest write queue whose draining is deferred to the end of a batch */
+#define DCB_DEFERRED_DRAIN_MAX (64 * 1024)
+
+/** The DCBs whose write queue is drained at the end of the current batch */
+static thread_local struct
+{
+    bool  active; /**< Whether a batch is being processed */
+    DCB **dcbs;   /**< The DCBs with deferred writes */
+    int   n_dcbs; /**< Number of DCBs in the array */
+    int   size;   /**< Size of the array */
+} deferred_drain;
+
 /** Variables for session timeout checks */
 bool check_timeouts = false;
-thread_local long next_timeout_check = 0;
 
 void dcb_global_init()
 {
@@ -141,25 +155,35 @@ static inline void dcb_process_victim_queue(int threadid);
 static void dcb_stop_polling_and_shutdown (DCB *dcb);
 static bool dcb_maybe_add_persistent(DCB *);
 static inline bool dcb_write_parameter_check(DCB *dcb, GWBUF *queue);
-static int dcb_bytes_readable(DCB *dcb);
-static int dcb_read_no_bytes_available(DCB *dcb, int nreadtotal);
 static int dcb_create_SSL(DCB* dcb, SSL_LISTENER *ssl);
+static SSL_LISTENER *dcb_get_ssl_listener(DCB *dcb);
+static void dcb_SSL_handshake_done(DCB *dcb, SSL_LISTENER *ssl);
 static int dcb_read_SSL(DCB *dcb, GWBUF **head);
-static GWBUF *dcb_basic_read(DCB *dcb, int bytesavailable, int maxbytes, int nreadtotal, int *nsingleread);
+static GWBUF *dcb_basic_read(DCB *dcb, int maxbytes, int nreadtotal, int *nsingleread, bool *drained);
 static GWBUF *dcb_basic_read_SSL(DCB *dcb, int *nsingleread);
+static GWBUF *dcb_alloc_read_buffer(DCB *dcb, int bufsize, int *nsingleread);
+static void dcb_adapt_read_size(DCB *dcb, GWBUF **buffer, int bufsize, int nsingleread);
 static void dcb_log_write_failure(DCB *dcb, GWBUF *queue, int eno);
 static inline void dcb_write_tidy_up(DCB *dcb, bool below_water);
 static int gw_write(DCB *dcb, GWBUF *writeq, bool *stop_writing);
+static void dcb_throttle_session(DCB *dcb, bool throttle);
+static DCB *dcb_connect_server(SERVER *server, MXS_SESSION *session, const char *protocol);
+static void dcb_warm_up(SERVER *server, MXS_SESSION *session, const char *protocol, const char *user);
+static GWBUF *dcb_coalesce_SSL_record(GWBUF *writeq);
 static int gw_write_SSL(DCB *dcb, GWBUF *writeq, bool *stop_writing);
 static int dcb_log_errors_SSL (DCB *dcb, const char *called_by, int ret);
 static int dcb_accept_one_connection(DCB *listener, struct sockaddr *client_conn);
-static int dcb_listen_create_socket_inet(const char *host, uint16_t port);
+static int dcb_listen_create_socket_inet(const char *host, uint16_t port, bool reuseport);
+static int *dcb_listen_create_shards(const char *host, uint16_t port);
 static int dcb_listen_create_socket_unix(const char *path);
 static int dcb_set_socket_option(int sockfd, int level, int optname, void *optval, socklen_t optlen);
 static void dcb_add_to_all_list(DCB *dcb);
 static DCB *dcb_find_free();
 static GWBUF *dcb_grab_writeq(DCB *dcb, bool first_time);
 static void dcb_remove_from_list(DCB *dcb);
+static void dcb_idle_timeout(MXS_TIMER *timer, void *data);
+static inline void dcb_record_response_time(DCB *dcb);
+static bool dcb_defer_drain(DCB *dcb);
 
 size_t dcb_get_session_id(
     DCB *dcb)
@@ -215,6 +239,14 @@ dcb_alloc(dcb_role_t role, SERV_LISTENER *listener)
     newdcb->dcb_role = role;
     newdcb->listener = listener;
     newdcb->last_read = hkheartbeat;
+    mxs_timer_init(&newdcb->idle_timer, dcb_idle_timeout, newdcb);
+
+    if (role == DCB_ROLE_CLIENT_HANDLER || role == DCB_ROLE_BACKEND_HANDLER)
+    {
+        MXS_CONFIG *config = config_get_global_options();
+        newdcb->high_water = config->writeq_high_water;
+        newdcb->low_water = config->writeq_low_water;
+    }
 
     return newdcb;
 }
@@ -328,6 +360,7 @@ dcb_final_free(DCB *dcb)
             bool is_client_dcb = (DCB_ROLE_CLIENT_HANDLER == dcb->dcb_role ||
                                   DCB_ROLE_INTERNAL == dcb->dcb_role);
 
+            session_unlink_dcb(local_session, dcb);
             session_put_ref(local_session);
 
             if (is_client_dcb)
@@ -356,6 +389,8 @@ dcb_free_all_memory(DCB *dcb)
 {
     DCB_CALLBACK *cb_dcb;
 
+    mxs_timer_stop(&dcb->idle_timer);
+
     if (dcb->protocol && (!DCB_IS_CLONE(dcb)))
     {
         MXS_FREE(dcb->protocol);
@@ -561,6 +596,17 @@ dcb_process_victim_queue(int threadid)
             }
         }
 
+        if (dcb->listener_fds)
+        {
+            /** The first socket is the one in dcb->fd */
+            for (int i = 1; i < config_threadcount(); i++)
+            {
+                close(dcb->listener_fds[i]);
+            }
+            MXS_FREE(dcb->listener_fds);
+            dcb->listener_fds = NULL;
+        }
+
         /** Move to the next DCB before freeing the previous one */
         dcblist = dcblist->memdata.next;
 
@@ -607,9 +653,6 @@ DCB *
 dcb_connect(SERVER *server, MXS_SESSION *session, const char *protocol)
 {
     DCB         *dcb;
-    MXS_PROTOCOL  *funcs;
-    int         fd;
-    int         rc;
     const char  *user;
 
     user = session_get_user(session);
@@ -636,16 +679,43 @@ dcb_connect(SERVER *server, MXS_SESSION *session, const char *protocol)
             dcb->persistentstart = 0;
             dcb->was_persistent = true;
             dcb->last_read = hkheartbeat;
+            dcb->request_start = 0;
             atomic_add_uint64(&server->stats.n_from_pool, 1);
+            dcb_warm_up(server, session, protocol, user);
             return dcb;
         }
         else
         {
             MXS_DEBUG("%lu [dcb_connect] Failed to find a reusable persistent connection.\n",
                       pthread_self());
+            atomic_add_uint64(&server->stats.n_new_conn, 1);
         }
     }
 
+    if ((dcb = dcb_connect_server(server, session, protocol)) && user && strlen(user))
+    {
+        dcb_warm_up(server, session, protocol, user);
+    }
+
+    return dcb;
+}
+
+/**
+ * Open a new connection to a server
+ *
+ * @param server        The server to connect to
+ * @param session       The session this connection is being made for
+ * @param protocol      The protocol module to use
+ * @return              The new allocated dcb or NULL if the DCB was not connected
+ */
+static DCB *
+dcb_connect_server(SERVER *server, MXS_SESSION *session, const char *protocol)
+{
+    DCB         *dcb;
+    MXS_PROTOCOL  *funcs;
+    int         fd;
+    int         rc;
+
     if ((dcb = dcb_alloc(DCB_ROLE_BACKEND_HANDLER, NULL)) == NULL)
     {
         return NULL;
@@ -691,6 +761,8 @@ dcb_connect(SERVER *server, MXS_SESSION *session, const char *protocol)
         dcb_final_free(dcb);
         return NULL;
     }
+
+    dcb->connect_start = mxs_histogram_now();
     fd = dcb->func.connect(dcb, server, session);
 
     if (fd == DCBFD_CLOSED)
@@ -767,6 +839,100 @@ dcb_connect(SERVER *server, MXS_SESSION *session, const char *protocol)
     return dcb;
 }
 
+/**
+ * Count the pooled connections of a user that a thread owns
+ *
+ * @param server The server whose pool is counted
+ * @param user   The user name
+ * @param id     Thread ID
+ * @return       Number of pooled connections of the user
+ */
+static int
+dcb_persistent_user_count(SERVER *server, const char *user, int id)
+{
+    int count = 0;
+
+    for (DCB *dcb = server->persistent[id]; dcb; dcb = dcb->nextpersistent)
+    {
+        if (dcb->user && strcmp(dcb->user, user) == 0)
+        {
+            count++;
+        }
+    }
+
+    return count;
+}
+
+/**
+ * Keep the persistent pool of a server warm
+ *
+ * When a session needs a connection and the pool of its thread has fewer than
+ * persistpoolwarm connections for the user, an extra connection is opened with
+ * the credentials of the session. The connection is put into the pool as soon
+ * as it has authenticated, so the next session of the user doesn't have to
+ * wait for the TCP connection and authentication round trips. Connections that
+ * are not used are closed after persistmaxtime seconds.
+ *
+ * @param server   The server to connect to
+ * @param session  The session whose credentials are used
+ * @param protocol The protocol module to use
+ * @param user     The user name of the session
+ */
+static void
+dcb_warm_up(SERVER *server, MXS_SESSION *session, const char *protocol, const char *user)
+{
+    int id = session->client_dcb->thread.id;
+
+    if (server->persistpoolwarm > 0
+        && server->stats.n_warming < server->persistpoolwarm
+        && server->stats.n_persistent + server->stats.n_warming < server->persistpoolmax
+        && dcb_persistent_user_count(server, user, id) < server->persistpoolwarm)
+    {
+        DCB *dcb = dcb_connect_server(server, session, protocol);
+
+        if (dcb)
+        {
+            MXS_DEBUG("%lu [dcb_warm_up] Opened a connection to [%s]:%d for the "
+                      "persistent pool, user %s.", pthread_self(),
+                      server->name, server->port, user);
+            dcb->flags |= DCBF_WARMUP;
+            atomic_add(&server->stats.n_warming, 1);
+            atomic_add_uint64(&server->stats.n_warm_conn, 1);
+        }
+    }
+}
+
+/**
+ * Record the backend connection and response times
+ *
+ * The first data that is read from a new backend connection is the server's
+ * handshake, which ends the connection phase. The first data read after
+ * a request was written is the start of the response to that request.
+ *
+ * @param dcb The DCB that data was read from
+ */
+static inline void dcb_record_response_time(DCB *dcb)
+{
+    if ((dcb->connect_start || dcb->request_start) && dcb->server)
+    {
+        uint64_t now = mxs_histogram_now();
+
+        if (dcb->connect_start)
+        {
+            mxs_histogram_record(dcb->server->stats.connect_time,
+                                 now - dcb->connect_start, dcb->thread.id);
+            dcb->connect_start = 0;
+        }
+
+        if (dcb->request_start)
+        {
+            mxs_histogram_record(dcb->server->stats.response_time,
+                                 now - dcb->request_start, dcb->thread.id);
+            dcb->request_start = 0;
+        }
+    }
+}
+
 /**
  * General purpose read routine to read data from a socket in the
  * Descriptor Control Block and append it to a linked list of buffers.
@@ -818,42 +984,44 @@ int dcb_read(DCB   *dcb,
 
     while (0 == maxbytes || nreadtotal < maxbytes)
     {
-        int bytes_available;
+        GWBUF *buffer;
+        bool drained = false;
 
-        bytes_available = dcb_bytes_readable(dcb);
-        if (bytes_available <= 0)
-        {
-            return bytes_available < 0 ? -1 :
-                   /** Handle closed client socket */
-                   dcb_read_no_bytes_available(dcb, nreadtotal);
-        }
-        else
-        {
-            GWBUF *buffer;
-            dcb->last_read = hkheartbeat;
+        buffer = dcb_basic_read(dcb, maxbytes, nreadtotal, &nsingleread, &drained);
 
-            buffer = dcb_basic_read(dcb, bytes_available, maxbytes, nreadtotal, &nsingleread);
-            if (buffer)
-            {
-                nreadtotal += nsingleread;
-                /* <editor-fold defaultstate="collapsed" desc=" Debug Logging "> */
-                MXS_DEBUG("%lu [dcb_read] Read %d bytes from dcb %p in state %s "
-                          "fd %d.",
-                          pthread_self(),
-                          nsingleread,
-                          dcb,
-                          STRDCBSTATE(dcb->state),
-                          dcb->fd);
-                /* </editor-fold> */
-                /*< Assign the target server for the gwbuf */
-                buffer->server = dcb->server;
-                /*< Append read data to the gwbuf */
-                *head = gwbuf_append(*head, buffer);
-            }
-            else
+        if (buffer == NULL)
+        {
+            if (nsingleread < 0)
             {
-                break;
+                /** Only a client that has not sent anything is an error, the
+                 * same as when the socket was found closed without reading */
+                return (nreadtotal == 0 && DCB_ROLE_CLIENT_HANDLER == dcb->dcb_role) ? -1 : nreadtotal;
             }
+            break;
+        }
+
+        dcb->last_read = hkheartbeat;
+        dcb_record_response_time(dcb);
+        nreadtotal += nsingleread;
+        /* <editor-fold defaultstate="collapsed" desc=" Debug Logging "> */
+        MXS_DEBUG("%lu [dcb_read] Read %d bytes from dcb %p in state %s "
+                  "fd %d.",
+                  pthread_self(),
+                  nsingleread,
+                  dcb,
+                  STRDCBSTATE(dcb->state),
+                  dcb->fd);
+        /* </editor-fold> */
+        /*< Assign the target server for the gwbuf */
+        buffer->server = dcb->server;
+        /*< Append read data to the gwbuf */
+        *head = gwbuf_append(*head, buffer);
+
+        if (drained)
+        {
+            /** A read that did not fill the buffer emptied the socket. More data
+             * generates a new event so there is no need to read until EAGAIN. */
+            break;
         }
     } /*< while (0 == maxbytes || nreadtotal < maxbytes) */
 
@@ -861,116 +1029,107 @@ int dcb_read(DCB   *dcb,
 }
 
 /**
- * Find the number of bytes available for the DCB's socket
+ * Allocate the buffer a read is done into
  *
- * @param dcb       The DCB to read from
- * @return          -1 on error, otherwise the total number of bytes available
+ * @param dcb           The DCB to read from
+ * @param bufsize       Size of the buffer
+ * @param nsingleread   Set to -1 if the allocation fails
+ * @return              The buffer or NULL on failure
  */
-static int
-dcb_bytes_readable(DCB *dcb)
+static GWBUF *
+dcb_alloc_read_buffer(DCB *dcb, int bufsize, int *nsingleread)
 {
-    int bytesavailable;
+    GWBUF *buffer = gwbuf_alloc(bufsize);
 
-    if (-1 == ioctl(dcb->fd, FIONREAD, &bytesavailable))
+    if (buffer == NULL)
     {
+        /*<
+         * This is a fatal error which should cause shutdown.
+         * Todo shutdown if memory allocation fails.
+         */
         char errbuf[MXS_STRERROR_BUFLEN];
         /* <editor-fold defaultstate="collapsed" desc=" Error Logging "> */
-        MXS_ERROR("%lu [dcb_read] Error : ioctl FIONREAD for dcb %p in "
-                  "state %s fd %d failed due error %d, %s.",
+        MXS_ERROR("%lu [dcb_read] Error : Failed to allocate read buffer "
+                  "for dcb %p fd %d, due %d, %s.",
                   pthread_self(),
                   dcb,
-                  STRDCBSTATE(dcb->state),
                   dcb->fd,
                   errno,
                   strerror_r(errno, errbuf, sizeof(errbuf)));
         /* </editor-fold> */
-        return -1;
-    }
-    else
-    {
-        return bytesavailable;
+        *nsingleread = -1;
     }
+
+    return buffer;
 }
 
 /**
- * Determine the return code needed when read has run out of data
+ * Trim the unused end of a read buffer and adapt the size of the next read
+ * buffer of the DCB to the size of the read. A read that fills the buffer
+ * doubles the size and a read that uses less than a quarter of it halves it.
  *
- * @param dcb           The DCB to read from
- * @param nreadtotal    Number of bytes that have been read
- * @return              -1 on error, 0 for conditions not treated as error
+ * @param dcb           The DCB that was read from
+ * @param buffer        The buffer that was read into
+ * @param bufsize       Size of the buffer
+ * @param nsingleread   Number of bytes read into the buffer, must be positive
  */
-static int
-dcb_read_no_bytes_available(DCB *dcb, int nreadtotal)
+static void
+dcb_adapt_read_size(DCB *dcb, GWBUF **buffer, int bufsize, int nsingleread)
 {
-    /** Handle closed client socket */
-    if (nreadtotal == 0 && DCB_ROLE_CLIENT_HANDLER == dcb->dcb_role)
+    if (nsingleread < bufsize)
     {
-        char c;
-        int l_errno = 0;
-        long r = -1;
+        *buffer = gwbuf_rtrim(*buffer, bufsize - nsingleread);
+    }
 
-        /* try to read 1 byte, without consuming the socket buffer */
-        r = recv(dcb->fd, &c, sizeof(char), MSG_PEEK);
-        l_errno = errno;
+    if (dcb->read_size == 0)
+    {
+        dcb->read_size = MXS_MIN_NW_READ_BUFFER_SIZE;
+    }
 
-        if (r <= 0 &&
-            l_errno != EAGAIN &&
-            l_errno != EWOULDBLOCK &&
-            l_errno != 0)
-        {
-            return -1;
-        }
+    if (nsingleread == dcb->read_size)
+    {
+        dcb->read_size = MXS_MIN(dcb->read_size * 2, MXS_MAX_NW_READ_BUFFER_SIZE);
     }
-    return nreadtotal;
+    else if (nsingleread < dcb->read_size / 4)
+    {
+        dcb->read_size = MXS_MAX(dcb->read_size / 2, MXS_MIN_NW_READ_BUFFER_SIZE);
+    }
+
+    dcb->stats.n_bytes_read += nsingleread;
 }
 
 /**
  * Basic read function to carry out a single read operation on the DCB socket.
+ * The data is read directly into a buffer sized by the earlier reads.
  *
  * @param dcb               The DCB to read from
- * @param bytesavailable    Pointer to linked list to append data to
  * @param maxbytes          Maximum bytes to read (0 = no limit)
  * @param nreadtotal        Total number of bytes already read
- * @param nsingleread       To be set as the number of bytes read this time
+ * @param nsingleread       To be set as the number of bytes read this time,
+ *                          -1 on error
+ * @param drained           Set to true if the read did not fill the buffer
  * @return                  GWBUF* buffer containing new data, or null.
  */
 static GWBUF *
-dcb_basic_read(DCB *dcb, int bytesavailable, int maxbytes, int nreadtotal, int *nsingleread)
+dcb_basic_read(DCB *dcb, int maxbytes, int nreadtotal, int *nsingleread, bool *drained)
 {
     GWBUF *buffer;
+    int bufsize = dcb->read_size ? dcb->read_size : MXS_MIN_NW_READ_BUFFER_SIZE;
 
-    int bufsize = MXS_MIN(bytesavailable, MXS_MAX_NW_READ_BUFFER_SIZE);
     if (maxbytes)
     {
         bufsize = MXS_MIN(bufsize, maxbytes - nreadtotal);
     }
 
-    if ((buffer = gwbuf_alloc(bufsize)) == NULL)
-    {
-        /*<
-         * This is a fatal error which should cause shutdown.
-         * Todo shutdown if memory allocation fails.
-         */
-        char errbuf[MXS_STRERROR_BUFLEN];
-        /* <editor-fold defaultstate="collapsed" desc=" Error Logging "> */
-        MXS_ERROR("%lu [dcb_read] Error : Failed to allocate read buffer "
-                  "for dcb %p fd %d, due %d, %s.",
-                  pthread_self(),
-                  dcb,
-                  dcb->fd,
-                  errno,
-                  strerror_r(errno, errbuf, sizeof(errbuf)));
-        /* </editor-fold> */
-        *nsingleread = -1;
-    }
-    else
+    if ((buffer = dcb_alloc_read_buffer(dcb, bufsize, nsingleread)))
     {
+        errno = 0;
         *nsingleread = read(dcb->fd, GWBUF_DATA(buffer), bufsize);
         dcb->stats.n_reads++;
 
         if (*nsingleread <= 0)
         {
-            if (errno != 0 && errno != EAGAIN && errno != EWOULDBLOCK)
+            if (*nsingleread < 0 && errno != EAGAIN && errno != EWOULDBLOCK)
             {
                 char errbuf[MXS_STRERROR_BUFLEN];
                 /* <editor-fold defaultstate="collapsed" desc=" Error Logging "> */
@@ -984,9 +1143,19 @@ dcb_basic_read(DCB *dcb, int bytesavailable, int maxbytes, int nreadtotal, int *
                           strerror_r(errno, errbuf, sizeof(errbuf)));
                 /* </editor-fold> */
             }
+            else
+            {
+                /** The socket is empty or the peer has closed it */
+                *nsingleread = 0;
+            }
             gwbuf_free(buffer);
             buffer = NULL;
         }
+        else
+        {
+            *drained = *nsingleread < bufsize;
+            dcb_adapt_read_size(dcb, &buffer, bufsize, *nsingleread);
+        }
     }
     return buffer;
 }
@@ -1026,6 +1195,7 @@ dcb_read_SSL(DCB *dcb, GWBUF **head)
     buffer = dcb_basic_read_SSL(dcb, &nsingleread);
     if (buffer)
     {
+        dcb_record_response_time(dcb);
         nreadtotal += nsingleread;
         *head = gwbuf_append(*head, buffer);
 
@@ -1048,7 +1218,8 @@ dcb_read_SSL(DCB *dcb, GWBUF **head)
 }
 
 /**
- * Basic read function to carry out a single read on the DCB's SSL connection
+ * Basic read function to carry out a single read on the DCB's SSL connection.
+ * The data is decrypted directly into a buffer sized by the earlier reads.
  *
  * @param dcb           The DCB to read from
  * @param nsingleread   To be set as the number of bytes read this time
@@ -1057,10 +1228,15 @@ dcb_read_SSL(DCB *dcb, GWBUF **head)
 static GWBUF *
 dcb_basic_read_SSL(DCB *dcb, int *nsingleread)
 {
-    unsigned char temp_buffer[MXS_MAX_NW_READ_BUFFER_SIZE];
-    GWBUF *buffer = NULL;
+    int bufsize = dcb->read_size ? dcb->read_size : MXS_MIN_NW_READ_BUFFER_SIZE;
+    GWBUF *buffer = dcb_alloc_read_buffer(dcb, bufsize, nsingleread);
+
+    if (buffer == NULL)
+    {
+        return NULL;
+    }
 
-    *nsingleread = SSL_read(dcb->ssl, (void *)temp_buffer, MXS_MAX_NW_READ_BUFFER_SIZE);
+    *nsingleread = SSL_read(dcb->ssl, GWBUF_DATA(buffer), bufsize);
     dcb->stats.n_reads++;
 
     switch (SSL_get_error(dcb->ssl, *nsingleread))
@@ -1075,24 +1251,9 @@ dcb_basic_read_SSL(DCB *dcb, int *nsingleread)
                   dcb,
                   STRDCBSTATE(dcb->state),
                   dcb->fd);
-        if (*nsingleread && (buffer = gwbuf_alloc_and_load(*nsingleread, (void *)temp_buffer)) == NULL)
+        if (*nsingleread > 0)
         {
-            /*<
-             * This is a fatal error which should cause shutdown.
-             * Todo shutdown if memory allocation fails.
-             */
-            char errbuf[MXS_STRERROR_BUFLEN];
-            /* <editor-fold defaultstate="collapsed" desc=" Error Logging "> */
-            MXS_ERROR("%lu [dcb_read] Error : Failed to allocate read buffer "
-                      "for dcb %p fd %d, due %d, %s.",
-                      pthread_self(),
-                      dcb,
-                      dcb->fd,
-                      errno,
-                      strerror_r(errno, errbuf, sizeof(errbuf)));
-            /* </editor-fold> */
-            *nsingleread = -1;
-            return NULL;
+            dcb_adapt_read_size(dcb, &buffer, bufsize, *nsingleread);
         }
 
         /* If we were in a retry situation, need to clear flag and attempt write */
@@ -1144,6 +1305,12 @@ dcb_basic_read_SSL(DCB *dcb, int *nsingleread)
         *nsingleread = dcb_log_errors_SSL(dcb, __func__, *nsingleread);
         break;
     }
+
+    if (*nsingleread <= 0)
+    {
+        gwbuf_free(buffer);
+        buffer = NULL;
+    }
     return buffer;
 }
 
@@ -1227,6 +1394,11 @@ dcb_write(DCB *dcb, GWBUF *queue)
     dcb->writeq = gwbuf_append(dcb->writeq, queue);
     dcb->stats.n_buffered++;
 
+    if (dcb->dcb_role == DCB_ROLE_BACKEND_HANDLER && dcb->request_start == 0)
+    {
+        dcb->request_start = mxs_histogram_now();
+    }
+
     MXS_DEBUG("%lu [dcb_write] Append to writequeue. %d writes "
               "buffered for dcb %p in state %s fd %d",
               pthread_self(),
@@ -1234,7 +1406,7 @@ dcb_write(DCB *dcb, GWBUF *queue)
               dcb,
               STRDCBSTATE(dcb->state),
               dcb->fd);
-    if (empty_queue)
+    if (empty_queue && !dcb_defer_drain(dcb))
     {
         dcb_drain_writeq(dcb);
     }
@@ -1243,6 +1415,74 @@ dcb_write(DCB *dcb, GWBUF *queue)
     return 1;
 }
 
+/**
+ * Defer the draining of the write queue to the end of the event batch
+ *
+ * Only small writes to the DCBs of the calling thread are deferred.
+ *
+ * @param dcb The DCB that was written to
+ * @return True if the write queue will be drained at the end of the batch
+ */
+static bool
+dcb_defer_drain(DCB *dcb)
+{
+    if (!deferred_drain.active || dcb->fd <= 0 ||
+        dcb->thread.id != poll_get_thread_id() ||
+        dcb->writeqlen > DCB_DEFERRED_DRAIN_MAX ||
+        (dcb->high_water && dcb->writeqlen > dcb->high_water))
+    {
+        return false;
+    }
+
+    if ((dcb->flags & DCBF_DRAIN_DEFERRED) == 0)
+    {
+        if (deferred_drain.n_dcbs == deferred_drain.size)
+        {
+            int size = deferred_drain.size ? deferred_drain.size * 2 : 64;
+            DCB **dcbs = MXS_REALLOC(deferred_drain.dcbs, size * sizeof(DCB*));
+
+            if (dcbs == NULL)
+            {
+                return false;
+            }
+
+            deferred_drain.dcbs = dcbs;
+            deferred_drain.size = size;
+        }
+
+        deferred_drain.dcbs[deferred_drain.n_dcbs++] = dcb;
+        dcb->flags |= DCBF_DRAIN_DEFERRED;
+    }
+
+    return true;
+}
+
+void dcb_start_batch()
+{
+    deferred_drain.active = true;
+}
+
+void dcb_end_batch()
+{
+    deferred_drain.active = false;
+
+    /** The DCBs closed during the batch are still valid as the zombies are
+     * processed after this. Their queues are drained so that the data written
+     * right before closing them is sent. */
+    for (int i = 0; i < deferred_drain.n_dcbs; i++)
+    {
+        DCB *dcb = deferred_drain.dcbs[i];
+        dcb->flags &= ~DCBF_DRAIN_DEFERRED;
+
+        if (dcb->writeq && dcb->fd > 0)
+        {
+            dcb_drain_writeq(dcb);
+        }
+    }
+
+    deferred_drain.n_dcbs = 0;
+}
+
 /**
  * Check the parameters for dcb_write
  *
@@ -1384,6 +1624,12 @@ dcb_write_tidy_up(DCB *dcb, bool below_water)
         atomic_add(&dcb->stats.n_high_water, 1);
         dcb_call_callback(dcb, DCB_REASON_HIGH_WATER);
     }
+
+    if (dcb->high_water && dcb->writeqlen > dcb->high_water &&
+        (dcb->flags & DCBF_THROTTLING) == 0)
+    {
+        dcb_throttle_session(dcb, true);
+    }
 }
 
 /**
@@ -1438,12 +1684,25 @@ dcb_drain_writeq(DCB *dcb)
             /* The value put into written will be >= 0 */
             if (dcb->ssl)
             {
+                /** A blocked write must be retried with the same data */
+                if (!dcb->ssl_write_want_read && !dcb->ssl_write_want_write)
+                {
+                    local_writeq = dcb_coalesce_SSL_record(local_writeq);
+                }
                 written = gw_write_SSL(dcb, local_writeq, &stop_writing);
             }
             else
             {
                 written = gw_write(dcb, local_writeq, &stop_writing);
             }
+            /*
+             * Consume the bytes we have written from the list of buffers,
+             * and increment the total bytes written. The write may have
+             * covered several buffers and ended in the middle of one.
+             */
+            local_writeq = gwbuf_consume(local_writeq, written);
+            total_written += written;
+
             /*
              * If the stop_writing boolean is set, writing has become blocked,
              * so the remaining data is put back at the front of the write
@@ -1471,12 +1730,6 @@ dcb_drain_writeq(DCB *dcb)
                     goto wrap_up;
                 }
             }
-            /*
-             * Consume the bytes we have written from the list of buffers,
-             * and increment the total bytes written.
-             */
-            local_writeq = gwbuf_consume(local_writeq, written);
-            total_written += written;
         }
     }
     while ((local_writeq = dcb_grab_writeq(dcb, false)) != NULL);
@@ -1500,6 +1753,11 @@ wrap_up:
             dcb_call_callback(dcb, DCB_REASON_LOW_WATER);
         }
 
+        if ((dcb->flags & DCBF_THROTTLING) && dcb->writeqlen <= dcb->low_water)
+        {
+            dcb_throttle_session(dcb, false);
+        }
+
     }
     return total_written;
 }
@@ -1617,6 +1875,19 @@ dcb_close(DCB *dcb)
     }
     else if (!dcb->dcb_is_zombie)
     {
+        if (dcb->flags & DCBF_WARMUP)
+        {
+            /** The flag is kept so that the connection is taken into the
+             * pool even though its session is still in use */
+            atomic_add(&dcb->server->stats.n_warming, -1);
+        }
+
+        if (dcb->flags & DCBF_THROTTLING)
+        {
+            /** Nothing will drain the write queue of a closed DCB */
+            dcb_throttle_session(dcb, false);
+        }
+
         if (DCB_ROLE_BACKEND_HANDLER == dcb->dcb_role && 0 == dcb->persistentstart
             && dcb->server && DCB_STATE_POLLING == dcb->state)
         {
@@ -1663,11 +1934,13 @@ dcb_maybe_add_persistent(DCB *dcb)
         && strlen(dcb->user)
         && dcb->server
         && dcb->session
-        && session_valid_for_pool(dcb->session)
+        && ((dcb->flags & DCBF_WARMUP) || session_valid_for_pool(dcb->session))
         && dcb->server->persistpoolmax
         && (dcb->server->status & SERVER_RUNNING)
         && !dcb->dcb_errhandle_called
         && !(dcb->flags & DCBF_HUNG)
+        /** Unread data may be left in the socket of a paused DCB */
+        && !(dcb->flags & DCBF_READ_PAUSED)
         && dcb_persistent_clean_count(dcb, dcb->thread.id, false) < dcb->server->persistpoolmax
         && dcb->server->stats.n_persistent < dcb->server->persistpoolmax)
     {
@@ -1678,6 +1951,7 @@ dcb_maybe_add_persistent(DCB *dcb)
         dcb->was_persistent = false;
         dcb->dcb_is_zombie = false;
         dcb->persistentstart = time(NULL);
+        dcb->flags &= ~DCBF_WARMUP;
         if (dcb->session)
             /*<
              * Terminate client session.
@@ -1688,6 +1962,7 @@ dcb_maybe_add_persistent(DCB *dcb)
             CHK_SESSION(local_session);
             if (SESSION_STATE_DUMMY != local_session->state)
             {
+                session_unlink_dcb(local_session, dcb);
                 session_put_ref(local_session);
             }
         }
@@ -1876,11 +2151,17 @@ dprintOneDCB(DCB *pdcb, DCB *dcb)
     }
     dcb_printf(pdcb, "\tStatistics:\n");
     dcb_printf(pdcb, "\t\tNo. of Reads:             %d\n", dcb->stats.n_reads);
+    dcb_printf(pdcb, "\t\tBytes Read:               %" PRIu64 "\n", dcb->stats.n_bytes_read);
     dcb_printf(pdcb, "\t\tNo. of Writes:            %d\n", dcb->stats.n_writes);
     dcb_printf(pdcb, "\t\tNo. of Buffered Writes:   %d\n", dcb->stats.n_buffered);
     dcb_printf(pdcb, "\t\tNo. of Accepts:           %d\n", dcb->stats.n_accepts);
     dcb_printf(pdcb, "\t\tNo. of High Water Events: %d\n", dcb->stats.n_high_water);
     dcb_printf(pdcb, "\t\tNo. of Low Water Events:  %d\n", dcb->stats.n_low_water);
+    dcb_printf(pdcb, "\t\tNo. of Read Pauses:       %d\n", dcb->stats.n_read_paused);
+    dcb_printf(pdcb, "\t\tNo. of Write Syscalls:    %d\n", dcb->stats.n_write_calls);
+    dcb_printf(pdcb, "\t\tBytes Written:            %" PRIu64 "\n", dcb->stats.n_bytes_written);
+    dcb_printf(pdcb, "\t\tAverage Bytes per Write:  %" PRIu64 "\n",
+               dcb->stats.n_write_calls ? dcb->stats.n_bytes_written / dcb->stats.n_write_calls : 0);
     if (dcb->flags & DCBF_CLONE)
     {
         dcb_printf(pdcb, "\t\tDCB is a clone.\n");
@@ -2031,6 +2312,10 @@ dprintDCB(DCB *pdcb, DCB *dcb)
     dcb_printf(pdcb, "\tStatistics:\n");
     dcb_printf(pdcb, "\t\tNo. of Reads:                     %d\n",
                dcb->stats.n_reads);
+    dcb_printf(pdcb, "\t\tBytes Read:                       %" PRIu64 "\n",
+               dcb->stats.n_bytes_read);
+    dcb_printf(pdcb, "\t\tRead Buffer Size:                 %d\n",
+               dcb->read_size ? dcb->read_size : MXS_MIN_NW_READ_BUFFER_SIZE);
     dcb_printf(pdcb, "\t\tNo. of Writes:                    %d\n",
                dcb->stats.n_writes);
     dcb_printf(pdcb, "\t\tNo. of Buffered Writes:           %d\n",
@@ -2041,6 +2326,15 @@ dprintDCB(DCB *pdcb, DCB *dcb)
                dcb->stats.n_high_water);
     dcb_printf(pdcb, "\t\tNo. of Low Water Events:  %d\n",
                dcb->stats.n_low_water);
+    dcb_printf(pdcb, "\t\tNo. of Read Pauses:       %d\n",
+               dcb->stats.n_read_paused);
+    dcb_printf(pdcb, "\t\tNo. of Write Syscalls:    %d\n",
+               dcb->stats.n_write_calls);
+    dcb_printf(pdcb, "\t\tBytes Written:            %" PRIu64 "\n",
+               dcb->stats.n_bytes_written);
+    dcb_printf(pdcb, "\t\tAverage Bytes per Write:  %" PRIu64 "\n",
+               dcb->stats.n_write_calls ?
+               dcb->stats.n_bytes_written / dcb->stats.n_write_calls : 0);
     if (DCB_POLL_BUSY(dcb))
     {
         dcb_printf(pdcb, "\t\tPending events in the queue:      %x %s\n",
@@ -2149,11 +2443,48 @@ void dcb_hashtable_stats(
     dcb_printf(dcb, "\tLongest chain length:        %d\n", longest);
 }
 
+/**
+ * Merge the small buffers at the head of a write queue into one buffer so
+ * that they are written as one TLS record instead of a record each. Only
+ * whole buffers that fit into one record are merged.
+ *
+ * @param writeq  The write queue
+ * @return The write queue with the head buffers merged
+ */
+static GWBUF *
+dcb_coalesce_SSL_record(GWBUF *writeq)
+{
+    size_t len = 0;
+    int n_buffers = 0;
+
+    for (GWBUF *buf = writeq; buf && len + GWBUF_LENGTH(buf) <= MXS_SSL_RECORD_SIZE; buf = buf->next)
+    {
+        len += GWBUF_LENGTH(buf);
+        n_buffers++;
+    }
+
+    if (n_buffers > 1)
+    {
+        GWBUF *record = gwbuf_alloc(len);
+
+        if (record)
+        {
+            gwbuf_copy_data(writeq, 0, len, GWBUF_DATA(record));
+            writeq = gwbuf_append(record, gwbuf_consume(writeq, len));
+        }
+    }
+
+    return writeq;
+}
+
 /**
  * Write data to a DCB socket through an SSL structure. The SSL structure is
  * linked from the DCB. All communication is encrypted and done via the SSL
  * structure. Data is written from the DCB write queue.
  *
+ * At most one record is written with each call so that every successful
+ * write is counted as one record.
+ *
  * @param dcb           The DCB having an SSL connection
  * @param writeq        A buffer list containing the data to be written
  * @param stop_writing  Set to true if the caller should stop writing, false otherwise
@@ -2162,9 +2493,13 @@ void dcb_hashtable_stats(
 static int
 gw_write_SSL(DCB *dcb, GWBUF *writeq, bool *stop_writing)
 {
+    SSL_LISTENER *ssl = dcb_get_ssl_listener(dcb);
+    void *data = GWBUF_DATA(writeq);
+    int len = MXS_MIN(GWBUF_LENGTH(writeq), MXS_SSL_RECORD_SIZE);
     int written;
 
-    written = SSL_write(dcb->ssl, GWBUF_DATA(writeq), GWBUF_LENGTH(writeq));
+    written = SSL_write(dcb->ssl, data, len);
+    dcb->stats.n_write_calls++;
 
     *stop_writing = false;
     switch ((SSL_get_error(dcb->ssl, written)))
@@ -2173,6 +2508,13 @@ gw_write_SSL(DCB *dcb, GWBUF *writeq, bool *stop_writing)
         /* Successful write */
         dcb->ssl_write_want_read = false;
         dcb->ssl_write_want_write = false;
+        dcb->stats.n_bytes_written += written;
+
+        if (ssl)
+        {
+            atomic_add_uint64(&ssl->n_records, 1);
+            atomic_add_uint64(&ssl->n_bytes, written);
+        }
         break;
 
     case SSL_ERROR_ZERO_RETURN:
@@ -2216,9 +2558,20 @@ gw_write_SSL(DCB *dcb, GWBUF *writeq, bool *stop_writing)
     return written > 0 ? written : 0;
 }
 
+/** The maximum number of buffers written with one system call */
+#if defined(IOV_MAX) && IOV_MAX < 1024
+#define DCB_WRITE_IOV_MAX IOV_MAX
+#else
+#define DCB_WRITE_IOV_MAX 1024
+#endif
+
 /**
  * Write data to a DCB. The data is taken from the DCB's write queue.
  *
+ * The buffers of the write queue are written with one system call. If not all
+ * of the data could be written, the socket buffer is full and the caller
+ * should stop writing until the socket is writable again.
+ *
  * @param dcb           The DCB to write buffer
  * @param writeq        A buffer list containing the data to be written
  * @param stop_writing  Set to true if the caller should stop writing, false otherwise
@@ -2227,17 +2580,38 @@ gw_write_SSL(DCB *dcb, GWBUF *writeq, bool *stop_writing)
 static int
 gw_write(DCB *dcb, GWBUF *writeq, bool *stop_writing)
 {
-    int written = 0;
+    struct iovec iov[DCB_WRITE_IOV_MAX];
+    int iovcnt = 0;
+    size_t nbytes = 0;
+    ssize_t written = 0;
     int fd = dcb->fd;
-    size_t nbytes = GWBUF_LENGTH(writeq);
-    void *buf = GWBUF_DATA(writeq);
     int saved_errno;
 
+    for (GWBUF *buf = writeq; buf && iovcnt < DCB_WRITE_IOV_MAX && nbytes < INT_MAX; buf = buf->next)
+    {
+        size_t len = GWBUF_LENGTH(buf);
+
+        if (len > 0)
+        {
+            if (len > INT_MAX - nbytes)
+            {
+                /** The return value must fit into an int */
+                len = INT_MAX - nbytes;
+            }
+
+            iov[iovcnt].iov_base = GWBUF_DATA(buf);
+            iov[iovcnt].iov_len = len;
+            iovcnt++;
+            nbytes += len;
+        }
+    }
+
     errno = 0;
 
-    if (fd > 0)
+    if (fd > 0 && iovcnt > 0)
     {
-        written = write(fd, buf, nbytes);
+        written = writev(fd, iov, iovcnt);
+        dcb->stats.n_write_calls++;
     }
 
     saved_errno = errno;
@@ -2267,7 +2641,9 @@ gw_write(DCB *dcb, GWBUF *writeq, bool *stop_writing)
     }
     else
     {
-        *stop_writing = false;
+        /** A partial write means that the socket buffer is full */
+        *stop_writing = (size_t)written < nbytes;
+        dcb->stats.n_bytes_written += written;
     }
 
     return written > 0 ? written : 0;
@@ -2641,6 +3017,13 @@ dcb_count_by_usage(DCB_USAGE usage)
 static int
 dcb_create_SSL(DCB* dcb, SSL_LISTENER *ssl)
 {
+    if (dcb->writeq)
+    {
+        /** The data written before the handshake, e.g. a deferred SSL request
+         * packet, must be sent unencrypted before the handshake starts */
+        dcb_drain_writeq(dcb);
+    }
+
     if ((dcb->ssl = SSL_new(ssl->ctx)) == NULL)
     {
         MXS_ERROR("Failed to initialize SSL for connection.");
@@ -2656,6 +3039,55 @@ dcb_create_SSL(DCB* dcb, SSL_LISTENER *ssl)
     return 0;
 }
 
+/**
+ * Get the SSL configuration of a DCB
+ *
+ * @param dcb A client or a backend DCB
+ * @return The SSL configuration of the listener or the server or NULL
+ */
+static SSL_LISTENER *
+dcb_get_ssl_listener(DCB *dcb)
+{
+    if (dcb->dcb_role == DCB_ROLE_CLIENT_HANDLER)
+    {
+        return dcb->listener ? dcb->listener->ssl : NULL;
+    }
+
+    return dcb->server ? dcb->server->server_ssl : NULL;
+}
+
+/**
+ * Record a completed SSL handshake
+ *
+ * With read ahead, OpenSSL may have read data that arrived after the handshake
+ * and no new event would be generated for it. A read event is added so that
+ * the data is processed.
+ *
+ * @param dcb DCB whose handshake completed
+ * @param ssl The SSL configuration of the DCB
+ */
+static void
+dcb_SSL_handshake_done(DCB *dcb, SSL_LISTENER *ssl)
+{
+    atomic_add_uint64(&ssl->n_handshakes, 1);
+
+    if (SSL_session_reused(dcb->ssl))
+    {
+        atomic_add_uint64(&ssl->n_resumed, 1);
+    }
+
+    /** Data read ahead during the handshake would otherwise wait for the
+     * next event on the socket */
+#if OPENSSL_VERSION_NUMBER >= 0x10100000L
+    if (SSL_has_pending(dcb->ssl))
+#else
+    if (SSL_pending(dcb->ssl) > 0)
+#endif
+    {
+        poll_fake_read_event(dcb);
+    }
+}
+
 /**
  * Accept a SSL connection and do the SSL authentication handshake.
  * This function accepts a client connection to a DCB. It assumes that the SSL
@@ -2686,6 +3118,7 @@ int dcb_accept_SSL(DCB* dcb)
         MXS_DEBUG("SSL_accept done for %s@%s", user, remote);
         dcb->ssl_state = SSL_ESTABLISHED;
         dcb->ssl_read_want_write = false;
+        dcb_SSL_handshake_done(dcb, dcb->listener->ssl);
         return 1;
 
     case SSL_ERROR_WANT_READ:
@@ -2746,12 +3179,33 @@ int dcb_connect_SSL(DCB* dcb)
     int ssl_rval;
     int return_code;
 
-    if ((NULL == dcb->server || NULL == dcb->server->server_ssl) ||
-        (NULL == dcb->ssl && dcb_create_SSL(dcb, dcb->server->server_ssl) != 0))
+    if (NULL == dcb->server || NULL == dcb->server->server_ssl)
     {
         ss_dassert((NULL != dcb->server) && (NULL != dcb->server->server_ssl));
         return -1;
     }
+
+    SSL_LISTENER *ssl = dcb->server->server_ssl;
+
+    if (NULL == dcb->ssl)
+    {
+        if (dcb_create_SSL(dcb, ssl) != 0)
+        {
+            return -1;
+        }
+
+        if (ssl->ssl_session_cache)
+        {
+            /** Resume the session of an earlier connection to the server */
+            spinlock_acquire(&ssl->session_lock);
+            if (ssl->session)
+            {
+                SSL_set_session(dcb->ssl, ssl->session);
+            }
+            spinlock_release(&ssl->session_lock);
+        }
+    }
+
     dcb->ssl_state = SSL_HANDSHAKE_REQUIRED;
     ssl_rval = SSL_connect(dcb->ssl);
     switch (SSL_get_error(dcb->ssl, ssl_rval))
@@ -2760,6 +3214,21 @@ int dcb_connect_SSL(DCB* dcb)
         MXS_DEBUG("SSL_connect done for %s", dcb->remote);
         dcb->ssl_state = SSL_ESTABLISHED;
         dcb->ssl_read_want_write = false;
+        dcb_SSL_handshake_done(dcb, ssl);
+
+        if (ssl->ssl_session_cache && !SSL_session_reused(dcb->ssl))
+        {
+            SSL_SESSION *session = SSL_get1_session(dcb->ssl);
+            spinlock_acquire(&ssl->session_lock);
+            SSL_SESSION *old_session = ssl->session;
+            ssl->session = session;
+            spinlock_release(&ssl->session_lock);
+
+            if (old_session)
+            {
+                SSL_SESSION_free(old_session);
+            }
+        }
         return_code = 1;
         break;
 
@@ -2840,6 +3309,7 @@ dcb_accept(DCB *listener)
     if ((c_sock = dcb_accept_one_connection(listener, (struct sockaddr *)&client_conn)) >= 0)
     {
         listener->stats.n_accepts++;
+        poll_count_accepted();
         MXS_DEBUG("%lu [gw_MySQLAccept] Accepted fd %d.",
                   pthread_self(),
                   c_sock);
@@ -2972,6 +3442,14 @@ static int
 dcb_accept_one_connection(DCB *listener, struct sockaddr *client_conn)
 {
     int c_sock;
+    int listener_fd = listener->fd;
+    int thread_id = poll_get_thread_id();
+
+    if (listener->listener_fds && thread_id >= 0)
+    {
+        /** Each thread accepts from its own socket */
+        listener_fd = listener->listener_fds[thread_id];
+    }
 
     /* Try up to 10 times to get a file descriptor by use of accept */
     for (int i = 0; i < 10; i++)
@@ -2980,7 +3458,7 @@ dcb_accept_one_connection(DCB *listener, struct sockaddr *client_conn)
         int eno = 0;
 
         /* new connection from client */
-        c_sock = accept(listener->fd,
+        c_sock = accept(listener_fd,
                         client_conn,
                         &client_len);
         eno = errno;
@@ -3080,7 +3558,16 @@ int dcb_listen(DCB *listener, const char *config, const char *protocol_name)
     }
     else if (port > 0)
     {
-        listener_socket = dcb_listen_create_socket_inet(host, port);
+        bool sharded = config_get_global_options()->listener_sharding && config_threadcount() > 1;
+
+        if (sharded && (listener->listener_fds = dcb_listen_create_shards(host, port)))
+        {
+            listener_socket = listener->listener_fds[0];
+        }
+        else
+        {
+            listener_socket = dcb_listen_create_socket_inet(host, port, false);
+        }
 
         if (listener_socket == -1 && strcmp(host, "::") == 0)
         {
@@ -3088,7 +3575,15 @@ int dcb_listen(DCB *listener, const char *config, const char *protocol_name)
             MXS_WARNING("Failed to bind on default IPv6 host '::', attempting "
                         "to bind on IPv4 version '0.0.0.0'");
             strcpy(host, "0.0.0.0");
-            listener_socket = dcb_listen_create_socket_inet(host, port);
+
+            if (sharded && (listener->listener_fds = dcb_listen_create_shards(host, port)))
+            {
+                listener_socket = listener->listener_fds[0];
+            }
+            else
+            {
+                listener_socket = dcb_listen_create_socket_inet(host, port, false);
+            }
         }
     }
     else
@@ -3110,7 +3605,7 @@ int dcb_listen(DCB *listener, const char *config, const char *protocol_name)
      *
      * @see man 2 listen
      */
-    if (listen(listener_socket, INT_MAX) != 0)
+    if (listener->listener_fds == NULL && listen(listener_socket, INT_MAX) != 0)
     {
         MXS_ERROR("Failed to start listening on '[%s]:%u' with protocol '%s': %d, %s",
                   host, port, protocol_name, errno, mxs_strerror(errno));
@@ -3118,7 +3613,8 @@ int dcb_listen(DCB *listener, const char *config, const char *protocol_name)
         return -1;
     }
 
-    MXS_NOTICE("Listening for connections at [%s]:%u with protocol %s", host, port, protocol_name);
+    MXS_NOTICE("Listening for connections at [%s]:%u with protocol %s%s", host, port, protocol_name,
+               listener->listener_fds ? ", one socket per thread" : "");
 
     // assign listener_socket to dcb
     listener->fd = listener_socket;
@@ -3136,17 +3632,30 @@ int dcb_listen(DCB *listener, const char *config, const char *protocol_name)
 /**
  * @brief Create a network listener socket
  *
- * @param host The network address to listen on
- * @param port The port to listen on
- * @return     The opened socket or -1 on error
+ * @param host      The network address to listen on
+ * @param port      The port to listen on
+ * @param reuseport Set SO_REUSEPORT so that other sockets can bind to the port
+ * @return          The opened socket or -1 on error
  */
-static int dcb_listen_create_socket_inet(const char *host, uint16_t port)
+static int dcb_listen_create_socket_inet(const char *host, uint16_t port, bool reuseport)
 {
     struct sockaddr_storage server_address = {};
     int listener_socket = open_network_socket(MXS_SOCKET_LISTENER, &server_address, host, port);
 
     if (listener_socket != -1)
     {
+#ifdef SO_REUSEPORT
+        int one = 1;
+
+        if (reuseport && dcb_set_socket_option(listener_socket, SOL_SOCKET, SO_REUSEPORT,
+                                               &one, sizeof(one)) != 0)
+        {
+            close(listener_socket);
+            return -1;
+        }
+#else
+        ss_dassert(!reuseport);
+#endif
         if (bind(listener_socket, (struct sockaddr*)&server_address, sizeof(server_address)) < 0)
         {
             MXS_ERROR("Failed to bind on '%s:%u': %d, %s",
@@ -3159,6 +3668,53 @@ static int dcb_listen_create_socket_inet(const char *host, uint16_t port)
     return listener_socket;
 }
 
+/**
+ * @brief Create one listening network socket for each thread
+ *
+ * The sockets share the port with SO_REUSEPORT and the kernel distributes the
+ * new connections between them. This way a new connection wakes up only the
+ * thread that owns the socket it arrived at.
+ *
+ * @param host The network address to listen on
+ * @param port The port to listen on
+ * @return     Array of config_threadcount() listening sockets or NULL on error
+ */
+static int *dcb_listen_create_shards(const char *host, uint16_t port)
+{
+#ifdef SO_REUSEPORT
+    int n_threads = config_threadcount();
+    int *fds = MXS_MALLOC(n_threads * sizeof(int));
+
+    if (fds)
+    {
+        for (int i = 0; i < n_threads; i++)
+        {
+            if ((fds[i] = dcb_listen_create_socket_inet(host, port, true)) == -1 ||
+                listen(fds[i], INT_MAX) != 0)
+            {
+                MXS_WARNING("Failed to create a listener socket for each thread at "
+                            "[%s]:%u, using one socket for all threads.", host, port);
+
+                for (int j = 0; j <= i; j++)
+                {
+                    if (fds[j] != -1)
+                    {
+                        close(fds[j]);
+                    }
+                }
+
+                MXS_FREE(fds);
+                return NULL;
+            }
+        }
+    }
+
+    return fds;
+#else
+    return NULL;
+#endif
+}
+
 /**
  * @brief Create a Unix domain socket
  *
@@ -3396,39 +3952,149 @@ void dcb_enable_session_timeouts()
  * Close sessions that have been idle for too long.
  *
  * If the time since a session last sent data is greater than the set value in the
- * service, it is disconnected. The connection timeout is disabled by default.
+ * service, it is disconnected. Otherwise the timer is restarted for the remaining
+ * time. This way each client DCB is only inspected once per timeout period instead
+ * of all DCBs being inspected every second. The connection timeout is disabled by
+ * default.
+ *
+ * @param timer The idle timer of the DCB
+ * @param data  The client DCB
  */
-void dcb_process_idle_sessions(int thr)
+static void dcb_idle_timeout(MXS_TIMER *timer, void *data)
 {
-    if (check_timeouts && hkheartbeat >= next_timeout_check)
+    DCB *dcb = (DCB*)data;
+    ss_dassert(dcb->listener);
+    SERVICE *service = dcb->listener->service;
+
+    if (service->conn_idle_timeout && dcb->state == DCB_STATE_POLLING)
     {
-        /** Because the resolution of the timeout is one second, we only need to
-         * check for it once per second. One heartbeat is 100 milliseconds. */
-        next_timeout_check = hkheartbeat + 10;
+        int64_t idle = hkheartbeat - dcb->last_read;
+        int64_t timeout = service->conn_idle_timeout * 10;
 
-        for (DCB *dcb = all_dcbs[thr]; dcb; dcb = dcb->thread.next)
+        if (idle > timeout)
         {
-            if (dcb->dcb_role == DCB_ROLE_CLIENT_HANDLER)
-            {
-                ss_dassert(dcb->listener);
-                SERVICE *service = dcb->listener->service;
+            MXS_WARNING("Timing out '%s'@%s, idle for %.1f seconds",
+                        dcb->user ? dcb->user : "<unknown>",
+                        dcb->remote ? dcb->remote : "<unknown>",
+                        (float)idle / 10.f);
+            poll_fake_hangup_event(dcb);
+        }
+        else
+        {
+            /** One heartbeat is 100 milliseconds */
+            mxs_timer_start(timer, (timeout - idle + 1) * 100, 0);
+        }
+    }
+}
 
-                if (service->conn_idle_timeout && dcb->state == DCB_STATE_POLLING)
-                {
-                    int64_t idle = hkheartbeat - dcb->last_read;
-                    int64_t timeout = service->conn_idle_timeout * 10;
+void dcb_start_idle_timer(DCB *dcb)
+{
+    if (check_timeouts && dcb->dcb_role == DCB_ROLE_CLIENT_HANDLER &&
+        dcb->state == DCB_STATE_POLLING && (dcb->flags & DCBF_HUNG) == 0)
+    {
+        ss_dassert(dcb->listener);
+        SERVICE *service = dcb->listener->service;
 
-                    if (idle > timeout)
-                    {
-                        MXS_WARNING("Timing out '%s'@%s, idle for %.1f seconds",
-                                    dcb->user ? dcb->user : "<unknown>",
-                                    dcb->remote ? dcb->remote : "<unknown>",
-                                    (float)idle / 10.f);
-                        poll_fake_hangup_event(dcb);
-                    }
-                }
+        if (service->conn_idle_timeout)
+        {
+            mxs_timer_start(&dcb->idle_timer, service->conn_idle_timeout * 1000, 0);
+        }
+    }
+}
+
+void dcb_pause_reading(DCB *dcb)
+{
+    if ((dcb->flags & DCBF_READ_PAUSED) == 0)
+    {
+        dcb->flags |= DCBF_READ_PAUSED;
+        atomic_add(&dcb->stats.n_read_paused, 1);
+    }
+}
+
+void dcb_resume_reading(DCB *dcb)
+{
+    if (dcb->flags & DCBF_READ_PAUSED)
+    {
+        dcb->flags &= ~DCBF_READ_PAUSED;
+
+        if (dcb->state == DCB_STATE_POLLING)
+        {
+            poll_fake_read_event(dcb);
+        }
+    }
+}
+
+/**
+ * @brief Pause or resume reading from the other side of a session
+ *
+ * When a client has more unsent data than its high water mark, reading from
+ * the backends of the session is paused. Likewise, reading from the client
+ * is paused when a backend can't keep up with it. This keeps the memory used
+ * by a session bounded. All DCBs of a session are owned by the same thread
+ * so the backends of the session can be walked without locking.
+ *
+ * @param dcb      DCB whose write queue crossed a water mark
+ * @param throttle True to pause reading, false to resume it
+ */
+static void dcb_throttle_session(DCB *dcb, bool throttle)
+{
+    MXS_SESSION *session = dcb->session;
+    dcb_role_t peer_role;
+
+    if (dcb->dcb_role == DCB_ROLE_CLIENT_HANDLER)
+    {
+        peer_role = DCB_ROLE_BACKEND_HANDLER;
+    }
+    else if (dcb->dcb_role == DCB_ROLE_BACKEND_HANDLER)
+    {
+        peer_role = DCB_ROLE_CLIENT_HANDLER;
+    }
+    else
+    {
+        return;
+    }
+
+    if (throttle)
+    {
+        if (session == NULL || session->state == SESSION_STATE_DUMMY)
+        {
+            return;
+        }
+
+        dcb->flags |= DCBF_THROTTLING;
+    }
+    else
+    {
+        dcb->flags &= ~DCBF_THROTTLING;
+
+        if (session == NULL || session->state == SESSION_STATE_DUMMY)
+        {
+            return;
+        }
+    }
+
+    MXS_INFO("%s %s with %d bytes of unsent data, %s reading from the %s.",
+             DCB_STRTYPE(dcb), dcb->remote ? dcb->remote : "", dcb->writeqlen,
+             throttle ? "pausing" : "resuming",
+             peer_role == DCB_ROLE_CLIENT_HANDLER ? "client" : "backends");
+
+    DCB *peer = peer_role == DCB_ROLE_CLIENT_HANDLER ? session->client_dcb : session->backends;
+
+    while (peer)
+    {
+        if (!peer->dcb_is_zombie)
+        {
+            if (throttle)
+            {
+                dcb_pause_reading(peer);
+            }
+            else
+            {
+                dcb_resume_reading(peer);
             }
         }
+
+        peer = peer_role == DCB_ROLE_CLIENT_HANDLER ? NULL : peer->session_next;
     }
 }
 
@@ -40,6 +40,7 @@
 #include <execinfo.h>
 #include <ftw.h>
 #include <getopt.h>
+#include <inttypes.h>
 #include <stdlib.h>
 #include <string.h>
 #include <strings.h>
@@ -65,6 +66,7 @@
 #include <maxscale/server.h>
 #include <maxscale/session.h>
 #include <maxscale/thread.h>
+#include <maxscale/timer.h>
 #include <maxscale/utils.h>
 #include <maxscale/version.h>
 #include <maxscale/random_jkiss.h>
@@ -1367,6 +1369,11 @@ int main(int argc, char **argv)
     MXS_CONFIG* cnf = NULL;
     int numlocks = 0;
     bool pid_file_created = false;
+    uint64_t startup_begin = 0;    /*< Startup time breakdown, in milliseconds */
+    uint64_t config_done = 0;
+    uint64_t modules_done = 0;
+    uint64_t monitors_done = 0;
+    uint64_t services_done = 0;
 
     *syslog_enabled = 1;
     *maxlog_enabled = 1;
@@ -1927,6 +1934,8 @@ int main(int argc, char **argv)
     MXS_NOTICE("Module directory: %s", get_libdir());
     MXS_NOTICE("Service cache: %s", get_cachedir());
 
+    startup_begin = mxs_timer_now();
+
     if (!config_load(cnf_file_path))
     {
         const char* fprerr =
@@ -1940,6 +1949,8 @@ int main(int argc, char **argv)
         goto return_main;
     }
 
+    config_done = mxs_timer_now();
+
     cnf = config_get_global_options();
     ss_dassert(cnf);
 
@@ -2001,12 +2012,18 @@ int main(int argc, char **argv)
         goto return_main;
     }
 
+    modules_done = mxs_timer_now();
+
     /** Start all monitors */
     monitorStartAll();
 
+    monitors_done = mxs_timer_now();
+
     /** Start the services that were created above */
     n_services = service_launch_all();
 
+    services_done = mxs_timer_now();
+
     if (n_services == 0)
     {
         const char* logerr = "Failed to start all MaxScale services. Exiting.";
@@ -2046,6 +2063,17 @@ int main(int argc, char **argv)
         goto return_main;
     }
 
+    /*
+     * Start the thread that refreshes the users of the services
+     */
+    if (!service_users_refresh_start())
+    {
+        const char* logerr = "Failed to start user refresh thread.";
+        print_log_n_stderr(true, true, logerr, logerr, 0);
+        rc = MAXSCALE_INTERNALERROR;
+        goto return_main;
+    }
+
     /*<
      * Start the polling threads, note this is one less than is
      * configured as the main thread will also poll.
@@ -2068,6 +2096,11 @@ int main(int argc, char **argv)
     }
 
     MXS_NOTICE("MaxScale started with %d server threads.", config_threadcount());
+    MXS_NOTICE("Startup took %" PRIu64 " ms: configuration %" PRIu64 " ms, modules %" PRIu64
+               " ms, monitors %" PRIu64 " ms, services %" PRIu64 " ms, threads %" PRIu64 " ms.",
+               mxs_timer_now() - startup_begin, config_done - startup_begin,
+               modules_done - config_done, monitors_done - modules_done,
+               services_done - monitors_done, mxs_timer_now() - services_done);
     /**
      * Successful start, notify the parent process that it can exit.
      */
@@ -2087,6 +2120,11 @@ int main(int argc, char **argv)
      */
     hkfinish();
 
+    /*<
+     * Wait for the user refresh thread to finish.
+     */
+    service_users_refresh_finish();
+
     /*<
      * Wait server threads' completion.
      */
@@ -0,0 +1,243 @@
+/*
+ * Copyright (c) 2016 MariaDB Corporation Ab
+ *
+ * Use of this software is governed by the Business Source License included
+ * in the LICENSE.TXT file and at www.mariadb.com/bsl11.
+ *
+ * Change Date: 2019-07-01
+ *
+ * On the date above, in accordance with the Business Source License, use
+ * of this software will be governed by version 2 or later of the General
+ * Public License.
+ */
+
+/**
+ * @file histogram.c  Per-thread latency histograms
+ */
+
+#include <maxscale/histogram.h>
+
+#include <inttypes.h>
+#include <string.h>
+#include <time.h>
+
+#include <maxscale/alloc.h>
+#include <maxscale/config.h>
+#include <maxscale/dcb.h>
+#include <maxscale/debug.h>
+
+/** The buckets that are exported to Prometheus, as powers of two */
+#define PROMETHEUS_MIN_BITS 4
+#define PROMETHEUS_MAX_BITS 24
+
+typedef struct histogram_shard
+{
+    uint64_t sum;
+    uint64_t max;
+    uint64_t buckets[MXS_HISTOGRAM_BUCKETS];
+} HISTOGRAM_SHARD;
+
+/** Pad the shards to a multiple of the cache line size so that two threads
+ * never write to the same cache line */
+#define SHARD_SIZE ((sizeof(HISTOGRAM_SHARD) + 63) & ~(size_t)63)
+
+struct mxs_histogram
+{
+    int   n_shards;
+    char *shards;
+};
+
+static inline HISTOGRAM_SHARD* get_shard(const MXS_HISTOGRAM *histogram, int i)
+{
+    return (HISTOGRAM_SHARD*)(histogram->shards + i * SHARD_SIZE);
+}
+
+MXS_HISTOGRAM* mxs_histogram_alloc()
+{
+    int n_shards = config_threadcount();
+
+    if (n_shards < 1)
+    {
+        n_shards = 1;
+    }
+
+    MXS_HISTOGRAM *histogram = (MXS_HISTOGRAM*)MXS_MALLOC(sizeof(MXS_HISTOGRAM));
+    char *shards = (char*)MXS_CALLOC(n_shards, SHARD_SIZE);
+
+    if (histogram == NULL || shards == NULL)
+    {
+        MXS_FREE(histogram);
+        MXS_FREE(shards);
+        return NULL;
+    }
+
+    histogram->n_shards = n_shards;
+    histogram->shards = shards;
+
+    return histogram;
+}
+
+void mxs_histogram_free(MXS_HISTOGRAM *histogram)
+{
+    if (histogram)
+    {
+        MXS_FREE(histogram->shards);
+        MXS_FREE(histogram);
+    }
+}
+
+int mxs_histogram_bucket(uint64_t value)
+{
+    if (value < MXS_HISTOGRAM_SUB_BUCKETS)
+    {
+        return value;
+    }
+
+    int msb = 63 - __builtin_clzll(value);
+
+    if (msb >= MXS_HISTOGRAM_MAX_BITS)
+    {
+        return MXS_HISTOGRAM_BUCKETS - 1;
+    }
+
+    int sub = (value >> (msb - MXS_HISTOGRAM_SUB_BITS)) & (MXS_HISTOGRAM_SUB_BUCKETS - 1);
+
+    return (msb - MXS_HISTOGRAM_SUB_BITS + 1) * MXS_HISTOGRAM_SUB_BUCKETS + sub;
+}
+
+uint64_t mxs_histogram_bucket_lower(int bucket)
+{
+    if (bucket < MXS_HISTOGRAM_SUB_BUCKETS)
+    {
+        return bucket;
+    }
+
+    int msb = bucket / MXS_HISTOGRAM_SUB_BUCKETS + MXS_HISTOGRAM_SUB_BITS - 1;
+    uint64_t sub = bucket % MXS_HISTOGRAM_SUB_BUCKETS;
+
+    return (MXS_HISTOGRAM_SUB_BUCKETS + sub) << (msb - MXS_HISTOGRAM_SUB_BITS);
+}
+
+void mxs_histogram_record(MXS_HISTOGRAM *histogram, uint64_t value, int thread_id)
+{
+    if (histogram && thread_id >= 0 && thread_id < histogram->n_shards)
+    {
+        HISTOGRAM_SHARD *shard = get_shard(histogram, thread_id);
+        shard->sum += value;
+        shard->buckets[mxs_histogram_bucket(value)]++;
+
+        if (value > shard->max)
+        {
+            shard->max = value;
+        }
+    }
+}
+
+void mxs_histogram_snapshot(const MXS_HISTOGRAM *histogram, MXS_HISTOGRAM_SNAPSHOT *snapshot)
+{
+    memset(snapshot, 0, sizeof(*snapshot));
+
+    for (int i = 0; i < histogram->n_shards; i++)
+    {
+        HISTOGRAM_SHARD *shard = get_shard(histogram, i);
+        uint64_t count = 0;
+
+        for (int b = 0; b < MXS_HISTOGRAM_BUCKETS; b++)
+        {
+            uint64_t n = shard->buckets[b];
+            snapshot->buckets[b] += n;
+            count += n;
+        }
+
+        /** The count is derived from the buckets so that the snapshot stays
+         * consistent even if the owning thread records a value while it is
+         * being read */
+        snapshot->count += count;
+        snapshot->sum += shard->sum;
+
+        if (shard->max > snapshot->max)
+        {
+            snapshot->max = shard->max;
+        }
+    }
+}
+
+uint64_t mxs_histogram_percentile(const MXS_HISTOGRAM_SNAPSHOT *snapshot, double percentile)
+{
+    if (snapshot->count == 0)
+    {
+        return 0;
+    }
+
+    uint64_t target = (uint64_t)(snapshot->count * percentile / 100.0 + 0.5);
+
+    if (target == 0)
+    {
+        target = 1;
+    }
+
+    uint64_t seen = 0;
+
+    for (int b = 0; b < MXS_HISTOGRAM_BUCKETS - 1; b++)
+    {
+        seen += snapshot->buckets[b];
+
+        if (seen >= target)
+        {
+            uint64_t upper = mxs_histogram_bucket_lower(b + 1) - 1;
+            return upper < snapshot->max ? upper : snapshot->max;
+        }
+    }
+
+    return snapshot->max;
+}
+
+void mxs_histogram_print_prometheus(DCB *dcb, const MXS_HISTOGRAM *histogram,
+                                    const char *name, const char *labels)
+{
+    MXS_HISTOGRAM_SNAPSHOT snapshot;
+    mxs_histogram_snapshot(histogram, &snapshot);
+
+    const char *sep = *labels ? "," : "";
+    uint64_t cumulative = 0;
+    int b = 0;
+
+    for (int bits = PROMETHEUS_MIN_BITS; bits <= PROMETHEUS_MAX_BITS; bits++)
+    {
+        /** The first bucket of a power of two starts at exactly that value */
+        int end = mxs_histogram_bucket(UINT64_C(1) << bits);
+
+        for (; b < end; b++)
+        {
+            cumulative += snapshot.buckets[b];
+        }
+
+        dcb_printf(dcb, "%s_bucket{%s%sle=\"%.6f\"} %" PRIu64 "\n", name, labels, sep,
+                   (double)(UINT64_C(1) << bits) / 1000000.0, cumulative);
+    }
+
+    dcb_printf(dcb, "%s_bucket{%s%sle=\"+Inf\"} %" PRIu64 "\n", name, labels, sep, snapshot.count);
+
+    const char *open = *labels ? "{" : "";
+    const char *close = *labels ? "}" : "";
+    dcb_printf(dcb, "%s_sum%s%s%s %.6f\n", name, open, labels, close,
+               (double)snapshot.sum / 1000000.0);
+    dcb_printf(dcb, "%s_count%s%s%s %" PRIu64 "\n", name, open, labels, close, snapshot.count);
+}
+
+void mxs_histogram_dprint(DCB *dcb, const MXS_HISTOGRAM *histogram, const char *title)
+{
+    MXS_HISTOGRAM_SNAPSHOT snapshot;
+    mxs_histogram_snapshot(histogram, &snapshot);
+
+    dcb_printf(dcb, "\t%-37s%" PRIu64 "/%" PRIu64 "/%" PRIu64 " us (p50/p99/max)\n", title,
+               mxs_histogram_percentile(&snapshot, 50), mxs_histogram_percentile(&snapshot, 99),
+               snapshot.max);
+}
+
+uint64_t mxs_histogram_now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
@@ -282,7 +282,28 @@ listener_init_SSL(SSL_LISTENER *ssl_listener)
             return -1;
         }
 
-        SSL_CTX_set_default_read_ahead(ssl_listener->ctx, 0);
+        /** Read ahead lets OpenSSL read several records with one system call.
+         * The DCB reads until OpenSSL wants more data from the socket so no
+         * buffered data is left behind. */
+        SSL_CTX_set_default_read_ahead(ssl_listener->ctx, 1);
+
+        /** A blocked write is retried from the head of the write queue
+         * rather than from a fixed address */
+        SSL_CTX_set_mode(ssl_listener->ctx, SSL_MODE_ACCEPT_MOVING_WRITE_BUFFER);
+
+        if (ssl_listener->ssl_session_cache)
+        {
+            /** The session cache of the context is shared by all threads. The
+             * ID context lets sessions resume when client certificates are used. */
+            static const unsigned char sid_ctx[] = "MaxScale";
+            SSL_CTX_set_session_cache_mode(ssl_listener->ctx, SSL_SESS_CACHE_SERVER);
+            SSL_CTX_set_session_id_context(ssl_listener->ctx, sid_ctx, sizeof(sid_ctx) - 1);
+        }
+        else
+        {
+            SSL_CTX_set_session_cache_mode(ssl_listener->ctx, SSL_SESS_CACHE_OFF);
+            SSL_CTX_set_options(ssl_listener->ctx, SSL_OP_NO_TICKET);
+        }
 
         /** Enable all OpenSSL bug fixes */
         SSL_CTX_set_options(ssl_listener->ctx, SSL_OP_ALL);
@@ -43,6 +43,7 @@
 #include <openssl/sha.h>
 #include <maxscale/paths.h>
 #include <maxscale/alloc.h>
+#include <pthread.h>
 
 #include "maxscale/modules.h"
 
@@ -59,6 +60,10 @@ typedef struct loaded_module
 
 static LOADED_MODULE *registered = NULL;
 
+/** Protects the list of loaded modules, services are initialized in parallel.
+ * A mutex is used as it is held while a module is opened and initialized. */
+static pthread_mutex_t load_lock = PTHREAD_MUTEX_INITIALIZER;
+
 static LOADED_MODULE *find_module(const char *module);
 static LOADED_MODULE* register_module(const char *module,
                                       const char *type,
@@ -160,9 +165,8 @@ static bool check_module(const MXS_MODULE *mod_info, const char *type, const cha
     return success;
 }
 
-void *load_module(const char *module, const char *type)
+static void *do_load_module(const char *module, const char *type)
 {
-    ss_dassert(module && type);
     LOADED_MODULE *mod;
 
     if ((mod = find_module(module)) == NULL)
@@ -217,8 +221,20 @@ void *load_module(const char *module, const char *type)
     return mod->modobj;
 }
 
+void *load_module(const char *module, const char *type)
+{
+    ss_dassert(module && type);
+
+    pthread_mutex_lock(&load_lock);
+    void *rval = do_load_module(module, type);
+    pthread_mutex_unlock(&load_lock);
+
+    return rval;
+}
+
 void unload_module(const char *module)
 {
+    pthread_mutex_lock(&load_lock);
     LOADED_MODULE *mod = find_module(module);
 
     if (mod)
@@ -227,12 +243,16 @@ void unload_module(const char *module)
         unregister_module(module);
         dlclose(handle);
     }
+
+    pthread_mutex_unlock(&load_lock);
 }
 
 /**
  * Find a module that has been previously loaded and return the handle for that
  * library
  *
+ * The caller must hold load_lock.
+ *
  * @param module        The name of the module
  * @return              The module handle or NULL if it was not found
  */
@@ -350,10 +370,14 @@ unregister_module(const char *module)
 
 void unload_all_modules()
 {
+    pthread_mutex_lock(&load_lock);
+
     while (registered)
     {
         unregister_module(registered->module);
     }
+
+    pthread_mutex_unlock(&load_lock);
 }
 
 void printModules()
@@ -841,13 +865,16 @@ cleanup:
 
 const MXS_MODULE *get_module(const char *name, const char *type)
 {
+    pthread_mutex_lock(&load_lock);
     LOADED_MODULE *mod = find_module(name);
 
-    if (mod == NULL && load_module(name, type))
+    if (mod == NULL && do_load_module(name, type))
     {
         mod = find_module(name);
     }
 
+    pthread_mutex_unlock(&load_lock);
+
     return mod ? mod->info : NULL;
 }
 
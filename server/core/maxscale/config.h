@@ -27,6 +27,8 @@ MXS_BEGIN_DECLS
 #define DEFAULT_NTHREADS            1    /**< Default number of polling threads */
 #define DEFAULT_QUERY_RETRIES       0    /**< Number of retries for interrupted queries */
 #define DEFAULT_QUERY_RETRY_TIMEOUT 5    /**< Timeout for query retries */
+#define DEFAULT_WRITEQ_HIGH_WATER   0    /**< Write queue throttling is disabled by default */
+#define DEFAULT_WRITEQ_LOW_WATER    0
 
 /**
  * @brief Generate default module parameters
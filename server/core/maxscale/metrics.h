@@ -0,0 +1,47 @@
+#pragma once
+/*
+ * Copyright (c) 2016 MariaDB Corporation Ab
+ *
+ * Use of this software is governed by the Business Source License included
+ * in the LICENSE.TXT file and at www.mariadb.com/bsl11.
+ *
+ * Change Date: 2019-07-01
+ *
+ * On the date above, in accordance with the Business Source License, use
+ * of this software will be governed by version 2 or later of the General
+ * Public License.
+ */
+
+/**
+ * @file
+ *
+ * Internal code for the metrics export. Each subsystem prints its own
+ * metric families in the Prometheus text exposition format.
+ */
+
+#include <maxscale/metrics.h>
+
+MXS_BEGIN_DECLS
+
+/**
+ * @brief Print the metrics of all services
+ *
+ * @param dcb DCB to print to
+ */
+void service_print_metrics(DCB *dcb);
+
+/**
+ * @brief Print the metrics of all servers
+ *
+ * @param dcb DCB to print to
+ */
+void server_print_metrics(DCB *dcb);
+
+/**
+ * @brief Print the metrics of the polling system
+ *
+ * @param dcb DCB to print to
+ */
+void poll_print_metrics(DCB *dcb);
+
+MXS_END_DECLS
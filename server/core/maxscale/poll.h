@@ -62,4 +62,9 @@ RESULTSET       *eventTimesGetList();
 
 void            poll_send_message(enum poll_message msg, void *data);
 
+/**
+ * @brief Count a client connection accepted by the calling thread
+ */
+void            poll_count_accepted();
+
 MXS_END_DECLS
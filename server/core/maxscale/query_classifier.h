@@ -36,4 +36,25 @@ typedef enum qc_trx_parse_using
  */
 uint32_t qc_get_trx_type_mask_using(GWBUF* stmt, qc_trx_parse_using_t use);
 
+/**
+ * Classifies a statement using only the fast path, without falling back
+ * to the query classifier plugin.
+ *
+ * @param stmt         A COM_QUERY or COM_STMT_PREPARE packet.
+ * @param type_mask    On successful return, the type mask of the statement.
+ * @param op           On successful return, the operation of the statement.
+ * @param fullnames    If true, table names are qualified with the database
+ *                     name when the statement contains one.
+ * @param table_names  On successful return, a NULL terminated array of table
+ *                     names or NULL if the statement refers to no tables. The
+ *                     array and its elements must be freed by the caller.
+ * @param tblsize      On successful return, the number of table names.
+ *
+ * @return True, if the statement is within the subset handled by the fast
+ *         path, false otherwise in which case the output arguments are
+ *         not modified.
+ */
+bool qc_get_fast_path_info(GWBUF* stmt, uint32_t* type_mask, qc_query_op_t* op,
+                           bool fullnames, char*** table_names, int* tblsize);
+
 MXS_END_DECLS
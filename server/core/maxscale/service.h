@@ -69,6 +69,21 @@ void service_destroy_instances(void);
  */
 int service_launch_all(void);
 
+/**
+ * @brief Start the background user refresh thread
+ *
+ * The thread serves the requests made with service_refresh_users_async() and
+ * exits once service_shutdown() has been called.
+ *
+ * @return True if the thread was started
+ */
+bool service_users_refresh_start(void);
+
+/**
+ * @brief Wait for the background user refresh thread to exit
+ */
+void service_users_refresh_finish(void);
+
 /**
  * Creating and adding new components to services
  */
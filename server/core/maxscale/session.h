@@ -44,6 +44,7 @@ int session_isvalid(MXS_SESSION *);
 int session_reply(void *inst, void *session, GWBUF *data);
 char *session_state(mxs_session_state_t);
 bool session_link_dcb(MXS_SESSION *, struct dcb *);
+void session_unlink_dcb(MXS_SESSION *, struct dcb *);
 
 RESULTSET *sessionGetList(SESSIONLISTFILTER);
 
@@ -0,0 +1,978 @@
+#pragma once
+/*
+ * Copyright (c) 2016 MariaDB Corporation Ab
+ *
+ * Use of this software is governed by the Business Source License included
+ * in the LICENSE.TXT file and at www.mariadb.com/bsl11.
+ *
+ * Change Date: 2019-07-01
+ *
+ * On the date above, in accordance with the Business Source License, use
+ * of this software will be governed by version 2 or later of the General
+ * Public License.
+ */
+
+#include <maxscale/cppdefs.hh>
+#include <ctype.h>
+#include <maxscale/buffer.h>
+#include <maxscale/protocol/mysql.h>
+#include <maxscale/query_classifier.h>
+
+namespace maxscale
+{
+
+#define SSP_WORD(string_literal) string_literal, (sizeof(string_literal) - 1)
+
+/**
+ * @class SimpleStatementParser
+ *
+ * SimpleStatementParser classifies a small, well-defined subset of statements
+ * without invoking the query classifier plugin. The accepted statements are
+ *
+ * - SELECT of columns or literals from at most one table, optionally with a
+ *   WHERE clause that compares columns with literals, ORDER BY and LIMIT,
+ * - INSERT [INTO] table [(columns)] VALUES with rows of literals,
+ * - SET NAMES and SET CHARACTER SET, and
+ * - USE db.
+ *
+ * Everything else is rejected. In particular, statements that contain
+ * comments, functions, variables, joins, subqueries, aliases or locking
+ * clauses must be classified by the plugin. For an accepted statement the
+ * type mask, the operation and the accessed table are the same as what
+ * qc_sqlite reports.
+ *
+ * Like TrxBoundaryParser, the class is defined in its entirety in the
+ * header to allow for aggressive inlining.
+ */
+class SimpleStatementParser
+{
+public:
+    enum token_t
+    {
+        TK_WORD,        // Unquoted identifier or keyword
+        TK_QUOTED,      // Identifier in backticks
+        TK_LITERAL,     // Number, string, NULL, TRUE, FALSE or ?
+        TK_COMMA,
+        TK_COMPARISON,
+        TK_DOT,
+        TK_LPAREN,
+        TK_RPAREN,
+        TK_STAR,
+
+        PARSER_UNKNOWN_TOKEN,
+        PARSER_EXHAUSTED,
+    };
+
+    /**
+     * SimpleStatementParser is not thread-safe. As with TrxBoundaryParser,
+     * an instance is intended to be created on the stack whenever a statement
+     * needs to be classified.
+     */
+    SimpleStatementParser()
+        : m_pI(NULL)
+        , m_pEnd(NULL)
+        , m_token(PARSER_UNKNOWN_TOKEN)
+        , m_pToken(NULL)
+        , m_token_len(0)
+        , m_type_mask(QUERY_TYPE_UNKNOWN)
+        , m_op(QUERY_OP_UNDEFINED)
+        , m_pDatabase(NULL)
+        , m_database_len(0)
+        , m_pTable(NULL)
+        , m_table_len(0)
+    {
+    }
+
+    /**
+     * Parse a statement.
+     *
+     * @param pSql  SQL statement.
+     * @param len   Length of pSql.
+     *
+     * @return True, if the statement belongs to the accepted subset.
+     */
+    bool parse(const char* pSql, size_t len)
+    {
+        m_pI = pSql;
+        m_pEnd = pSql + len;
+        m_type_mask = QUERY_TYPE_UNKNOWN;
+        m_op = QUERY_OP_UNDEFINED;
+        m_pDatabase = NULL;
+        m_database_len = 0;
+        m_pTable = NULL;
+        m_table_len = 0;
+
+        bool rv = false;
+
+        next_token();
+
+        if (m_token == TK_WORD)
+        {
+            if (is_word(SSP_WORD("SELECT")))
+            {
+                rv = parse_select();
+            }
+            else if (is_word(SSP_WORD("INSERT")))
+            {
+                rv = parse_insert();
+            }
+            else if (is_word(SSP_WORD("SET")))
+            {
+                rv = parse_set();
+            }
+            else if (is_word(SSP_WORD("USE")))
+            {
+                rv = parse_use();
+            }
+        }
+
+        return rv;
+    }
+
+    /**
+     * Parse a statement.
+     *
+     * @param pBuf  A contiguous COM_QUERY or COM_STMT_PREPARE packet.
+     *
+     * @return True, if the statement belongs to the accepted subset.
+     */
+    bool parse(GWBUF* pBuf)
+    {
+        bool rv = false;
+
+        if (GWBUF_LENGTH(pBuf) > MYSQL_HEADER_LEN)
+        {
+            const uint8_t* pData = GWBUF_DATA(pBuf);
+            size_t payload_len = MYSQL_GET_PAYLOAD_LEN(pData);
+            uint8_t command = MYSQL_GET_COMMAND(pData);
+
+            if ((size_t)GWBUF_LENGTH(pBuf) == MYSQL_HEADER_LEN + payload_len &&
+                (command == MYSQL_COM_QUERY || command == MYSQL_COM_STMT_PREPARE))
+            {
+                rv = parse((const char*)pData + MYSQL_HEADER_LEN + 1, payload_len - 1);
+
+                if (rv && command == MYSQL_COM_STMT_PREPARE)
+                {
+                    m_type_mask |= QUERY_TYPE_PREPARE_STMT;
+                }
+            }
+        }
+
+        return rv;
+    }
+
+    /**
+     * @return The type mask of the latest accepted statement.
+     */
+    uint32_t type_mask() const
+    {
+        return m_type_mask;
+    }
+
+    /**
+     * @return The operation of the latest accepted statement.
+     */
+    qc_query_op_t operation() const
+    {
+        return m_op;
+    }
+
+    /**
+     * Get the table of the latest accepted statement.
+     *
+     * @param ppDatabase  On return the database name, or NULL if the table
+     *                    was not qualified.
+     * @param pDatabase_len  On return the length of the database name.
+     * @param ppTable  On return the table name, or NULL if the statement
+     *                 does not access a table.
+     * @param pTable_len  On return the length of the table name.
+     *
+     * @return True, if the statement accesses a table.
+     */
+    bool get_table(const char** ppDatabase, size_t* pDatabase_len,
+                   const char** ppTable, size_t* pTable_len) const
+    {
+        *ppDatabase = m_pDatabase;
+        *pDatabase_len = m_database_len;
+        *ppTable = m_pTable;
+        *pTable_len = m_table_len;
+
+        return m_pTable != NULL;
+    }
+
+private:
+    bool accept(uint32_t type_mask, qc_query_op_t op)
+    {
+        bool rv = (m_token == PARSER_EXHAUSTED);
+
+        if (rv)
+        {
+            m_type_mask = type_mask;
+            m_op = op;
+        }
+
+        return rv;
+    }
+
+    // SELECT {* | column[, ...]} [FROM table [WHERE ...] [ORDER BY ...] [LIMIT ...]]
+    bool parse_select()
+    {
+        bool literals_only = true;
+
+        do
+        {
+            next_token();
+
+            if (m_token == TK_LITERAL)
+            {
+                next_token();
+            }
+            else if (m_token == TK_STAR)
+            {
+                literals_only = false;
+                next_token();
+            }
+            else if (is_identifier())
+            {
+                literals_only = false;
+
+                if (!parse_column(true))
+                {
+                    return false;
+                }
+            }
+            else
+            {
+                return false;
+            }
+        }
+        while (m_token == TK_COMMA);
+
+        if (m_token == PARSER_EXHAUSTED && literals_only)
+        {
+            // E.g. "SELECT 1"
+            return accept(QUERY_TYPE_READ, QUERY_OP_SELECT);
+        }
+
+        if (!is_keyword(SSP_WORD("FROM")))
+        {
+            return false;
+        }
+
+        next_token();
+
+        if (!parse_table())
+        {
+            return false;
+        }
+
+        if (is_keyword(SSP_WORD("WHERE")) && !parse_where())
+        {
+            return false;
+        }
+
+        if (is_keyword(SSP_WORD("ORDER")) && !parse_order_by())
+        {
+            return false;
+        }
+
+        if (is_keyword(SSP_WORD("LIMIT")) && !parse_limit())
+        {
+            return false;
+        }
+
+        return accept(QUERY_TYPE_READ, QUERY_OP_SELECT);
+    }
+
+    // INSERT [INTO] table [(column[, ...])] {VALUES | VALUE} (literal[, ...])[, ...]
+    bool parse_insert()
+    {
+        next_token();
+
+        if (is_keyword(SSP_WORD("INTO")))
+        {
+            next_token();
+        }
+
+        if (!parse_table())
+        {
+            return false;
+        }
+
+        if (m_token == TK_LPAREN)
+        {
+            do
+            {
+                next_token();
+
+                if (!is_identifier())
+                {
+                    return false;
+                }
+
+                next_token();
+            }
+            while (m_token == TK_COMMA);
+
+            if (m_token != TK_RPAREN)
+            {
+                return false;
+            }
+
+            next_token();
+        }
+
+        if (!is_keyword(SSP_WORD("VALUES")) && !is_keyword(SSP_WORD("VALUE")))
+        {
+            return false;
+        }
+
+        do
+        {
+            next_token();
+
+            if (m_token != TK_LPAREN || !parse_literal_list())
+            {
+                return false;
+            }
+        }
+        while (m_token == TK_COMMA);
+
+        return accept(QUERY_TYPE_WRITE, QUERY_OP_INSERT);
+    }
+
+    // SET NAMES charset [COLLATE collation] | SET CHARACTER SET charset
+    bool parse_set()
+    {
+        next_token();
+
+        if (is_keyword(SSP_WORD("NAMES")))
+        {
+            next_token();
+
+            if (!parse_name())
+            {
+                return false;
+            }
+
+            if (is_keyword(SSP_WORD("COLLATE")))
+            {
+                next_token();
+
+                if (!parse_name())
+                {
+                    return false;
+                }
+            }
+        }
+        else if (is_keyword(SSP_WORD("CHARACTER")))
+        {
+            next_token();
+
+            if (!is_keyword(SSP_WORD("SET")))
+            {
+                return false;
+            }
+
+            next_token();
+
+            if (!parse_name())
+            {
+                return false;
+            }
+        }
+        else
+        {
+            return false;
+        }
+
+        return accept(QUERY_TYPE_GSYSVAR_WRITE, QUERY_OP_UNDEFINED);
+    }
+
+    // USE db
+    bool parse_use()
+    {
+        next_token();
+
+        if (!is_identifier())
+        {
+            return false;
+        }
+
+        next_token();
+
+        return accept(QUERY_TYPE_SESSION_WRITE, QUERY_OP_CHANGE_DB);
+    }
+
+    // A character set or collation name
+    bool parse_name()
+    {
+        bool rv = is_identifier() || (m_token == TK_LITERAL && *m_pToken == '\'');
+
+        if (rv)
+        {
+            next_token();
+        }
+
+        return rv;
+    }
+
+    // [[db.]table.]column or, if allowed, table.*
+    bool parse_column(bool allow_star)
+    {
+        int parts = 1;
+
+        next_token();
+
+        while (m_token == TK_DOT)
+        {
+            next_token();
+
+            if (m_token == TK_STAR && allow_star && parts < 3)
+            {
+                next_token();
+                break;
+            }
+            else if (!is_identifier() || ++parts > 3)
+            {
+                return false;
+            }
+
+            next_token();
+        }
+
+        return true;
+    }
+
+    // [db.]table
+    bool parse_table()
+    {
+        if (!is_identifier())
+        {
+            return false;
+        }
+
+        m_pTable = m_pToken;
+        m_table_len = m_token_len;
+
+        next_token();
+
+        if (m_token == TK_DOT)
+        {
+            next_token();
+
+            if (!is_identifier())
+            {
+                return false;
+            }
+
+            m_pDatabase = m_pTable;
+            m_database_len = m_table_len;
+            m_pTable = m_pToken;
+            m_table_len = m_token_len;
+
+            next_token();
+        }
+
+        return true;
+    }
+
+    // WHERE column {op literal | IN (literal[, ...])} [{AND | OR} ...]
+    bool parse_where()
+    {
+        do
+        {
+            next_token();
+
+            if (!is_identifier() || !parse_column(false))
+            {
+                return false;
+            }
+
+            if (m_token == TK_COMPARISON)
+            {
+                next_token();
+
+                if (m_token != TK_LITERAL)
+                {
+                    return false;
+                }
+
+                next_token();
+            }
+            else if (is_keyword(SSP_WORD("IN")))
+            {
+                next_token();
+
+                if (m_token != TK_LPAREN || !parse_literal_list())
+                {
+                    return false;
+                }
+            }
+            else
+            {
+                return false;
+            }
+        }
+        while (is_keyword(SSP_WORD("AND")) || is_keyword(SSP_WORD("OR")));
+
+        return true;
+    }
+
+    // ORDER BY column [ASC | DESC][, ...]
+    bool parse_order_by()
+    {
+        next_token();
+
+        if (!is_keyword(SSP_WORD("BY")))
+        {
+            return false;
+        }
+
+        do
+        {
+            next_token();
+
+            if (!is_identifier() || !parse_column(false))
+            {
+                return false;
+            }
+
+            if (is_keyword(SSP_WORD("ASC")) || is_keyword(SSP_WORD("DESC")))
+            {
+                next_token();
+            }
+        }
+        while (m_token == TK_COMMA);
+
+        return true;
+    }
+
+    // LIMIT count | LIMIT offset, count | LIMIT count OFFSET offset
+    bool parse_limit()
+    {
+        next_token();
+
+        if (m_token != TK_LITERAL)
+        {
+            return false;
+        }
+
+        next_token();
+
+        if (m_token == TK_COMMA || is_keyword(SSP_WORD("OFFSET")))
+        {
+            next_token();
+
+            if (m_token != TK_LITERAL)
+            {
+                return false;
+            }
+
+            next_token();
+        }
+
+        return true;
+    }
+
+    // (literal[, ...]), the current token is the opening parenthesis
+    bool parse_literal_list()
+    {
+        do
+        {
+            next_token();
+
+            if (m_token != TK_LITERAL)
+            {
+                return false;
+            }
+
+            next_token();
+        }
+        while (m_token == TK_COMMA);
+
+        if (m_token != TK_RPAREN)
+        {
+            return false;
+        }
+
+        next_token();
+
+        return true;
+    }
+
+    // Significantly faster than library version.
+    static char toupper(char c)
+    {
+        return (c >= 'a' && c <= 'z') ? c - ('a' - 'A') : c;
+    }
+
+    static bool is_word_char(char c)
+    {
+        return
+            (c >= 'a' && c <= 'z') ||
+            (c >= 'A' && c <= 'Z') ||
+            (c >= '0' && c <= '9') ||
+            (c == '_') || (c == '$') || (static_cast<unsigned char>(c) >= 0x80);
+    }
+
+    static bool is_digit(char c)
+    {
+        return c >= '0' && c <= '9';
+    }
+
+    static bool is_space(char c)
+    {
+        return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\f' || c == '\v';
+    }
+
+    bool is_word(const char* zWord, size_t len) const
+    {
+        if (m_token_len != len)
+        {
+            return false;
+        }
+
+        for (size_t i = 0; i < len; ++i)
+        {
+            if (toupper(m_pToken[i]) != zWord[i])
+            {
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    bool is_keyword(const char* zWord, size_t len) const
+    {
+        return m_token == TK_WORD && is_word(zWord, len);
+    }
+
+    /**
+     * Words that are not accepted as unquoted identifiers. Either they are
+     * reserved, in which case the statement is not one that we handle, or
+     * they are functions that can be called without parentheses.
+     */
+    bool is_reserved() const
+    {
+        static const struct
+        {
+            const char* zWord;
+            size_t len;
+        } reserved[] =
+        {
+            { SSP_WORD("ALL") }, { SSP_WORD("AND") }, { SSP_WORD("AS") }, { SSP_WORD("ASC") },
+            { SSP_WORD("BETWEEN") }, { SSP_WORD("BINARY") }, { SSP_WORD("BY") }, { SSP_WORD("CASE") },
+            { SSP_WORD("CHARACTER") }, { SSP_WORD("COLLATE") }, { SSP_WORD("CROSS") },
+            { SSP_WORD("CURRENT_DATE") }, { SSP_WORD("CURRENT_TIME") }, { SSP_WORD("CURRENT_TIMESTAMP") },
+            { SSP_WORD("CURRENT_USER") }, { SSP_WORD("DEFAULT") }, { SSP_WORD("DESC") },
+            { SSP_WORD("DISTINCT") }, { SSP_WORD("DISTINCTROW") }, { SSP_WORD("DIV") }, { SSP_WORD("DUAL") },
+            { SSP_WORD("ELSE") }, { SSP_WORD("EXISTS") }, { SSP_WORD("FOR") }, { SSP_WORD("FROM") },
+            { SSP_WORD("GROUP") }, { SSP_WORD("HAVING") }, { SSP_WORD("HIGH_PRIORITY") },
+            { SSP_WORD("IGNORE") }, { SSP_WORD("IN") }, { SSP_WORD("INNER") }, { SSP_WORD("INSERT") },
+            { SSP_WORD("INTERVAL") }, { SSP_WORD("INTO") }, { SSP_WORD("IS") }, { SSP_WORD("JOIN") },
+            { SSP_WORD("LEFT") }, { SSP_WORD("LIKE") }, { SSP_WORD("LIMIT") }, { SSP_WORD("LOCALTIME") },
+            { SSP_WORD("LOCALTIMESTAMP") }, { SSP_WORD("LOCK") }, { SSP_WORD("LOW_PRIORITY") },
+            { SSP_WORD("MOD") }, { SSP_WORD("NAMES") }, { SSP_WORD("NATURAL") }, { SSP_WORD("NOT") },
+            { SSP_WORD("OFFSET") }, { SSP_WORD("ON") }, { SSP_WORD("OR") }, { SSP_WORD("ORDER") },
+            { SSP_WORD("OUTER") }, { SSP_WORD("PARTITION") }, { SSP_WORD("PROCEDURE") },
+            { SSP_WORD("REGEXP") }, { SSP_WORD("RIGHT") }, { SSP_WORD("RLIKE") }, { SSP_WORD("SELECT") },
+            { SSP_WORD("SET") }, { SSP_WORD("SQL_BIG_RESULT") }, { SSP_WORD("SQL_BUFFER_RESULT") },
+            { SSP_WORD("SQL_CACHE") }, { SSP_WORD("SQL_CALC_FOUND_ROWS") }, { SSP_WORD("SQL_NO_CACHE") },
+            { SSP_WORD("SQL_SMALL_RESULT") }, { SSP_WORD("STRAIGHT_JOIN") }, { SSP_WORD("THEN") },
+            { SSP_WORD("UNION") }, { SSP_WORD("UPDATE") }, { SSP_WORD("USE") }, { SSP_WORD("USING") },
+            { SSP_WORD("UTC_DATE") }, { SSP_WORD("UTC_TIME") }, { SSP_WORD("UTC_TIMESTAMP") },
+            { SSP_WORD("VALUE") }, { SSP_WORD("VALUES") }, { SSP_WORD("WHEN") }, { SSP_WORD("WHERE") },
+            { SSP_WORD("WITH") }, { SSP_WORD("XOR") },
+        };
+
+        for (size_t i = 0; i < sizeof(reserved) / sizeof(reserved[0]); ++i)
+        {
+            if (is_word(reserved[i].zWord, reserved[i].len))
+            {
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    bool is_identifier() const
+    {
+        return m_token == TK_QUOTED || (m_token == TK_WORD && !is_reserved());
+    }
+
+    // Skips a number, returns false if it turns out to be an identifier.
+    bool skip_number()
+    {
+        const char* pI = m_pI;
+
+        if (*pI == '-' || *pI == '+')
+        {
+            ++pI;
+        }
+
+        if (*pI == '0' && (pI + 1 < m_pEnd) && (pI[1] == 'x' || pI[1] == 'X'))
+        {
+            pI += 2;
+
+            while (pI < m_pEnd && isxdigit(static_cast<unsigned char>(*pI)))
+            {
+                ++pI;
+            }
+        }
+        else
+        {
+            while (pI < m_pEnd && is_digit(*pI))
+            {
+                ++pI;
+            }
+
+            if (pI < m_pEnd && *pI == '.')
+            {
+                ++pI;
+
+                while (pI < m_pEnd && is_digit(*pI))
+                {
+                    ++pI;
+                }
+            }
+
+            if (pI + 1 < m_pEnd && (*pI == 'e' || *pI == 'E') &&
+                (is_digit(pI[1]) || ((pI[1] == '-' || pI[1] == '+') && pI + 2 < m_pEnd && is_digit(pI[2]))))
+            {
+                pI += 2;
+
+                while (pI < m_pEnd && is_digit(*pI))
+                {
+                    ++pI;
+                }
+            }
+        }
+
+        m_pI = pI;
+
+        return pI == m_pEnd || !is_word_char(*pI);
+    }
+
+    // Skips a quoted string or identifier, returns false if it is not terminated.
+    bool skip_quoted(char quote)
+    {
+        const char* pI = m_pI + 1;
+
+        while (pI < m_pEnd)
+        {
+            if (*pI == '\\' && quote != '`')
+            {
+                pI += 2;
+            }
+            else if (*pI == quote)
+            {
+                if (pI + 1 < m_pEnd && pI[1] == quote)
+                {
+                    if (quote == '`')
+                    {
+                        // Doubled backticks would have to be removed from the name.
+                        return false;
+                    }
+
+                    pI += 2;
+                }
+                else
+                {
+                    m_pI = pI + 1;
+                    return true;
+                }
+            }
+            else
+            {
+                ++pI;
+            }
+        }
+
+        return false;
+    }
+
+    void next_token()
+    {
+        while (m_pI < m_pEnd && is_space(*m_pI))
+        {
+            ++m_pI;
+        }
+
+        m_pToken = m_pI;
+        m_token = PARSER_UNKNOWN_TOKEN;
+
+        if (m_pI == m_pEnd)
+        {
+            m_token = PARSER_EXHAUSTED;
+        }
+        else
+        {
+            char c = *m_pI;
+            char n = (m_pI + 1 < m_pEnd) ? m_pI[1] : 0;
+
+            switch (c)
+            {
+            case ';':
+                ++m_pI;
+
+                while (m_pI < m_pEnd && is_space(*m_pI))
+                {
+                    ++m_pI;
+                }
+
+                if (m_pI == m_pEnd)
+                {
+                    m_token = PARSER_EXHAUSTED;
+                }
+                break;
+
+            case ',':
+                ++m_pI;
+                m_token = TK_COMMA;
+                break;
+
+            case '.':
+                ++m_pI;
+                m_token = TK_DOT;
+                break;
+
+            case '(':
+                ++m_pI;
+                m_token = TK_LPAREN;
+                break;
+
+            case ')':
+                ++m_pI;
+                m_token = TK_RPAREN;
+                break;
+
+            case '*':
+                ++m_pI;
+                m_token = TK_STAR;
+                break;
+
+            case '?':
+                ++m_pI;
+                m_token = TK_LITERAL;
+                break;
+
+            case '=':
+                ++m_pI;
+                m_token = TK_COMPARISON;
+                break;
+
+            case '<':
+                ++m_pI;
+                if (n == '=')
+                {
+                    ++m_pI;
+
+                    if (m_pI < m_pEnd && *m_pI == '>')
+                    {
+                        ++m_pI;
+                    }
+                }
+                else if (n == '>')
+                {
+                    ++m_pI;
+                }
+                m_token = TK_COMPARISON;
+                break;
+
+            case '>':
+                ++m_pI;
+                if (n == '=')
+                {
+                    ++m_pI;
+                }
+                m_token = TK_COMPARISON;
+                break;
+
+            case '!':
+                if (n == '=')
+                {
+                    m_pI += 2;
+                    m_token = TK_COMPARISON;
+                }
+                break;
+
+            case '\'':
+                if (skip_quoted(c))
+                {
+                    m_token = TK_LITERAL;
+                }
+                break;
+
+            case '`':
+                if (skip_quoted(c) && (m_pI - m_pToken > 2))
+                {
+                    m_token = TK_QUOTED;
+                    // The name without the backticks.
+                    ++m_pToken;
+                    m_token_len = m_pI - m_pToken - 1;
+                    return;
+                }
+                break;
+
+            case '-':
+            case '+':
+                // A comment, an expression or a signed number.
+                if (is_digit(n) && skip_number())
+                {
+                    m_token = TK_LITERAL;
+                }
+                break;
+
+            default:
+                if (is_digit(c))
+                {
+                    // Identifiers may start with a digit.
+                    if (skip_number())
+                    {
+                        m_token = TK_LITERAL;
+                    }
+                }
+                else if (is_word_char(c))
+                {
+                    while (m_pI < m_pEnd && is_word_char(*m_pI))
+                    {
+                        ++m_pI;
+                    }
+
+                    m_token = TK_WORD;
+                    m_token_len = m_pI - m_pToken;
+
+                    if (is_word(SSP_WORD("NULL")) || is_word(SSP_WORD("TRUE")) || is_word(SSP_WORD("FALSE")))
+                    {
+                        m_token = TK_LITERAL;
+                    }
+                }
+                // Double quotes, comments, variables and operators are not handled.
+            }
+        }
+
+        m_token_len = m_pI - m_pToken;
+    }
+
+private:
+    SimpleStatementParser(const SimpleStatementParser&);
+    SimpleStatementParser& operator = (const SimpleStatementParser&);
+
+private:
+    const char*   m_pI;
+    const char*   m_pEnd;
+    token_t       m_token;
+    const char*   m_pToken;
+    size_t        m_token_len;
+    uint32_t      m_type_mask;
+    qc_query_op_t m_op;
+    const char*   m_pDatabase;
+    size_t        m_database_len;
+    const char*   m_pTable;
+    size_t        m_table_len;
+};
+
+}
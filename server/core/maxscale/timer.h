@@ -0,0 +1,75 @@
+#pragma once
+/*
+ * Copyright (c) 2016 MariaDB Corporation Ab
+ *
+ * Use of this software is governed by the Business Source License included
+ * in the LICENSE.TXT file and at www.mariadb.com/bsl11.
+ *
+ * Change Date: 2019-07-01
+ *
+ * On the date above, in accordance with the Business Source License, use
+ * of this software will be governed by version 2 or later of the General
+ * Public License.
+ */
+
+/**
+ * @file
+ *
+ * Internal code for the per-thread timer wheels.
+ */
+
+#include <maxscale/timer.h>
+#include <maxscale/dcb.h>
+
+MXS_BEGIN_DECLS
+
+/**
+ * @brief Allocate the timer wheels
+ *
+ * This function should only be called once by the MaxScale core.
+ *
+ * @param n_threads Number of polling threads
+ *
+ * @return True if the wheels were allocated
+ */
+bool timer_wheel_init(int n_threads);
+
+/**
+ * @brief Make the calling thread the owner of a timer wheel
+ *
+ * Called by a polling thread before it enters its event loop.
+ *
+ * @param thread_id The polling thread ID
+ */
+void timer_wheel_attach(int thread_id);
+
+/**
+ * @brief Fire all expired timers of the calling thread
+ *
+ * @param now Current monotonic time in milliseconds
+ *
+ * @return Number of timers that were fired
+ */
+int timer_wheel_process(uint64_t now);
+
+/**
+ * @brief Time until the next timer of the calling thread may expire
+ *
+ * The returned value is never larger than the time until the next timer
+ * expires, so it can be used as an upper bound for a blocking wait.
+ *
+ * @param max The maximum value to return
+ *
+ * @return Milliseconds until the next expiry or @c max if there is nothing
+ *         that would expire sooner
+ */
+int timer_wheel_next_timeout(int max);
+
+/**
+ * @brief Print timer wheel statistics
+ *
+ * @param dcb DCB to print to
+ */
+void dShowTimers(DCB *dcb);
+
+MXS_END_DECLS
@@ -25,7 +25,190 @@
  */
 
 #include <maxscale/pcre2.h>
+#include <string.h>
 #include <maxscale/alloc.h>
+#include <maxscale/log_manager.h>
+#include <maxscale/platform.h>
+#include <maxscale/spinlock.h>
+
+/**
+ * A compiled pattern in the pattern registry
+ */
+typedef struct mxs_pcre2_pattern
+{
+    char                     *pattern;  /**< The pattern text */
+    uint32_t                  options;  /**< Compilation options */
+    pcre2_code               *code;     /**< The compiled pattern */
+    int                       refcount; /**< Number of users of the pattern */
+    struct mxs_pcre2_pattern *next;     /**< Next pattern in the registry */
+} MXS_PCRE2_PATTERN;
+
+/** The patterns compiled with mxs_pcre2_compile() */
+static MXS_PCRE2_PATTERN *patterns = NULL;
+static SPINLOCK patterns_lock = SPINLOCK_INIT;
+
+/** The match data and the JIT stack of each thread */
+static thread_local pcre2_match_data    *thread_mdata = NULL;
+static thread_local uint32_t             thread_mdata_pairs = 0;
+static thread_local pcre2_match_context *thread_mcontext = NULL;
+static thread_local pcre2_jit_stack     *thread_jit_stack = NULL;
+
+pcre2_match_data* mxs_pcre2_thread_match_data(const pcre2_code *code)
+{
+    uint32_t captures = 0;
+    pcre2_pattern_info(code, PCRE2_INFO_CAPTURECOUNT, &captures);
+
+    if (thread_mdata_pairs < captures + 1)
+    {
+        pcre2_match_data_free(thread_mdata);
+        thread_mdata = pcre2_match_data_create(captures + 1, NULL);
+        thread_mdata_pairs = thread_mdata ? captures + 1 : 0;
+    }
+
+    return thread_mdata;
+}
+
+pcre2_match_context* mxs_pcre2_thread_match_context()
+{
+    if (thread_mcontext == NULL)
+    {
+        pcre2_match_context *mcontext = pcre2_match_context_create(NULL);
+        pcre2_jit_stack *stack = pcre2_jit_stack_create(MXS_PCRE2_JIT_STACK_MIN,
+                                                        MXS_PCRE2_JIT_STACK_MAX, NULL);
+
+        if (mcontext && stack)
+        {
+            pcre2_jit_stack_assign(mcontext, NULL, stack);
+            thread_mcontext = mcontext;
+            thread_jit_stack = stack;
+        }
+        else
+        {
+            pcre2_match_context_free(mcontext);
+            pcre2_jit_stack_free(stack);
+        }
+    }
+
+    return thread_mcontext;
+}
+
+pcre2_code* mxs_pcre2_compile(const char *pattern, uint32_t options)
+{
+    pcre2_code *code = NULL;
+
+    spinlock_acquire(&patterns_lock);
+
+    for (MXS_PCRE2_PATTERN *p = patterns; p; p = p->next)
+    {
+        if (p->options == options && strcmp(p->pattern, pattern) == 0)
+        {
+            p->refcount++;
+            code = p->code;
+            break;
+        }
+    }
+
+    if (code == NULL)
+    {
+        int err;
+        PCRE2_SIZE erroff;
+        MXS_PCRE2_PATTERN *p = MXS_MALLOC(sizeof(*p));
+        char *text = MXS_STRDUP(pattern);
+
+        if (p && text)
+        {
+            code = pcre2_compile((PCRE2_SPTR) pattern, PCRE2_ZERO_TERMINATED,
+                                 options, &err, &erroff, NULL);
+
+            if (code)
+            {
+                int rc = pcre2_jit_compile(code, PCRE2_JIT_COMPLETE);
+
+                if (rc < 0 && rc != PCRE2_ERROR_JIT_BADOPTION)
+                {
+                    PCRE2_UCHAR errbuf[512];
+                    pcre2_get_error_message(rc, errbuf, sizeof(errbuf));
+                    MXS_WARNING("JIT compilation of pattern '%s' failed, the pattern "
+                                "is interpreted: %s", pattern, errbuf);
+                }
+
+                p->pattern = text;
+                p->options = options;
+                p->code = code;
+                p->refcount = 1;
+                p->next = patterns;
+                patterns = p;
+            }
+            else
+            {
+                PCRE2_UCHAR errbuf[512];
+                pcre2_get_error_message(err, errbuf, sizeof(errbuf));
+                MXS_ERROR("Failed to compile pattern '%s' at offset %d: %s",
+                          pattern, (int)erroff, errbuf);
+            }
+        }
+
+        if (code == NULL)
+        {
+            MXS_FREE(p);
+            MXS_FREE(text);
+        }
+    }
+
+    spinlock_release(&patterns_lock);
+
+    return code;
+}
+
+void mxs_pcre2_release(pcre2_code *code)
+{
+    if (code)
+    {
+        spinlock_acquire(&patterns_lock);
+
+        for (MXS_PCRE2_PATTERN **pp = &patterns; *pp; pp = &(*pp)->next)
+        {
+            MXS_PCRE2_PATTERN *p = *pp;
+
+            if (p->code == code)
+            {
+                if (--p->refcount == 0)
+                {
+                    *pp = p->next;
+                    pcre2_code_free(p->code);
+                    MXS_FREE(p->pattern);
+                    MXS_FREE(p);
+                }
+                break;
+            }
+        }
+
+        spinlock_release(&patterns_lock);
+    }
+}
+
+mxs_pcre2_result_t mxs_pcre2_match(const pcre2_code *code, const char *subject, size_t length)
+{
+    mxs_pcre2_result_t rval = MXS_PCRE2_ERROR;
+    pcre2_match_data *mdata = mxs_pcre2_thread_match_data(code);
+
+    if (mdata)
+    {
+        int rc = pcre2_match(code, (PCRE2_SPTR) subject, length, 0, 0, mdata,
+                             mxs_pcre2_thread_match_context());
+
+        if (rc >= 0)
+        {
+            rval = MXS_PCRE2_MATCH;
+        }
+        else if (rc == PCRE2_ERROR_NOMATCH)
+        {
+            rval = MXS_PCRE2_NOMATCH;
+        }
+    }
+
+    return rval;
+}
 
 /**
  * Utility wrapper for PCRE2 library function call pcre2_substitute.
@@ -48,13 +231,14 @@ mxs_pcre2_result_t mxs_pcre2_substitute(pcre2_code *re, const char *subject, con
 {
     int rc;
     mxs_pcre2_result_t rval = MXS_PCRE2_ERROR;
-    pcre2_match_data *mdata = pcre2_match_data_create_from_pattern(re, NULL);
+    pcre2_match_data *mdata = mxs_pcre2_thread_match_data(re);
 
     if (mdata)
     {
         size_t size_tmp = *size;
         while ((rc = pcre2_substitute(re, (PCRE2_SPTR) subject, PCRE2_ZERO_TERMINATED, 0,
-                                      PCRE2_SUBSTITUTE_GLOBAL, mdata, NULL,
+                                      PCRE2_SUBSTITUTE_GLOBAL, mdata,
+                                      mxs_pcre2_thread_match_context(),
                                       (PCRE2_SPTR) replace, PCRE2_ZERO_TERMINATED,
                                       (PCRE2_UCHAR*) *dest, &size_tmp)) == PCRE2_ERROR_NOMEMORY)
         {
@@ -76,7 +260,6 @@ mxs_pcre2_result_t mxs_pcre2_substitute(pcre2_code *re, const char *subject, con
         {
             rval = MXS_PCRE2_NOMATCH;
         }
-        pcre2_match_data_free(mdata);
     }
 
     return rval;
@@ -106,7 +289,7 @@ mxs_pcre2_result_t mxs_pcre2_simple_match(const char* pattern, const char* subje
                                    options, &err, &erroff, NULL);
     if (re)
     {
-        pcre2_match_data *mdata = pcre2_match_data_create_from_pattern(re, NULL);
+        pcre2_match_data *mdata = mxs_pcre2_thread_match_data(re);
         if (mdata)
         {
             int rc = pcre2_match(re, (PCRE2_SPTR) subject, PCRE2_ZERO_TERMINATED,
@@ -121,7 +304,6 @@ mxs_pcre2_result_t mxs_pcre2_simple_match(const char* pattern, const char* subje
                  * pcre2_match will never return 0 */
                 rval = MXS_PCRE2_MATCH;
             }
-            pcre2_match_data_free(mdata);
         }
         else
         {
@@ -0,0 +1,57 @@
+/*
+ * Copyright (c) 2016 MariaDB Corporation Ab
+ *
+ * Use of this software is governed by the Business Source License included
+ * in the LICENSE.TXT file and at www.mariadb.com/bsl11.
+ *
+ * Change Date: 2019-07-01
+ *
+ * On the date above, in accordance with the Business Source License, use
+ * of this software will be governed by version 2 or later of the General
+ * Public License.
+ */
+
+/**
+ * @file metrics.c  Export of the MaxScale metrics
+ *
+ * The metrics are computed when they are requested: the counters are read
+ * directly from the objects and the per-thread histograms are combined.
+ */
+
+#include "maxscale/metrics.h"
+
+char* mxs_metrics_escape_label(char *dest, const char *value)
+{
+    char *ptr = dest;
+
+    for (; *value; value++)
+    {
+        switch (*value)
+        {
+        case '\\':
+        case '"':
+            *ptr++ = '\\';
+            *ptr++ = *value;
+            break;
+
+        case '\n':
+            *ptr++ = '\\';
+            *ptr++ = 'n';
+            break;
+
+        default:
+            *ptr++ = *value;
+        }
+    }
+
+    *ptr = '\0';
+
+    return dest;
+}
+
+void mxs_metrics_print_prometheus(DCB *dcb)
+{
+    service_print_metrics(dcb);
+    server_print_metrics(dcb);
+    poll_print_metrics(dcb);
+}
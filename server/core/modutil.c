@@ -39,13 +39,17 @@ static bool pattern_init = false;
 static pcre2_code *re_percent = NULL;
 static pcre2_code *re_single = NULL;
 static pcre2_code *re_escape = NULL;
-static const PCRE2_SPTR pattern_percent = (PCRE2_SPTR) "%";
-static const PCRE2_SPTR pattern_single = (PCRE2_SPTR) "([^\\\\]|^)_";
-static const PCRE2_SPTR pattern_escape = (PCRE2_SPTR) "[.]";
+static const char* pattern_percent = "%";
+static const char* pattern_single = "([^\\\\]|^)_";
+static const char* pattern_escape = "[.]";
 static const char* sub_percent = ".*";
 static const char* sub_single = "$1.";
 static const char* sub_escape = "\\.";
 
+/** The intermediate results of modutil_rewrite_SQL() */
+static thread_local char *rewrite_buf[2] = {NULL, NULL};
+static thread_local size_t rewrite_size[2] = {0, 0};
+
 static void modutil_reply_routing_error(
     DCB*     backend_dcb,
     int      error,
@@ -260,6 +264,132 @@ modutil_replace_SQL(GWBUF *orig, char *sql)
     return orig;
 }
 
+/**
+ * Apply one rewrite rule to a statement
+ *
+ * The result is stored in the rewrite buffer @c out of the calling thread.
+ *
+ * @param rule   The rule to apply
+ * @param sql    The statement, does not need to be null terminated
+ * @param len    Length of @c sql
+ * @param out    Index of the rewrite buffer to use
+ * @param outlen Length of the result
+ *
+ * @return Number of replacements, 0 if the rule did not match and -1 on error
+ */
+static int rewrite_apply(const MXS_REWRITE_RULE *rule, const char *sql, size_t len,
+                         int out, size_t *outlen)
+{
+    if (mxs_pcre2_match(rule->re, sql, len) != MXS_PCRE2_MATCH)
+    {
+        return 0;
+    }
+
+    pcre2_match_data *mdata = mxs_pcre2_thread_match_data(rule->re);
+    pcre2_match_context *mcontext = mxs_pcre2_thread_match_context();
+    size_t size = len + strlen(rule->replace) + 1;
+    int rc = -1;
+
+    while (mdata)
+    {
+        if (rewrite_size[out] < size)
+        {
+            char *tmp = MXS_REALLOC(rewrite_buf[out], size);
+
+            if (tmp == NULL)
+            {
+                break;
+            }
+
+            rewrite_buf[out] = tmp;
+            rewrite_size[out] = size;
+        }
+
+        PCRE2_SIZE length = rewrite_size[out];
+        rc = pcre2_substitute(rule->re, (PCRE2_SPTR)sql, len, 0, PCRE2_SUBSTITUTE_GLOBAL,
+                              mdata, mcontext, (PCRE2_SPTR)rule->replace, PCRE2_ZERO_TERMINATED,
+                              (PCRE2_UCHAR*)rewrite_buf[out], &length);
+
+        if (rc == PCRE2_ERROR_NOMEMORY)
+        {
+            size = rewrite_size[out] * 2;
+        }
+        else
+        {
+            *outlen = length;
+            break;
+        }
+    }
+
+    return rc < 0 ? -1 : rc;
+}
+
+GWBUF* modutil_rewrite_SQL(GWBUF *buffer, const MXS_REWRITE_RULE *rules, int n_rules, bool *matched)
+{
+    GWBUF *rval = NULL;
+    char *sql;
+    int len;
+
+    if (matched)
+    {
+        memset(matched, 0, n_rules * sizeof(*matched));
+    }
+
+    /** Statements that span multiple packets are not rewritten */
+    if (modutil_extract_SQL(buffer, &sql, &len) &&
+        len + 1 < GW_MYSQL_MAX_PACKET_LEN &&
+        GWBUF_LENGTH(buffer) >= (size_t)len + MYSQL_HEADER_LEN + 1)
+    {
+        const char *subject = sql;
+        size_t length = len;
+        int out = 0;
+        bool rewritten = false;
+
+        for (int i = 0; i < n_rules; i++)
+        {
+            size_t outlen = 0;
+            int rc = rewrite_apply(&rules[i], subject, length, out, &outlen);
+
+            if (rc < 0)
+            {
+                MXS_ERROR("Failed to rewrite statement, the statement is left unchanged.");
+                return NULL;
+            }
+            else if (rc > 0)
+            {
+                subject = rewrite_buf[out];
+                length = outlen;
+                out = 1 - out;
+                rewritten = true;
+
+                if (matched)
+                {
+                    matched[i] = true;
+                }
+            }
+        }
+
+        if (rewritten && length + 1 < GW_MYSQL_MAX_PACKET_LEN &&
+            (rval = gwbuf_alloc(MYSQL_HEADER_LEN + 1 + length)))
+        {
+            uint8_t *ptr = GWBUF_DATA(rval);
+            gw_mysql_set_byte3(ptr, length + 1);
+            ptr[3] = GWBUF_DATA(buffer)[3];
+            ptr[4] = MYSQL_COM_QUERY;
+            memcpy(ptr + MYSQL_HEADER_LEN + 1, subject, length);
+
+            rval->gwbuf_type = buffer->gwbuf_type;
+            rval->hint = buffer->hint;
+            rval->properties = buffer->properties;
+            rval->server = buffer->server;
+            buffer->hint = NULL;
+            buffer->properties = NULL;
+            buffer->server = NULL;
+        }
+    }
+
+    return rval;
+}
 
 /**
  * Extract the SQL from a COM_QUERY packet and return in a NULL terminated buffer.
@@ -1058,31 +1188,19 @@ void prepare_pcre2_patterns()
     spinlock_acquire(&re_lock);
     if (!pattern_init)
     {
-        int err;
-        size_t erroff;
-        PCRE2_UCHAR errbuf[MXS_STRERROR_BUFLEN];
-
-        if ((re_percent = pcre2_compile(pattern_percent, PCRE2_ZERO_TERMINATED,
-                                        0, &err, &erroff, NULL)) &&
-            (re_single = pcre2_compile(pattern_single, PCRE2_ZERO_TERMINATED,
-                                       0, &err, &erroff, NULL)) &&
-            (re_escape = pcre2_compile(pattern_escape, PCRE2_ZERO_TERMINATED,
-                                       0, &err, &erroff, NULL)))
+        if ((re_percent = mxs_pcre2_compile(pattern_percent, 0)) &&
+            (re_single = mxs_pcre2_compile(pattern_single, 0)) &&
+            (re_escape = mxs_pcre2_compile(pattern_escape, 0)))
         {
             assert(!pattern_init);
             pattern_init = true;
         }
-        else
-        {
-            pcre2_get_error_message(err, errbuf, sizeof(errbuf));
-            MXS_ERROR("Failed to compile PCRE2 pattern: %s", errbuf);
-        }
 
         if (!pattern_init)
         {
-            pcre2_code_free(re_percent);
-            pcre2_code_free(re_single);
-            pcre2_code_free(re_escape);
+            mxs_pcre2_release(re_percent);
+            mxs_pcre2_release(re_single);
+            mxs_pcre2_release(re_escape);
             re_percent = NULL;
             re_single = NULL;
             re_escape = NULL;
@@ -1114,11 +1232,7 @@ mxs_pcre2_result_t modutil_mysql_wildcard_match(const char* pattern, const char*
 
     if (matchstr && tempstr)
     {
-        pcre2_match_data *mdata_percent = pcre2_match_data_create_from_pattern(re_percent, NULL);
-        pcre2_match_data *mdata_single = pcre2_match_data_create_from_pattern(re_single, NULL);
-        pcre2_match_data *mdata_escape = pcre2_match_data_create_from_pattern(re_escape, NULL);
-
-        if (mdata_percent && mdata_single && mdata_escape)
+        if (pattern_init)
         {
             if (mxs_pcre2_substitute(re_escape, pattern, sub_escape,
                                      &matchstr, &matchsize) == MXS_PCRE2_ERROR ||
@@ -1155,10 +1269,6 @@ mxs_pcre2_result_t modutil_mysql_wildcard_match(const char* pattern, const char*
         {
             MXS_ERROR("Fatal error when matching wildcard patterns.");
         }
-
-        pcre2_match_data_free(mdata_percent);
-        pcre2_match_data_free(mdata_single);
-        pcre2_match_data_free(mdata_escape);
     }
 
     MXS_FREE(matchstr);
@@ -1403,3 +1513,284 @@ const char* STRPACKETTYPE(int p)
 
     return unknow_type;
 }
+
+/** Reply tracker states */
+enum
+{
+    REPLY_TRACKER_START,    /**< Expecting the first packet of a result */
+    REPLY_TRACKER_COLDEF,   /**< Reading column definitions */
+    REPLY_TRACKER_ROWS,     /**< Reading rows */
+    REPLY_TRACKER_PREPARE,  /**< Reading the definitions of a prepared statement */
+    REPLY_TRACKER_DONE      /**< The reply is complete */
+};
+
+bool modutil_command_has_reply(uint8_t command)
+{
+    return command != MYSQL_COM_QUIT &&
+           command != MYSQL_COM_STMT_CLOSE &&
+           command != MYSQL_COM_STMT_SEND_LONG_DATA;
+}
+
+void modutil_reply_tracker_init(MXS_REPLY_TRACKER *tracker, uint8_t command)
+{
+    memset(tracker, 0, sizeof(*tracker));
+    tracker->command = command;
+
+    if (!modutil_command_has_reply(command))
+    {
+        tracker->state = REPLY_TRACKER_DONE;
+    }
+    else if (command == MYSQL_COM_FIELD_LIST)
+    {
+        /** The reply is a list of column definitions */
+        tracker->state = REPLY_TRACKER_COLDEF;
+    }
+    else if (command == MYSQL_COM_STMT_FETCH)
+    {
+        /** The reply is binary protocol rows that start with a zero byte
+         * and would look like an OK packet */
+        tracker->state = REPLY_TRACKER_ROWS;
+    }
+    else
+    {
+        tracker->state = REPLY_TRACKER_START;
+    }
+}
+
+/** Read a length-encoded integer, returns the number of bytes it used */
+static size_t tracker_read_lenenc(const uint8_t *ptr, const uint8_t *end, uint64_t *value)
+{
+    size_t len = *ptr < 0xfb ? 1 : *ptr == 0xfc ? 3 : *ptr == 0xfd ? 4 : 9;
+    *value = 0;
+
+    if (ptr + len > end)
+    {
+        return end - ptr;
+    }
+
+    if (len == 1)
+    {
+        *value = *ptr;
+    }
+    else
+    {
+        for (size_t i = 1; i < len; i++)
+        {
+            *value |= (uint64_t)ptr[i] << (8 * (i - 1));
+        }
+    }
+
+    return len;
+}
+
+/**
+ * Process the start of one reply packet
+ *
+ * @param tracker Reply tracker
+ * @param length  Payload length of the packet
+ */
+static void tracker_process_packet(MXS_REPLY_TRACKER *tracker, size_t length)
+{
+    const uint8_t *data = tracker->packet + MYSQL_HEADER_LEN;
+    const uint8_t *end = tracker->packet + tracker->packet_have;
+    bool continuation = tracker->large_packet;
+    tracker->large_packet = length == GW_MYSQL_MAX_PACKET_LEN;
+
+    if (continuation)
+    {
+        /** The rest of a packet that did not fit into one */
+        return;
+    }
+
+    uint8_t cmd = length > 0 ? data[0] : 0;
+    bool is_eof = cmd == MYSQL_REPLY_EOF && length < 9;
+    uint16_t status = 0;
+
+    switch (tracker->state)
+    {
+    case REPLY_TRACKER_START:
+        if (cmd == MYSQL_REPLY_ERR)
+        {
+            tracker->error = true;
+            tracker->state = REPLY_TRACKER_DONE;
+        }
+        else if (tracker->command == MYSQL_COM_STATISTICS)
+        {
+            /** The reply is a single string without a header byte */
+            tracker->state = REPLY_TRACKER_DONE;
+        }
+        else if (cmd == MYSQL_REPLY_OK && tracker->command == MYSQL_COM_STMT_PREPARE)
+        {
+            /** Statement ID, number of columns and number of parameters */
+            if (end - data >= 9)
+            {
+                int columns = data[5] | (data[6] << 8);
+                int params = data[7] | (data[8] << 8);
+                tracker->n_eof = (columns > 0) + (params > 0);
+            }
+
+            tracker->state = tracker->n_eof ? REPLY_TRACKER_PREPARE : REPLY_TRACKER_DONE;
+        }
+        else if (cmd == MYSQL_REPLY_OK)
+        {
+            uint64_t dummy;
+            const uint8_t *ptr = data + 1;
+            ptr += tracker_read_lenenc(ptr, end, &dummy);
+            ptr += tracker_read_lenenc(ptr, end, &dummy);
+
+            if (ptr + 2 <= end)
+            {
+                status = ptr[0] | (ptr[1] << 8);
+            }
+
+            if ((status & SERVER_MORE_RESULTS_EXIST) == 0)
+            {
+                tracker->state = REPLY_TRACKER_DONE;
+            }
+        }
+        else if (cmd == MYSQL_REPLY_EOF && tracker->command == MYSQL_COM_CHANGE_USER)
+        {
+            /** Authentication switch request, nothing more will arrive
+             * before the client responds to it */
+            tracker->state = REPLY_TRACKER_DONE;
+        }
+        else if (cmd == MYSQL_REPLY_LOCAL_INFILE)
+        {
+            /** The final OK to LOAD DATA LOCAL INFILE arrives after the
+             * client has sent the file */
+            tracker->local_infile = true;
+        }
+        else
+        {
+            tracker->state = REPLY_TRACKER_COLDEF;
+        }
+        break;
+
+    case REPLY_TRACKER_COLDEF:
+        if (is_eof)
+        {
+            if (end - data >= 5)
+            {
+                status = data[3] | (data[4] << 8);
+            }
+
+            /** A COM_STMT_EXECUTE that opens a cursor returns no rows, they
+             * are read with COM_STMT_FETCH */
+            tracker->state = tracker->command == MYSQL_COM_FIELD_LIST ||
+                             (status & SERVER_STATUS_CURSOR_EXISTS) ?
+                             REPLY_TRACKER_DONE : REPLY_TRACKER_ROWS;
+        }
+        else if (cmd == MYSQL_REPLY_ERR)
+        {
+            tracker->error = true;
+            tracker->state = REPLY_TRACKER_DONE;
+        }
+        break;
+
+    case REPLY_TRACKER_ROWS:
+        if (is_eof)
+        {
+            if (end - data >= 5)
+            {
+                status = data[3] | (data[4] << 8);
+            }
+
+            tracker->state = status & SERVER_MORE_RESULTS_EXIST ?
+                             REPLY_TRACKER_START : REPLY_TRACKER_DONE;
+        }
+        else if (cmd == MYSQL_REPLY_ERR)
+        {
+            tracker->error = true;
+            tracker->state = REPLY_TRACKER_DONE;
+        }
+        else
+        {
+            tracker->rows++;
+        }
+        break;
+
+    case REPLY_TRACKER_PREPARE:
+        if (is_eof && --tracker->n_eof == 0)
+        {
+            tracker->state = REPLY_TRACKER_DONE;
+        }
+        break;
+
+    default:
+        break;
+    }
+}
+
+bool modutil_reply_tracker_process(MXS_REPLY_TRACKER *tracker, GWBUF *reply)
+{
+    size_t offset = 0;
+    return modutil_reply_tracker_consume(tracker, reply, &offset);
+}
+
+bool modutil_reply_tracker_consume(MXS_REPLY_TRACKER *tracker, GWBUF *reply, size_t *p_offset)
+{
+    size_t total = gwbuf_length(reply);
+    size_t offset = *p_offset;
+
+    while (offset < total && tracker->state != REPLY_TRACKER_DONE)
+    {
+        if (tracker->packet_skip)
+        {
+            size_t n = MXS_MIN(tracker->packet_skip, total - offset);
+            tracker->packet_skip -= n;
+            offset += n;
+            continue;
+        }
+
+        if (tracker->packet_have < MYSQL_HEADER_LEN)
+        {
+            size_t n = gwbuf_copy_data(reply, offset, MYSQL_HEADER_LEN - tracker->packet_have,
+                                       tracker->packet + tracker->packet_have);
+            tracker->packet_have += n;
+            offset += n;
+
+            if (tracker->packet_have < MYSQL_HEADER_LEN)
+            {
+                break;
+            }
+        }
+
+        size_t length = gw_mysql_get_byte3(tracker->packet);
+        size_t wanted = MYSQL_HEADER_LEN + MXS_MIN(length, MXS_REPLY_TRACKER_PREFIX - MYSQL_HEADER_LEN);
+
+        if (tracker->packet_have < wanted)
+        {
+            size_t n = gwbuf_copy_data(reply, offset, wanted - tracker->packet_have,
+                                       tracker->packet + tracker->packet_have);
+            tracker->packet_have += n;
+            offset += n;
+
+            if (tracker->packet_have < wanted)
+            {
+                break;
+            }
+        }
+
+        tracker->packet_skip = MYSQL_HEADER_LEN + length - tracker->packet_have;
+        tracker_process_packet(tracker, length);
+        tracker->packet_have = 0;
+    }
+
+    if (tracker->state == REPLY_TRACKER_DONE)
+    {
+        /** The rest of the last packet belongs to this reply */
+        size_t n = MXS_MIN(tracker->packet_skip, total - offset);
+        tracker->packet_skip -= n;
+        offset += n;
+    }
+
+    *p_offset = offset;
+    return tracker->state == REPLY_TRACKER_DONE;
+}
+
+void modutil_reply_tracker_next(MXS_REPLY_TRACKER *tracker, uint8_t command)
+{
+    size_t skip = tracker->packet_skip;
+    modutil_reply_tracker_init(tracker, command);
+    tracker->packet_skip = skip;
+}
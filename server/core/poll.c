@@ -39,7 +39,9 @@
 #include <maxscale/thread.h>
 #include <maxscale/utils.h>
 
+#include "maxscale/metrics.h"
 #include "maxscale/poll.h"
+#include "maxscale/timer.h"
 
 #define         PROFILE_POLL    0
 
@@ -51,6 +53,11 @@ int number_poll_spins;
 int max_poll_sleep;
 static thread_local DCB* current_dcb;
 
+/** How often the persistent pools of a thread are checked for expired connections */
+#define POLL_POOL_CLEAN_INTERVAL 1000
+
+static thread_local MXS_TIMER pool_timer; /*< Closes expired pooled connections */
+
 /**
  * @file poll.c  - Abstraction of the epoll functionality
  *
@@ -96,6 +103,7 @@ typedef struct fake_event
 } fake_event_t;
 
 thread_local int current_thread_id; /**< This thread's ID */
+static thread_local bool is_poll_thread = false; /**< Whether this is a polling thread */
 static int *epoll_fd;    /*< The epoll file descriptor */
 static int next_epoll_fd = 0; /*< Which thread handles the next DCB */
 static fake_event_t **fake_events; /*< Thread-specific fake event queue */
@@ -113,9 +121,11 @@ static simple_mutex_t epoll_wait_mutex; /*< serializes calls to epoll_wait */
 static int n_waiting = 0;    /*< No. of threads in epoll_wait */
 
 static int process_pollq(int thread_id, struct epoll_event *event);
+static void process_batch(int thread_id, struct epoll_event *events, int nfds);
 static void poll_add_event_to_dcb(DCB* dcb, GWBUF* buf, uint32_t ev);
 static bool poll_dcb_session_check(DCB *dcb, const char *);
 static void poll_check_message(void);
+static void poll_clean_persistent(MXS_TIMER *timer, void *data);
 
 DCB *eventq = NULL;
 SPINLOCK pollqlock = SPINLOCK_INIT;
@@ -159,6 +169,8 @@ typedef struct
     DCB *cur_dcb;       /*< Current DCB being processed */
     uint32_t event;     /*< Current event being processed */
     uint64_t cycle_start; /*< The time when the poll loop was started */
+    int64_t n_accept_wakeups; /*< No. of accept events on listeners */
+    int64_t n_accepted; /*< No. of client connections accepted */
 } THREAD_DATA;
 
 static THREAD_DATA *thread_data = NULL;    /*< Status of each thread */
@@ -204,8 +216,12 @@ static struct
     uint32_t exectimes[N_QUEUE_TIMES + 1];
     ts_stats_t *maxqtime;
     ts_stats_t *maxexectime;
+    MXS_HISTOGRAM *queue_delay; /*< Time from epoll_wait returning to processing the event */
 } queueStats;
 
+/** When the current batch of events was returned by epoll_wait, in microseconds */
+static thread_local uint64_t cycle_start_us;
+
 /**
  * How frequently to call the poll_loadav function used to monitor the load
  * average of the poll subsystem.
@@ -266,6 +282,11 @@ poll_init()
         spinlock_init(&fake_event_lock[i]);
     }
 
+    if (!timer_wheel_init(n_threads))
+    {
+        exit(-1);
+    }
+
     memset(&pollStats, 0, sizeof(pollStats));
     memset(&queueStats, 0, sizeof(queueStats));
     thread_data = (THREAD_DATA *)MXS_MALLOC(n_threads * sizeof(THREAD_DATA));
@@ -274,6 +295,8 @@ poll_init()
         for (int i = 0; i < n_threads; i++)
         {
             thread_data[i].state = THREAD_STOPPED;
+            thread_data[i].n_accept_wakeups = 0;
+            thread_data[i].n_accepted = 0;
         }
     }
 
@@ -290,7 +313,8 @@ poll_init()
         (pollStats.evq_max = ts_stats_alloc()) == NULL ||
         (queueStats.maxqtime = ts_stats_alloc()) == NULL ||
         (queueStats.maxexectime = ts_stats_alloc()) == NULL ||
-        (pollStats.blockingpolls = ts_stats_alloc()) == NULL)
+        (pollStats.blockingpolls = ts_stats_alloc()) == NULL ||
+        (queueStats.queue_delay = mxs_histogram_alloc()) == NULL)
     {
         MXS_OOM_MESSAGE("FATAL: Could not allocate statistics data.");
         exit(-1);
@@ -395,18 +419,22 @@ int poll_add_dcb(DCB *dcb)
 
     if (dcb->dcb_role == DCB_ROLE_SERVICE_LISTENER)
     {
-        /** Listeners are added to all epoll instances */
+        /** Listeners are added to all epoll instances. A sharded listener
+         * has a separate socket for each of them. */
         int nthr = config_threadcount();
 
         for (int i = 0; i < nthr; i++)
         {
-            if ((rc = epoll_ctl(epoll_fd[i], EPOLL_CTL_ADD, dcb->fd, &ev)))
+            int fd = dcb->listener_fds ? dcb->listener_fds[i] : dcb->fd;
+
+            if ((rc = epoll_ctl(epoll_fd[i], EPOLL_CTL_ADD, fd, &ev)))
             {
                 error_num = errno;
                 /** Remove the listener from the previous epoll instances */
                 for (int j = 0; j < i; j++)
                 {
-                    epoll_ctl(epoll_fd[j], EPOLL_CTL_DEL, dcb->fd, &ev);
+                    fd = dcb->listener_fds ? dcb->listener_fds[j] : dcb->fd;
+                    epoll_ctl(epoll_fd[j], EPOLL_CTL_DEL, fd, &ev);
                 }
                 break;
             }
@@ -485,7 +513,8 @@ int poll_remove_dcb(DCB *dcb)
 
             for (int i = 0; i < nthr; i++)
             {
-                int tmp_rc = epoll_ctl(epoll_fd[i], EPOLL_CTL_DEL, dcb->fd, &ev);
+                int fd = dcb->listener_fds ? dcb->listener_fds[i] : dcb->fd;
+                int tmp_rc = epoll_ctl(epoll_fd[i], EPOLL_CTL_DEL, fd, &ev);
                 if (tmp_rc && rc == 0)
                 {
                     /** Even if one of the instances failed to remove it, try
@@ -655,6 +684,7 @@ poll_waitevents(void *arg)
     struct epoll_event events[MAX_EVENTS];
     int i, nfds, timeout_bias = 1;
     current_thread_id = (intptr_t)arg;
+    is_poll_thread = true;
     int poll_spins = 0;
 
     int thread_id = current_thread_id;
@@ -664,6 +694,11 @@ poll_waitevents(void *arg)
         thread_data[thread_id].state = THREAD_IDLE;
     }
 
+    timer_wheel_attach(thread_id);
+
+    mxs_timer_init(&pool_timer, poll_clean_persistent, NULL);
+    mxs_timer_start(&pool_timer, POLL_POOL_CLEAN_INTERVAL, POLL_POOL_CLEAN_INTERVAL);
+
     while (1)
     {
         atomic_add(&n_waiting, 1);
@@ -707,10 +742,14 @@ poll_waitevents(void *arg)
                 timeout_bias++;
             }
             ts_stats_increment(pollStats.blockingpolls, thread_id);
+
+            /** Don't sleep past the next timer expiry */
+            int timeout = timer_wheel_next_timeout((max_poll_sleep * timeout_bias) / 10);
+
             nfds = epoll_wait(epoll_fd[thread_id],
                               events,
                               MAX_EVENTS,
-                              (max_poll_sleep * timeout_bias) / 10);
+                              timeout);
             if (nfds == 0)
             {
                 poll_spins = 0;
@@ -771,12 +810,11 @@ poll_waitevents(void *arg)
         }
 
         thread_data[thread_id].cycle_start = hkheartbeat;
+        cycle_start_us = mxs_histogram_now();
 
         /* Process of the queue of waiting requests */
-        for (int i = 0; i < nfds; i++)
-        {
-            process_pollq(thread_id, &events[i]);
-        }
+        dcb_start_batch();
+        process_batch(thread_id, events, nfds);
 
         fake_event_t *event = NULL;
 
@@ -803,7 +841,11 @@ poll_waitevents(void *arg)
             MXS_FREE(tmp);
         }
 
-        dcb_process_idle_sessions(thread_id);
+        /** Send the replies written during the batch */
+        dcb_end_batch();
+
+        /** Fire the timers of this thread, e.g. session timeouts */
+        timer_wheel_process(mxs_timer_now());
 
         if (thread_data)
         {
@@ -867,6 +909,76 @@ poll_set_maxwait(unsigned int maxwait)
     max_poll_sleep = maxwait;
 }
 
+/** The number of protocols whose events are grouped separately in a batch */
+#define POLL_BATCH_GROUPS 8
+
+/**
+ * Process the events returned by one epoll_wait call
+ *
+ * The events are processed grouped by the protocol of the DCB so that the
+ * same protocol code handles the events back to back. The order of the
+ * events of one protocol is kept. The groups are linked in one pass over
+ * the events.
+ *
+ * @param thread_id The thread ID of the calling thread
+ * @param events    The events
+ * @param nfds      Number of events, at most MAX_EVENTS
+ */
+static void
+process_batch(int thread_id, struct epoll_event *events, int nfds)
+{
+    int32_t (*handlers[POLL_BATCH_GROUPS])(struct dcb *);
+    int first[POLL_BATCH_GROUPS];
+    int last[POLL_BATCH_GROUPS];
+    int next[MAX_EVENTS];
+    int n_groups = 0;
+
+    ss_dassert(nfds <= MAX_EVENTS);
+
+    for (int i = 0; i < nfds; i++)
+    {
+        int32_t (*handler)(struct dcb *) = ((DCB*)events[i].data.ptr)->func.read;
+        int group = 0;
+
+        while (group < n_groups && handlers[group] != handler)
+        {
+            group++;
+        }
+
+        next[i] = -1;
+
+        if (group == n_groups && n_groups < POLL_BATCH_GROUPS)
+        {
+            handlers[n_groups++] = handler;
+            first[group] = i;
+        }
+        else
+        {
+            /** The protocols that don't fit in the table share the last group */
+            group = MXS_MIN(group, POLL_BATCH_GROUPS - 1);
+            next[last[group]] = i;
+        }
+
+        last[group] = i;
+    }
+
+    for (int group = 0; group < n_groups; group++)
+    {
+        for (int i = first[group]; i != -1; i = next[i])
+        {
+            process_pollq(thread_id, &events[i]);
+        }
+    }
+}
+
+void poll_count_accepted()
+{
+    if (is_poll_thread && thread_data)
+    {
+        thread_data[current_thread_id].n_accepted++;
+    }
+}
+
 /**
  * Process of the queue of DCB's that have outstanding events
  *
@@ -911,6 +1023,7 @@ process_pollq(int thread_id, struct epoll_event *event)
     }
 
     ts_stats_set_max(queueStats.maxqtime, qtime, thread_id);
+    mxs_histogram_record(queueStats.queue_delay, mxs_histogram_now() - cycle_start_us, thread_id);
 
     CHK_DCB(dcb);
     if (thread_data)
@@ -927,6 +1040,12 @@ process_pollq(int thread_id, struct epoll_event *event)
         return 0;
     }
 
+    if (dcb->dcb_role == DCB_ROLE_CLIENT_HANDLER && !mxs_timer_is_active(&dcb->idle_timer))
+    {
+        /** The idle timer must be started by the thread that owns the DCB */
+        dcb_start_idle_timer(dcb);
+    }
+
     MXS_DEBUG("%lu [poll_waitevents] event %d dcb %p "
               "role %s",
               pthread_self(),
@@ -971,6 +1090,11 @@ process_pollq(int thread_id, struct epoll_event *event)
                       dcb->fd);
             ts_stats_increment(pollStats.n_accept, thread_id);
 
+            if (thread_data)
+            {
+                thread_data[thread_id].n_accept_wakeups++;
+            }
+
             if (poll_dcb_session_check(dcb, "accept"))
             {
                 dcb->func.accept(dcb);
@@ -985,7 +1109,11 @@ process_pollq(int thread_id, struct epoll_event *event)
                       dcb->fd);
             ts_stats_increment(pollStats.n_read, thread_id);
 
-            if (poll_dcb_session_check(dcb, "read"))
+            if ((dcb->flags & DCBF_READ_PAUSED) && dcb->dcb_fakequeue == NULL)
+            {
+                /** The data is read when reading is resumed */
+            }
+            else if (poll_dcb_session_check(dcb, "read"))
             {
                 int return_code = 1;
                 /** SSL authentication is still going on, we need to call dcb_accept_SSL
@@ -1143,6 +1271,38 @@ spin_reporter(void *dcb, char *desc, int value)
     dcb_printf((DCB *)dcb, "\t%-40s  %d\n", desc, value);
 }
 
+void poll_print_metrics(DCB *dcb)
+{
+    static const struct
+    {
+        const char *name;
+        const char *help;
+        ts_stats_t **stats;
+    } counters[] =
+    {
+        {"maxscale_poll_read_events_total", "Number of read events.", &pollStats.n_read},
+        {"maxscale_poll_write_events_total", "Number of write events.", &pollStats.n_write},
+        {"maxscale_poll_error_events_total", "Number of error events.", &pollStats.n_error},
+        {"maxscale_poll_hangup_events_total", "Number of hangup events.", &pollStats.n_hup},
+        {"maxscale_poll_accept_events_total", "Number of accept events.", &pollStats.n_accept},
+        {NULL}
+    };
+
+    for (int i = 0; counters[i].name; i++)
+    {
+        dcb_printf(dcb, "# HELP %s %s\n", counters[i].name, counters[i].help);
+        dcb_printf(dcb, "# TYPE %s counter\n", counters[i].name);
+        dcb_printf(dcb, "%s %" PRId64 "\n", counters[i].name,
+                   ts_stats_get(*counters[i].stats, TS_STATS_SUM));
+    }
+
+    dcb_printf(dcb, "# HELP maxscale_poll_queue_delay_seconds Time from epoll_wait "
+               "returning an event to the event being processed.\n");
+    dcb_printf(dcb, "# TYPE maxscale_poll_queue_delay_seconds histogram\n");
+    mxs_histogram_print_prometheus(dcb, queueStats.queue_delay,
+                                   "maxscale_poll_queue_delay_seconds", "");
+}
+
 /**
  * Debug routine to print the polling statistics
  *
@@ -1377,6 +1537,17 @@ dShowThreads(DCB *dcb)
             }
         }
     }
+
+    dcb_printf(dcb, "\n ID | Accepts    | Accept wakeups | Wakeups per accept\n");
+    dcb_printf(dcb, "----+------------+----------------+-------------------\n");
+    for (i = 0; i < n_threads; i++)
+    {
+        int64_t accepted = thread_data[i].n_accepted;
+        int64_t wakeups = thread_data[i].n_accept_wakeups;
+
+        dcb_printf(dcb, " %2d | %10" PRId64 " | %14" PRId64 " | %.2f\n", i, accepted, wakeups,
+                   accepted ? (double)wakeups / accepted : 0.0);
+    }
 }
 
 /**
@@ -1666,6 +1837,21 @@ static void poll_check_message()
     }
 }
 
+/**
+ * Close the pooled connections of this thread that have been idle for longer
+ * than persistmaxtime. Without this, the pools would only be cleaned when a
+ * connection is added to or taken from them.
+ */
+static void poll_clean_persistent(MXS_TIMER *timer, void *data)
+{
+    server_clean_persistent(current_thread_id);
+}
+
+int poll_get_thread_id()
+{
+    return is_poll_thread ? current_thread_id : -1;
+}
+
 DCB* dcb_get_current()
 {
     return current_dcb;
@@ -18,6 +18,7 @@
 #include <maxscale/platform.h>
 #include <maxscale/pcre2.h>
 #include <maxscale/utils.h>
+#include "maxscale/simplestatementparser.hh"
 #include "maxscale/trxboundaryparser.hh"
 
 #include "../core/maxscale/modules.h"
@@ -39,10 +40,15 @@ struct type_name_info
 
 static const char DEFAULT_QC_NAME[] = "qc_sqlite";
 static const char QC_TRX_PARSE_USING[] = "QC_TRX_PARSE_USING";
+static const char QC_FAST_PATH[] = "QC_FAST_PATH";
 
 static QUERY_CLASSIFIER* classifier;
 
 static qc_trx_parse_using_t qc_trx_parse_using = QC_TRX_PARSE_USING_PARSER;
+static bool qc_fast_path = true;
+
+static char** qc_fast_path_table_names(const maxscale::SimpleStatementParser& parser,
+                                       bool fullnames, int* tblsize);
 
 
 bool qc_setup(const char* plugin_name, const char* plugin_args)
@@ -98,6 +104,27 @@ bool qc_process_init(uint32_t kind)
         }
     }
 
+    const char* fast_path = getenv(QC_FAST_PATH);
+
+    if (fast_path)
+    {
+        if (strcmp(fast_path, "QC_FAST_PATH_ENABLED") == 0)
+        {
+            qc_fast_path = true;
+            MXS_NOTICE("Simple statements are classified using the fast path.");
+        }
+        else if (strcmp(fast_path, "QC_FAST_PATH_DISABLED") == 0)
+        {
+            qc_fast_path = false;
+            MXS_NOTICE("All statements are classified using QC.");
+        }
+        else
+        {
+            MXS_NOTICE("QC_FAST_PATH set, but the value %s is not known. "
+                       "Using the fast path.", fast_path);
+        }
+    }
+
     bool rc = qc_thread_init(QC_INIT_SELF);
 
     if (rc)
@@ -196,8 +223,16 @@ uint32_t qc_get_type_mask(GWBUF* query)
     ss_dassert(classifier);
 
     uint32_t type_mask = QUERY_TYPE_UNKNOWN;
+    maxscale::SimpleStatementParser parser;
 
-    classifier->qc_get_type_mask(query, &type_mask);
+    if (qc_fast_path && parser.parse(query))
+    {
+        type_mask = parser.type_mask();
+    }
+    else
+    {
+        classifier->qc_get_type_mask(query, &type_mask);
+    }
 
     return type_mask;
 }
@@ -208,8 +243,16 @@ qc_query_op_t qc_get_operation(GWBUF* query)
     ss_dassert(classifier);
 
     int32_t op = QUERY_OP_UNDEFINED;
+    maxscale::SimpleStatementParser parser;
 
-    classifier->qc_get_operation(query, &op);
+    if (qc_fast_path && parser.parse(query))
+    {
+        op = parser.operation();
+    }
+    else
+    {
+        classifier->qc_get_operation(query, &op);
+    }
 
     return (qc_query_op_t)op;
 }
@@ -220,8 +263,13 @@ char* qc_get_created_table_name(GWBUF* query)
     ss_dassert(classifier);
 
     char* name = NULL;
+    maxscale::SimpleStatementParser parser;
 
-    classifier->qc_get_created_table_name(query, &name);
+    // None of the statements handled by the fast path create tables.
+    if (!qc_fast_path || !parser.parse(query))
+    {
+        classifier->qc_get_created_table_name(query, &name);
+    }
 
     return name;
 }
@@ -232,8 +280,12 @@ bool qc_is_drop_table_query(GWBUF* query)
     ss_dassert(classifier);
 
     int32_t is_drop_table = 0;
+    maxscale::SimpleStatementParser parser;
 
-    classifier->qc_is_drop_table_query(query, &is_drop_table);
+    if (!qc_fast_path || !parser.parse(query))
+    {
+        classifier->qc_is_drop_table_query(query, &is_drop_table);
+    }
 
     return (is_drop_table != 0) ? true : false;
 }
@@ -245,8 +297,16 @@ char** qc_get_table_names(GWBUF* query, int* tblsize, bool fullnames)
 
     char** names = NULL;
     *tblsize = 0;
+    maxscale::SimpleStatementParser parser;
 
-    classifier->qc_get_table_names(query, fullnames, &names, tblsize);
+    if (qc_fast_path && parser.parse(query))
+    {
+        names = qc_fast_path_table_names(parser, fullnames, tblsize);
+    }
+    else
+    {
+        classifier->qc_get_table_names(query, fullnames, &names, tblsize);
+    }
 
     return names;
 }
@@ -904,3 +964,54 @@ uint32_t qc_get_trx_type_mask(GWBUF* stmt)
 {
     return qc_get_trx_type_mask_using(stmt, qc_trx_parse_using);
 }
+
+static char** qc_fast_path_table_names(const maxscale::SimpleStatementParser& parser,
+                                       bool fullnames, int* tblsize)
+{
+    char** names = NULL;
+    const char* database;
+    size_t database_len;
+    const char* table;
+    size_t table_len;
+
+    *tblsize = 0;
+
+    if (parser.get_table(&database, &database_len, &table, &table_len))
+    {
+        names = (char**)MXS_MALLOC(2 * sizeof(char*));
+        MXS_ABORT_IF_NULL(names);
+
+        if (fullnames && database)
+        {
+            names[0] = (char*)MXS_MALLOC(database_len + 1 + table_len + 1);
+            MXS_ABORT_IF_NULL(names[0]);
+            sprintf(names[0], "%.*s.%.*s", (int)database_len, database, (int)table_len, table);
+        }
+        else
+        {
+            names[0] = MXS_STRNDUP_A(table, table_len);
+        }
+
+        names[1] = NULL;
+        *tblsize = 1;
+    }
+
+    return names;
+}
+
+bool qc_get_fast_path_info(GWBUF* stmt, uint32_t* type_mask, qc_query_op_t* op,
+                           bool fullnames, char*** table_names, int* tblsize)
+{
+    maxscale::SimpleStatementParser parser;
+
+    bool rv = parser.parse(stmt);
+
+    if (rv)
+    {
+        *type_mask = parser.type_mask();
+        *op = parser.operation();
+        *table_names = qc_fast_path_table_names(parser, fullnames, tblsize);
+    }
+
+    return rv;
+}
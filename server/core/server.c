@@ -49,6 +49,7 @@
 #include <maxscale/alloc.h>
 #include <maxscale/paths.h>
 
+#include "maxscale/metrics.h"
 #include "maxscale/monitor.h"
 #include "maxscale/poll.h"
 
@@ -94,9 +95,14 @@ SERVER* server_alloc(const char *name, const char *address, unsigned short port,
     char *my_protocol = MXS_STRDUP(protocol);
     char *my_authenticator = MXS_STRDUP(authenticator);
     DCB **persistent = MXS_CALLOC(nthr, sizeof(*persistent));
+    MXS_HISTOGRAM *response_time = mxs_histogram_alloc();
+    MXS_HISTOGRAM *connect_time = mxs_histogram_alloc();
 
-    if (!server || !my_name || !my_protocol || !my_authenticator || !persistent)
+    if (!server || !my_name || !my_protocol || !my_authenticator || !persistent ||
+        !response_time || !connect_time)
     {
+        mxs_histogram_free(response_time);
+        mxs_histogram_free(connect_time);
         MXS_FREE(server);
         MXS_FREE(my_name);
         MXS_FREE(persistent);
@@ -134,11 +140,14 @@ SERVER* server_alloc(const char *name, const char *address, unsigned short port,
     server->persistmax = 0;
     server->persistmaxtime = 0;
     server->persistpoolmax = 0;
+    server->persistpoolwarm = 0;
     server->monuser[0] = '\0';
     server->monpw[0] = '\0';
     server->is_active = true;
     server->created_online = false;
     server->charset = SERVER_DEFAULT_CHARSET;
+    server->stats.response_time = response_time;
+    server->stats.connect_time = connect_time;
 
     // Log all warnings once
     memset(&server->log_warning, 1, sizeof(server->log_warning));
@@ -188,6 +197,8 @@ server_free(SERVER *tofreeserver)
     MXS_FREE(tofreeserver->unique_name);
     MXS_FREE(tofreeserver->server_string);
     server_parameter_free(tofreeserver->parameters);
+    mxs_histogram_free(tofreeserver->stats.response_time);
+    mxs_histogram_free(tofreeserver->stats.connect_time);
 
     if (tofreeserver->persistent)
     {
@@ -274,6 +285,57 @@ static inline SERVER* next_active_server(SERVER *server)
     return server;
 }
 
+/** How many pools server_clean_persistent() collects per acquisition of
+ * server_spin */
+#define SERVER_CLEAN_BATCH 32
+
+/**
+ * Close the expired connections in the persistent pools of a thread
+ *
+ * The pools of a thread are only modified by the thread itself, so only the
+ * heads of the pools are collected under server_spin and the connections are
+ * closed after it has been released. Servers are never removed from the list
+ * while MaxScale is running, which allows continuing from the last server of
+ * a batch.
+ *
+ * @param id Thread ID
+ */
+void server_clean_persistent(int id)
+{
+    DCB *pools[SERVER_CLEAN_BATCH];
+    SERVER *server = NULL;
+    bool more = true;
+
+    while (more)
+    {
+        int n = 0;
+
+        spinlock_acquire(&server_spin);
+
+        for (server = server ? server->next : allServers; server; server = server->next)
+        {
+            if (server->persistent[id])
+            {
+                pools[n++] = server->persistent[id];
+            }
+
+            if (n == SERVER_CLEAN_BATCH)
+            {
+                break;
+            }
+        }
+
+        more = server && server->next;
+
+        spinlock_release(&server_spin);
+
+        for (int i = 0; i < n; i++)
+        {
+            dcb_persistent_clean_count(pools[i], id, false);
+        }
+    }
+}
+
 /**
  * @brief Find a server with the specified name
  *
@@ -386,6 +448,68 @@ dprintAllServers(DCB *dcb)
     spinlock_release(&server_spin);
 }
 
+/**
+ * Print a server histogram in the Prometheus format
+ *
+ * @param dcb  DCB to print to
+ * @param name Metric name
+ * @param help Metric description
+ * @param offset Offset of the histogram in SERVER_STATS
+ */
+static void print_server_histogram(DCB *dcb, const char *name, const char *help, size_t offset)
+{
+    dcb_printf(dcb, "# HELP %s %s\n", name, help);
+    dcb_printf(dcb, "# TYPE %s histogram\n", name);
+
+    for (SERVER *server = next_active_server(allServers); server;
+         server = next_active_server(server->next))
+    {
+        MXS_HISTOGRAM *histogram = *(MXS_HISTOGRAM**)((char*)&server->stats + offset);
+        char name_esc[2 * strlen(server->unique_name) + 1];
+        char labels[sizeof(name_esc) + sizeof("server=\"\"")];
+        sprintf(labels, "server=\"%s\"", mxs_metrics_escape_label(name_esc, server->unique_name));
+        mxs_histogram_print_prometheus(dcb, histogram, name, labels);
+    }
+}
+
+void server_print_metrics(DCB *dcb)
+{
+    spinlock_acquire(&server_spin);
+
+    dcb_printf(dcb, "# HELP maxscale_server_connections_total Number of connections created to the server.\n");
+    dcb_printf(dcb, "# TYPE maxscale_server_connections_total counter\n");
+
+    for (SERVER *server = next_active_server(allServers); server;
+         server = next_active_server(server->next))
+    {
+        char name_esc[2 * strlen(server->unique_name) + 1];
+        dcb_printf(dcb, "maxscale_server_connections_total{server=\"%s\"} %d\n",
+                   mxs_metrics_escape_label(name_esc, server->unique_name),
+                   server->stats.n_connections);
+    }
+
+    dcb_printf(dcb, "# HELP maxscale_server_current_connections Number of open connections to the server.\n");
+    dcb_printf(dcb, "# TYPE maxscale_server_current_connections gauge\n");
+
+    for (SERVER *server = next_active_server(allServers); server;
+         server = next_active_server(server->next))
+    {
+        char name_esc[2 * strlen(server->unique_name) + 1];
+        dcb_printf(dcb, "maxscale_server_current_connections{server=\"%s\"} %d\n",
+                   mxs_metrics_escape_label(name_esc, server->unique_name),
+                   server->stats.n_current);
+    }
+
+    print_server_histogram(dcb, "maxscale_server_response_time_seconds",
+                           "Time from a request to the first byte of the server's response.",
+                           offsetof(SERVER_STATS, response_time));
+    print_server_histogram(dcb, "maxscale_server_connect_time_seconds",
+                           "Time from the start of a connection to the server's handshake.",
+                           offsetof(SERVER_STATS, connect_time));
+
+    spinlock_release(&server_spin);
+}
+
 /**
  * Print all servers in Json format to a DCB
  *
@@ -560,6 +684,8 @@ dprintServer(DCB *dcb, const SERVER *server)
     dcb_printf(dcb, "\tNumber of connections:               %d\n", server->stats.n_connections);
     dcb_printf(dcb, "\tCurrent no. of conns:                %d\n", server->stats.n_current);
     dcb_printf(dcb, "\tCurrent no. of operations:           %d\n", server->stats.n_current_ops);
+    mxs_histogram_dprint(dcb, server->stats.response_time, "Response time:");
+    mxs_histogram_dprint(dcb, server->stats.connect_time, "Connect time:");
     if (server->persistpoolmax)
     {
         dcb_printf(dcb, "\tPersistent pool size:                %d\n", server->stats.n_persistent);
@@ -568,9 +694,19 @@ dprintServer(DCB *dcb, const SERVER *server)
         dcb_printf(dcb, "\tPersistent actual size max:          %d\n", server->persistmax);
         dcb_printf(dcb, "\tPersistent pool size limit:          %ld\n", server->persistpoolmax);
         dcb_printf(dcb, "\tPersistent max time (secs):          %ld\n", server->persistmaxtime);
+        dcb_printf(dcb, "\tPersistent warm size:                %ld\n", server->persistpoolwarm);
         dcb_printf(dcb, "\tConnections taken from pool:         %lu\n", server->stats.n_from_pool);
         double d =  (double)server->stats.n_from_pool / (double)(server->stats.n_connections + server->stats.n_from_pool + 1);
         dcb_printf(dcb, "\tPool availability:                   %0.2lf%%\n", d * 100.0);
+        d = (double)server->stats.n_from_pool / (double)(server->stats.n_new_conn + server->stats.n_from_pool + 1);
+        dcb_printf(dcb, "\tPool hit rate:                       %0.2lf%%\n", d * 100.0);
+        dcb_printf(dcb, "\tConnections opened for the pool:     %lu\n", server->stats.n_warm_conn);
+
+        /** Every connection taken from the pool saves a connection setup */
+        MXS_HISTOGRAM_SNAPSHOT snapshot;
+        mxs_histogram_snapshot(server->stats.connect_time, &snapshot);
+        uint64_t saved = server->stats.n_from_pool * mxs_histogram_percentile(&snapshot, 50) / 1000;
+        dcb_printf(dcb, "\tEstimated connect time saved (ms):   %lu\n", saved);
     }
     if (server->server_ssl)
     {
@@ -587,6 +723,7 @@ dprintServer(DCB *dcb, const SERVER *server)
                    l->ssl_key ? l->ssl_key : "null");
         dcb_printf(dcb, "\tSSL CA certificate:                  %s\n",
                    l->ssl_ca_cert ? l->ssl_ca_cert : "null");
+        ssl_print_stats(dcb, l);
     }
 }
 
@@ -1161,6 +1298,11 @@ static bool create_server_config(const SERVER *server, const char *filename)
         dprintf(file, "persistmaxtime=%ld\n", server->persistmaxtime);
     }
 
+    if (server->persistpoolwarm)
+    {
+        dprintf(file, "persistpoolwarm=%ld\n", server->persistpoolwarm);
+    }
+
     for (SERVER_PARAM *p = server->parameters; p; p = p->next)
     {
         if (p->active)
@@ -47,13 +47,17 @@
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <math.h>
+#include <pthread.h>
 #include <fcntl.h>
+#include <inttypes.h>
 #include <maxscale/alloc.h>
+#include <maxscale/atomic.h>
 #include <maxscale/dcb.h>
 #include <maxscale/paths.h>
 #include <maxscale/housekeeper.h>
 #include <maxscale/listener.h>
 #include <maxscale/log_manager.h>
+#include <maxscale/mysql_utils.h>
 #include <maxscale/poll.h>
 #include <maxscale/protocol.h>
 #include <maxscale/queuemanager.h>
@@ -62,12 +66,15 @@
 #include <maxscale/server.h>
 #include <maxscale/session.h>
 #include <maxscale/spinlock.h>
+#include <maxscale/thread.h>
+#include <maxscale/timer.h>
 #include <maxscale/users.h>
 #include <maxscale/utils.h>
 #include <maxscale/version.h>
 
 #include "maxscale/config.h"
 #include "maxscale/filter.h"
+#include "maxscale/metrics.h"
 #include "maxscale/modules.h"
 #include "maxscale/queuemanager.h"
 #include "maxscale/service.h"
@@ -99,6 +106,18 @@ typelib_t sqlvar_target_type =
 static SPINLOCK service_spin = SPINLOCK_INIT;
 static SERVICE  *allServices = NULL;
 
+/** Maximum number of threads used to initialize the services at startup */
+#define SERVICE_INIT_MAX_THREADS 16
+
+static THREAD users_refresh_thr;
+static bool   users_refresh_running = false;
+static bool   users_refresh_shutdown = false;
+
+/** Wakes up the user refresh thread when a refresh is requested */
+static pthread_mutex_t users_refresh_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t  users_refresh_cond = PTHREAD_COND_INITIALIZER;
+static bool            users_refresh_signaled = false;
+
 static int find_type(typelib_t* tl, const char* needle, int maxlen);
 
 static void service_add_qualified_param(SERVICE*          svc,
@@ -112,12 +131,14 @@ SERVICE* service_alloc(const char *name, const char *router)
     char *my_name = MXS_STRDUP(name);
     char *my_router = MXS_STRDUP(router);
     SERVICE *service = (SERVICE *)MXS_CALLOC(1, sizeof(*service));
+    MXS_HISTOGRAM *query_latency = mxs_histogram_alloc();
 
-    if (!my_name || !my_router || !service)
+    if (!my_name || !my_router || !service || !query_latency)
     {
         MXS_FREE(my_name);
         MXS_FREE(my_router);
         MXS_FREE(service);
+        mxs_histogram_free(query_latency);
         return NULL;
     }
 
@@ -139,6 +160,7 @@ SERVICE* service_alloc(const char *name, const char *router)
         MXS_FREE(my_name);
         MXS_FREE(my_router);
         MXS_FREE(service);
+        mxs_histogram_free(query_latency);
         return NULL;
     }
 
@@ -167,10 +189,12 @@ SERVICE* service_alloc(const char *name, const char *router)
             MXS_FREE(service->name);
         }
         MXS_FREE(service);
+        mxs_histogram_free(query_latency);
         return NULL;
     }
     service->stats.started = time(0);
     service->stats.n_failed_starts = 0;
+    service->stats.query_latency = query_latency;
     service->state = SERVICE_STATE_ALLOC;
     spinlock_init(&service->spin);
 
@@ -477,6 +501,8 @@ static void free_string_array(char** array)
  */
 int serviceInitialize(SERVICE *service)
 {
+    uint64_t start = mxs_timer_now();
+
     /** Calculate the server weights */
     service_calculate_weights(service);
 
@@ -486,6 +512,7 @@ int serviceInitialize(SERVICE *service)
     if ((service->router_instance = service->router->createInstance(service, router_options)))
     {
         service->capabilities |= service->router->getCapabilities(service->router_instance);
+        uint64_t router_done = mxs_timer_now();
 
         if (!config_get_global_options()->config_check)
         {
@@ -496,6 +523,11 @@ int serviceInitialize(SERVICE *service)
             /** We're only checking that the configuration is valid */
             listeners++;
         }
+
+        uint64_t end = mxs_timer_now();
+        MXS_NOTICE("Service '%s' initialized in %" PRIu64 " ms (router: %" PRIu64 " ms, "
+                   "listeners: %" PRIu64 " ms).",
+                   service->name, end - start, router_done - start, end - router_done);
     }
     else
     {
@@ -612,28 +644,108 @@ bool serviceStartListener(SERVICE *service, const char *name)
     return rval;
 }
 
+/**
+ * Shared state of the threads that initialize the services
+ */
+typedef struct service_launch
+{
+    SPINLOCK lock;      /**< Protects the other members */
+    SERVICE *next;      /**< The next service to initialize */
+    int      listeners; /**< Total number of started listeners */
+    bool     error;     /**< Whether a service failed to start */
+} SERVICE_LAUNCH;
+
+/**
+ * Initialize services until all of them have been initialized
+ *
+ * @param launch The shared state
+ */
+static void service_launch_services(SERVICE_LAUNCH *launch)
+{
+    while (true)
+    {
+        spinlock_acquire(&launch->lock);
+        SERVICE *service = launch->next;
+
+        if (service)
+        {
+            launch->next = service->next;
+        }
+
+        spinlock_release(&launch->lock);
+
+        if (service == NULL || service->svc_do_shutdown)
+        {
+            break;
+        }
+
+        int listeners = serviceInitialize(service);
+
+        if (listeners == 0)
+        {
+            MXS_ERROR("Failed to start service '%s'.", service->name);
+        }
+
+        spinlock_acquire(&launch->lock);
+        launch->listeners += listeners;
+        launch->error = launch->error || listeners == 0;
+        spinlock_release(&launch->lock);
+    }
+}
+
+/**
+ * Entry point of the threads that initialize the services
+ *
+ * @param data The shared SERVICE_LAUNCH state
+ */
+static void service_launch_thread(void *data)
+{
+    /** The authenticators use the MySQL connector to load the users */
+    mysql_thread_init();
+    service_launch_services((SERVICE_LAUNCH*)data);
+    mysql_thread_end();
+}
+
 int service_launch_all()
 {
-    SERVICE *ptr;
-    int n = 0, i;
-    bool error = false;
+    SERVICE_LAUNCH launch = {SPINLOCK_INIT, allServices, 0, false};
+    uint64_t start = mxs_timer_now();
+    int n_services = 0;
 
     config_enable_feedback_task();
 
-    ptr = allServices;
-    while (ptr && !ptr->svc_do_shutdown)
+    for (SERVICE *service = allServices; service; service = service->next)
     {
-        n += (i = serviceInitialize(ptr));
+        n_services++;
+    }
 
-        if (i == 0)
-        {
-            MXS_ERROR("Failed to start service '%s'.", ptr->name);
-            error = true;
-        }
+    /**
+     * The services are initialized in parallel as loading the users and
+     * creating the router instances can require a connection to each backend
+     * server. If the threads can't be started, the remaining services are
+     * initialized by this thread.
+     */
+    int n_threads = MXS_MIN(n_services, SERVICE_INIT_MAX_THREADS);
+    THREAD threads[n_threads > 0 ? n_threads : 1];
+    int started = 0;
 
-        ptr = ptr->next;
+    while (started < n_threads - 1 &&
+           thread_start(&threads[started], service_launch_thread, &launch))
+    {
+        started++;
     }
-    return error ? 0 : n;
+
+    service_launch_services(&launch);
+
+    for (int i = 0; i < started; i++)
+    {
+        thread_wait(threads[i]);
+    }
+
+    MXS_NOTICE("Initialized %d services in %" PRIu64 " ms using %d threads.",
+               n_services, mxs_timer_now() - start, started + 1);
+
+    return launch.error ? 0 : launch.listeners;
 }
 
 bool serviceStop(SERVICE *service)
@@ -731,6 +843,7 @@ void service_free(SERVICE *service)
     MXS_FREE(service->version_string);
     MXS_FREE(service->credentials.name);
     MXS_FREE(service->credentials.authdata);
+    mxs_histogram_free(service->stats.query_latency);
 
     config_parameter_free(service->svc_config_param);
     serviceClearRouterOptions(service);
@@ -1379,6 +1492,48 @@ dprintAllServices(DCB *dcb)
     spinlock_release(&service_spin);
 }
 
+void service_print_metrics(DCB *dcb)
+{
+    SERVICE *ptr;
+
+    spinlock_acquire(&service_spin);
+
+    dcb_printf(dcb, "# HELP maxscale_service_sessions_total Number of sessions created on the service.\n");
+    dcb_printf(dcb, "# TYPE maxscale_service_sessions_total counter\n");
+
+    for (ptr = allServices; ptr; ptr = ptr->next)
+    {
+        char name_esc[2 * strlen(ptr->name) + 1];
+        dcb_printf(dcb, "maxscale_service_sessions_total{service=\"%s\"} %d\n",
+                   mxs_metrics_escape_label(name_esc, ptr->name), ptr->stats.n_sessions);
+    }
+
+    dcb_printf(dcb, "# HELP maxscale_service_current_sessions Number of open sessions on the service.\n");
+    dcb_printf(dcb, "# TYPE maxscale_service_current_sessions gauge\n");
+
+    for (ptr = allServices; ptr; ptr = ptr->next)
+    {
+        char name_esc[2 * strlen(ptr->name) + 1];
+        dcb_printf(dcb, "maxscale_service_current_sessions{service=\"%s\"} %d\n",
+                   mxs_metrics_escape_label(name_esc, ptr->name), ptr->stats.n_current);
+    }
+
+    dcb_printf(dcb, "# HELP maxscale_service_query_latency_seconds Time from a client "
+               "request to the first byte of the reply.\n");
+    dcb_printf(dcb, "# TYPE maxscale_service_query_latency_seconds histogram\n");
+
+    for (ptr = allServices; ptr; ptr = ptr->next)
+    {
+        char name_esc[2 * strlen(ptr->name) + 1];
+        char labels[sizeof(name_esc) + sizeof("service=\"\"")];
+        sprintf(labels, "service=\"%s\"", mxs_metrics_escape_label(name_esc, ptr->name));
+        mxs_histogram_print_prometheus(dcb, ptr->stats.query_latency,
+                                       "maxscale_service_query_latency_seconds", labels);
+    }
+
+    spinlock_release(&service_spin);
+}
+
 /**
  * Print details of a single service.
  *
@@ -1448,6 +1603,16 @@ void dprintService(DCB *dcb, SERVICE *service)
                service->stats.n_sessions);
     dcb_printf(dcb, "\tCurrently connected:                 %d\n",
                service->stats.n_current);
+    mxs_histogram_dprint(dcb, service->stats.query_latency, "Query latency:");
+
+    for (SERV_LISTENER *port = service->ports; port; port = port->next)
+    {
+        if (port->ssl)
+        {
+            dcb_printf(dcb, "\tListener %s:\n", port->name);
+            ssl_print_stats(dcb, port->ssl);
+        }
+    }
 }
 
 /**
@@ -1663,6 +1828,136 @@ int service_refresh_users(SERVICE *service)
     return ret;
 }
 
+/**
+ * Wake up the user refresh thread
+ *
+ * @param shutdown Whether the thread should exit
+ */
+static void service_users_refresh_signal(bool shutdown)
+{
+    pthread_mutex_lock(&users_refresh_lock);
+    users_refresh_signaled = true;
+
+    if (shutdown)
+    {
+        users_refresh_shutdown = true;
+    }
+
+    pthread_cond_signal(&users_refresh_cond);
+    pthread_mutex_unlock(&users_refresh_lock);
+}
+
+uint64_t service_refresh_users_async(SERVICE *service)
+{
+    uint64_t ticket = atomic_add_uint64(&service->users_refresh_requested, 1) + 1;
+    service_users_refresh_signal(false);
+    return ticket;
+}
+
+bool service_users_refreshed(SERVICE *service, uint64_t ticket)
+{
+    return atomic_add_uint64(&service->users_refresh_served, 0) >= ticket;
+}
+
+/**
+ * Find a service with unserved user refresh requests
+ *
+ * @param requested Set to the number of requests made so far
+ * @return The service or NULL if no refreshes are pending
+ */
+static SERVICE* service_next_users_refresh(uint64_t *requested)
+{
+    SERVICE *rval = NULL;
+
+    spinlock_acquire(&service_spin);
+
+    for (SERVICE *service = allServices; service; service = service->next)
+    {
+        uint64_t n = atomic_add_uint64(&service->users_refresh_requested, 0);
+
+        if (n != service->users_refresh_served)
+        {
+            *requested = n;
+            rval = service;
+            break;
+        }
+    }
+
+    spinlock_release(&service_spin);
+
+    return rval;
+}
+
+/**
+ * The user refresh thread
+ *
+ * Loads the users of services for which a refresh was requested with
+ * service_refresh_users_async(). All requests made before the load starts
+ * are marked as served once it completes, even if the rate limit prevented
+ * the load, so that nobody waits for a refresh that will not happen.
+ *
+ * @param data Unused
+ */
+static void service_users_refresh_main(void *data)
+{
+    if (mysql_thread_init())
+    {
+        MXS_ERROR("mysql_thread_init failed, users will not be refreshed in the background.");
+        return;
+    }
+
+    while (!users_refresh_shutdown)
+    {
+        SERVICE *service;
+        uint64_t requested;
+
+        while (!users_refresh_shutdown &&
+               (service = service_next_users_refresh(&requested)))
+        {
+            service_refresh_users(service);
+            atomic_synchronize();
+            service->users_refresh_served = requested;
+            atomic_synchronize();
+        }
+
+        /** Requests made while the loads above were running have set the
+         * flag, so none of them is missed */
+        pthread_mutex_lock(&users_refresh_lock);
+
+        while (!users_refresh_signaled && !users_refresh_shutdown)
+        {
+            pthread_cond_wait(&users_refresh_cond, &users_refresh_lock);
+        }
+
+        users_refresh_signaled = false;
+        pthread_mutex_unlock(&users_refresh_lock);
+    }
+
+    mysql_thread_end();
+}
+
+bool service_users_refresh_start()
+{
+    if (thread_start(&users_refresh_thr, service_users_refresh_main, NULL) == NULL)
+    {
+        MXS_ALERT("Failed to start user refresh thread.");
+        return false;
+    }
+
+    users_refresh_running = true;
+    return true;
+}
+
+void service_users_refresh_finish()
+{
+    if (users_refresh_running)
+    {
+        ss_dassert(users_refresh_shutdown);
+        thread_wait(users_refresh_thr);
+        users_refresh_running = false;
+    }
+}
+
 void service_add_parameters(SERVICE *service, const MXS_CONFIG_PARAMETER *param)
 {
     while (param)
@@ -1841,6 +2136,8 @@ void service_shutdown()
         svc = svc->next;
     }
     spinlock_release(&service_spin);
+
+    service_users_refresh_signal(true);
 }
 
 void service_destroy_instances(void)
@@ -265,9 +265,38 @@ session_link_dcb(MXS_SESSION *session, DCB *dcb)
     dcb->session = session;
     /** Move this DCB under the same thread */
     dcb->thread.id = session->client_dcb->thread.id;
+
+    if (dcb->dcb_role == DCB_ROLE_BACKEND_HANDLER)
+    {
+        dcb->session_next = session->backends;
+        session->backends = dcb;
+    }
     return true;
 }
 
+/**
+ * Remove a backend DCB from the backend connections of a session. This is
+ * called by the owning thread before the reference the DCB holds to the
+ * session is released.
+ *
+ * @param session       The session the DCB is linked to
+ * @param dcb           The DCB to be unlinked
+ */
+void
+session_unlink_dcb(MXS_SESSION *session, DCB *dcb)
+{
+    for (DCB **prev = &session->backends; *prev; prev = &(*prev)->session_next)
+    {
+        if (*prev == dcb)
+        {
+            *prev = dcb->session_next;
+            break;
+        }
+    }
+
+    dcb->session_next = NULL;
+}
+
 /**
  * Deallocate the specified session, minimal actions during session_alloc
  * Since changes to keep new session in existence until all related DCBs
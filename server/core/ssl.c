@@ -25,6 +25,7 @@
  *
  * @endverbatim
  */
+#include <inttypes.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -242,6 +243,7 @@ void write_ssl_config(int fd, SSL_LISTENER* ssl)
 
         dprintf(fd, "ssl_verify_peer_certificate=%s\n",
                 ssl->ssl_verify_peer_certificate ? "true" : "false");
+        dprintf(fd, "ssl_session_cache=%s\n", ssl->ssl_session_cache ? "true" : "false");
 
         const char *version = NULL;
 
@@ -274,4 +276,22 @@ void write_ssl_config(int fd, SSL_LISTENER* ssl)
             dprintf(fd, "ssl_version=%s\n", version);
         }
     }
-}
\ No newline at end of file
+}
+
+/**
+ * @brief Print the handshake and record statistics of an SSL configuration
+ *
+ * @param dcb DCB to print to
+ * @param ssl The SSL configuration of a listener or a server
+ */
+void ssl_print_stats(DCB *dcb, SSL_LISTENER* ssl)
+{
+    dcb_printf(dcb, "\tSSL session cache:                   %s\n",
+               ssl->ssl_session_cache ? "enabled" : "disabled");
+    dcb_printf(dcb, "\tSSL handshakes:                      %" PRIu64 "\n", ssl->n_handshakes);
+    dcb_printf(dcb, "\tSSL resumed sessions:                %" PRIu64 "\n", ssl->n_resumed);
+    dcb_printf(dcb, "\tSSL records written:                 %" PRIu64 "\n", ssl->n_records);
+    dcb_printf(dcb, "\tSSL bytes written:                   %" PRIu64 "\n", ssl->n_bytes);
+    dcb_printf(dcb, "\tSSL average bytes per record:        %" PRIu64 "\n",
+               ssl->n_records ? ssl->n_bytes / ssl->n_records : 0);
+}
@@ -0,0 +1,164 @@
+/*
+ * Copyright (c) 2016 MariaDB Corporation Ab
+ *
+ * Use of this software is governed by the Business Source License included
+ * in the LICENSE.TXT file and at www.mariadb.com/bsl11.
+ *
+ * Change Date: 2019-07-01
+ *
+ * On the date above, in accordance with the Business Source License, use
+ * of this software will be governed by version 2 or later of the General
+ * Public License.
+ */
+
+#include <maxscale/cppdefs.hh>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <maxscale/log_manager.h>
+#include <maxscale/pcre2.h>
+
+using namespace std;
+
+namespace
+{
+
+char USAGE[] = "usage: pcre2_profile -n count -p pattern -s subject\n";
+
+double seconds_between(const timespec& later, const timespec& earlier)
+{
+    return (later.tv_sec - earlier.tv_sec) + (later.tv_nsec - earlier.tv_nsec) / 1000000000.0;
+}
+
+/**
+ * Match the subject @c count times and report the number of matches per second.
+ *
+ * @param zName    Name of the test
+ * @param code     Compiled pattern
+ * @param zSubject The subject
+ * @param count    How many times to match
+ *
+ * @return Number of successful matches
+ */
+int profile(const char* zName, const pcre2_code* code, const char* zSubject, int count)
+{
+    size_t len = strlen(zSubject);
+    pcre2_match_data* mdata = mxs_pcre2_thread_match_data(code);
+    pcre2_match_context* mcontext = mxs_pcre2_thread_match_context();
+    int nMatches = 0;
+
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC_RAW, &start);
+
+    for (int i = 0; i < count; ++i)
+    {
+        if (pcre2_match(code, (PCRE2_SPTR)zSubject, len, 0, 0, mdata, mcontext) >= 0)
+        {
+            ++nMatches;
+        }
+    }
+
+    struct timespec finish;
+    clock_gettime(CLOCK_MONOTONIC_RAW, &finish);
+
+    double secs = seconds_between(finish, start);
+
+    cout << setw(12) << left << zName
+         << "Time: " << fixed << setprecision(6) << secs << "s, "
+         << setprecision(0) << (secs > 0 ? count / secs : 0) << " matches/s" << endl;
+
+    return nMatches;
+}
+
+}
+
+int main(int argc, char* argv[])
+{
+    int rc = EXIT_SUCCESS;
+
+    int nCount = 0;
+    const char* zPattern = NULL;
+    const char* zSubject = NULL;
+
+    int c;
+    while ((c = getopt(argc, argv, "n:p:s:")) != -1)
+    {
+        switch (c)
+        {
+        case 'n':
+            nCount = atoi(optarg);
+            break;
+
+        case 'p':
+            zPattern = optarg;
+            break;
+
+        case 's':
+            zSubject = optarg;
+            break;
+
+        default:
+            rc = EXIT_FAILURE;
+        }
+    }
+
+    if ((rc == EXIT_SUCCESS) && zPattern && zSubject && (nCount > 0))
+    {
+        rc = EXIT_FAILURE;
+
+        if (mxs_log_init(NULL, ".", MXS_LOG_TARGET_DEFAULT))
+        {
+            int err;
+            PCRE2_SIZE erroff;
+            // The interpreted pattern is compiled directly, without JIT.
+            pcre2_code* interpreted = pcre2_compile((PCRE2_SPTR)zPattern, PCRE2_ZERO_TERMINATED,
+                                                    0, &err, &erroff, NULL);
+            pcre2_code* code = mxs_pcre2_compile(zPattern, 0);
+
+            if (interpreted && code)
+            {
+                size_t jit_size = 0;
+                pcre2_pattern_info(code, PCRE2_INFO_JITSIZE, &jit_size);
+
+                if (jit_size == 0)
+                {
+                    cerr << "warning: The pattern was not JIT compiled." << endl;
+                }
+
+                int nInterpreted = profile("Interpreter", interpreted, zSubject, nCount);
+                int nJit = profile("JIT", code, zSubject, nCount);
+
+                if (nInterpreted == nJit)
+                {
+                    cout << "Matches: " << nJit << endl;
+                    rc = EXIT_SUCCESS;
+                }
+                else
+                {
+                    cerr << "error: The interpreter matched " << nInterpreted
+                         << " times but JIT " << nJit << " times." << endl;
+                }
+
+            }
+            else
+            {
+                cerr << "error: Could not compile the pattern." << endl;
+            }
+
+            pcre2_code_free(interpreted);
+            mxs_pcre2_release(code);
+
+            mxs_log_finish();
+        }
+        else
+        {
+            cerr << "error: Could not initialize log." << endl;
+        }
+    }
+    else
+    {
+        cout << USAGE << endl;
+    }
+
+    return rc;
+}
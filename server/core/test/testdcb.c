@@ -30,13 +30,21 @@
 #undef NDEBUG
 #endif
 
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
 
+#include <maxscale/alloc.h>
 #include <maxscale/config.h>
 #include <maxscale/dcb.h>
+#include <maxscale/limits.h>
 #include <maxscale/listener.h>
+#include <maxscale/server.h>
+#include <maxscale/session.h>
+#include <maxscale/utils.h>
 
 /**
  * test1    Allocate a dcb and do lots of other things
@@ -81,6 +89,272 @@ test1()
     return 0;
 }
 
+/**
+ * Write to a client DCB that is read slower than it is written to and check
+ * that the backend DCB of the session is paused until the queue drains
+ */
+static void
+test_throttle(int low_water)
+{
+    MXS_SESSION session = {.state = SESSION_STATE_ALLOC};
+    SERV_LISTENER dummy;
+    int sv[2];
+    int chunk = 64 * 1024;
+    char buf[chunk];
+
+    ss_info_dassert(socketpair(AF_UNIX, SOCK_STREAM, 0, sv) == 0, "socketpair must succeed");
+    setnonblocking(sv[0]);
+
+    DCB *client = dcb_alloc(DCB_ROLE_CLIENT_HANDLER, &dummy);
+    DCB *backend = dcb_alloc(DCB_ROLE_BACKEND_HANDLER, NULL);
+    client->fd = sv[0];
+    client->session = &session;
+    client->high_water = 1024 * 1024;
+    client->low_water = low_water;
+    backend->session = &session;
+    session.client_dcb = client;
+    session.backends = backend;
+    dcb_add_to_list(client);
+    dcb_add_to_list(backend);
+
+    /** Write until the socket buffer is full and the data is queued */
+    memset(buf, 'a', sizeof(buf));
+
+    for (int i = 0; i < 64; i++)
+    {
+        dcb_write(client, gwbuf_alloc_and_load(sizeof(buf), buf));
+    }
+
+    ss_info_dassert(client->writeqlen > client->high_water, "Write queue must be above high water");
+    ss_info_dassert(client->flags & DCBF_THROTTLING, "Client must throttle the session");
+    ss_info_dassert(backend->flags & DCBF_READ_PAUSED, "Reading from the backend must be paused");
+    ss_info_dassert((client->flags & DCBF_READ_PAUSED) == 0, "Reading from the client must not be paused");
+
+    while (client->writeqlen > 0)
+    {
+        ss_info_dassert(backend->flags & DCBF_READ_PAUSED ||
+                        client->writeqlen <= client->low_water,
+                        "Reading must be paused until the queue is at low water");
+        ss_info_dassert(read(sv[1], buf, sizeof(buf)) > 0, "Read must succeed");
+        dcb_drain_writeq(client);
+    }
+
+    ss_info_dassert((client->flags & DCBF_THROTTLING) == 0, "Client must not throttle the session");
+    ss_info_dassert((backend->flags & DCBF_READ_PAUSED) == 0, "Reading from the backend must be resumed");
+    ss_info_dassert(backend->stats.n_read_paused == 1, "Backend must be paused once");
+
+    client->session = NULL;
+    backend->session = NULL;
+    client->state = DCB_STATE_NOPOLLING;
+    backend->state = DCB_STATE_NOPOLLING;
+    dcb_close(client);
+    dcb_close(backend);
+    dcb_process_zombies(0);
+    close(sv[1]);
+}
+
+/**
+ * test2    A client DCB that is read slower than it is written to pauses
+ *          the backend DCBs of the session until its write queue drains,
+ *          also when it has no low water mark
+ */
+static int
+test2()
+{
+    ss_dfprintf(stderr, "testdcb : write queue throttling with a slow reader");
+    test_throttle(64 * 1024);
+    ss_dfprintf(stderr, "\t..done\nWrite queue throttling without a low water mark");
+    test_throttle(0);
+    ss_dfprintf(stderr, "\t..done\n");
+
+    return 0;
+}
+
+/**
+ * test5    A connection opened for the persistent pool goes into the pool
+ *          when it is closed even though its session is still in use
+ */
+static int
+test5()
+{
+    MXS_SESSION session = {.ses_chk_top = CHK_NUM_SESSION, .ses_chk_tail = CHK_NUM_SESSION,
+                           .state = SESSION_STATE_ROUTER_READY, .refcount = 2};
+    DCB *pool[1] = {NULL};
+    SERVER server = {.server_chk_top = CHK_NUM_SERVER, .server_chk_tail = CHK_NUM_SERVER,
+                     .status = SERVER_RUNNING, .persistent = pool,
+                     .persistpoolmax = 10, .persistmaxtime = 60};
+
+    ss_dfprintf(stderr, "testdcb : warm-up connection goes into the persistent pool");
+    DCB *dcb = dcb_alloc(DCB_ROLE_BACKEND_HANDLER, NULL);
+    dcb->server = &server;
+    dcb->user = MXS_STRDUP_A("user");
+    dcb->session = &session;
+    dcb->state = DCB_STATE_POLLING;
+    dcb->flags |= DCBF_WARMUP;
+    server.stats.n_warming = 1;
+    dcb_add_to_list(dcb);
+
+    ss_info_dassert(!session_valid_for_pool(&session), "Session must not be valid for the pool");
+    dcb_close(dcb);
+    dcb_process_zombies(0);
+
+    ss_info_dassert(server.stats.n_warming == 0, "Connection must no longer be warming up");
+    ss_info_dassert(server.stats.n_persistent == 1, "Pool must have one connection");
+    ss_info_dassert(pool[0] == dcb, "Connection must be in the pool");
+    ss_info_dassert((dcb->flags & DCBF_WARMUP) == 0, "Pooled connection must not be warming up");
+    ss_info_dassert(session.refcount == 1, "Pooled connection must release the session");
+    ss_dfprintf(stderr, "\t..done\n");
+
+    return 0;
+}
+
+/** Allocate a buffer that continues the byte pattern at position pos */
+static GWBUF *
+alloc_pattern(size_t *pos, size_t len)
+{
+    GWBUF *buf = gwbuf_alloc(len);
+    uint8_t *data = GWBUF_DATA(buf);
+
+    for (size_t i = 0; i < len; i++)
+    {
+        data[i] = (*pos)++ % 251;
+    }
+
+    return buf;
+}
+
+/**
+ * test3    A write queue of many small buffers is written with a few system
+ *          calls and the data arrives intact and in order
+ */
+static int
+test3()
+{
+    SERV_LISTENER dummy;
+    int sv[2];
+    int nbufs = 20000;
+    size_t written = 0;
+    size_t received = 0;
+    uint8_t buf[64 * 1024];
+
+    ss_dfprintf(stderr, "testdcb : gather writes of small buffers");
+    ss_info_dassert(socketpair(AF_UNIX, SOCK_STREAM, 0, sv) == 0, "socketpair must succeed");
+    setnonblocking(sv[0]);
+    setnonblocking(sv[1]);
+
+    DCB *client = dcb_alloc(DCB_ROLE_CLIENT_HANDLER, &dummy);
+    client->fd = sv[0];
+    dcb_add_to_list(client);
+
+    /** Fill the socket buffer so that the small buffers are queued */
+    while (client->writeq == NULL)
+    {
+        dcb_write(client, alloc_pattern(&written, sizeof(buf)));
+    }
+
+    int calls = client->stats.n_write_calls;
+
+    for (int i = 0; i < nbufs; i++)
+    {
+        dcb_write(client, alloc_pattern(&written, 1 + i % 100));
+    }
+
+    ss_dfprintf(stderr, "\t..done\nRead and verify the data");
+
+    while (received < written)
+    {
+        int n = read(sv[1], buf, sizeof(buf));
+
+        if (n > 0)
+        {
+            for (int i = 0; i < n; i++)
+            {
+                ss_info_dassert(buf[i] == (received + i) % 251, "Data must arrive in order");
+            }
+            received += n;
+        }
+
+        dcb_drain_writeq(client);
+    }
+
+    calls = client->stats.n_write_calls - calls;
+    ss_dfprintf(stderr, "\t..done\n%d buffers written with %d system calls", nbufs, calls);
+    ss_info_dassert(client->writeq == NULL && client->writeqlen == 0, "Write queue must be empty");
+    ss_info_dassert(client->stats.n_bytes_written == written, "All bytes must be counted");
+    ss_info_dassert(calls < nbufs / 10, "Buffers must be gathered into few system calls");
+    ss_dfprintf(stderr, "\t..done\n");
+
+    client->state = DCB_STATE_NOPOLLING;
+    dcb_close(client);
+    dcb_process_zombies(0);
+    close(sv[1]);
+
+    return 0;
+}
+
+/**
+ * test4    Reads go directly into buffers that grow to the size of the reads
+ *          and the data is read with few system calls
+ */
+static int
+test4()
+{
+    SERV_LISTENER dummy;
+    int sv[2];
+    int total = 1024 * 1024;
+    int nread = 0;
+    size_t pos = 0;
+    size_t checked = 0;
+
+    ss_dfprintf(stderr, "testdcb : adaptive direct reads");
+    ss_info_dassert(socketpair(AF_UNIX, SOCK_STREAM, 0, sv) == 0, "socketpair must succeed");
+    setnonblocking(sv[0]);
+
+    DCB *client = dcb_alloc(DCB_ROLE_CLIENT_HANDLER, &dummy);
+    client->fd = sv[0];
+    dcb_add_to_list(client);
+
+    while (nread < total)
+    {
+        GWBUF *data = alloc_pattern(&pos, 16 * 1024);
+        ss_info_dassert(write(sv[1], GWBUF_DATA(data), GWBUF_LENGTH(data)) == GWBUF_LENGTH(data),
+                        "Write must succeed");
+        gwbuf_free(data);
+
+        GWBUF *head = NULL;
+        int n = dcb_read(client, &head, 0);
+        ss_info_dassert(n > 0 && n == gwbuf_length(head), "Read must return the data");
+
+        for (GWBUF *b = head; b; b = b->next)
+        {
+            uint8_t *ptr = GWBUF_DATA(b);
+
+            for (size_t i = 0; i < GWBUF_LENGTH(b); i++)
+            {
+                ss_info_dassert(ptr[i] == checked++ % 251, "Data must arrive in order");
+            }
+        }
+
+        gwbuf_free(head);
+        nread += n;
+    }
+
+    ss_dfprintf(stderr, "\t..done\n%d bytes read with %d system calls, read size %d",
+                nread, client->stats.n_reads, client->read_size);
+    ss_info_dassert(client->stats.n_bytes_read == nread, "All bytes must be counted");
+    ss_info_dassert(client->read_size > MXS_MIN_NW_READ_BUFFER_SIZE, "Read size must grow");
+    ss_info_dassert(client->stats.n_reads < nread / MXS_MIN_NW_READ_BUFFER_SIZE,
+                    "Reads must use the grown buffers");
+    ss_dfprintf(stderr, "\t..done\n");
+
+    client->state = DCB_STATE_NOPOLLING;
+    dcb_close(client);
+    dcb_process_zombies(0);
+    close(sv[1]);
+
+    return 0;
+}
+
 int main(int argc, char **argv)
 {
     int result = 0;
@@ -89,6 +363,10 @@ int main(int argc, char **argv)
     dcb_global_init();
 
     result += test1();
+    result += test2();
+    result += test3();
+    result += test4();
+    result += test5();
 
     exit(result);
 }
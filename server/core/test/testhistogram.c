@@ -0,0 +1,152 @@
+/*
+ * Copyright (c) 2016 MariaDB Corporation Ab
+ *
+ * Use of this software is governed by the Business Source License included
+ * in the LICENSE.TXT file and at www.mariadb.com/bsl11.
+ *
+ * Change Date: 2019-07-01
+ *
+ * On the date above, in accordance with the Business Source License, use
+ * of this software will be governed by version 2 or later of the General
+ * Public License.
+ */
+
+// To ensure that ss_info_assert asserts also when builing in non-debug mode.
+#if !defined(SS_DEBUG)
+#define SS_DEBUG
+#endif
+#if defined(NDEBUG)
+#undef NDEBUG
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <maxscale/config.h>
+#include <maxscale/debug.h>
+#include <maxscale/histogram.h>
+#include <maxscale/metrics.h>
+
+#define N_THREADS 4
+
+/**
+ * Every value falls into a bucket whose bounds contain it
+ */
+static int test_buckets()
+{
+    int prev = 0;
+
+    for (uint64_t value = 0; value < 100000; value++)
+    {
+        int bucket = mxs_histogram_bucket(value);
+        ss_info_dassert(bucket >= prev, "Buckets should be in ascending order");
+        ss_info_dassert(bucket < MXS_HISTOGRAM_BUCKETS, "Bucket should be valid");
+        ss_info_dassert(mxs_histogram_bucket_lower(bucket) <= value,
+                        "Value should not be below the bucket");
+        ss_info_dassert(mxs_histogram_bucket_lower(bucket + 1) > value,
+                        "Value should be below the next bucket");
+        prev = bucket;
+    }
+
+    for (int bits = 3; bits < MXS_HISTOGRAM_MAX_BITS; bits++)
+    {
+        uint64_t value = UINT64_C(1) << bits;
+        ss_info_dassert(mxs_histogram_bucket_lower(mxs_histogram_bucket(value)) == value,
+                        "Powers of two should start a bucket");
+    }
+
+    ss_info_dassert(mxs_histogram_bucket(UINT64_MAX) == MXS_HISTOGRAM_BUCKETS - 1,
+                    "Large values should go to the last bucket");
+
+    return 0;
+}
+
+/**
+ * Values recorded by different threads are combined in the snapshot
+ */
+static int test_snapshot()
+{
+    MXS_HISTOGRAM *histogram = mxs_histogram_alloc();
+    ss_info_dassert(histogram, "Histogram should be allocated");
+
+    for (int i = 0; i < 1000; i++)
+    {
+        mxs_histogram_record(histogram, i + 1, i % N_THREADS);
+    }
+
+    /** Values from unknown threads are ignored */
+    mxs_histogram_record(histogram, 5, N_THREADS);
+    mxs_histogram_record(histogram, 5, -1);
+
+    MXS_HISTOGRAM_SNAPSHOT snapshot;
+    mxs_histogram_snapshot(histogram, &snapshot);
+
+    ss_info_dassert(snapshot.count == 1000, "Snapshot should contain all values");
+    ss_info_dassert(snapshot.sum == 1000 * 1001 / 2, "Sum should match");
+    ss_info_dassert(snapshot.max == 1000, "Maximum should match");
+
+    mxs_histogram_free(histogram);
+    return 0;
+}
+
+/**
+ * Percentiles are within the precision of the buckets
+ */
+static int test_percentiles()
+{
+    MXS_HISTOGRAM *histogram = mxs_histogram_alloc();
+    MXS_HISTOGRAM_SNAPSHOT snapshot;
+
+    mxs_histogram_snapshot(histogram, &snapshot);
+    ss_info_dassert(mxs_histogram_percentile(&snapshot, 50) == 0, "Empty histogram should return 0");
+
+    for (int i = 1; i <= 10000; i++)
+    {
+        mxs_histogram_record(histogram, i, 0);
+    }
+
+    mxs_histogram_snapshot(histogram, &snapshot);
+
+    uint64_t p50 = mxs_histogram_percentile(&snapshot, 50);
+    uint64_t p99 = mxs_histogram_percentile(&snapshot, 99);
+    uint64_t p100 = mxs_histogram_percentile(&snapshot, 100);
+
+    ss_info_dassert(p50 >= 5000 && p50 <= 5000 * 1.125, "Median should be within 12.5%");
+    ss_info_dassert(p99 >= 9900 && p99 <= 9900 * 1.125, "99th percentile should be within 12.5%");
+    ss_info_dassert(p100 == 10000, "100th percentile should be the maximum");
+
+    mxs_histogram_free(histogram);
+    return 0;
+}
+
+/**
+ * Label values are escaped as the Prometheus text format requires
+ */
+static int test_escape_label()
+{
+    const char *value = "a\\b\"c\nd";
+    char escaped[2 * strlen(value) + 1];
+
+    mxs_metrics_escape_label(escaped, value);
+    ss_info_dassert(strcmp(escaped, "a\\\\b\\\"c\\nd") == 0,
+                    "Backslashes, quotes and newlines should be escaped");
+
+    mxs_metrics_escape_label(escaped, "plain");
+    ss_info_dassert(strcmp(escaped, "plain") == 0, "Other characters should be unchanged");
+
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    int result = 0;
+
+    config_get_global_options()->n_threads = N_THREADS;
+
+    result += test_buckets();
+    result += test_snapshot();
+    result += test_percentiles();
+    result += test_escape_label();
+
+    return result;
+}
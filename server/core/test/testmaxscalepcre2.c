@@ -36,6 +36,7 @@
 #include <maxscale/alloc.h>
 #include <maxscale/pcre2.h>
 #include <maxscale/debug.h>
+#include <maxscale/log_manager.h>
 
 #define test_assert(a, b) if(!(a)){fprintf(stderr, b);return 1;}
 
@@ -105,12 +106,55 @@ static int test2()
     return 0;
 }
 
+/**
+ * Test the shared, JIT compiled patterns
+ */
+static int test3()
+{
+    const char* subject = "The quick brown fox jumps over the lazy dog";
+
+    pcre2_code *re = mxs_pcre2_compile("brown.*dog", 0);
+    test_assert(re != NULL, "Pattern should compile");
+    test_assert(mxs_pcre2_compile("brown.*dog", 0) == re,
+                "Identical patterns should be shared");
+    pcre2_code *re2 = mxs_pcre2_compile("brown.*dog", PCRE2_CASELESS);
+    test_assert(re2 != NULL && re2 != re,
+                "Patterns with different options should not be shared");
+    test_assert(mxs_pcre2_compile("black.*[dog", 0) == NULL,
+                "Invalid pattern should not compile");
+
+    test_assert(mxs_pcre2_match(re, subject, PCRE2_ZERO_TERMINATED) == MXS_PCRE2_MATCH,
+                "Pattern should match");
+    test_assert(mxs_pcre2_match(re, subject, strlen("The quick brown fox")) == MXS_PCRE2_NOMATCH,
+                "Pattern should not match a partial subject");
+    test_assert(mxs_pcre2_match(re, "THE QUICK BROWN FOX JUMPS OVER THE LAZY DOG",
+                                PCRE2_ZERO_TERMINATED) == MXS_PCRE2_NOMATCH,
+                "Case sensitive pattern should not match");
+    test_assert(mxs_pcre2_match(re2, "THE QUICK BROWN FOX JUMPS OVER THE LAZY DOG",
+                                PCRE2_ZERO_TERMINATED) == MXS_PCRE2_MATCH,
+                "Pattern should match with PCRE2_CASELESS option");
+
+    /** One reference remains after the first release */
+    mxs_pcre2_release(re);
+    test_assert(mxs_pcre2_match(re, subject, PCRE2_ZERO_TERMINATED) == MXS_PCRE2_MATCH,
+                "Pattern should still match after releasing one reference");
+    mxs_pcre2_release(re);
+    mxs_pcre2_release(re2);
+    mxs_pcre2_release(NULL);
+    return 0;
+}
+
 int main(int argc, char **argv)
 {
     int result = 0;
 
+    mxs_log_init(NULL, "/tmp", MXS_LOG_TARGET_FS);
+
     result += test1();
     result += test2();
+    result += test3();
+
+    mxs_log_finish();
 
     return result;
 }
@@ -36,6 +36,8 @@
 #include <maxscale/alloc.h>
 #include <maxscale/modutil.h>
 #include <maxscale/buffer.h>
+#include <maxscale/protocol/mysql.h>
+#include <maxscale/hint.h>
 
 /**
  * test1    Allocate a service and do lots of other things
@@ -628,6 +630,225 @@ void test_bypass_whitespace()
     ss_info_dassert(*sql == 'S', "9");
 }
 
+//
+// modutil_reply_tracker_process
+//
+void test_reply_tracker()
+{
+    MXS_REPLY_TRACKER tracker;
+    GWBUF *buffer;
+
+    /** A complete result set in one buffer */
+    modutil_reply_tracker_init(&tracker, MYSQL_COM_QUERY);
+    buffer = gwbuf_alloc_and_load(sizeof(resultset), resultset);
+    ss_info_dassert(modutil_reply_tracker_process(&tracker, buffer), "Result set should be complete");
+    ss_info_dassert(tracker.rows == 1, "Result set should have one row");
+    ss_info_dassert(!tracker.error, "Result set is not an error");
+    gwbuf_free(buffer);
+
+    /** The same result set split into single bytes */
+    modutil_reply_tracker_init(&tracker, MYSQL_COM_QUERY);
+
+    for (size_t i = 0; i < sizeof(resultset); i++)
+    {
+        buffer = gwbuf_alloc_and_load(1, resultset + i);
+        bool done = modutil_reply_tracker_process(&tracker, buffer);
+        ss_info_dassert(done == (i == sizeof(resultset) - 1), "Only the last byte should complete the reply");
+        gwbuf_free(buffer);
+    }
+
+    ss_info_dassert(tracker.rows == 1, "Split result set should have one row");
+
+    /** An OK packet */
+    modutil_reply_tracker_init(&tracker, MYSQL_COM_QUERY);
+    buffer = gwbuf_alloc_and_load(sizeof(ok), ok);
+    ss_info_dassert(modutil_reply_tracker_process(&tracker, buffer), "OK should be complete");
+    ss_info_dassert(tracker.rows == 0 && !tracker.error, "OK has no rows and no error");
+    gwbuf_free(buffer);
+
+    /** An ERR packet */
+    static const uint8_t err[] = {0x09, 0x00, 0x00, 0x01, 0xff, 0x15, 0x04, '#', '2', '8', '0', '0', '0'};
+    modutil_reply_tracker_init(&tracker, MYSQL_COM_QUERY);
+    buffer = gwbuf_alloc_and_load(sizeof(err), err);
+    ss_info_dassert(modutil_reply_tracker_process(&tracker, buffer), "ERR should be complete");
+    ss_info_dassert(tracker.error, "ERR should be an error");
+    gwbuf_free(buffer);
+
+    /** LOAD DATA LOCAL INFILE is complete after the OK that follows the file */
+    static const uint8_t infile[] = {0x06, 0x00, 0x00, 0x01, 0xfb, 'a', '.', 'c', 's', 'v'};
+    modutil_reply_tracker_init(&tracker, MYSQL_COM_QUERY);
+    buffer = gwbuf_alloc_and_load(sizeof(infile), infile);
+    ss_info_dassert(!modutil_reply_tracker_process(&tracker, buffer), "File request is not the end");
+    ss_info_dassert(tracker.local_infile, "File request should be detected");
+    gwbuf_free(buffer);
+    buffer = gwbuf_alloc_and_load(sizeof(ok), ok);
+    ss_info_dassert(modutil_reply_tracker_process(&tracker, buffer), "OK after the file should be complete");
+    gwbuf_free(buffer);
+
+    /** Commands without replies are complete immediately */
+    modutil_reply_tracker_init(&tracker, MYSQL_COM_STMT_CLOSE);
+    buffer = gwbuf_alloc_and_load(sizeof(ok), ok);
+    ss_info_dassert(modutil_reply_tracker_process(&tracker, buffer), "COM_STMT_CLOSE has no reply");
+    gwbuf_free(buffer);
+
+    /** Replies to pipelined commands in one buffer */
+    size_t offset = 0;
+    buffer = gwbuf_alloc_and_load(sizeof(resultset), resultset);
+    buffer = gwbuf_append(buffer, gwbuf_alloc_and_load(sizeof(ok), ok));
+    buffer = gwbuf_append(buffer, gwbuf_alloc_and_load(sizeof(resultset), resultset));
+    modutil_reply_tracker_init(&tracker, MYSQL_COM_QUERY);
+    ss_info_dassert(modutil_reply_tracker_consume(&tracker, buffer, &offset), "First reply should be complete");
+    ss_info_dassert(offset == sizeof(resultset), "First reply should end at the OK packet");
+    modutil_reply_tracker_next(&tracker, MYSQL_COM_QUERY);
+    ss_info_dassert(modutil_reply_tracker_consume(&tracker, buffer, &offset), "Second reply should be complete");
+    ss_info_dassert(offset == sizeof(resultset) + sizeof(ok), "Second reply should be the OK packet");
+    modutil_reply_tracker_next(&tracker, MYSQL_COM_QUERY);
+    ss_info_dassert(modutil_reply_tracker_consume(&tracker, buffer, &offset), "Third reply should be complete");
+    ss_info_dassert(offset == gwbuf_length(buffer), "Third reply should end the buffer");
+    ss_info_dassert(tracker.rows == 1, "Third reply should have one row");
+    gwbuf_free(buffer);
+
+    /** A pipelined reply that starts in the middle of a split packet */
+    size_t split = sizeof(resultset) + 6;
+    uint8_t both[sizeof(resultset) + sizeof(ok)];
+    memcpy(both, resultset, sizeof(resultset));
+    memcpy(both + sizeof(resultset), ok, sizeof(ok));
+    modutil_reply_tracker_init(&tracker, MYSQL_COM_QUERY);
+    buffer = gwbuf_alloc_and_load(split, both);
+    offset = 0;
+    ss_info_dassert(modutil_reply_tracker_consume(&tracker, buffer, &offset), "Result set should be complete");
+    modutil_reply_tracker_next(&tracker, MYSQL_COM_QUERY);
+    ss_info_dassert(!modutil_reply_tracker_consume(&tracker, buffer, &offset), "OK should not be complete");
+    gwbuf_free(buffer);
+    buffer = gwbuf_alloc_and_load(sizeof(both) - split, both + split);
+    offset = 0;
+    ss_info_dassert(modutil_reply_tracker_consume(&tracker, buffer, &offset), "OK should be complete");
+    ss_info_dassert(offset == gwbuf_length(buffer), "OK should end the buffer");
+    gwbuf_free(buffer);
+
+    /** COM_STATISTICS is answered with a bare string */
+    static const uint8_t statistics[] = {0x0a, 0x00, 0x00, 0x01, 'U', 'p', 't', 'i', 'm', 'e', ':', ' ', '1', '0'};
+    modutil_reply_tracker_init(&tracker, MYSQL_COM_STATISTICS);
+    buffer = gwbuf_alloc_and_load(sizeof(statistics), statistics);
+    ss_info_dassert(modutil_reply_tracker_process(&tracker, buffer), "Statistics should be complete");
+    ss_info_dassert(!tracker.error, "Statistics is not an error");
+    gwbuf_free(buffer);
+
+    /** A COM_STMT_EXECUTE that opens a cursor ends at the EOF after the columns */
+    static const uint8_t cursor_eof[] = {0x05, 0x00, 0x00, 0x03, 0xfe, 0x00, 0x00, 0x42, 0x00};
+    uint8_t cursor[PACKET_3_IDX + sizeof(cursor_eof)];
+    memcpy(cursor, resultset, PACKET_3_IDX);
+    memcpy(cursor + PACKET_3_IDX, cursor_eof, sizeof(cursor_eof));
+    modutil_reply_tracker_init(&tracker, MYSQL_COM_STMT_EXECUTE);
+    buffer = gwbuf_alloc_and_load(sizeof(cursor), cursor);
+    ss_info_dassert(modutil_reply_tracker_process(&tracker, buffer), "Cursor execution should be complete");
+    ss_info_dassert(tracker.rows == 0, "Cursor execution should have no rows");
+    gwbuf_free(buffer);
+
+    /** Without a cursor the rows follow the same columns */
+    static const uint8_t binary_rows[] =
+    {
+        0x06, 0x00, 0x00, 0x04, 0x00, 0x00, 0xb8, 0x0b, 0x00, 0x00,
+        0x05, 0x00, 0x00, 0x05, 0xfe, 0x00, 0x00, 0x02, 0x00
+    };
+    modutil_reply_tracker_init(&tracker, MYSQL_COM_STMT_EXECUTE);
+    buffer = gwbuf_alloc_and_load(PACKET_3_IDX, resultset);
+    buffer = gwbuf_append(buffer, gwbuf_alloc_and_load(PACKET_3_LEN, resultset + PACKET_3_IDX));
+    ss_info_dassert(!modutil_reply_tracker_process(&tracker, buffer), "Rows should follow the columns");
+    gwbuf_free(buffer);
+    buffer = gwbuf_alloc_and_load(sizeof(binary_rows), binary_rows);
+    ss_info_dassert(modutil_reply_tracker_process(&tracker, buffer), "Execution should be complete");
+    ss_info_dassert(tracker.rows == 1, "Execution should have one row");
+    gwbuf_free(buffer);
+
+    /** COM_STMT_FETCH returns binary rows that start with a zero byte */
+    static const uint8_t fetch[] =
+    {
+        0x06, 0x00, 0x00, 0x01, 0x00, 0x00, 0xb8, 0x0b, 0x00, 0x00,
+        0x06, 0x00, 0x00, 0x02, 0x00, 0x00, 0xb9, 0x0b, 0x00, 0x00,
+        0x05, 0x00, 0x00, 0x03, 0xfe, 0x00, 0x00, 0x42, 0x00
+    };
+    modutil_reply_tracker_init(&tracker, MYSQL_COM_STMT_FETCH);
+
+    for (size_t i = 0; i < sizeof(fetch); i++)
+    {
+        buffer = gwbuf_alloc_and_load(1, fetch + i);
+        bool done = modutil_reply_tracker_process(&tracker, buffer);
+        ss_info_dassert(done == (i == sizeof(fetch) - 1), "Only the EOF should complete the fetch");
+        gwbuf_free(buffer);
+    }
+
+    ss_info_dassert(tracker.rows == 2 && !tracker.error, "Fetch should have two rows");
+
+    /** A failed COM_STMT_FETCH */
+    modutil_reply_tracker_init(&tracker, MYSQL_COM_STMT_FETCH);
+    buffer = gwbuf_alloc_and_load(sizeof(err), err);
+    ss_info_dassert(modutil_reply_tracker_process(&tracker, buffer), "Failed fetch should be complete");
+    ss_info_dassert(tracker.error, "Failed fetch should be an error");
+    gwbuf_free(buffer);
+}
+
+//
+// modutil_rewrite_SQL
+//
+void test_rewrite_SQL()
+{
+    MXS_REWRITE_RULE rules[] =
+    {
+        {mxs_pcre2_compile("TYPE\\s*=", 0), "ENGINE="},
+        {mxs_pcre2_compile("t([0-9])", 0), "table_$1"},
+        {mxs_pcre2_compile("no such text", 0), "x"}
+    };
+    const int n_rules = sizeof(rules) / sizeof(rules[0]);
+    bool matched[n_rules];
+    char *sql;
+    int len;
+
+    for (int i = 0; i < n_rules; i++)
+    {
+        ss_info_dassert(rules[i].re, "Pattern should compile");
+    }
+
+    /** Both matching rules are applied, the first one to two places */
+    GWBUF *buffer = modutil_create_query("CREATE TABLE t1 (id INT) TYPE = InnoDB, TYPE=MyISAM");
+    buffer->hint = hint_create_route(NULL, HINT_ROUTE_TO_MASTER, NULL);
+    GWBUF *result = modutil_rewrite_SQL(buffer, rules, n_rules, matched);
+    ss_info_dassert(result, "Statement should be rewritten");
+    ss_info_dassert(matched[0] && matched[1] && !matched[2], "Only the first two rules should match");
+    ss_info_dassert(modutil_extract_SQL(result, &sql, &len), "Result should be a COM_QUERY");
+
+    const char expected[] = "CREATE TABLE table_1 (id INT) ENGINE= InnoDB, ENGINE=MyISAM";
+    ss_info_dassert(len == sizeof(expected) - 1 && memcmp(sql, expected, len) == 0,
+                    "Rewritten statement should be as expected");
+    ss_info_dassert(GWBUF_LENGTH(result) == MYSQL_HEADER_LEN + 1 + sizeof(expected) - 1,
+                    "Result should have the exact size of the packet");
+    ss_info_dassert(result->hint && buffer->hint == NULL, "Hint should be moved to the result");
+    gwbuf_free(buffer);
+    gwbuf_free(result);
+
+    /** A statement that none of the rules match is not rewritten */
+    buffer = modutil_create_query("SELECT 1");
+    ss_info_dassert(modutil_rewrite_SQL(buffer, rules, n_rules, matched) == NULL,
+                    "Non-matching statement should not be rewritten");
+    ss_info_dassert(!matched[0] && !matched[1] && !matched[2], "No rule should match");
+    gwbuf_free(buffer);
+
+    /** A result that is much longer than the original statement */
+    MXS_REWRITE_RULE grow = {mxs_pcre2_compile("a", 0), "0123456789abcdef0123456789abcdef"};
+    buffer = modutil_create_query("aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa");
+    result = modutil_rewrite_SQL(buffer, &grow, 1, NULL);
+    ss_info_dassert(result && modutil_extract_SQL(result, &sql, &len) && len == 64 * 32,
+                    "All characters should be replaced");
+    gwbuf_free(buffer);
+    gwbuf_free(result);
+    mxs_pcre2_release(grow.re);
+
+    for (int i = 0; i < n_rules; i++)
+    {
+        mxs_pcre2_release(rules[i].re);
+    }
+}
+
 int main(int argc, char **argv)
 {
     int result = 0;
@@ -642,5 +863,7 @@ int main(int argc, char **argv)
     test_strnchr_esc_mysql();
     test_large_packets();
     test_bypass_whitespace();
+    test_reply_tracker();
+    test_rewrite_SQL();
     exit(result);
 }
@@ -0,0 +1,221 @@
+/*
+ * Copyright (c) 2016 MariaDB Corporation Ab
+ *
+ * Use of this software is governed by the Business Source License included
+ * in the LICENSE.TXT file and at www.mariadb.com/bsl11.
+ *
+ * Change Date: 2019-07-01
+ *
+ * On the date above, in accordance with the Business Source License, use
+ * of this software will be governed by version 2 or later of the General
+ * Public License.
+ */
+
+// To ensure that ss_info_assert asserts also when builing in non-debug mode.
+#if !defined(SS_DEBUG)
+#define SS_DEBUG
+#endif
+#if defined(NDEBUG)
+#undef NDEBUG
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <maxscale/debug.h>
+
+#include "../maxscale/timer.h"
+
+#define N_WHEELS 5
+
+typedef struct
+{
+    int      fired;
+    uint64_t fired_at;
+    MXS_TIMER *victim;
+} TEST_DATA;
+
+static uint64_t process_now = 0;
+
+static void test_cb(MXS_TIMER *timer, void *data)
+{
+    TEST_DATA *td = (TEST_DATA*)data;
+    td->fired++;
+    td->fired_at = process_now;
+
+    if (td->victim)
+    {
+        mxs_timer_stop(td->victim);
+    }
+}
+
+/** Advance the wheel of the calling thread to the given time */
+static int advance(uint64_t now)
+{
+    process_now = now;
+    return timer_wheel_process(now);
+}
+
+/**
+ * One-shot timers fire exactly once, in order, and not before they are due
+ */
+static int test_oneshot()
+{
+    timer_wheel_attach(0);
+    uint64_t start = mxs_timer_now();
+    TEST_DATA td[3] = {};
+    MXS_TIMER timers[3];
+
+    for (int i = 0; i < 3; i++)
+    {
+        mxs_timer_init(&timers[i], test_cb, &td[i]);
+    }
+
+    ss_info_dassert(!mxs_timer_is_active(&timers[0]), "Timer should not be active");
+    ss_info_dassert(mxs_timer_start(&timers[0], 10, 0), "Timer should start");
+    ss_info_dassert(mxs_timer_start(&timers[1], 300, 0), "Timer should start");
+    ss_info_dassert(mxs_timer_start(&timers[2], 5, 0), "Timer should start");
+    ss_info_dassert(mxs_timer_is_active(&timers[0]), "Timer should be active");
+
+    advance(start);
+    ss_info_dassert(td[0].fired == 0 && td[1].fired == 0 && td[2].fired == 0,
+                    "No timer should fire before it is due");
+
+    advance(start + 20);
+    ss_info_dassert(td[0].fired == 1 && td[2].fired == 1, "Short timers should have fired");
+    ss_info_dassert(td[1].fired == 0, "Long timer should not have fired");
+    ss_info_dassert(td[2].fired_at <= td[0].fired_at, "Timers should fire in order");
+
+    advance(start + 1000);
+    ss_info_dassert(td[0].fired == 1 && td[1].fired == 1 && td[2].fired == 1,
+                    "All timers should have fired once");
+    ss_info_dassert(!mxs_timer_is_active(&timers[1]), "Expired timer should not be active");
+
+    return 0;
+}
+
+/**
+ * Periodic timers fire once per interval until stopped
+ */
+static int test_periodic()
+{
+    timer_wheel_attach(1);
+    uint64_t start = mxs_timer_now();
+    TEST_DATA td = {};
+    MXS_TIMER timer;
+
+    mxs_timer_init(&timer, test_cb, &td);
+    mxs_timer_start(&timer, 100, 100);
+
+    for (uint64_t t = start; t <= start + 1050; t += 7)
+    {
+        advance(t);
+    }
+
+    ss_info_dassert(td.fired == 10, "Periodic timer should have fired ten times");
+    ss_info_dassert(mxs_timer_is_active(&timer), "Periodic timer should be active");
+
+    mxs_timer_stop(&timer);
+    advance(start + 5000);
+    ss_info_dassert(td.fired == 10, "Stopped timer should not fire");
+
+    return 0;
+}
+
+/**
+ * Timers far in the future are cascaded through all levels of the wheel
+ */
+static int test_cascade()
+{
+    timer_wheel_attach(2);
+    uint32_t delays[] = {255, 256, 65535, 65536, 70000, 17000000};
+    const int n_delays = sizeof(delays) / sizeof(delays[0]);
+    TEST_DATA td[n_delays];
+    MXS_TIMER timers[n_delays];
+
+    for (int i = 0; i < n_delays; i++)
+    {
+        td[i].fired = 0;
+        td[i].victim = NULL;
+        mxs_timer_init(&timers[i], test_cb, &td[i]);
+        mxs_timer_start(&timers[i], delays[i], 0);
+    }
+
+    for (int i = 0; i < n_delays; i++)
+    {
+        uint64_t due = timers[i].expires;
+        advance(due - 1);
+        ss_info_dassert(td[i].fired == 0, "Timer should not fire early");
+        advance(due);
+        ss_info_dassert(td[i].fired == 1, "Timer should fire when due");
+        ss_info_dassert(td[i].fired_at == due, "Timer should fire exactly when due");
+    }
+
+    return 0;
+}
+
+/**
+ * A timer callback can stop a timer that expires on the same tick
+ */
+static int test_stop_from_callback()
+{
+    timer_wheel_attach(3);
+    uint64_t start = mxs_timer_now();
+    TEST_DATA td[2] = {};
+    MXS_TIMER timers[2];
+
+    mxs_timer_init(&timers[0], test_cb, &td[0]);
+    mxs_timer_init(&timers[1], test_cb, &td[1]);
+    td[0].victim = &timers[1];
+    td[1].victim = &timers[0];
+
+    mxs_timer_start(&timers[0], 50, 0);
+    mxs_timer_start(&timers[1], 50, 0);
+
+    advance(start + 100);
+    ss_info_dassert(td[0].fired + td[1].fired == 1, "Only one of the timers should fire");
+    ss_info_dassert(!mxs_timer_is_active(&timers[0]) && !mxs_timer_is_active(&timers[1]),
+                    "Neither timer should be active");
+
+    return 0;
+}
+
+/**
+ * The next timeout never exceeds the time until the next expiry
+ */
+static int test_next_timeout()
+{
+    timer_wheel_attach(4);
+    TEST_DATA td = {};
+    MXS_TIMER timer;
+
+    ss_info_dassert(timer_wheel_next_timeout(1000) == 1000, "Empty wheel should not limit the timeout");
+
+    mxs_timer_init(&timer, test_cb, &td);
+    mxs_timer_start(&timer, 20, 0);
+    int timeout = timer_wheel_next_timeout(1000);
+    ss_info_dassert(timeout <= 20, "Timeout should not exceed the timer delay");
+
+    mxs_timer_start(&timer, 5000, 0);
+    timeout = timer_wheel_next_timeout(1000);
+    ss_info_dassert(timeout <= 256, "Timeout should not exceed the next cascade");
+
+    mxs_timer_stop(&timer);
+    ss_info_dassert(timer_wheel_next_timeout(1000) == 1000, "Empty wheel should not limit the timeout");
+
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    int result = 0;
+
+    ss_info_dassert(timer_wheel_init(N_WHEELS), "Timer wheels should be allocated");
+
+    result += test_oneshot();
+    result += test_periodic();
+    result += test_cascade();
+    result += test_stop_from_callback();
+    result += test_next_timeout();
+
+    return result;
+}
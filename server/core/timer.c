@@ -0,0 +1,373 @@
+/*
+ * Copyright (c) 2016 MariaDB Corporation Ab
+ *
+ * Use of this software is governed by the Business Source License included
+ * in the LICENSE.TXT file and at www.mariadb.com/bsl11.
+ *
+ * Change Date: 2019-07-01
+ *
+ * On the date above, in accordance with the Business Source License, use
+ * of this software will be governed by version 2 or later of the General
+ * Public License.
+ */
+
+/**
+ * @file timer.c  Per-thread hierarchical timer wheels
+ *
+ * Each polling thread has its own timer wheel which is advanced from the
+ * polling loop. The wheel consists of TW_LEVELS levels of TW_SLOTS slots.
+ * The slots of the first level are one millisecond apart and the slots of
+ * each following level cover a full rotation of the previous level. A timer
+ * is placed in the lowest level that can hold its expiry time and timers in
+ * the higher levels are cascaded down one level whenever the level below
+ * completes a rotation.
+ *
+ * Adding and removing a timer is O(1) and expiring a timer is amortized
+ * O(1) regardless of the number of active timers. As a wheel is only ever
+ * accessed by the thread that owns it, no locking is required.
+ */
+
+#include "maxscale/timer.h"
+
+#include <inttypes.h>
+#include <string.h>
+#include <time.h>
+
+#include <maxscale/alloc.h>
+#include <maxscale/debug.h>
+#include <maxscale/log_manager.h>
+#include <maxscale/platform.h>
+
+#define TW_LEVELS     4
+#define TW_SLOT_BITS  8
+#define TW_SLOTS      (1 << TW_SLOT_BITS)
+#define TW_SLOT_MASK  (TW_SLOTS - 1)
+
+/** The longest delay that the wheel can hold, roughly 49 days */
+#define TW_MAX_DELAY  ((UINT64_C(1) << (TW_LEVELS * TW_SLOT_BITS)) - 1)
+
+typedef struct timer_wheel
+{
+    uint64_t   now;                          /*< The next tick to process */
+    MXS_TIMER *slots[TW_LEVELS][TW_SLOTS];   /*< Timer lists */
+    MXS_TIMER *expiring;                     /*< Timers that are being fired */
+    int        n_active;                     /*< Number of active timers */
+    uint64_t   n_fired;                      /*< Number of expired timers */
+    uint64_t   n_cascaded;                   /*< Number of timers moved between levels */
+} TIMER_WHEEL;
+
+static TIMER_WHEEL *wheels = NULL;
+static int n_wheels = 0;
+static thread_local TIMER_WHEEL *current_wheel = NULL;
+static thread_local int current_wheel_id = -1;
+
+uint64_t mxs_timer_now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+bool timer_wheel_init(int n_threads)
+{
+    ss_dassert(wheels == NULL);
+    wheels = (TIMER_WHEEL*)MXS_CALLOC(n_threads, sizeof(TIMER_WHEEL));
+
+    if (wheels)
+    {
+        uint64_t now = mxs_timer_now();
+        n_wheels = n_threads;
+
+        for (int i = 0; i < n_threads; i++)
+        {
+            wheels[i].now = now;
+        }
+    }
+
+    return wheels != NULL;
+}
+
+void timer_wheel_attach(int thread_id)
+{
+    ss_dassert(thread_id >= 0 && thread_id < n_wheels);
+    current_wheel = &wheels[thread_id];
+    current_wheel_id = thread_id;
+}
+
+/**
+ * Link a timer into the slot that matches its expiry time
+ *
+ * @param wheel Wheel to add to
+ * @param timer Timer to add
+ */
+static void timer_wheel_link(TIMER_WHEEL *wheel, MXS_TIMER *timer)
+{
+    if (timer->expires < wheel->now)
+    {
+        /** Already due, fire it on the next tick */
+        timer->expires = wheel->now;
+    }
+
+    uint64_t delta = timer->expires - wheel->now;
+
+    if (delta > TW_MAX_DELAY)
+    {
+        timer->expires = wheel->now + TW_MAX_DELAY;
+        delta = TW_MAX_DELAY;
+    }
+
+    int level = 0;
+
+    while (level < TW_LEVELS - 1 && delta >= (UINT64_C(1) << ((level + 1) * TW_SLOT_BITS)))
+    {
+        level++;
+    }
+
+    MXS_TIMER **head = &wheel->slots[level][(timer->expires >> (level * TW_SLOT_BITS)) & TW_SLOT_MASK];
+
+    timer->prev = NULL;
+    timer->next = *head;
+
+    if (*head)
+    {
+        (*head)->prev = timer;
+    }
+
+    *head = timer;
+}
+
+/**
+ * Unlink a timer from the slot it is in
+ *
+ * @param wheel Wheel to remove from
+ * @param timer Timer to remove
+ */
+static void timer_wheel_unlink(TIMER_WHEEL *wheel, MXS_TIMER *timer)
+{
+    if (timer->prev)
+    {
+        timer->prev->next = timer->next;
+    }
+    else if (wheel->expiring == timer)
+    {
+        wheel->expiring = timer->next;
+    }
+    else
+    {
+        /** The timer is the head of its slot, find the slot it is in */
+        for (int level = 0; level < TW_LEVELS; level++)
+        {
+            MXS_TIMER **head = &wheel->slots[level][(timer->expires >> (level * TW_SLOT_BITS)) & TW_SLOT_MASK];
+
+            if (*head == timer)
+            {
+                *head = timer->next;
+                break;
+            }
+        }
+    }
+
+    if (timer->next)
+    {
+        timer->next->prev = timer->prev;
+    }
+
+    timer->next = NULL;
+    timer->prev = NULL;
+}
+
+/**
+ * Move the timers of one slot to lower levels
+ *
+ * @param wheel Wheel to process
+ * @param level Level to cascade from
+ *
+ * @return The index of the slot that was cascaded
+ */
+static int timer_wheel_cascade(TIMER_WHEEL *wheel, int level)
+{
+    int index = (wheel->now >> (level * TW_SLOT_BITS)) & TW_SLOT_MASK;
+    MXS_TIMER *timer = wheel->slots[level][index];
+    wheel->slots[level][index] = NULL;
+
+    while (timer)
+    {
+        MXS_TIMER *next = timer->next;
+        timer_wheel_link(wheel, timer);
+        wheel->n_cascaded++;
+        timer = next;
+    }
+
+    return index;
+}
+
+void mxs_timer_init(MXS_TIMER *timer, mxs_timer_cb_t cb, void *data)
+{
+    timer->next = NULL;
+    timer->prev = NULL;
+    timer->expires = 0;
+    timer->interval = 0;
+    timer->thread_id = -1;
+    timer->cb = cb;
+    timer->data = data;
+}
+
+bool mxs_timer_start(MXS_TIMER *timer, uint32_t delay, uint32_t interval)
+{
+    TIMER_WHEEL *wheel = current_wheel;
+
+    if (wheel == NULL)
+    {
+        MXS_ERROR("Timers can only be started from a polling thread.");
+        return false;
+    }
+
+    if (mxs_timer_is_active(timer))
+    {
+        mxs_timer_stop(timer);
+    }
+
+    timer->expires = mxs_timer_now() + delay;
+    timer->interval = interval;
+    timer->thread_id = current_wheel_id;
+    timer_wheel_link(wheel, timer);
+    wheel->n_active++;
+
+    return true;
+}
+
+void mxs_timer_stop(MXS_TIMER *timer)
+{
+    if (mxs_timer_is_active(timer))
+    {
+        ss_dassert(timer->thread_id == current_wheel_id);
+        TIMER_WHEEL *wheel = &wheels[timer->thread_id];
+        timer_wheel_unlink(wheel, timer);
+        timer->thread_id = -1;
+        wheel->n_active--;
+    }
+}
+
+int timer_wheel_process(uint64_t now)
+{
+    TIMER_WHEEL *wheel = current_wheel;
+    ss_dassert(wheel);
+    int n_fired = 0;
+
+    if (wheel->n_active == 0)
+    {
+        /** Nothing to expire, skip directly to the current time */
+        if (now >= wheel->now)
+        {
+            wheel->now = now + 1;
+        }
+
+        return 0;
+    }
+
+    while (wheel->now <= now)
+    {
+        int index = wheel->now & TW_SLOT_MASK;
+
+        /** Cascade the higher levels when the level below wraps around */
+        for (int level = 1; index == 0 && level < TW_LEVELS; level++)
+        {
+            index = timer_wheel_cascade(wheel, level);
+        }
+
+        index = wheel->now & TW_SLOT_MASK;
+        wheel->expiring = wheel->slots[0][index];
+        wheel->slots[0][index] = NULL;
+
+        /** Timers started from the callbacks must not end up in this slot */
+        wheel->now++;
+
+        /** The callbacks may stop any of the timers that are about to expire
+         * which is why the list is kept in the wheel instead of on the stack */
+        MXS_TIMER *timer;
+
+        while ((timer = wheel->expiring))
+        {
+            wheel->expiring = timer->next;
+
+            if (wheel->expiring)
+            {
+                wheel->expiring->prev = NULL;
+            }
+
+            timer->next = NULL;
+            timer->prev = NULL;
+
+            if (timer->interval)
+            {
+                timer->expires += timer->interval;
+                timer_wheel_link(wheel, timer);
+            }
+            else
+            {
+                timer->thread_id = -1;
+                wheel->n_active--;
+            }
+
+            wheel->n_fired++;
+            n_fired++;
+            timer->cb(timer, timer->data);
+        }
+
+        if (wheel->n_active == 0 && wheel->now <= now)
+        {
+            wheel->now = now + 1;
+        }
+    }
+
+    return n_fired;
+}
+
+int timer_wheel_next_timeout(int max)
+{
+    TIMER_WHEEL *wheel = current_wheel;
+    ss_dassert(wheel);
+    int rval = max;
+
+    if (wheel->n_active)
+    {
+        uint64_t now = mxs_timer_now();
+        uint64_t behind = now >= wheel->now ? now - wheel->now : 0;
+        int index = wheel->now & TW_SLOT_MASK;
+        int distance;
+
+        /** Only the slots up to the next cascade need to be inspected as
+         * any timer in the other slots expires after the cascade. */
+        for (distance = 0; index + distance < TW_SLOTS; distance++)
+        {
+            if (wheel->slots[0][index + distance])
+            {
+                break;
+            }
+        }
+
+        if ((uint64_t)distance <= behind)
+        {
+            rval = 0;
+        }
+        else if ((uint64_t)distance - behind < (uint64_t)rval)
+        {
+            rval = distance - behind;
+        }
+    }
+
+    return rval;
+}
+
+void dShowTimers(DCB *dcb)
+{
+    dcb_printf(dcb, "Timer Wheels.\n\n");
+    dcb_printf(dcb, " ID | Active     | Fired                | Cascaded\n");
+    dcb_printf(dcb, "----+------------+----------------------+---------------------\n");
+
+    for (int i = 0; i < n_wheels; i++)
+    {
+        dcb_printf(dcb, " %2d | %10d | %20" PRIu64 " | %20" PRIu64 "\n", i,
+                   wheels[i].n_active, wheels[i].n_fired, wheels[i].n_cascaded);
+    }
+}
@@ -433,23 +433,18 @@ static bool validate_user(gssapi_auth_t *auth, DCB *dcb, MYSQL_session *session,
     sprintf(sql, gssapi_auth_query, session->user, dcb->remote, session->db,
             session->db, princ_user, session->user, princ);
 
-    /**
-     * Try authentication twice; first time with the current users, second
-     * time with fresh users
-     */
-    for (int i = 0; i < 2 && !rval; i++)
+    if (sqlite3_exec(auth->handle, sql, auth_cb, &rval, &err) != SQLITE_OK)
     {
-        if (sqlite3_exec(auth->handle, sql, auth_cb, &rval, &err) != SQLITE_OK)
-        {
-            MXS_ERROR("Failed to execute auth query: %s", err);
-            sqlite3_free(err);
-            rval = false;
-        }
+        MXS_ERROR("Failed to execute auth query: %s", err);
+        sqlite3_free(err);
+        rval = false;
+    }
 
-        if (!rval)
-        {
-            service_refresh_users(dcb->service);
-        }
+    if (!rval)
+    {
+        /** The users might be out of date, refresh them in the background
+         * so that the next attempt uses fresh users */
+        service_refresh_users_async(dcb->service);
     }
 
     return rval;
@@ -729,62 +729,50 @@ void commit_sqlite_transaction(sqlite3 *handle)
     }
 }
 
-int get_users_from_server(MYSQL *con, SERVER_REF *server, SERVICE *service, SERV_LISTENER *listener)
+/**
+ * The results of the user queries executed on one backend server
+ */
+typedef struct users_result
+{
+    MYSQL_RES *users;     /**< Result of the user query */
+    MYSQL_RES *databases; /**< Result of SHOW DATABASES */
+} USERS_RESULT;
+
+/**
+ * @brief Query the users and databases of a server
+ *
+ * No changes are made to the users database, the results are stored only
+ * after all servers have been queried.
+ *
+ * @param con     Connection to the server
+ * @param server  The server reference
+ * @param service The service whose users are loaded
+ * @param res     Where the results are stored
+ *
+ * @return True if the users were queried successfully
+ */
+static bool fetch_users_from_server(MYSQL *con, SERVER_REF *server, SERVICE *service,
+                                    USERS_RESULT *res)
 {
+    res->users = NULL;
+    res->databases = NULL;
+
     if (server->server->server_string == NULL)
     {
         const char *server_string = mysql_get_server_info(con);
         if (!server_set_version_string(server->server, server_string))
         {
-            return -1;
+            return false;
         }
     }
 
     char *query = get_new_users_query(server->server->server_string, service->enable_root);
-    MYSQL_AUTH *instance = (MYSQL_AUTH*)listener->auth_instance;
-    bool anon_user = false;
-    int users = 0;
 
     if (query)
     {
         if (mxs_mysql_query(con, query) == 0)
         {
-            MYSQL_RES *result = mysql_store_result(con);
-
-            if (result)
-            {
-                start_sqlite_transaction(instance->handle);
-
-                MYSQL_ROW row;
-
-                while ((row = mysql_fetch_row(result)))
-                {
-                    if (service->strip_db_esc)
-                    {
-                        strip_escape_chars(row[2]);
-                    }
-
-                    if (strchr(row[1], '/'))
-                    {
-                        merge_netmask(row[1]);
-                    }
-
-                    add_mysql_user(instance->handle, row[0], row[1], row[2],
-                                   row[3] && strcmp(row[3], "Y") == 0, row[4]);
-                    users++;
-
-                    if (row[0] && *row[0] == '\0')
-                    {
-                        /** Empty username is used for the anonymous user. This means
-                         that localhost does not match wildcard host. */
-                        anon_user = true;
-                    }
-                }
-
-                commit_sqlite_transaction(instance->handle);
-
-                mysql_free_result(result);
-            }
+            res->users = mysql_store_result(con);
         }
         else
         {
@@ -794,30 +782,77 @@ int get_users_from_server(MYSQL *con, SERVER_REF *server, SERVICE *service, SERV
         MXS_FREE(query);
     }
 
-    /** Set the parameter if it is not configured by the user */
-    if (service->localhost_match_wildcard_host == SERVICE_PARAM_UNINIT)
+    /** Load the list of databases */
+    if (mxs_mysql_query(con, "SHOW DATABASES") == 0)
     {
-        service->localhost_match_wildcard_host = anon_user ? 0 : 1;
+        res->databases = mysql_store_result(con);
+    }
+    else
+    {
+        MXS_ERROR("Failed to load list of databases: %s", mysql_error(con));
     }
 
-    /** Load the list of databases */
-    if (mxs_mysql_query(con, "SHOW DATABASES") == 0)
+    return res->users != NULL;
+}
+
+/**
+ * @brief Store the users and databases queried from a server
+ *
+ * @param handle  SQLite handle with an open transaction
+ * @param service The service whose users are loaded
+ * @param res     Results of fetch_users_from_server(), freed by this function
+ *
+ * @return Number of users stored
+ */
+static int store_users(sqlite3 *handle, SERVICE *service, USERS_RESULT *res)
+{
+    bool anon_user = false;
+    int users = 0;
+    MYSQL_ROW row;
+
+    if (res->users)
     {
-        MYSQL_RES *result = mysql_store_result(con);
-        if (result)
+        while ((row = mysql_fetch_row(res->users)))
         {
-            MYSQL_ROW row;
-            while ((row = mysql_fetch_row(result)))
+            if (service->strip_db_esc)
+            {
+                strip_escape_chars(row[2]);
+            }
+
+            if (strchr(row[1], '/'))
             {
-                add_database(instance->handle, row[0]);
+                merge_netmask(row[1]);
             }
 
-            mysql_free_result(result);
+            add_mysql_user(handle, row[0], row[1], row[2],
+                           row[3] && strcmp(row[3], "Y") == 0, row[4]);
+            users++;
+
+            if (row[0] && *row[0] == '\0')
+            {
+                /** Empty username is used for the anonymous user. This means
+                 that localhost does not match wildcard host. */
+                anon_user = true;
+            }
+        }
+
+        mysql_free_result(res->users);
+
+        /** Set the parameter if it is not configured by the user */
+        if (service->localhost_match_wildcard_host == SERVICE_PARAM_UNINIT)
+        {
+            service->localhost_match_wildcard_host = anon_user ? 0 : 1;
         }
     }
-    else
+
+    if (res->databases)
     {
-        MXS_ERROR("Failed to load list of databases: %s", mysql_error(con));
+        while ((row = mysql_fetch_row(res->databases)))
+        {
+            add_database(handle, row[0]);
+        }
+
+        mysql_free_result(res->databases);
     }
 
     return users;
@@ -849,9 +884,10 @@ static int get_users(SERV_LISTENER *listener, bool skip_local)
         return -1;
     }
 
-    /** Delete the old users */
     MYSQL_AUTH *instance = (MYSQL_AUTH*)listener->auth_instance;
-    delete_mysql_users(instance->handle);
+    int max_results = service->n_dbref + 1;
+    USERS_RESULT results[max_results];
+    int n_results = 0;
 
     SERVER_REF *server = service->dbref;
     int total_users = -1;
@@ -881,16 +917,16 @@ static int get_users(SERV_LISTENER *listener, bool skip_local)
             else
             {
                 /** Successfully connected to a server */
-                int users = get_users_from_server(con, server, service, listener);
+                fetch_users_from_server(con, server, service, &results[n_results]);
 
-                if (users > total_users)
+                if (results[n_results].users || results[n_results].databases)
                 {
-                    total_users = users;
+                    n_results++;
                 }
 
                 mysql_close(con);
 
-                if (!service->users_from_all)
+                if (!service->users_from_all || n_results == max_results)
                 {
                     break;
                 }
@@ -900,6 +936,31 @@ static int get_users(SERV_LISTENER *listener, bool skip_local)
 
     MXS_FREE(dpwd);
 
+    /**
+     * Replace the old users in one transaction. The backend queries were
+     * done before the transaction was started which keeps it short and
+     * clients never see a partially loaded set of users. If none of the
+     * servers could be queried, the old users are kept.
+     */
+    if (n_results > 0 || no_active_servers)
+    {
+        start_sqlite_transaction(instance->handle);
+        delete_mysql_users(instance->handle);
+
+        for (int i = 0; i < n_results; i++)
+        {
+            bool has_users = results[i].users != NULL;
+            int users = store_users(instance->handle, service, &results[i]);
+
+            if (has_users && users > total_users)
+            {
+                total_users = users;
+            }
+        }
+
+        commit_sqlite_transaction(instance->handle);
+    }
+
     if (no_active_servers)
     {
         // This service has no servers or all servers are local MaxScale services
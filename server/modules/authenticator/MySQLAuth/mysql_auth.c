@@ -183,6 +183,8 @@ static void* mysql_auth_init(char **options)
         instance->cache_dir = NULL;
         instance->inject_service_user = true;
         instance->skip_auth = false;
+        instance->refresh_policy = MYSQL_AUTH_REFRESH_WAIT;
+        instance->check_permissions = false;
         instance->handle = NULL;
 
         for (int i = 0; options[i]; i++)
@@ -209,6 +211,22 @@ static void* mysql_auth_init(char **options)
                 {
                     instance->skip_auth = config_truth_value(value);
                 }
+                else if (strcmp(options[i], "refresh_policy") == 0)
+                {
+                    if (strcmp(value, "wait") == 0)
+                    {
+                        instance->refresh_policy = MYSQL_AUTH_REFRESH_WAIT;
+                    }
+                    else if (strcmp(value, "reject") == 0)
+                    {
+                        instance->refresh_policy = MYSQL_AUTH_REFRESH_REJECT;
+                    }
+                    else
+                    {
+                        MXS_ERROR("Invalid value for 'refresh_policy': %s", value);
+                        error = true;
+                    }
+                }
                 else
                 {
                     MXS_ERROR("Unknown authenticator option: %s", options[i]);
@@ -240,6 +258,10 @@ static void* mysql_auth_create(void *instance)
     if (rval)
     {
         rval->handle = NULL;
+        rval->packet = NULL;
+        rval->refresh_ticket = 0;
+        rval->parked_at = 0;
+        mxs_timer_init(&rval->park_timer, NULL, NULL);
     }
 
     return rval;
@@ -250,11 +272,63 @@ static void mysql_auth_destroy(void *data)
     mysql_auth_t *auth = (mysql_auth_t*)data;
     if (auth)
     {
+        mxs_timer_stop(&auth->park_timer);
+        gwbuf_free(auth->packet);
         sqlite3_close_v2(auth->handle);
         MXS_FREE(auth);
     }
 }
 
+/**
+ * @brief Resume a parked client
+ *
+ * Once the users have been refreshed, or the client has waited for too long,
+ * the stored authentication packet is delivered to the client DCB again so
+ * that the authentication is retried with the new users.
+ *
+ * @param timer The park timer
+ * @param data  The client DCB
+ */
+static void mysql_auth_check_parked(MXS_TIMER *timer, void *data)
+{
+    DCB *dcb = (DCB*)data;
+    mysql_auth_t *auth_ses = (mysql_auth_t*)dcb->authenticator_data;
+
+    if (dcb->state != DCB_STATE_POLLING)
+    {
+        mxs_timer_stop(timer);
+    }
+    else if (service_users_refreshed(dcb->service, auth_ses->refresh_ticket) ||
+             mxs_timer_now() - auth_ses->parked_at >= MYSQL_AUTH_PARK_TIMEOUT)
+    {
+        mxs_timer_stop(timer);
+        poll_add_epollin_event_to_dcb(dcb, auth_ses->packet);
+        auth_ses->packet = NULL;
+    }
+}
+
+/**
+ * @brief Park a client until the users have been refreshed
+ *
+ * @param dcb Client DCB
+ * @return True if the client was parked
+ */
+static bool mysql_auth_park_client(DCB *dcb)
+{
+    mysql_auth_t *auth_ses = (mysql_auth_t*)dcb->authenticator_data;
+    bool rval = false;
+
+    if (auth_ses->packet)
+    {
+        mxs_timer_init(&auth_ses->park_timer, mysql_auth_check_parked, dcb);
+        auth_ses->parked_at = mxs_timer_now();
+        rval = mxs_timer_start(&auth_ses->park_timer, MYSQL_AUTH_PARK_INTERVAL,
+                               MYSQL_AUTH_PARK_INTERVAL);
+    }
+
+    return rval;
+}
+
 static bool is_localhost_address(struct sockaddr_storage *addr)
 {
     bool rval = false;
@@ -285,8 +359,10 @@ static bool is_localhost_address(struct sockaddr_storage *addr)
  * First call the SSL authentication function, passing the DCB and a boolean
  * indicating whether the client is SSL capable. If SSL authentication is
  * successful, check whether connection is complete. Fail if we do not have a
- * user name.  Call other functions to validate the user, reloading the user
- * data if the first attempt fails.
+ * user name.  Call other functions to validate the user. If the first attempt
+ * fails, a background refresh of the users is requested and, depending on the
+ * refresh policy, the client is either parked until the refresh is complete
+ * or rejected immediately.
  *
  * @param dcb Request handler DCB connected to the client
  * @return Authentication status
@@ -329,14 +405,21 @@ mysql_auth_authenticate(DCB *dcb)
 
         MYSQL_AUTH *instance = (MYSQL_AUTH*)dcb->listener->auth_instance;
 
+        mysql_auth_t *auth_ses = (mysql_auth_t*)dcb->authenticator_data;
+
         auth_ret = validate_mysql_user(instance, dcb, client_data,
                                        protocol->scramble, sizeof(protocol->scramble));
 
-        if (auth_ret != MXS_AUTH_SUCCEEDED &&
-            service_refresh_users(dcb->service) == 0)
+        if (auth_ret != MXS_AUTH_SUCCEEDED && auth_ses->refresh_ticket == 0)
         {
-            auth_ret = validate_mysql_user(instance, dcb, client_data,
-                                           protocol->scramble, sizeof(protocol->scramble));
+            /** The users might be out of date, refresh them without blocking this thread */
+            auth_ses->refresh_ticket = service_refresh_users_async(dcb->service);
+
+            if (instance->refresh_policy == MYSQL_AUTH_REFRESH_WAIT &&
+                mysql_auth_park_client(dcb))
+            {
+                auth_ret = MXS_AUTH_INCOMPLETE;
+            }
         }
 
         /* on successful authentication, set user into dcb field */
@@ -346,7 +429,7 @@ mysql_auth_authenticate(DCB *dcb)
             dcb->user = MXS_STRDUP_A(client_data->user);
             /** Send an OK packet to the client */
         }
-        else if (dcb->service->log_auth_warnings)
+        else if (auth_ret != MXS_AUTH_INCOMPLETE && dcb->service->log_auth_warnings)
         {
             MXS_WARNING("%s: login attempt for user '%s'@[%s]:%d, authentication failed.",
                         dcb->service->name, client_data->user, dcb->remote, dcb_get_port(dcb));
@@ -406,6 +489,15 @@ mysql_auth_set_protocol_data(DCB *dcb, GWBUF *buf)
         }
     }
 
+    MYSQL_AUTH *instance = (MYSQL_AUTH*)dcb->listener->auth_instance;
+
+    if (instance->refresh_policy == MYSQL_AUTH_REFRESH_WAIT && auth_ses->refresh_ticket == 0)
+    {
+        /** Keep the packet in case the client needs to be parked */
+        gwbuf_free(auth_ses->packet);
+        auth_ses->packet = gwbuf_clone(buf);
+    }
+
     protocol = DCB_PROTOCOL(dcb, MySQLProtocol);
     CHK_PROTOCOL(protocol);
 
@@ -592,10 +684,43 @@ static bool add_service_user(SERV_LISTENER *port)
     return rval;
 }
 
+/** @brief Callback for counting the cached users */
+static int count_cb(void *data, int columns, char** rows, char** row_names)
+{
+    int *count = (int*)data;
+    *count = rows[0] ? atoi(rows[0]) : 0;
+    return 0;
+}
+
+/**
+ * @brief Count the users stored in the users database
+ *
+ * @param handle SQLite handle
+ * @return Number of users
+ */
+static int count_cached_users(sqlite3 *handle)
+{
+    int count = 0;
+    char *err;
+
+    if (sqlite3_exec(handle, "SELECT COUNT(*) FROM " MYSQLAUTH_USERS_TABLE_NAME,
+                     count_cb, &count, &err) != SQLITE_OK)
+    {
+        MXS_ERROR("Failed to count cached users: %s", err);
+        sqlite3_free(err);
+    }
+
+    return count;
+}
+
 /**
  * @brief Load MySQL authentication users
  *
- * This function loads MySQL users from the backend database.
+ * This function loads MySQL users from the backend database. When the
+ * listener is started and users persisted by a previous run are found in the
+ * cache, the cached users are used and the users are loaded from the backend
+ * database in the background. The permissions of the service user are then
+ * checked by the background load.
  *
  * @param port Listener definition
  * @return MXS_AUTH_LOADUSERS_OK on success, MXS_AUTH_LOADUSERS_ERROR and
@@ -613,12 +738,43 @@ static int mysql_auth_load_users(SERV_LISTENER *port)
         skip_local = true;
         char path[PATH_MAX];
         get_database_path(port, path, sizeof(path));
-        if (!check_service_permissions(port->service) ||
-            !open_instance_database(path, &instance->handle))
+
+        if (!open_instance_database(path, &instance->handle))
+        {
+            return MXS_AUTH_LOADUSERS_FATAL;
+        }
+
+        int cached = count_cached_users(instance->handle);
+
+        if (cached > 0)
         {
+            MXS_NOTICE("[%s] Using %d cached users for listener %s until the users "
+                       "have been loaded from the backend servers.",
+                       service->name, cached, port->name);
+            instance->check_permissions = true;
+            service_refresh_users_async(service);
+            return MXS_AUTH_LOADUSERS_OK;
+        }
+
+        if (!check_service_permissions(port->service))
+        {
+            sqlite3_close_v2(instance->handle);
+            instance->handle = NULL;
             return MXS_AUTH_LOADUSERS_FATAL;
         }
     }
+    else if (instance->check_permissions)
+    {
+        /** The listener was started with cached users. The service keeps
+         * running, the check only reports the errors. */
+        instance->check_permissions = false;
+
+        if (!check_service_permissions(port->service))
+        {
+            MXS_ERROR("[%s] The service user does not have the permissions required to "
+                      "load the users for listener %s.", service->name, port->name);
+        }
+    }
 
     int loaded = replace_mysql_users(port, skip_local);
     bool injected = false;
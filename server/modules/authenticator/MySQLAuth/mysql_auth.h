@@ -34,6 +34,7 @@
 #include <maxscale/buffer.h>
 #include <maxscale/service.h>
 #include <maxscale/sqlite3.h>
+#include <maxscale/timer.h>
 #include <maxscale/protocol/mysql.h>
 
 MXS_BEGIN_DECLS
@@ -104,18 +105,37 @@ static int db_flags = SQLITE_OPEN_READWRITE |
                       SQLITE_OPEN_CREATE |
                       SQLITE_OPEN_SHAREDCACHE;
 
+/** How often a parked client checks whether the users have been refreshed */
+#define MYSQL_AUTH_PARK_INTERVAL 50
+
+/** Maximum time a client is parked while the users are refreshed, in milliseconds */
+#define MYSQL_AUTH_PARK_TIMEOUT 10000
+
+/** What is done to a client whose authentication fails before the users are refreshed */
+typedef enum mysql_auth_refresh_policy
+{
+    MYSQL_AUTH_REFRESH_WAIT,  /**< Park the client until the refresh is complete */
+    MYSQL_AUTH_REFRESH_REJECT /**< Reject the client immediately */
+} mysql_auth_refresh_policy_t;
+
 typedef struct mysql_auth
 {
     sqlite3 *handle;          /**< SQLite3 database handle */
     char *cache_dir;          /**< Custom cache directory location */
     bool inject_service_user; /**< Inject the service user into the list of users */
     bool skip_auth;           /**< Authentication will always be successful */
+    mysql_auth_refresh_policy_t refresh_policy; /**< Handling of failed authentications */
+    bool check_permissions;   /**< Check the service permissions when the users are next loaded */
 } MYSQL_AUTH;
 
 /** Common structure for both backend and client authenticators */
 typedef struct gssapi_auth
 {
     sqlite3 *handle;              /**< SQLite3 database handle */
+    GWBUF *packet;                /**< Latest authentication packet, kept while parked */
+    uint64_t refresh_ticket;      /**< The user refresh the client waits for, 0 if none */
+    uint64_t parked_at;           /**< When the client was parked */
+    MXS_TIMER park_timer;         /**< Checks whether a parked client can be resumed */
 } mysql_auth_t;
 
 /**
@@ -21,7 +21,7 @@
 #include <string.h>
 #include <maxscale/hint.h>
 #include <maxscale/query_classifier.h>
-#include <regex.h>
+#include <maxscale/pcre2.h>
 #include <maxscale/alloc.h>
 
 /**
@@ -80,8 +80,8 @@ typedef struct
     int count;       /*< Number of hints to add after each operation
                      * that modifies data. */
     LAGSTATS stats;
-    regex_t re;      /* Compiled regex text of match */
-    regex_t nore;    /* Compiled regex text of ignore */
+    pcre2_code *re;   /* Compiled regex text of match */
+    pcre2_code *nore; /* Compiled regex text of ignore */
 } CCR_INSTANCE;
 
 /**
@@ -96,9 +96,9 @@ typedef struct
 
 static const MXS_ENUM_VALUE option_values[] =
 {
-    {"ignorecase", REG_ICASE},
+    {"ignorecase", PCRE2_CASELESS},
     {"case",       0},
-    {"extended",   REG_EXTENDED},
+    {"extended",   PCRE2_EXTENDED},
     {NULL}
 };
 
@@ -182,22 +182,33 @@ createInstance(const char *name, char **options, MXS_CONFIG_PARAMETER *params)
         my_instance->stats.n_modified = 0;
 
         int cflags = config_get_enum(params, "options", option_values);
+        bool error = false;
 
         if ((my_instance->match = config_copy_string(params, "match")))
         {
-            if (regcomp(&my_instance->re, my_instance->match, cflags))
+            if ((my_instance->re = mxs_pcre2_compile(my_instance->match, cflags)) == NULL)
             {
-                MXS_ERROR("Failed to compile regex '%s'.", my_instance->match);
+                error = true;
             }
         }
 
         if ((my_instance->nomatch = config_copy_string(params, "ignore")))
         {
-            if (regcomp(&my_instance->nore, my_instance->nomatch, cflags))
+            if ((my_instance->nore = mxs_pcre2_compile(my_instance->nomatch, cflags)) == NULL)
             {
-                MXS_ERROR("Failed to compile regex '%s'.", my_instance->nomatch);
+                error = true;
             }
         }
+
+        if (error)
+        {
+            mxs_pcre2_release(my_instance->re);
+            mxs_pcre2_release(my_instance->nore);
+            MXS_FREE(my_instance->match);
+            MXS_FREE(my_instance->nomatch);
+            MXS_FREE(my_instance);
+            my_instance = NULL;
+        }
     }
 
     return (MXS_FILTER *)my_instance;
@@ -284,7 +295,7 @@ routeQuery(MXS_FILTER *instance, MXS_FILTER_SESSION *session, GWBUF *queue)
     CCR_INSTANCE *my_instance = (CCR_INSTANCE *)instance;
     CCR_SESSION  *my_session = (CCR_SESSION *)session;
     char *sql;
-    regmatch_t limits[] = {{0, 0}};
+    int len;
     time_t now = time(NULL);
 
     if (modutil_is_SQL(queue))
@@ -295,13 +306,13 @@ routeQuery(MXS_FILTER *instance, MXS_FILTER_SESSION *session, GWBUF *queue)
          */
         if (qc_query_is_type(qc_get_type_mask(queue), QUERY_TYPE_WRITE))
         {
-            if (modutil_extract_SQL(queue, &sql, &limits[0].rm_eo))
+            if (modutil_extract_SQL(queue, &sql, &len))
             {
-                if (my_instance->nomatch == NULL ||
-                    (my_instance->nomatch && regexec(&my_instance->nore, sql, 0, limits, REG_STARTEND) != 0))
+                if (my_instance->nore == NULL ||
+                    mxs_pcre2_match(my_instance->nore, sql, len) != MXS_PCRE2_MATCH)
                 {
-                    if (my_instance->match == NULL ||
-                        (my_instance->match && regexec(&my_instance->re, sql, 0, limits, REG_STARTEND) == 0))
+                    if (my_instance->re == NULL ||
+                        mxs_pcre2_match(my_instance->re, sql, len) == MXS_PCRE2_MATCH)
                     {
                         if (my_instance->count)
                         {
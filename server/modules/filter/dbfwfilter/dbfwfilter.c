@@ -1055,7 +1055,7 @@ static void rule_free_all(RULE* rule)
             break;
 
         case RT_REGEX:
-            pcre2_code_free((pcre2_code*) rule->data);
+            mxs_pcre2_release((pcre2_code*) rule->data);
             break;
 
         default:
@@ -1315,26 +1315,17 @@ bool define_limit_queries_rule(void* scanner, int max, int timeperiod, int holdo
 bool define_regex_rule(void* scanner, char* pattern)
 {
     /** This should never fail as long as the rule syntax is correct */
-    PCRE2_SPTR start = (PCRE2_SPTR) get_regex_string(&pattern);
+    const char *start = get_regex_string(&pattern);
     ss_dassert(start);
     pcre2_code *re;
-    int err;
-    size_t offset;
-    if ((re = pcre2_compile(start, PCRE2_ZERO_TERMINATED,
-                            0, &err, &offset, NULL)))
+
+    if ((re = mxs_pcre2_compile(start, 0)))
     {
         struct parser_stack* rstack = dbfw_yyget_extra((yyscan_t) scanner);
         ss_dassert(rstack);
         rstack->rule->type = RT_REGEX;
         rstack->rule->data = (void*) re;
     }
-    else
-    {
-        PCRE2_UCHAR errbuf[MXS_STRERROR_BUFLEN];
-        pcre2_get_error_message(err, errbuf, sizeof(errbuf));
-        MXS_ERROR("Invalid regular expression '%s': %s",
-                  start, errbuf);
-    }
 
     return re != NULL;
 }
@@ -1888,26 +1879,12 @@ bool match_throttle(FW_SESSION* my_session, RULE_BOOK *rulebook, char **msg)
 
 void match_regex(RULE_BOOK *rulebook, const char *query, bool *matches, char **msg)
 {
-
-    pcre2_match_data *mdata = pcre2_match_data_create_from_pattern(rulebook->rule->data, NULL);
-
-    if (mdata)
-    {
-        if (pcre2_match((pcre2_code*)rulebook->rule->data,
-                        (PCRE2_SPTR)query, PCRE2_ZERO_TERMINATED,
-                        0, 0, mdata, NULL) > 0)
-        {
-            MXS_NOTICE("rule '%s': regex matched on query", rulebook->rule->name);
-            *matches = true;
-            *msg = MXS_STRDUP_A("Permission denied, query matched regular expression.");
-        }
-
-        pcre2_match_data_free(mdata);
-    }
-    else
+    if (mxs_pcre2_match((pcre2_code*)rulebook->rule->data, query,
+                        PCRE2_ZERO_TERMINATED) == MXS_PCRE2_MATCH)
     {
-        MXS_ERROR("Allocation of matching data for PCRE2 failed."
-                  " This is most likely caused by a lack of memory");
+        MXS_NOTICE("rule '%s': regex matched on query", rulebook->rule->name);
+        *matches = true;
+        *msg = MXS_STRDUP_A("Permission denied, query matched regular expression.");
     }
 }
 
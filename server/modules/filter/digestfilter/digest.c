@@ -0,0 +1,364 @@
+/*
+ * Copyright (c) 2016 MariaDB Corporation Ab
+ *
+ * Use of this software is governed by the Business Source License included
+ * in the LICENSE.TXT file and at www.mariadb.com/bsl11.
+ *
+ * Change Date: 2019-07-01
+ *
+ * On the date above, in accordance with the Business Source License, use
+ * of this software will be governed by version 2 or later of the General
+ * Public License.
+ */
+
+/**
+ * @file digest.c  Statement normalization for the digest filter
+ */
+
+#include "digest.h"
+
+#include <ctype.h>
+#include <stdbool.h>
+#include <string.h>
+
+/** The class of the previous token, used to decide where spaces go */
+#define TOKEN_WORD    'a'
+#define TOKEN_LITERAL '?'
+
+typedef struct canonical
+{
+    char   *dest;               /**< Output buffer */
+    size_t  size;               /**< Usable size of the buffer */
+    size_t  len;                /**< Bytes written so far */
+    size_t  literal_start;      /**< Where the latest literal starts */
+    char    last;               /**< Class of the previous token */
+    bool    comma_after_literal; /**< The previous token is a comma after a literal */
+} CANONICAL;
+
+static inline bool is_ident_char(char c)
+{
+    return isalnum((unsigned char)c) || c == '_' || c == '$' || (unsigned char)c >= 0x80;
+}
+
+static void append(CANONICAL *c, const char *str, size_t len)
+{
+    if (len > c->size - c->len)
+    {
+        len = c->size - c->len;
+    }
+
+    memcpy(c->dest + c->len, str, len);
+    c->len += len;
+}
+
+/**
+ * Separate a new token from the previous one. Commas, closing parentheses
+ * and dots are attached to the previous token and nothing is placed after
+ * opening parentheses, dots and variable markers.
+ */
+static void start_token(CANONICAL *c, char first)
+{
+    if (c->len > 0 &&
+        first != ',' && first != ')' && first != ';' && first != '.' &&
+        c->last != '(' && c->last != '.' && c->last != '@')
+    {
+        append(c, " ", 1);
+    }
+}
+
+static void add_word(CANONICAL *c, const char *word, size_t len, bool fold)
+{
+    start_token(c, *word);
+
+    if (fold)
+    {
+        /** Unquoted keywords and identifiers are case-insensitive */
+        if (len > c->size - c->len)
+        {
+            len = c->size - c->len;
+        }
+
+        for (size_t i = 0; i < len; i++)
+        {
+            c->dest[c->len + i] = toupper((unsigned char)word[i]);
+        }
+
+        c->len += len;
+    }
+    else
+    {
+        append(c, word, len);
+    }
+
+    c->last = TOKEN_WORD;
+}
+
+static void add_literal(CANONICAL *c)
+{
+    if (c->last == ',' && c->comma_after_literal)
+    {
+        /** A list of literals, replace everything from the start of the
+         * first literal with an ellipsis */
+        c->len = c->literal_start;
+        append(c, "...", 3);
+    }
+    else
+    {
+        start_token(c, TOKEN_LITERAL);
+        c->literal_start = c->len;
+        append(c, "?", 1);
+    }
+
+    c->last = TOKEN_LITERAL;
+}
+
+static void add_punctuation(CANONICAL *c, const char *str, size_t len)
+{
+    start_token(c, *str);
+    append(c, str, len);
+    c->comma_after_literal = *str == ',' && c->last == TOKEN_LITERAL;
+    c->last = *str;
+}
+
+/**
+ * Skip a quoted string or identifier
+ *
+ * @param ptr Pointer to the opening quote
+ * @param end End of the statement
+ *
+ * @return Pointer to the first character after the closing quote
+ */
+static const char* skip_quoted(const char *ptr, const char *end)
+{
+    char quote = *ptr++;
+
+    while (ptr < end)
+    {
+        if (*ptr == '\\' && quote != '`')
+        {
+            if (end - ptr < 2)
+            {
+                break;
+            }
+            ptr += 2;
+        }
+        else if (*ptr == quote)
+        {
+            if (end - ptr >= 2 && ptr[1] == quote)
+            {
+                /** Doubled quote inside the string */
+                ptr += 2;
+            }
+            else
+            {
+                return ptr + 1;
+            }
+        }
+        else
+        {
+            ptr++;
+        }
+    }
+
+    return end;
+}
+
+/**
+ * Skip a numeric literal, including hexadecimal, binary and exponent forms
+ *
+ * @param ptr Pointer to the first character of the number
+ * @param end End of the statement
+ *
+ * @return Pointer to the first character after the number
+ */
+static const char* skip_number(const char *ptr, const char *end)
+{
+    if (*ptr == '0' && end - ptr > 2 && (ptr[1] == 'x' || ptr[1] == 'X' || ptr[1] == 'b' || ptr[1] == 'B') &&
+        isxdigit((unsigned char)ptr[2]))
+    {
+        ptr += 2;
+
+        while (ptr < end && isxdigit((unsigned char)*ptr))
+        {
+            ptr++;
+        }
+
+        return ptr;
+    }
+
+    while (ptr < end && isdigit((unsigned char)*ptr))
+    {
+        ptr++;
+    }
+
+    if (ptr < end && *ptr == '.')
+    {
+        ptr++;
+
+        while (ptr < end && isdigit((unsigned char)*ptr))
+        {
+            ptr++;
+        }
+    }
+
+    if (ptr < end && (*ptr == 'e' || *ptr == 'E'))
+    {
+        const char *exp = ptr + 1;
+
+        if (exp < end && (*exp == '+' || *exp == '-'))
+        {
+            exp++;
+        }
+
+        if (exp < end && isdigit((unsigned char)*exp))
+        {
+            ptr = exp;
+
+            while (ptr < end && isdigit((unsigned char)*ptr))
+            {
+                ptr++;
+            }
+        }
+    }
+
+    return ptr;
+}
+
+static size_t operator_length(const char *ptr, const char *end)
+{
+    static const char *operators[] =
+    {
+        "<=>", "<=", ">=", "<>", "!=", ":=", "||", "&&", "<<", ">>", "->", NULL
+    };
+
+    size_t avail = end - ptr;
+
+    for (int i = 0; operators[i]; i++)
+    {
+        size_t len = strlen(operators[i]);
+
+        if (len <= avail && memcmp(ptr, operators[i], len) == 0)
+        {
+            return len;
+        }
+    }
+
+    return 1;
+}
+
+size_t digest_canonicalize(const char *sql, size_t len, char *dest, size_t size)
+{
+    CANONICAL c = {dest, size - 1, 0, 0, 0, false};
+    const char *ptr = sql;
+    const char *end = sql + len;
+
+    while (ptr < end && c.len < c.size)
+    {
+        char ch = *ptr;
+
+        if (isspace((unsigned char)ch))
+        {
+            ptr++;
+        }
+        else if (ch == '#' || (ch == '-' && end - ptr >= 2 && ptr[1] == '-' &&
+                               (end - ptr == 2 || isspace((unsigned char)ptr[2]))))
+        {
+            while (ptr < end && *ptr != '\n')
+            {
+                ptr++;
+            }
+        }
+        else if (ch == '/' && end - ptr >= 2 && ptr[1] == '*')
+        {
+            ptr += 2;
+
+            while (ptr < end && !(*ptr == '*' && end - ptr >= 2 && ptr[1] == '/'))
+            {
+                ptr++;
+            }
+
+            ptr = ptr < end ? ptr + 2 : end;
+        }
+        else if (ch == '\'' || ch == '"')
+        {
+            ptr = skip_quoted(ptr, end);
+            add_literal(&c);
+        }
+        else if (ch == '`')
+        {
+            const char *start = ptr;
+            ptr = skip_quoted(ptr, end);
+            add_word(&c, start, ptr - start, false);
+        }
+        else if (isdigit((unsigned char)ch) ||
+                 (ch == '.' && c.last != TOKEN_WORD && end - ptr >= 2 && isdigit((unsigned char)ptr[1])))
+        {
+            const char *start = ptr;
+            ptr = skip_number(ptr, end);
+
+            if (ptr < end && is_ident_char(*ptr))
+            {
+                /** Identifiers can start with digits */
+                while (ptr < end && is_ident_char(*ptr))
+                {
+                    ptr++;
+                }
+
+                add_word(&c, start, ptr - start, true);
+            }
+            else
+            {
+                add_literal(&c);
+            }
+        }
+        else if (is_ident_char(ch))
+        {
+            const char *start = ptr;
+
+            while (ptr < end && is_ident_char(*ptr))
+            {
+                ptr++;
+            }
+
+            if (ptr - start == 1 && ptr < end && *ptr == '\'' && strchr("xXbBnN", ch))
+            {
+                /** Hexadecimal, bit or national character string literal */
+                ptr = skip_quoted(ptr, end);
+                add_literal(&c);
+            }
+            else
+            {
+                add_word(&c, start, ptr - start, true);
+            }
+        }
+        else if (ch == '?')
+        {
+            /** Placeholders are treated like literals */
+            ptr++;
+            add_literal(&c);
+        }
+        else
+        {
+            size_t n = operator_length(ptr, end);
+            add_punctuation(&c, ptr, n);
+            ptr += n;
+        }
+    }
+
+    dest[c.len] = '\0';
+    return c.len;
+}
+
+uint64_t digest_hash(const char *canonical, size_t len)
+{
+    /** 64-bit FNV-1a */
+    uint64_t hash = UINT64_C(14695981039346656037);
+
+    for (size_t i = 0; i < len; i++)
+    {
+        hash ^= (unsigned char)canonical[i];
+        hash *= UINT64_C(1099511628211);
+    }
+
+    return hash;
+}
@@ -0,0 +1,53 @@
+#pragma once
+/*
+ * Copyright (c) 2016 MariaDB Corporation Ab
+ *
+ * Use of this software is governed by the Business Source License included
+ * in the LICENSE.TXT file and at www.mariadb.com/bsl11.
+ *
+ * Change Date: 2019-07-01
+ *
+ * On the date above, in accordance with the Business Source License, use
+ * of this software will be governed by version 2 or later of the General
+ * Public License.
+ */
+
+/**
+ * @file digest.h  Statement normalization for the digest filter
+ */
+
+#include <maxscale/cdefs.h>
+#include <stdint.h>
+#include <stddef.h>
+
+MXS_BEGIN_DECLS
+
+/**
+ * @brief Convert an SQL statement into its canonical form
+ *
+ * The canonical form is produced in a single pass over the statement:
+ * comments are removed, tokens are separated by exactly one space, string
+ * and numeric literals are replaced with @c ? and lists of two or more
+ * literals are collapsed into @c ... so that statements that only differ
+ * by their values have the same canonical form.
+ *
+ * @param sql  The statement, does not need to be null terminated
+ * @param len  Length of @c sql
+ * @param dest Buffer where the canonical form is stored
+ * @param size Size of @c dest, the result is truncated to fit it
+ *
+ * @return Length of the null terminated canonical form
+ */
+size_t digest_canonicalize(const char *sql, size_t len, char *dest, size_t size);
+
+/**
+ * @brief Calculate the 64-bit digest of a canonical statement
+ *
+ * @param canonical The canonical form
+ * @param len       Length of @c canonical
+ *
+ * @return The digest
+ */
+uint64_t digest_hash(const char *canonical, size_t len);
+
+MXS_END_DECLS
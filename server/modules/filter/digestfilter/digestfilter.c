@@ -0,0 +1,989 @@
+/*
+ * Copyright (c) 2016 MariaDB Corporation Ab
+ *
+ * Use of this software is governed by the Business Source License included
+ * in the LICENSE.TXT file and at www.mariadb.com/bsl11.
+ *
+ * Change Date: 2019-07-01
+ *
+ * On the date above, in accordance with the Business Source License, use
+ * of this software will be governed by version 2 or later of the General
+ * Public License.
+ */
+
+/**
+ * @file digestfilter.c - Service-wide statement digest statistics
+ *
+ * The filter converts each statement into its canonical form, where the
+ * literal values have been replaced with placeholders, and aggregates the
+ * execution statistics of all statements with the same canonical form.
+ *
+ * Each polling thread updates its own digest table so the statistics can be
+ * recorded without contention. The tables are merged only when they are
+ * read with the module commands. Each table holds at most @c max_digests
+ * entries and the least recently used entry is evicted when a new statement
+ * shape needs room.
+ */
+
+#define MXS_MODULE_NAME "digestfilter"
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <maxscale/alloc.h>
+#include <maxscale/config.h>
+#include <maxscale/filter.h>
+#include <maxscale/histogram.h>
+#include <maxscale/log_manager.h>
+#include <maxscale/modinfo.h>
+#include <maxscale/modulecmd.h>
+#include <maxscale/modutil.h>
+#include <maxscale/poll.h>
+#include <maxscale/protocol/mysql.h>
+#include <maxscale/resultset.h>
+#include <maxscale/spinlock.h>
+
+#include "digest.h"
+
+/** Latencies are stored in power of two buckets up to 2^31 microseconds */
+#define DIGEST_BUCKETS 32
+
+/** The default number of rows returned by the top command */
+#define DEFAULT_TOP_ROWS 20
+
+typedef struct digest_entry
+{
+    uint64_t             digest;
+    char                *canonical;
+    uint64_t             count;     /**< Number of executions */
+    uint64_t             total;     /**< Total latency in microseconds */
+    uint64_t             min;       /**< Smallest latency */
+    uint64_t             max;       /**< Largest latency */
+    uint64_t             rows;      /**< Rows returned */
+    uint64_t             errors;    /**< Executions that returned an error */
+    uint64_t             buckets[DIGEST_BUCKETS];
+    struct digest_entry *hash_next; /**< Next entry in the hash chain */
+    struct digest_entry *lru_prev;  /**< More recently used entry */
+    struct digest_entry *lru_next;  /**< Less recently used entry */
+} DIGEST_ENTRY;
+
+/**
+ * The digest table of one thread. The lock is only contended when the
+ * statistics are being read.
+ */
+typedef struct digest_shard
+{
+    SPINLOCK       lock;
+    DIGEST_ENTRY **table;
+    size_t         table_size;  /**< Number of hash chains, a power of two */
+    DIGEST_ENTRY  *lru_head;
+    DIGEST_ENTRY  *lru_tail;
+    int            n_entries;
+    uint64_t       n_evicted;
+} DIGEST_SHARD;
+
+typedef struct
+{
+    int            max_digests;  /**< Maximum number of digests per thread */
+    size_t         max_length;   /**< Maximum length of the canonical form */
+    DIGEST_SHARD **shards;
+    int            n_shards;
+} DIGEST_INSTANCE;
+
+typedef struct
+{
+    MXS_DOWNSTREAM down;
+    MXS_UPSTREAM   up;
+    char          *canonical;   /**< Canonical form of the current statement */
+    size_t         canonical_len;
+    uint64_t       digest;
+    uint64_t       start;       /**< When the statement was routed */
+    bool           active;      /**< A statement is being tracked */
+    MXS_REPLY_TRACKER reply;    /**< Progress of the reply */
+} DIGEST_SESSION;
+
+static MXS_FILTER *createInstance(const char *name, char **options, MXS_CONFIG_PARAMETER *params);
+static MXS_FILTER_SESSION *newSession(MXS_FILTER *instance, MXS_SESSION *session);
+static void closeSession(MXS_FILTER *instance, MXS_FILTER_SESSION *session);
+static void freeSession(MXS_FILTER *instance, MXS_FILTER_SESSION *session);
+static void setDownstream(MXS_FILTER *instance, MXS_FILTER_SESSION *fsession, MXS_DOWNSTREAM *downstream);
+static void setUpstream(MXS_FILTER *instance, MXS_FILTER_SESSION *fsession, MXS_UPSTREAM *upstream);
+static int routeQuery(MXS_FILTER *instance, MXS_FILTER_SESSION *fsession, GWBUF *queue);
+static int clientReply(MXS_FILTER *instance, MXS_FILTER_SESSION *fsession, GWBUF *queue);
+static void diagnostic(MXS_FILTER *instance, MXS_FILTER_SESSION *fsession, DCB *dcb);
+static uint64_t getCapabilities(MXS_FILTER* instance);
+
+static bool digest_command_top(const MODULECMD_ARG *argv);
+static bool digest_command_top_json(const MODULECMD_ARG *argv);
+static bool digest_command_reset(const MODULECMD_ARG *argv);
+
+/**
+ * The module entry point routine.
+ *
+ * @return The module object
+ */
+MXS_MODULE* MXS_CREATE_MODULE()
+{
+    static modulecmd_arg_type_t top_args[] =
+    {
+        {MODULECMD_ARG_OUTPUT, "DCB where the result is written"},
+        {MODULECMD_ARG_FILTER | MODULECMD_ARG_NAME_MATCHES_DOMAIN, "Filter to inspect"},
+        {MODULECMD_ARG_STRING | MODULECMD_ARG_OPTIONAL,
+         "Sort by: count, total, avg, max, rows or errors (default: total)"},
+        {MODULECMD_ARG_STRING | MODULECMD_ARG_OPTIONAL, "Number of rows to show (default: 20)"}
+    };
+
+    modulecmd_register_command(MXS_MODULE_NAME, "top", digest_command_top, 4, top_args);
+    modulecmd_register_command(MXS_MODULE_NAME, "top/json", digest_command_top_json, 4, top_args);
+
+    static modulecmd_arg_type_t reset_args[] =
+    {
+        {MODULECMD_ARG_FILTER | MODULECMD_ARG_NAME_MATCHES_DOMAIN, "Filter to reset"}
+    };
+
+    modulecmd_register_command(MXS_MODULE_NAME, "reset", digest_command_reset, 1, reset_args);
+
+    static MXS_FILTER_OBJECT MyObject =
+    {
+        createInstance,
+        newSession,
+        closeSession,
+        freeSession,
+        setDownstream,
+        setUpstream,
+        routeQuery,
+        clientReply,
+        diagnostic,
+        getCapabilities,
+        NULL, // No destroyInstance
+    };
+
+    static MXS_MODULE info =
+    {
+        MXS_MODULE_API_FILTER,
+        MXS_MODULE_IN_DEVELOPMENT,
+        MXS_FILTER_VERSION,
+        "Service-wide statement digest statistics",
+        "V1.0.0",
+        &MyObject,
+        NULL, /* Process init. */
+        NULL, /* Process finish. */
+        NULL, /* Thread init. */
+        NULL, /* Thread finish. */
+        {
+            {"max_digests", MXS_MODULE_PARAM_COUNT, "1000"},
+            {"max_length", MXS_MODULE_PARAM_COUNT, "1024"},
+            {MXS_END_MODULE_PARAMS}
+        }
+    };
+
+    return &info;
+}
+
+/**
+ * Free all entries of a shard. The caller must hold the shard lock.
+ */
+static void shard_clear(DIGEST_SHARD *shard)
+{
+    DIGEST_ENTRY *entry = shard->lru_head;
+
+    while (entry)
+    {
+        DIGEST_ENTRY *next = entry->lru_next;
+        MXS_FREE(entry->canonical);
+        MXS_FREE(entry);
+        entry = next;
+    }
+
+    memset(shard->table, 0, shard->table_size * sizeof(DIGEST_ENTRY*));
+    shard->lru_head = NULL;
+    shard->lru_tail = NULL;
+    shard->n_entries = 0;
+}
+
+static void free_instance(DIGEST_INSTANCE *inst)
+{
+    if (inst->shards)
+    {
+        for (int i = 0; i < inst->n_shards; i++)
+        {
+            if (inst->shards[i])
+            {
+                if (inst->shards[i]->table)
+                {
+                    shard_clear(inst->shards[i]);
+                }
+                MXS_FREE(inst->shards[i]->table);
+                MXS_FREE(inst->shards[i]);
+            }
+        }
+
+        MXS_FREE(inst->shards);
+    }
+
+    MXS_FREE(inst);
+}
+
+/**
+ * Create an instance of the filter for a particular service
+ * within MaxScale.
+ *
+ * @param name      The name of the instance (as defined in the config file).
+ * @param options   The options for this filter
+ * @param params    The array of name/value pair parameters for the filter
+ *
+ * @return The instance data for this new instance
+ */
+static MXS_FILTER *
+createInstance(const char *name, char **options, MXS_CONFIG_PARAMETER *params)
+{
+    DIGEST_INSTANCE *my_instance = (DIGEST_INSTANCE*)MXS_CALLOC(1, sizeof(DIGEST_INSTANCE));
+
+    if (my_instance == NULL)
+    {
+        return NULL;
+    }
+
+    my_instance->max_digests = config_get_integer(params, "max_digests");
+    my_instance->max_length = config_get_integer(params, "max_length");
+    my_instance->n_shards = config_threadcount() > 0 ? config_threadcount() : 1;
+
+    if (my_instance->max_digests < 1 || my_instance->max_length < 16)
+    {
+        MXS_ERROR("The value of 'max_digests' must be at least 1 and the value "
+                  "of 'max_length' must be at least 16.");
+        free_instance(my_instance);
+        return NULL;
+    }
+
+    /** Keep the hash chains short */
+    size_t table_size = 16;
+
+    while (table_size < (size_t)my_instance->max_digests * 2)
+    {
+        table_size *= 2;
+    }
+
+    my_instance->shards = (DIGEST_SHARD**)MXS_CALLOC(my_instance->n_shards, sizeof(DIGEST_SHARD*));
+    bool error = my_instance->shards == NULL;
+
+    for (int i = 0; !error && i < my_instance->n_shards; i++)
+    {
+        /** The shards are allocated separately so that no two threads
+         * write to the same cache line */
+        DIGEST_SHARD *shard = (DIGEST_SHARD*)MXS_CALLOC(1, sizeof(DIGEST_SHARD));
+
+        if (shard)
+        {
+            my_instance->shards[i] = shard;
+            spinlock_init(&shard->lock);
+            shard->table_size = table_size;
+            shard->table = (DIGEST_ENTRY**)MXS_CALLOC(table_size, sizeof(DIGEST_ENTRY*));
+        }
+
+        error = shard == NULL || shard->table == NULL;
+    }
+
+    if (error)
+    {
+        free_instance(my_instance);
+        return NULL;
+    }
+
+    return (MXS_FILTER*)my_instance;
+}
+
+/**
+ * Associate a new session with this instance of the filter.
+ *
+ * @param instance  The filter instance data
+ * @param session   The session itself
+ * @return Session specific data for this session
+ */
+static MXS_FILTER_SESSION *
+newSession(MXS_FILTER *instance, MXS_SESSION *session)
+{
+    DIGEST_INSTANCE *my_instance = (DIGEST_INSTANCE*)instance;
+    DIGEST_SESSION *my_session = (DIGEST_SESSION*)MXS_CALLOC(1, sizeof(DIGEST_SESSION));
+
+    if (my_session)
+    {
+        if ((my_session->canonical = (char*)MXS_MALLOC(my_instance->max_length + 1)) == NULL)
+        {
+            MXS_FREE(my_session);
+            return NULL;
+        }
+
+    }
+
+    return (MXS_FILTER_SESSION*)my_session;
+}
+
+/**
+ * Close a session with the filter
+ *
+ * @param instance  The filter instance data
+ * @param session   The session being closed
+ */
+static void
+closeSession(MXS_FILTER *instance, MXS_FILTER_SESSION *session)
+{
+}
+
+/**
+ * Free the memory associated with the session
+ *
+ * @param instance  The filter instance
+ * @param session   The filter session
+ */
+static void
+freeSession(MXS_FILTER *instance, MXS_FILTER_SESSION *session)
+{
+    DIGEST_SESSION *my_session = (DIGEST_SESSION*)session;
+
+    MXS_FREE(my_session->canonical);
+    MXS_FREE(my_session);
+}
+
+/**
+ * Set the downstream filter or router to which queries will be
+ * passed from this filter.
+ *
+ * @param instance  The filter instance data
+ * @param session   The filter session
+ * @param downstream    The downstream filter or router.
+ */
+static void
+setDownstream(MXS_FILTER *instance, MXS_FILTER_SESSION *session, MXS_DOWNSTREAM *downstream)
+{
+    DIGEST_SESSION *my_session = (DIGEST_SESSION*)session;
+
+    my_session->down = *downstream;
+}
+
+/**
+ * Set the upstream filter or session to which results will be
+ * passed from this filter.
+ *
+ * @param instance  The filter instance data
+ * @param session   The filter session
+ * @param upstream  The upstream filter or session.
+ */
+static void
+setUpstream(MXS_FILTER *instance, MXS_FILTER_SESSION *session, MXS_UPSTREAM *upstream)
+{
+    DIGEST_SESSION *my_session = (DIGEST_SESSION*)session;
+
+    my_session->up = *upstream;
+}
+
+/**
+ * The routeQuery entry point. The canonical form of each text protocol
+ * statement is calculated and the reply to it is tracked.
+ *
+ * @param instance  The filter instance data
+ * @param session   The filter session
+ * @param queue     The query data
+ */
+static int
+routeQuery(MXS_FILTER *instance, MXS_FILTER_SESSION *session, GWBUF *queue)
+{
+    DIGEST_INSTANCE *my_instance = (DIGEST_INSTANCE*)instance;
+    DIGEST_SESSION *my_session = (DIGEST_SESSION*)session;
+    char *sql;
+    int len;
+
+    my_session->active = false;
+
+    if (modutil_is_SQL(queue) && modutil_extract_SQL(queue, &sql, &len))
+    {
+        my_session->canonical_len = digest_canonicalize(sql, len, my_session->canonical,
+                                                        my_instance->max_length + 1);
+        my_session->digest = digest_hash(my_session->canonical, my_session->canonical_len);
+        my_session->start = mxs_histogram_now();
+        my_session->active = true;
+        modutil_reply_tracker_init(&my_session->reply, MYSQL_COM_QUERY);
+    }
+
+    /* Pass the query downstream */
+    return my_session->down.routeQuery(my_session->down.instance,
+                                       my_session->down.session, queue);
+}
+
+/**
+ * Move an entry to the head of the LRU list
+ */
+static void lru_touch(DIGEST_SHARD *shard, DIGEST_ENTRY *entry)
+{
+    if (shard->lru_head == entry)
+    {
+        return;
+    }
+
+    if (entry->lru_prev)
+    {
+        entry->lru_prev->lru_next = entry->lru_next;
+    }
+
+    if (entry->lru_next)
+    {
+        entry->lru_next->lru_prev = entry->lru_prev;
+    }
+    else if (shard->lru_tail == entry)
+    {
+        shard->lru_tail = entry->lru_prev;
+    }
+
+    entry->lru_prev = NULL;
+    entry->lru_next = shard->lru_head;
+
+    if (shard->lru_head)
+    {
+        shard->lru_head->lru_prev = entry;
+    }
+
+    shard->lru_head = entry;
+
+    if (shard->lru_tail == NULL)
+    {
+        shard->lru_tail = entry;
+    }
+}
+
+/**
+ * Remove the least recently used entry from a shard
+ *
+ * @return The removed entry
+ */
+static DIGEST_ENTRY* lru_evict(DIGEST_SHARD *shard)
+{
+    DIGEST_ENTRY *entry = shard->lru_tail;
+    DIGEST_ENTRY **ptr = &shard->table[entry->digest & (shard->table_size - 1)];
+
+    while (*ptr != entry)
+    {
+        ptr = &(*ptr)->hash_next;
+    }
+
+    *ptr = entry->hash_next;
+    shard->lru_tail = entry->lru_prev;
+
+    if (shard->lru_tail)
+    {
+        shard->lru_tail->lru_next = NULL;
+    }
+    else
+    {
+        shard->lru_head = NULL;
+    }
+
+    shard->n_entries--;
+    shard->n_evicted++;
+
+    return entry;
+}
+
+/**
+ * Add the statistics of the completed statement to the digest table of
+ * the calling thread.
+ */
+static void digest_record(DIGEST_INSTANCE *inst, DIGEST_SESSION *ses)
+{
+    uint64_t latency = mxs_histogram_now() - ses->start;
+    int id = poll_get_thread_id();
+    DIGEST_SHARD *shard = inst->shards[id >= 0 && id < inst->n_shards ? id : 0];
+
+    spinlock_acquire(&shard->lock);
+
+    DIGEST_ENTRY **head = &shard->table[ses->digest & (shard->table_size - 1)];
+    DIGEST_ENTRY *entry = *head;
+
+    while (entry && (entry->digest != ses->digest || strcmp(entry->canonical, ses->canonical) != 0))
+    {
+        entry = entry->hash_next;
+    }
+
+    if (entry == NULL)
+    {
+        if (shard->n_entries >= inst->max_digests)
+        {
+            /** Recycle the least recently used statement shape */
+            entry = lru_evict(shard);
+            MXS_FREE(entry->canonical);
+        }
+        else
+        {
+            entry = (DIGEST_ENTRY*)MXS_MALLOC(sizeof(DIGEST_ENTRY));
+        }
+
+        char *canonical = entry ? MXS_STRDUP(ses->canonical) : NULL;
+
+        if (canonical == NULL)
+        {
+            MXS_FREE(entry);
+            spinlock_release(&shard->lock);
+            return;
+        }
+
+        memset(entry, 0, sizeof(*entry));
+        entry->digest = ses->digest;
+        entry->canonical = canonical;
+        entry->min = UINT64_MAX;
+        entry->hash_next = *head;
+        *head = entry;
+        shard->n_entries++;
+    }
+
+    entry->count++;
+    entry->total += latency;
+    entry->rows += ses->reply.rows;
+    entry->errors += ses->reply.error ? 1 : 0;
+
+    if (latency < entry->min)
+    {
+        entry->min = latency;
+    }
+
+    if (latency > entry->max)
+    {
+        entry->max = latency;
+    }
+
+    int bucket = latency ? 64 - __builtin_clzll(latency) : 0;
+    entry->buckets[bucket < DIGEST_BUCKETS ? bucket : DIGEST_BUCKETS - 1]++;
+
+    lru_touch(shard, entry);
+
+    spinlock_release(&shard->lock);
+}
+
+static int
+clientReply(MXS_FILTER *instance, MXS_FILTER_SESSION *session, GWBUF *reply)
+{
+    DIGEST_INSTANCE *my_instance = (DIGEST_INSTANCE*)instance;
+    DIGEST_SESSION *my_session = (DIGEST_SESSION*)session;
+
+    if (my_session->active && modutil_reply_tracker_process(&my_session->reply, reply))
+    {
+        digest_record(my_instance, my_session);
+        my_session->active = false;
+    }
+
+    /* Pass the result upstream */
+    return my_session->up.clientReply(my_session->up.instance,
+                                      my_session->up.session, reply);
+}
+
+/**
+ * Diagnostics routine
+ *
+ * If fsession is NULL then print diagnostics on the filter
+ * instance as a whole, otherwise print diagnostics for the
+ * particular session.
+ *
+ * @param   instance    The filter instance
+ * @param   fsession    Filter session, may be NULL
+ * @param   dcb     The DCB for diagnostic output
+ */
+static void
+diagnostic(MXS_FILTER *instance, MXS_FILTER_SESSION *fsession, DCB *dcb)
+{
+    DIGEST_INSTANCE *my_instance = (DIGEST_INSTANCE*)instance;
+    DIGEST_SESSION *my_session = (DIGEST_SESSION*)fsession;
+    int n_entries = 0;
+    uint64_t n_evicted = 0;
+
+    for (int i = 0; i < my_instance->n_shards; i++)
+    {
+        n_entries += my_instance->shards[i]->n_entries;
+        n_evicted += my_instance->shards[i]->n_evicted;
+    }
+
+    dcb_printf(dcb, "\t\tMaximum digests per thread    %d\n", my_instance->max_digests);
+    dcb_printf(dcb, "\t\tDigests in use                %d\n", n_entries);
+    dcb_printf(dcb, "\t\tEvicted digests               %" PRIu64 "\n", n_evicted);
+
+    if (my_session && my_session->active)
+    {
+        dcb_printf(dcb, "\t\tCurrent statement             %s\n", my_session->canonical);
+    }
+}
+
+/**
+ * Capability routine.
+ *
+ * @return The capabilities of the filter.
+ */
+static uint64_t getCapabilities(MXS_FILTER* instance)
+{
+    return RCAP_TYPE_CONTIGUOUS_INPUT;
+}
+
+/**
+ * The merged statistics of all threads
+ */
+typedef struct
+{
+    DIGEST_ENTRY **entries;
+    int            n_entries;
+    int            n_rows;     /**< Number of rows to return */
+    int            current;    /**< Next row for the result set callback */
+} DIGEST_REPORT;
+
+static void report_free(DIGEST_REPORT *report)
+{
+    for (int i = 0; i < report->n_entries; i++)
+    {
+        MXS_FREE(report->entries[i]->canonical);
+        MXS_FREE(report->entries[i]);
+    }
+
+    MXS_FREE(report->entries);
+}
+
+static void entry_merge(DIGEST_ENTRY *dest, const DIGEST_ENTRY *src)
+{
+    dest->count += src->count;
+    dest->total += src->total;
+    dest->rows += src->rows;
+    dest->errors += src->errors;
+    dest->min = MXS_MIN(dest->min, src->min);
+    dest->max = MXS_MAX(dest->max, src->max);
+
+    for (int i = 0; i < DIGEST_BUCKETS; i++)
+    {
+        dest->buckets[i] += src->buckets[i];
+    }
+}
+
+/**
+ * Merge the digest tables of all threads
+ *
+ * @param inst   Filter instance
+ * @param report The merged entries are stored here
+ *
+ * @return True on success, false on memory allocation failure
+ */
+static bool report_create(DIGEST_INSTANCE *inst, DIGEST_REPORT *report)
+{
+    size_t table_size = inst->shards[0]->table_size;
+    DIGEST_ENTRY **table = (DIGEST_ENTRY**)MXS_CALLOC(table_size, sizeof(DIGEST_ENTRY*));
+    int capacity = inst->max_digests * inst->n_shards;
+
+    report->entries = (DIGEST_ENTRY**)MXS_MALLOC(capacity * sizeof(DIGEST_ENTRY*));
+    report->n_entries = 0;
+    report->current = 0;
+    bool ok = table && report->entries;
+
+    for (int i = 0; ok && i < inst->n_shards; i++)
+    {
+        DIGEST_SHARD *shard = inst->shards[i];
+        spinlock_acquire(&shard->lock);
+
+        for (DIGEST_ENTRY *entry = shard->lru_head; entry && ok; entry = entry->lru_next)
+        {
+            DIGEST_ENTRY **head = &table[entry->digest & (table_size - 1)];
+            DIGEST_ENTRY *merged = *head;
+
+            while (merged && (merged->digest != entry->digest ||
+                              strcmp(merged->canonical, entry->canonical) != 0))
+            {
+                merged = merged->hash_next;
+            }
+
+            if (merged == NULL)
+            {
+                merged = (DIGEST_ENTRY*)MXS_MALLOC(sizeof(DIGEST_ENTRY));
+                char *canonical = MXS_STRDUP(entry->canonical);
+
+                if (merged && canonical)
+                {
+                    *merged = *entry;
+                    merged->canonical = canonical;
+                    merged->hash_next = *head;
+                    *head = merged;
+                    report->entries[report->n_entries++] = merged;
+                }
+                else
+                {
+                    MXS_FREE(merged);
+                    MXS_FREE(canonical);
+                    ok = false;
+                }
+            }
+            else
+            {
+                entry_merge(merged, entry);
+            }
+        }
+
+        spinlock_release(&shard->lock);
+    }
+
+    MXS_FREE(table);
+
+    if (!ok)
+    {
+        report_free(report);
+    }
+
+    return ok;
+}
+
+static uint64_t entry_avg(const DIGEST_ENTRY *entry)
+{
+    return entry->count ? entry->total / entry->count : 0;
+}
+
+/** The upper bound of the bucket that contains the 99th percentile */
+static uint64_t entry_p99(const DIGEST_ENTRY *entry)
+{
+    uint64_t target = entry->count - entry->count / 100;
+    uint64_t seen = 0;
+
+    for (int i = 0; i < DIGEST_BUCKETS; i++)
+    {
+        seen += entry->buckets[i];
+
+        if (seen >= target)
+        {
+            uint64_t upper = i ? (UINT64_C(1) << i) - 1 : 0;
+            return MXS_MIN(upper, entry->max);
+        }
+    }
+
+    return entry->max;
+}
+
+typedef uint64_t (*entry_value_t)(const DIGEST_ENTRY *entry);
+
+static uint64_t entry_count(const DIGEST_ENTRY *entry)
+{
+    return entry->count;
+}
+
+static uint64_t entry_total(const DIGEST_ENTRY *entry)
+{
+    return entry->total;
+}
+
+static uint64_t entry_max(const DIGEST_ENTRY *entry)
+{
+    return entry->max;
+}
+
+static uint64_t entry_rows(const DIGEST_ENTRY *entry)
+{
+    return entry->rows;
+}
+
+static uint64_t entry_errors(const DIGEST_ENTRY *entry)
+{
+    return entry->errors;
+}
+
+static const struct
+{
+    const char    *name;
+    entry_value_t  value;
+} sort_keys[] =
+{
+    {"count",  entry_count},
+    {"total",  entry_total},
+    {"avg",    entry_avg},
+    {"max",    entry_max},
+    {"rows",   entry_rows},
+    {"errors", entry_errors},
+    {NULL}
+};
+
+/** The sort key of the current sort, qsort takes no user data */
+static entry_value_t current_sort_key;
+static SPINLOCK sort_lock = SPINLOCK_INIT;
+
+static int entry_cmp(const void *a, const void *b)
+{
+    uint64_t va = current_sort_key(*(const DIGEST_ENTRY**)a);
+    uint64_t vb = current_sort_key(*(const DIGEST_ENTRY**)b);
+
+    return va < vb ? 1 : va > vb ? -1 : 0;
+}
+
+/**
+ * Merge and sort the statistics according to the command arguments
+ *
+ * @return True if the report was created
+ */
+static bool report_from_args(const MODULECMD_ARG *argv, DIGEST_REPORT *report)
+{
+    DIGEST_INSTANCE *inst = (DIGEST_INSTANCE*)filter_def_get_instance(argv->argv[1].value.filter);
+    entry_value_t key = entry_total;
+    int n_rows = DEFAULT_TOP_ROWS;
+
+    if (modulecmd_arg_is_present(argv, 2))
+    {
+        const char *name = argv->argv[2].value.string;
+        key = NULL;
+
+        for (int i = 0; sort_keys[i].name; i++)
+        {
+            if (strcasecmp(sort_keys[i].name, name) == 0)
+            {
+                key = sort_keys[i].value;
+            }
+        }
+
+        if (key == NULL)
+        {
+            modulecmd_set_error("Unknown sort column '%s'.", name);
+            return false;
+        }
+    }
+
+    if (modulecmd_arg_is_present(argv, 3))
+    {
+        char *end;
+        n_rows = strtol(argv->argv[3].value.string, &end, 10);
+
+        if (*end || n_rows < 1)
+        {
+            modulecmd_set_error("Invalid number of rows: %s", argv->argv[3].value.string);
+            return false;
+        }
+    }
+
+    if (!report_create(inst, report))
+    {
+        modulecmd_set_error("Memory allocation failed.");
+        return false;
+    }
+
+    spinlock_acquire(&sort_lock);
+    current_sort_key = key;
+    qsort(report->entries, report->n_entries, sizeof(DIGEST_ENTRY*), entry_cmp);
+    spinlock_release(&sort_lock);
+
+    report->n_rows = MXS_MIN(n_rows, report->n_entries);
+
+    return true;
+}
+
+static bool digest_command_top(const MODULECMD_ARG *argv)
+{
+    DCB *dcb = argv->argv[0].value.dcb;
+    DIGEST_REPORT report;
+
+    if (!report_from_args(argv, &report))
+    {
+        return false;
+    }
+
+    dcb_printf(dcb, "Digest           | Count      | Total (us)     | Avg (us)   | "
+               "Max (us)   | P99 (us)   | Rows         | Errors     | Statement\n");
+    dcb_printf(dcb, "-----------------+------------+----------------+------------+"
+               "------------+------------+--------------+------------+----------\n");
+
+    for (int i = 0; i < report.n_rows; i++)
+    {
+        DIGEST_ENTRY *e = report.entries[i];
+        dcb_printf(dcb, "%016" PRIx64 " | %10" PRIu64 " | %14" PRIu64 " | %10" PRIu64 " | "
+                   "%10" PRIu64 " | %10" PRIu64 " | %12" PRIu64 " | %10" PRIu64 " | %s\n",
+                   e->digest, e->count, e->total, entry_avg(e), e->max, entry_p99(e),
+                   e->rows, e->errors, e->canonical);
+    }
+
+    report_free(&report);
+    return true;
+}
+
+/**
+ * Provide a row to the result set of the top/json command
+ */
+static RESULT_ROW* report_row(RESULTSET *set, void *data)
+{
+    DIGEST_REPORT *report = (DIGEST_REPORT*)data;
+
+    if (report->current >= report->n_rows)
+    {
+        return NULL;
+    }
+
+    DIGEST_ENTRY *e = report->entries[report->current++];
+    RESULT_ROW *row = resultset_make_row(set);
+
+    if (row)
+    {
+        uint64_t values[] = {e->count, e->total, e->min, entry_avg(e), e->max,
+                             entry_p99(e), e->rows, e->errors};
+        char buf[40];
+
+        snprintf(buf, sizeof(buf), "%016" PRIx64, e->digest);
+        resultset_row_set(row, 0, buf);
+
+        for (size_t i = 0; i < sizeof(values) / sizeof(values[0]); i++)
+        {
+            snprintf(buf, sizeof(buf), "%" PRIu64, values[i]);
+            resultset_row_set(row, i + 1, buf);
+        }
+
+        resultset_row_set(row, 9, e->canonical);
+    }
+
+    return row;
+}
+
+static bool digest_command_top_json(const MODULECMD_ARG *argv)
+{
+    DCB *dcb = argv->argv[0].value.dcb;
+    DIGEST_REPORT report;
+
+    if (!report_from_args(argv, &report))
+    {
+        return false;
+    }
+
+    RESULTSET *set = resultset_create(report_row, &report);
+    const char *columns[] = {"digest", "count", "total_us", "min_us", "avg_us", "max_us",
+                             "p99_us", "rows", "errors", "statement", NULL};
+    bool ok = set != NULL;
+
+    for (int i = 0; ok && columns[i]; i++)
+    {
+        ok = resultset_add_column(set, columns[i], i == 9 ? 256 : 20, COL_TYPE_VARCHAR) != 0;
+    }
+
+    if (ok)
+    {
+        resultset_stream_json(set, dcb);
+    }
+    else
+    {
+        modulecmd_set_error("Memory allocation failed.");
+    }
+
+    if (set)
+    {
+        resultset_free(set);
+    }
+
+    report_free(&report);
+    return ok;
+}
+
+static bool digest_command_reset(const MODULECMD_ARG *argv)
+{
+    DIGEST_INSTANCE *inst = (DIGEST_INSTANCE*)filter_def_get_instance(argv->argv[0].value.filter);
+
+    for (int i = 0; i < inst->n_shards; i++)
+    {
+        DIGEST_SHARD *shard = inst->shards[i];
+        spinlock_acquire(&shard->lock);
+        shard_clear(shard);
+        shard->n_evicted = 0;
+        spinlock_release(&shard->lock);
+    }
+
+    return true;
+}
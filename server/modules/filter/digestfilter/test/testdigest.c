@@ -0,0 +1,103 @@
+/*
+ * Copyright (c) 2016 MariaDB Corporation Ab
+ *
+ * Use of this software is governed by the Business Source License included
+ * in the LICENSE.TXT file and at www.mariadb.com/bsl11.
+ *
+ * Change Date: 2019-07-01
+ *
+ * On the date above, in accordance with the Business Source License, use
+ * of this software will be governed by version 2 or later of the General
+ * Public License.
+ */
+
+// To ensure that ss_info_assert asserts also when builing in non-debug mode.
+#if !defined(SS_DEBUG)
+#define SS_DEBUG
+#endif
+#if defined(NDEBUG)
+#undef NDEBUG
+#endif
+
+#include <stdio.h>
+#include <string.h>
+#include <maxscale/debug.h>
+
+#include "../digest.h"
+
+static const struct
+{
+    const char *sql;
+    const char *canonical;
+} test_cases[] =
+{
+    {"SELECT * FROM t WHERE a = 1", "SELECT * FROM T WHERE A = ?"},
+    {"select  *\n from t where a=1 -- comment", "SELECT * FROM T WHERE A = ?"},
+    {"SELECT a FROM t /* comment */ WHERE b = 'x' # comment", "SELECT A FROM T WHERE B = ?"},
+    {"SELECT a FROM t WHERE id IN (1, 2, 3, 'x')", "SELECT A FROM T WHERE ID IN (...)"},
+    {"INSERT INTO t VALUES (1,'a'),(2,'b')", "INSERT INTO T VALUES (...), (...)"},
+    {"SELECT COUNT(*) FROM `My Table` WHERE x<=>-1.5e3", "SELECT COUNT (*) FROM `My Table` WHERE X <=> - ?"},
+    {"SELECT 'it''s', \"a\\\"b\", X'0F', 0xFF FROM t1", "SELECT ... FROM T1"},
+    {"SELECT @@session.autocommit, @a := 5", "SELECT @@SESSION.AUTOCOMMIT, @A := ?"},
+    {"SELECT c FROM t2 WHERE c LIKE ? LIMIT 10", "SELECT C FROM T2 WHERE C LIKE ? LIMIT ?"},
+    {"SELECT t.c1, 1abc FROM t", "SELECT T.C1, 1ABC FROM T"},
+    {NULL}
+};
+
+static int test_canonical()
+{
+    char buf[512];
+
+    for (int i = 0; test_cases[i].sql; i++)
+    {
+        size_t len = digest_canonicalize(test_cases[i].sql, strlen(test_cases[i].sql), buf, sizeof(buf));
+
+        if (strcmp(buf, test_cases[i].canonical) != 0 || len != strlen(buf))
+        {
+            fprintf(stderr, "Expected '%s', got '%s'\n", test_cases[i].canonical, buf);
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+static int test_truncation()
+{
+    const char *sql = "SELECT a, b, c FROM t WHERE d = 1";
+    char buf[10];
+    size_t len = digest_canonicalize(sql, strlen(sql), buf, sizeof(buf));
+
+    ss_info_dassert(len == sizeof(buf) - 1, "Canonical form should be truncated");
+    ss_info_dassert(strcmp(buf, "SELECT A,") == 0, "Truncated form should be a prefix");
+
+    return 0;
+}
+
+static int test_hash()
+{
+    const char *a = "SELECT * FROM t WHERE id = 1";
+    const char *b = "select * from t where id = 2";
+    const char *c = "SELECT * FROM t WHERE name = 1";
+    char ca[100], cb[100], cc[100];
+
+    size_t la = digest_canonicalize(a, strlen(a), ca, sizeof(ca));
+    size_t lb = digest_canonicalize(b, strlen(b), cb, sizeof(cb));
+    size_t lc = digest_canonicalize(c, strlen(c), cc, sizeof(cc));
+
+    ss_info_dassert(digest_hash(ca, la) == digest_hash(cb, lb), "Same shape should have the same digest");
+    ss_info_dassert(digest_hash(ca, la) != digest_hash(cc, lc), "Different shapes should differ");
+
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    int rval = 0;
+
+    rval += test_canonical();
+    rval += test_truncation();
+    rval += test_hash();
+
+    return rval;
+}
@@ -0,0 +1,447 @@
+/*
+ * Copyright (c) 2016 MariaDB Corporation Ab
+ *
+ * Use of this software is governed by the Business Source License included
+ * in the LICENSE.TXT file and at www.mariadb.com/bsl11.
+ *
+ * Change Date: 2019-07-01
+ *
+ * On the date above, in accordance with the Business Source License, use
+ * of this software will be governed by version 2 or later of the General
+ * Public License.
+ */
+
+/**
+ * @file insertbatch.c  Merging of inserts for the insertstream filter
+ *
+ * The statements are recognised with a lexical scan instead of the query
+ * classifier to keep the per-insert cost low.
+ */
+
+#include "insertbatch.h"
+
+#include <ctype.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <maxscale/alloc.h>
+#include <maxscale/modutil.h>
+#include <maxscale/protocol/mysql.h>
+
+/**
+ * @brief Skip a quoted string or identifier
+ *
+ * @param ptr Pointer to the opening quote
+ * @param end End of the statement
+ *
+ * @return Pointer to the character after the closing quote or NULL if the
+ *         quote is not closed
+ */
+static const char* skip_quoted(const char *ptr, const char *end)
+{
+    char quote = *ptr++;
+
+    while (ptr < end)
+    {
+        if (*ptr == '\\' && quote != '`')
+        {
+            ptr += 2;
+        }
+        else if (*ptr == quote)
+        {
+            if (ptr + 1 < end && ptr[1] == quote)
+            {
+                /** A doubled quote is a quote character */
+                ptr += 2;
+            }
+            else
+            {
+                return ptr + 1;
+            }
+        }
+        else
+        {
+            ptr++;
+        }
+    }
+
+    return NULL;
+}
+
+static inline bool is_quote(char c)
+{
+    return c == '\'' || c == '"' || c == '`';
+}
+
+static inline bool is_comment(const char *ptr, const char *end)
+{
+    return *ptr == '#' ||
+           (ptr + 1 < end && ((ptr[0] == '/' && ptr[1] == '*') || (ptr[0] == '-' && ptr[1] == '-')));
+}
+
+static inline const char* skip_space(const char *ptr, const char *end)
+{
+    while (ptr < end && isspace(*ptr))
+    {
+        ptr++;
+    }
+
+    return ptr;
+}
+
+/**
+ * @brief Skip a parenthesized expression
+ *
+ * @param ptr Pointer to the opening parenthesis
+ * @param end End of the statement
+ *
+ * @return Pointer to the character after the closing parenthesis or NULL if
+ *         the parenthesis is not closed or the expression contains comments
+ */
+static const char* skip_parentheses(const char *ptr, const char *end)
+{
+    int depth = 0;
+
+    while (ptr && ptr < end)
+    {
+        if (is_quote(*ptr))
+        {
+            ptr = skip_quoted(ptr, end);
+        }
+        else if (is_comment(ptr, end))
+        {
+            return NULL;
+        }
+        else
+        {
+            if (*ptr == '(')
+            {
+                depth++;
+            }
+            else if (*ptr == ')' && --depth == 0)
+            {
+                return ptr + 1;
+            }
+
+            ptr++;
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ * @brief Check whether a keyword starts at a position
+ *
+ * @return Pointer to the character after the keyword or NULL if the keyword
+ *         does not start at @c ptr
+ */
+static const char* match_keyword(const char *ptr, const char *end, const char *keyword)
+{
+    size_t len = strlen(keyword);
+
+    if ((size_t)(end - ptr) >= len && strncasecmp(ptr, keyword, len) == 0 &&
+        (ptr + len == end || !(isalnum(ptr[len]) || ptr[len] == '_')))
+    {
+        return ptr + len;
+    }
+
+    return NULL;
+}
+
+/**
+ * @brief Find the end of the VALUES keyword of an insert
+ *
+ * @return Pointer to the character after the keyword or NULL if the statement
+ *         has no VALUES keyword
+ */
+static const char* find_values(const char *ptr, const char *end)
+{
+    while (ptr && ptr < end)
+    {
+        if (is_quote(*ptr))
+        {
+            ptr = skip_quoted(ptr, end);
+        }
+        else if (*ptr == '(')
+        {
+            ptr = skip_parentheses(ptr, end);
+        }
+        else if (is_comment(ptr, end) || *ptr == ';')
+        {
+            return NULL;
+        }
+        else if (isalpha(*ptr) || *ptr == '_')
+        {
+            const char *word = ptr;
+
+            if ((ptr = match_keyword(word, end, "VALUES")) ||
+                (ptr = match_keyword(word, end, "VALUE")))
+            {
+                return ptr;
+            }
+
+            for (ptr = word; ptr < end && (isalnum(*ptr) || *ptr == '_' || *ptr == '$'); ptr++)
+            {
+                ;
+            }
+        }
+        else
+        {
+            ptr++;
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ * @brief Check that the rest of an insert is an ON DUPLICATE KEY UPDATE clause
+ *
+ * @return True if the clause is valid and nothing follows it
+ */
+static bool is_duplicate_key_update(const char *ptr, const char *end)
+{
+    static const char *keywords[] = {"ON", "DUPLICATE", "KEY", "UPDATE"};
+
+    for (size_t i = 0; ptr && i < sizeof(keywords) / sizeof(keywords[0]); i++)
+    {
+        if ((ptr = match_keyword(ptr, end, keywords[i])))
+        {
+            ptr = skip_space(ptr, end);
+        }
+    }
+
+    while (ptr && ptr < end)
+    {
+        if (is_quote(*ptr))
+        {
+            ptr = skip_quoted(ptr, end);
+        }
+        else if (*ptr == ';' || is_comment(ptr, end))
+        {
+            /** Anything that might start another statement is rejected */
+            return false;
+        }
+        else
+        {
+            ptr++;
+        }
+    }
+
+    return ptr != NULL;
+}
+
+bool ds_parse_insert(GWBUF *buffer, DS_INSERT *insert)
+{
+    char *sql;
+    int len;
+
+    if (!modutil_extract_SQL(buffer, &sql, &len) ||
+        GWBUF_LENGTH(buffer) < (size_t)len + MYSQL_HEADER_LEN + 1)
+    {
+        return false;
+    }
+
+    const char *end = sql + len;
+    const char *ptr = skip_space(sql, end);
+
+    insert->head = ptr;
+
+    if (match_keyword(ptr, end, "INSERT") == NULL ||
+        (ptr = find_values(ptr, end)) == NULL)
+    {
+        return false;
+    }
+
+    insert->head_len = ptr - insert->head;
+    insert->values = ptr = skip_space(ptr, end);
+    insert->n_rows = 0;
+
+    bool more = true;
+
+    while (more)
+    {
+        if (ptr >= end || *ptr != '(' || (ptr = skip_parentheses(ptr, end)) == NULL)
+        {
+            return false;
+        }
+
+        insert->n_rows++;
+        insert->values_len = ptr - insert->values;
+        ptr = skip_space(ptr, end);
+
+        if ((more = (ptr < end && *ptr == ',')))
+        {
+            ptr = skip_space(ptr + 1, end);
+        }
+    }
+
+    /** Trailing whitespace and semicolons are not a part of the tail */
+    while (end > ptr && (isspace(end[-1]) || end[-1] == ';'))
+    {
+        end--;
+    }
+
+    insert->tail = ptr;
+    insert->tail_len = end - ptr;
+
+    return insert->tail_len == 0 || is_duplicate_key_update(ptr, end);
+}
+
+bool ds_batch_accepts(const DS_BATCH *batch, int batch_size, const DS_INSERT *insert)
+{
+    return batch->n_stmts < batch_size &&
+           batch->len + insert->values_len + batch->tail_len + 2 < DS_BATCH_MAX_LEN &&
+           batch->head_len == insert->head_len &&
+           memcmp(batch->sql, insert->head, insert->head_len) == 0 &&
+           batch->tail_len == insert->tail_len &&
+           memcmp(batch->tail, insert->tail, insert->tail_len) == 0;
+}
+
+/**
+ * @brief Make sure a buffer has room for @c needed bytes
+ *
+ * @return False if memory allocation failed
+ */
+static bool reserve(char **buf, size_t *size, size_t needed)
+{
+    if (*size < needed)
+    {
+        size_t new_size = MXS_MAX(needed, *size * 2);
+        char *tmp = MXS_REALLOC(*buf, new_size);
+
+        if (tmp == NULL)
+        {
+            return false;
+        }
+
+        *buf = tmp;
+        *size = new_size;
+    }
+
+    return true;
+}
+
+bool ds_batch_add(DS_BATCH *batch, const DS_INSERT *insert)
+{
+    if (batch->n_stmts == 0)
+    {
+        if (!reserve(&batch->sql, &batch->size, insert->head_len + insert->values_len + 1) ||
+            !reserve(&batch->tail, &batch->tail_size, insert->tail_len + 1))
+        {
+            return false;
+        }
+
+        memcpy(batch->sql, insert->head, insert->head_len);
+        memcpy(batch->tail, insert->tail, insert->tail_len);
+        batch->len = batch->head_len = insert->head_len;
+        batch->tail_len = insert->tail_len;
+        batch->n_rows = 0;
+    }
+    else if (!reserve(&batch->sql, &batch->size, batch->len + insert->values_len + 1))
+    {
+        return false;
+    }
+
+    /** The values are separated from the head by a space and from each other by a comma */
+    batch->sql[batch->len++] = batch->n_stmts == 0 ? ' ' : ',';
+
+    DS_BATCH_STMT *stmt = &batch->stmts[batch->n_stmts++];
+    stmt->first_row = batch->n_rows;
+    stmt->n_rows = insert->n_rows;
+    stmt->offset = batch->len;
+    stmt->length = insert->values_len;
+
+    memcpy(batch->sql + batch->len, insert->values, insert->values_len);
+    batch->len += insert->values_len;
+    batch->n_rows += insert->n_rows;
+
+    return true;
+}
+
+GWBUF* ds_batch_create_query(const DS_BATCH *batch)
+{
+    size_t len = batch->len + (batch->tail_len ? batch->tail_len + 1 : 0);
+    GWBUF *rval = gwbuf_alloc(MYSQL_HEADER_LEN + 1 + len);
+
+    if (rval)
+    {
+        uint8_t *ptr = GWBUF_DATA(rval);
+        gw_mysql_set_byte3(ptr, len + 1);
+        ptr[3] = 0;
+        ptr[4] = MYSQL_COM_QUERY;
+        ptr += MYSQL_HEADER_LEN + 1;
+        memcpy(ptr, batch->sql, batch->len);
+
+        if (batch->tail_len)
+        {
+            ptr[batch->len] = ' ';
+            memcpy(ptr + batch->len + 1, batch->tail, batch->tail_len);
+        }
+
+        gwbuf_set_type(rval, GWBUF_TYPE_MYSQL);
+    }
+
+    return rval;
+}
+
+GWBUF* ds_batch_create_error(const DS_BATCH *batch, GWBUF *reply)
+{
+    /** Header, command byte, error code, SQL state marker and SQL state */
+    const size_t msg_offset = MYSQL_HEADER_LEN + 1 + 2 + 1 + 5;
+    uint8_t data[msg_offset + DS_ERRMSG_LEN + 1];
+    size_t len = gwbuf_copy_data(reply, 0, sizeof(data) - 1, data);
+    uint16_t errnum = 0;
+    char state[6] = "HY000";
+    const char *msg = "";
+
+    if (len > MYSQL_HEADER_LEN + 3)
+    {
+        len = MXS_MIN(len, MYSQL_GET_PAYLOAD_LEN(data) + MYSQL_HEADER_LEN);
+        errnum = MYSQL_GET_ERRCODE(data);
+
+        data[len] = '\0';
+
+        if (len >= msg_offset && data[MYSQL_HEADER_LEN + 3] == '#')
+        {
+            memcpy(state, data + MYSQL_HEADER_LEN + 4, 5);
+            msg = (const char*)data + msg_offset;
+        }
+        else
+        {
+            msg = (const char*)data + MYSQL_HEADER_LEN + 3;
+        }
+    }
+
+    const char *at_row = strstr(msg, " at row ");
+    unsigned long row = at_row ? strtoul(at_row + strlen(" at row "), NULL, 10) : 0;
+    int stmt = -1;
+
+    for (int i = 0; i < batch->n_stmts && row > 0; i++)
+    {
+        if (row - 1 >= batch->stmts[i].first_row &&
+            row - 1 < batch->stmts[i].first_row + batch->stmts[i].n_rows)
+        {
+            stmt = i;
+            break;
+        }
+    }
+
+    char message[DS_ERRMSG_LEN + DS_BATCH_ERROR_VALUES + 100];
+
+    if (stmt != -1)
+    {
+        const DS_BATCH_STMT *s = &batch->stmts[stmt];
+        snprintf(message, sizeof(message), "%s (insert %d of %d in a merged insert, values %.*s%s)",
+                 msg, stmt + 1, batch->n_stmts, (int)MXS_MIN(s->length, DS_BATCH_ERROR_VALUES),
+                 batch->sql + s->offset, s->length > DS_BATCH_ERROR_VALUES ? "..." : "");
+    }
+    else
+    {
+        snprintf(message, sizeof(message), "%s (in a merged insert of %d statements)",
+                 msg, batch->n_stmts);
+    }
+
+    return modutil_create_mysql_err_msg(1, 0, errnum, state, message);
+}
@@ -0,0 +1,139 @@
+#pragma once
+/*
+ * Copyright (c) 2016 MariaDB Corporation Ab
+ *
+ * Use of this software is governed by the Business Source License included
+ * in the LICENSE.TXT file and at www.mariadb.com/bsl11.
+ *
+ * Change Date: 2019-07-01
+ *
+ * On the date above, in accordance with the Business Source License, use
+ * of this software will be governed by version 2 or later of the General
+ * Public License.
+ */
+
+/**
+ * @file insertbatch.h  Merging of inserts for the insertstream filter
+ */
+
+#include <maxscale/cdefs.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <maxscale/buffer.h>
+
+MXS_BEGIN_DECLS
+
+/** Maximum length of the SQL of a merged INSERT */
+#define DS_BATCH_MAX_LEN (1024 * 1024)
+
+/** How much of the values of a statement is shown in error messages */
+#define DS_BATCH_ERROR_VALUES 64
+
+/** Maximum length of an error message from the server */
+#define DS_ERRMSG_LEN 512
+
+/**
+ * A parsed INSERT ... VALUES statement
+ */
+typedef struct
+{
+    const char *head;       /**< The statement up to and including VALUES */
+    size_t      head_len;   /**< Length of the head */
+    const char *values;     /**< The value lists */
+    size_t      values_len; /**< Length of the value lists */
+    const char *tail;       /**< The ON DUPLICATE KEY UPDATE clause */
+    size_t      tail_len;   /**< Length of the tail, 0 if there is none */
+    uint32_t    n_rows;     /**< Number of value lists */
+} DS_INSERT;
+
+/**
+ * A statement that was merged into a batch
+ */
+typedef struct
+{
+    uint32_t first_row; /**< Index of the first row of the statement */
+    uint32_t n_rows;    /**< Number of rows in the statement */
+    size_t   offset;    /**< Offset of the values in the merged SQL */
+    size_t   length;    /**< Length of the values */
+} DS_BATCH_STMT;
+
+/**
+ * Inserts that are merged into one multi-row insert
+ */
+typedef struct
+{
+    char          *sql;      /**< The head followed by the values of each statement */
+    size_t         len;      /**< Length of the SQL */
+    size_t         size;     /**< Allocated size of the SQL */
+    size_t         head_len; /**< Length of the head of the statements */
+    char          *tail;     /**< The common ON DUPLICATE KEY UPDATE clause */
+    size_t         tail_len; /**< Length of the tail */
+    size_t         tail_size;/**< Allocated size of the tail */
+    DS_BATCH_STMT *stmts;    /**< The merged statements */
+    int            n_stmts;  /**< Number of merged statements */
+    uint32_t       n_rows;   /**< Number of merged rows */
+} DS_BATCH;
+
+/**
+ * @brief Parse an INSERT ... VALUES statement
+ *
+ * Only plain single statement inserts without comments are accepted. The
+ * statement may have a column list and an ON DUPLICATE KEY UPDATE clause.
+ * Trailing semicolons are ignored.
+ *
+ * @param buffer Contiguous buffer with the statement
+ * @param insert The parsed statement, points to the buffer
+ *
+ * @return True if the statement can be merged with other inserts
+ */
+bool ds_parse_insert(GWBUF *buffer, DS_INSERT *insert);
+
+/**
+ * @brief Check whether an insert can be merged into a batch
+ *
+ * @param batch      The batch, must not be empty
+ * @param batch_size Maximum number of statements in the batch
+ * @param insert     The insert
+ *
+ * @return True if the batch is not full and the insert has the same head and
+ *         tail as the statements already in the batch
+ */
+bool ds_batch_accepts(const DS_BATCH *batch, int batch_size, const DS_INSERT *insert);
+
+/**
+ * @brief Add an insert to a batch
+ *
+ * The @c stmts array of the batch must have room for the statement.
+ *
+ * @param batch  The batch
+ * @param insert The insert
+ *
+ * @return True if the insert was added, false if memory allocation failed
+ */
+bool ds_batch_add(DS_BATCH *batch, const DS_INSERT *insert);
+
+/**
+ * @brief Create the merged insert
+ *
+ * @param batch The batch
+ *
+ * @return Buffer with the COM_QUERY packet or NULL if memory allocation failed
+ */
+GWBUF* ds_batch_create_query(const DS_BATCH *batch);
+
+/**
+ * @brief Create the error that is sent to the client when a merged insert fails
+ *
+ * The statement that caused the error is identified from the row number
+ * that the server reports for errors related to the values of a row.
+ * Otherwise the error is attributed to the whole batch.
+ *
+ * @param batch The batch that was sent
+ * @param reply The error packet from the server
+ *
+ * @return The error packet for the client
+ */
+GWBUF* ds_batch_create_error(const DS_BATCH *batch, GWBUF *reply);
+
+MXS_END_DECLS
@@ -15,6 +15,8 @@
 
 #include <maxscale/cdefs.h>
 
+#include <ctype.h>
+#include <inttypes.h>
 #include <strings.h>
 #include <maxscale/alloc.h>
 #include <maxscale/buffer.h>
@@ -25,6 +27,9 @@
 #include <maxscale/poll.h>
 #include <maxscale/protocol/mysql.h>
 #include <maxscale/query_classifier.h>
+#include <maxscale/timer.h>
+
+#include "insertbatch.h"
 
 /**
  * @file datastream.c - Streaming of bulk inserts
@@ -44,13 +49,29 @@ static bool extract_insert_target(GWBUF *buffer, char* target, int len);
 static GWBUF* create_load_data_command(const char *target);
 static GWBUF* convert_to_stream(GWBUF* buffer, uint8_t packet_num);
 
+enum ds_mode
+{
+    DS_MODE_STREAM, /**< Inserts are converted into LOAD DATA LOCAL INFILE streams */
+    DS_MODE_BATCH   /**< Inserts are merged into multi-row inserts */
+};
+
+static const MXS_ENUM_VALUE mode_values[] =
+{
+    {"stream", DS_MODE_STREAM},
+    {"batch",  DS_MODE_BATCH},
+    {NULL}
+};
+
 /**
  * Instance structure
  */
 typedef struct
 {
-    char *source; /**< Source address to restrict matches */
-    char *user;   /**< User name to restrict matches */
+    char *source;       /**< Source address to restrict matches */
+    char *user;         /**< User name to restrict matches */
+    enum ds_mode mode;  /**< How the inserts are combined */
+    int batch_size;     /**< Maximum number of statements in a merged insert */
+    int batch_interval; /**< Milliseconds a batch waits for more statements */
 } DS_INSTANCE;
 
 enum ds_state
@@ -59,7 +80,8 @@ enum ds_state
     DS_REQUEST_SENT,     /**< Request for stream sent */
     DS_REQUEST_ACCEPTED, /**< Stream request accepted */
     DS_STREAM_OPEN,      /**< Stream is open */
-    DS_CLOSING_STREAM    /**< Stream is about to be closed */
+    DS_CLOSING_STREAM,   /**< Stream is about to be closed */
+    DS_BATCH_SENT        /**< A merged insert was sent, waiting for the reply */
 };
 
 /**
@@ -75,8 +97,17 @@ typedef struct
     DCB* client_dcb;     /**< Client DCB */
     enum ds_state state; /**< The current state of the stream */
     char target[MYSQL_TABLE_MAXLEN + MYSQL_DATABASE_MAXLEN + 1]; /**< Current target table */
+    DS_BATCH batch;      /**< The statements waiting to be merged */
+    GWBUF *batch_error;  /**< Unreported error of a merged insert */
+    MXS_TIMER timer;     /**< Sends the batch when the batch interval expires */
+    uint64_t n_batches;  /**< Number of merged inserts sent */
+    uint64_t n_batched;  /**< Number of statements merged */
 } DS_SESSION;
 
+static int32_t route_batch(DS_INSTANCE *instance, DS_SESSION *session, GWBUF *queue);
+static int32_t reply_batch(DS_SESSION *session, GWBUF *reply);
+static void batch_timeout(MXS_TIMER *timer, void *data);
+
 /**
  * The module entry point routine. It is this routine that
  * must populate the structure that is referred to as the
@@ -118,6 +149,9 @@ MXS_MODULE* MXS_CREATE_MODULE()
         {
             {"source", MXS_MODULE_PARAM_STRING},
             {"user", MXS_MODULE_PARAM_STRING},
+            {"mode", MXS_MODULE_PARAM_ENUM, "stream", MXS_MODULE_OPT_NONE, mode_values},
+            {"batch_size", MXS_MODULE_PARAM_COUNT, "100"},
+            {"batch_interval", MXS_MODULE_PARAM_COUNT, "1000"},
             {MXS_END_MODULE_PARAMS}
         }
     };
@@ -163,6 +197,16 @@ createInstance(const char *name, char **options, MXS_CONFIG_PARAMETER *params)
     {
         my_instance->source = config_copy_string(params, "source");
         my_instance->user = config_copy_string(params, "user");
+        my_instance->mode = config_get_enum(params, "mode", mode_values);
+        my_instance->batch_size = config_get_integer(params, "batch_size");
+        my_instance->batch_interval = config_get_integer(params, "batch_interval");
+
+        if (my_instance->batch_size < 1)
+        {
+            MXS_ERROR("The value of 'batch_size' must be greater than zero.");
+            free_instance(my_instance);
+            my_instance = NULL;
+        }
     }
 
     return (MXS_FILTER *) my_instance;
@@ -187,6 +231,15 @@ newSession(MXS_FILTER *instance, MXS_SESSION *session)
         my_session->state = DS_STREAM_CLOSED;
         my_session->active = true;
         my_session->client_dcb = session->client_dcb;
+        mxs_timer_init(&my_session->timer, batch_timeout, my_session);
+
+        if (my_instance->mode == DS_MODE_BATCH &&
+            (my_session->batch.stmts = MXS_MALLOC(my_instance->batch_size *
+                                                  sizeof(DS_BATCH_STMT))) == NULL)
+        {
+            MXS_FREE(my_session);
+            return NULL;
+        }
 
         if (my_instance->source &&
             strcmp(session->client_dcb->remote, my_instance->source) != 0)
@@ -214,6 +267,8 @@ newSession(MXS_FILTER *instance, MXS_SESSION *session)
 static void
 closeSession(MXS_FILTER *instance, MXS_FILTER_SESSION *session)
 {
+    DS_SESSION *my_session = (DS_SESSION*) session;
+    mxs_timer_stop(&my_session->timer);
 }
 
 /**
@@ -225,6 +280,12 @@ closeSession(MXS_FILTER *instance, MXS_FILTER_SESSION *session)
 static void
 freeSession(MXS_FILTER *instance, MXS_FILTER_SESSION *session)
 {
+    DS_SESSION *my_session = (DS_SESSION*) session;
+    gwbuf_free(my_session->queue);
+    gwbuf_free(my_session->batch_error);
+    MXS_FREE(my_session->batch.sql);
+    MXS_FREE(my_session->batch.tail);
+    MXS_FREE(my_session->batch.stmts);
     MXS_FREE(session);
 }
 
@@ -268,6 +329,7 @@ static void setUpstream(MXS_FILTER *instance, MXS_FILTER_SESSION *session, MXS_U
  */
 static int32_t routeQuery(MXS_FILTER *instance, MXS_FILTER_SESSION *session, GWBUF *queue)
 {
+    DS_INSTANCE *my_instance = (DS_INSTANCE *) instance;
     DS_SESSION *my_session = (DS_SESSION *) session;
     char target[MYSQL_TABLE_MAXLEN + MYSQL_DATABASE_MAXLEN + 1];
     bool send_ok = false;
@@ -275,6 +337,11 @@ static int32_t routeQuery(MXS_FILTER *instance, MXS_FILTER_SESSION *session, GWB
     int rc = 0;
     ss_dassert(GWBUF_IS_CONTIGUOUS(queue));
 
+    if (my_instance->mode == DS_MODE_BATCH)
+    {
+        return route_batch(my_instance, my_session, queue);
+    }
+
     if (session_trx_is_active(my_session->client_dcb->session) &&
         extract_insert_target(queue, target, sizeof(target)))
     {
@@ -453,10 +520,15 @@ static GWBUF* convert_to_stream(GWBUF* buffer, uint8_t packet_num)
  */
 static int32_t clientReply(MXS_FILTER* instance, MXS_FILTER_SESSION *session, GWBUF *reply)
 {
+    DS_INSTANCE *my_instance = (DS_INSTANCE *) instance;
     DS_SESSION *my_session = (DS_SESSION*) session;
     int rc = 1;
 
-    if (my_session->state == DS_CLOSING_STREAM ||
+    if (my_instance->mode == DS_MODE_BATCH)
+    {
+        rc = reply_batch(my_session, reply);
+    }
+    else if (my_session->state == DS_CLOSING_STREAM ||
         (my_session->state == DS_REQUEST_SENT &&
          !MYSQL_IS_ERROR_PACKET((uint8_t*)GWBUF_DATA(reply))))
     {
@@ -501,6 +573,23 @@ static int32_t clientReply(MXS_FILTER* instance, MXS_FILTER_SESSION *session, GW
 static void diagnostic(MXS_FILTER *instance, MXS_FILTER_SESSION *fsession, DCB *dcb)
 {
     DS_INSTANCE *my_instance = (DS_INSTANCE *) instance;
+    DS_SESSION *my_session = (DS_SESSION *) fsession;
+
+    if (my_instance->mode == DS_MODE_BATCH)
+    {
+        dcb_printf(dcb, "\t\tInserts merged into batches of at most %d statements\n",
+                   my_instance->batch_size);
+        dcb_printf(dcb, "\t\tBatch interval                      %d ms\n",
+                   my_instance->batch_interval);
+
+        if (my_session)
+        {
+            dcb_printf(dcb, "\t\tMerged inserts sent                 %" PRIu64 "\n",
+                       my_session->n_batches);
+            dcb_printf(dcb, "\t\tStatements merged                   %" PRIu64 "\n",
+                       my_session->n_batched);
+        }
+    }
 
     if (my_instance->source)
     {
@@ -628,3 +717,241 @@ static GWBUF* create_load_data_command(const char *target)
 
     return rval;
 }
+
+/**
+ * @brief Report the failure of a merged insert
+ *
+ * The error is the reply to the first held statement, which is not executed.
+ * The statements held after it are routed again. If no statement is held,
+ * the error is the reply to the next statement.
+ *
+ * @param my_session Filter session
+ * @param error      The error for the client
+ *
+ * @return 1 on success, 0 on error
+ */
+static int32_t batch_report_error(DS_SESSION *my_session, GWBUF *error)
+{
+    int32_t rc = 1;
+    GWBUF *queue = my_session->queue;
+    my_session->queue = NULL;
+
+    if (queue)
+    {
+        /** Each held statement is in a buffer of its own */
+        gwbuf_free(gwbuf_split(&queue, GWBUF_LENGTH(queue)));
+        rc = my_session->up.clientReply(my_session->up.instance, my_session->up.session, error);
+
+        if (queue)
+        {
+            poll_add_epollin_event_to_dcb(my_session->client_dcb, queue);
+        }
+    }
+    else
+    {
+        gwbuf_free(my_session->batch_error);
+        my_session->batch_error = error;
+    }
+
+    return rc;
+}
+
+/**
+ * @brief Send the merged insert
+ *
+ * The reply is handled by reply_batch(). If the merged insert can't be
+ * routed, the failure is reported like the failure of the insert itself.
+ *
+ * @param my_session Filter session
+ *
+ * @return 1 on success, 0 on error
+ */
+static int32_t batch_send(DS_SESSION *my_session)
+{
+    int32_t rc = 0;
+    GWBUF *query = ds_batch_create_query(&my_session->batch);
+
+    mxs_timer_stop(&my_session->timer);
+
+    if (query)
+    {
+        my_session->state = DS_BATCH_SENT;
+        my_session->n_batches++;
+        my_session->n_batched += my_session->batch.n_stmts;
+        rc = my_session->down.routeQuery(my_session->down.instance,
+                                         my_session->down.session, query);
+    }
+
+    if (rc == 0)
+    {
+        char message[100];
+        snprintf(message, sizeof(message), "Failed to send a merged insert of %d statements.",
+                 my_session->batch.n_stmts);
+        MXS_ERROR("%s", message);
+
+        my_session->batch.n_stmts = 0;
+        my_session->state = DS_STREAM_CLOSED;
+
+        GWBUF *error = modutil_create_mysql_err_msg(1, 0, 1927, "08S01", message);
+
+        if (error)
+        {
+            batch_report_error(my_session, error);
+        }
+    }
+
+    return rc;
+}
+
+/**
+ * @brief Send the batch when it has waited for the batch interval
+ *
+ * @param timer The batch timer
+ * @param data  Filter session
+ */
+static void batch_timeout(MXS_TIMER *timer, void *data)
+{
+    DS_SESSION *my_session = (DS_SESSION*) data;
+
+    if (my_session->state == DS_STREAM_CLOSED && my_session->batch.n_stmts > 0)
+    {
+        batch_send(my_session);
+    }
+}
+
+/**
+ * @brief Route a statement in the batch mode
+ *
+ * Inserts inside transactions are acknowledged immediately and merged into
+ * one multi-row insert. The merged insert is sent when the batch is full,
+ * when the batch interval expires or when a statement that can't be merged
+ * is received. A statement that ends a batch is routed only after the reply
+ * to the merged insert has been received.
+ *
+ * @param my_instance Filter instance
+ * @param my_session  Filter session
+ * @param queue       The statement
+ *
+ * @return 1 on success, 0 on error
+ */
+static int32_t route_batch(DS_INSTANCE *my_instance, DS_SESSION *my_session, GWBUF *queue)
+{
+    DS_BATCH *batch = &my_session->batch;
+    DS_INSERT insert;
+    int32_t rc = 1;
+
+    if (my_session->state == DS_BATCH_SENT)
+    {
+        /** Processed when the merged insert is complete */
+        my_session->queue = gwbuf_append(my_session->queue, queue);
+    }
+    else if (my_session->batch_error)
+    {
+        /** A merged insert failed after its statements were acknowledged */
+        GWBUF *error = my_session->batch_error;
+        my_session->batch_error = NULL;
+        gwbuf_free(queue);
+        rc = my_session->up.clientReply(my_session->up.instance, my_session->up.session, error);
+    }
+    else if (my_session->active &&
+             session_trx_is_active(my_session->client_dcb->session) &&
+             ds_parse_insert(queue, &insert) &&
+             insert.head_len + insert.values_len + insert.tail_len + 2 < DS_BATCH_MAX_LEN)
+    {
+        if (batch->n_stmts > 0 && !ds_batch_accepts(batch, my_instance->batch_size, &insert))
+        {
+            /** The insert starts a new batch after the current one is sent */
+            my_session->queue = queue;
+            rc = batch_send(my_session);
+        }
+        else if (ds_batch_add(batch, &insert))
+        {
+            gwbuf_free(queue);
+
+            if (batch->n_stmts == 1 && my_instance->batch_interval > 0)
+            {
+                mxs_timer_start(&my_session->timer, my_instance->batch_interval, 0);
+            }
+
+            rc = mxs_mysql_send_ok(my_session->client_dcb, 1, insert.n_rows, NULL);
+
+            if (batch->n_stmts >= my_instance->batch_size)
+            {
+                rc = batch_send(my_session) && rc;
+            }
+        }
+        else if (batch->n_stmts > 0)
+        {
+            my_session->queue = queue;
+            rc = batch_send(my_session);
+        }
+        else
+        {
+            rc = my_session->down.routeQuery(my_session->down.instance,
+                                             my_session->down.session, queue);
+        }
+    }
+    else if (batch->n_stmts > 0)
+    {
+        /** The merged insert is executed before this statement */
+        my_session->queue = queue;
+        rc = batch_send(my_session);
+    }
+    else
+    {
+        rc = my_session->down.routeQuery(my_session->down.instance,
+                                         my_session->down.session, queue);
+    }
+
+    return rc;
+}
+
+/**
+ * @brief Handle a reply in the batch mode
+ *
+ * The reply to a merged insert is not sent to the client since the merged
+ * statements were already acknowledged. If the merged insert failed, the
+ * error is sent as the reply to the next statement which is not executed.
+ * The statements after it are executed normally.
+ *
+ * @param my_session Filter session
+ * @param reply      The reply from the backend
+ *
+ * @return 1 on success, 0 on error
+ */
+static int32_t reply_batch(DS_SESSION *my_session, GWBUF *reply)
+{
+    int32_t rc = 1;
+
+    if (my_session->state == DS_BATCH_SENT)
+    {
+        GWBUF *error = NULL;
+
+        if (MYSQL_IS_ERROR_PACKET((uint8_t*)GWBUF_DATA(reply)))
+        {
+            error = ds_batch_create_error(&my_session->batch, reply);
+        }
+
+        gwbuf_free(reply);
+        my_session->batch.n_stmts = 0;
+        my_session->state = DS_STREAM_CLOSED;
+
+        if (error)
+        {
+            rc = batch_report_error(my_session, error);
+        }
+        else if (my_session->queue)
+        {
+            GWBUF *queue = my_session->queue;
+            my_session->queue = NULL;
+            poll_add_epollin_event_to_dcb(my_session->client_dcb, queue);
+        }
+    }
+    else
+    {
+        rc = my_session->up.clientReply(my_session->up.instance,
+                                        my_session->up.session, reply);
+    }
+
+    return rc;
+}
@@ -0,0 +1,308 @@
+/*
+ * Copyright (c) 2016 MariaDB Corporation Ab
+ *
+ * Use of this software is governed by the Business Source License included
+ * in the LICENSE.TXT file and at www.mariadb.com/bsl11.
+ *
+ * Change Date: 2019-07-01
+ *
+ * On the date above, in accordance with the Business Source License, use
+ * of this software will be governed by version 2 or later of the General
+ * Public License.
+ */
+
+// To ensure that ss_info_assert asserts also when builing in non-debug mode.
+#if !defined(SS_DEBUG)
+#define SS_DEBUG
+#endif
+#if defined(NDEBUG)
+#undef NDEBUG
+#endif
+
+#include <stdio.h>
+#include <string.h>
+#include <maxscale/alloc.h>
+#include <maxscale/debug.h>
+#include <maxscale/modutil.h>
+#include <maxscale/protocol/mysql.h>
+
+#include "../insertbatch.h"
+
+static const struct
+{
+    const char *sql;
+    bool        accepted;
+    uint32_t    n_rows;
+    const char *head;
+    const char *values;
+    const char *tail;
+} parse_cases[] =
+{
+    {"INSERT INTO t VALUES (1, 'a')", true, 1, "INSERT INTO t VALUES", "(1, 'a')", ""},
+    {"  insert into t (a, b) value (1, 2),(3, 4)  ", true, 2, "insert into t (a, b) value", "(1, 2),(3, 4)", ""},
+    {"INSERT INTO values_t VALUES (1)", true, 1, "INSERT INTO values_t VALUES", "(1)", ""},
+    {"INSERT INTO `values` VALUES (1)", true, 1, "INSERT INTO `values` VALUES", "(1)", ""},
+    /** Quotes and escapes */
+    {"INSERT INTO t VALUES ('a)b', \"c,d\", 'it''s')", true, 1, "INSERT INTO t VALUES",
+     "('a)b', \"c,d\", 'it''s')", ""},
+    {"INSERT INTO t VALUES ('a\\')', \"b\\\"(\")", true, 1, "INSERT INTO t VALUES",
+     "('a\\')', \"b\\\"(\")", ""},
+    {"INSERT INTO t VALUES ('/* no comment */', '-- ', '#')", true, 1, "INSERT INTO t VALUES",
+     "('/* no comment */', '-- ', '#')", ""},
+    {"INSERT INTO t VALUES ('a)", false},
+    {"INSERT INTO t VALUES (1", false},
+    /** Comments */
+    {"INSERT /* c */ INTO t VALUES (1)", false},
+    {"INSERT INTO t VALUES (1 /* c */)", false},
+    {"INSERT INTO t VALUES (1) -- c", false},
+    {"INSERT INTO t VALUES (1) # c", false},
+    /** ON DUPLICATE KEY UPDATE */
+    {"INSERT INTO t VALUES (1, 2) ON DUPLICATE KEY UPDATE b = b + 1", true, 1, "INSERT INTO t VALUES",
+     "(1, 2)", "ON DUPLICATE KEY UPDATE b = b + 1"},
+    {"INSERT INTO t VALUES (1), (2) on duplicate key update a = ';';", true, 2, "INSERT INTO t VALUES",
+     "(1), (2)", "on duplicate key update a = ';'"},
+    {"INSERT INTO t VALUES (1) ON DUPLICATE KEY UPDATE a = 1; DROP TABLE t", false},
+    {"INSERT INTO t VALUES (1) ON DUPLICATE KEY UPDATE a = 1 -- c", false},
+    {"INSERT INTO t VALUES (1) RETURNING a", false},
+    /** Semicolons */
+    {"INSERT INTO t VALUES (1);", true, 1, "INSERT INTO t VALUES", "(1)", ""},
+    {"INSERT INTO t VALUES (1) ; ; ", true, 1, "INSERT INTO t VALUES", "(1)", ""},
+    {"INSERT INTO t VALUES (1); DELETE FROM t", false},
+    {"INSERT INTO t; VALUES (1)", false},
+    /** Other statements */
+    {"SELECT 1", false},
+    {"REPLACE INTO t VALUES (1)", false},
+    {"INSERT INTO t SELECT * FROM t2", false},
+    {"INSERT INTO t SET a = 1", false},
+    {NULL}
+};
+
+static bool has_text(const char *ptr, size_t len, const char *expected)
+{
+    return len == strlen(expected) && memcmp(ptr, expected, len) == 0;
+}
+
+static int test_parse()
+{
+    int rval = 0;
+
+    for (int i = 0; parse_cases[i].sql; i++)
+    {
+        GWBUF *buffer = modutil_create_query(parse_cases[i].sql);
+        DS_INSERT insert;
+        bool accepted = ds_parse_insert(buffer, &insert);
+
+        if (accepted != parse_cases[i].accepted)
+        {
+            fprintf(stderr, "'%s' should %sbe accepted\n", parse_cases[i].sql,
+                    parse_cases[i].accepted ? "" : "not ");
+            rval++;
+        }
+        else if (accepted &&
+                 (insert.n_rows != parse_cases[i].n_rows ||
+                  !has_text(insert.head, insert.head_len, parse_cases[i].head) ||
+                  !has_text(insert.values, insert.values_len, parse_cases[i].values) ||
+                  !has_text(insert.tail, insert.tail_len, parse_cases[i].tail)))
+        {
+            fprintf(stderr, "'%s' was parsed into %u rows, head '%.*s', values '%.*s' and tail '%.*s'\n",
+                    parse_cases[i].sql, insert.n_rows, (int)insert.head_len, insert.head,
+                    (int)insert.values_len, insert.values, (int)insert.tail_len, insert.tail);
+            rval++;
+        }
+
+        gwbuf_free(buffer);
+    }
+
+    return rval;
+}
+
+/**
+ * Merge the statements into a batch of at most @c batch_size statements.
+ *
+ * @return The number of statements the batch accepted
+ */
+static int fill_batch(DS_BATCH *batch, int batch_size, const char **statements)
+{
+    int n = 0;
+
+    for (; statements[n]; n++)
+    {
+        GWBUF *buffer = modutil_create_query(statements[n]);
+        DS_INSERT insert;
+
+        bool parsed = ds_parse_insert(buffer, &insert);
+        ss_info_dassert(parsed, "Statement should be parsed");
+
+        bool accepted = batch->n_stmts == 0 || ds_batch_accepts(batch, batch_size, &insert);
+
+        if (accepted)
+        {
+            bool added = ds_batch_add(batch, &insert);
+            ss_info_dassert(added, "Statement should be added");
+        }
+
+        gwbuf_free(buffer);
+
+        if (!accepted)
+        {
+            break;
+        }
+    }
+
+    return n;
+}
+
+static bool query_is(const DS_BATCH *batch, const char *expected)
+{
+    GWBUF *query = ds_batch_create_query(batch);
+    char *sql;
+    int len;
+    bool rval = modutil_extract_SQL(query, &sql, &len) && has_text(sql, len, expected);
+
+    if (!rval)
+    {
+        fprintf(stderr, "Expected '%s', got '%.*s'\n", expected, len, sql);
+    }
+
+    gwbuf_free(query);
+    return rval;
+}
+
+static void free_batch(DS_BATCH *batch)
+{
+    MXS_FREE(batch->sql);
+    MXS_FREE(batch->tail);
+    memset(batch, 0, sizeof(*batch));
+}
+
+static int test_batch()
+{
+    DS_BATCH_STMT stmts[4];
+    DS_BATCH batch = {};
+    batch.stmts = stmts;
+
+    const char *plain[] =
+    {
+        "INSERT INTO t VALUES (1)",
+        "INSERT INTO t VALUES (2), (3);",
+        "insert into t values (4)",
+        NULL
+    };
+
+    ss_info_dassert(fill_batch(&batch, 4, plain) == 2, "A different head should end the batch");
+    ss_info_dassert(batch.n_stmts == 2 && batch.n_rows == 3, "Batch should have two statements");
+    ss_info_dassert(stmts[1].first_row == 1 && stmts[1].n_rows == 2, "Rows should be counted");
+    ss_info_dassert(query_is(&batch, "INSERT INTO t VALUES (1),(2), (3)"), "Values should be merged");
+    free_batch(&batch);
+    batch.stmts = stmts;
+
+    const char *full[] =
+    {
+        "INSERT INTO t VALUES (1)",
+        "INSERT INTO t VALUES (2)",
+        "INSERT INTO t VALUES (3)",
+        NULL
+    };
+
+    ss_info_dassert(fill_batch(&batch, 2, full) == 2, "A full batch should not accept statements");
+    free_batch(&batch);
+    batch.stmts = stmts;
+
+    const char *update[] =
+    {
+        "INSERT INTO t (a) VALUES (1) ON DUPLICATE KEY UPDATE a = a + 1",
+        "INSERT INTO t (a) VALUES (2) ON DUPLICATE KEY UPDATE a = a + 1;",
+        "INSERT INTO t (a) VALUES (3) ON DUPLICATE KEY UPDATE a = 0",
+        NULL
+    };
+
+    ss_info_dassert(fill_batch(&batch, 4, update) == 2, "A different tail should end the batch");
+    ss_info_dassert(query_is(&batch, "INSERT INTO t (a) VALUES (1),(2) ON DUPLICATE KEY UPDATE a = a + 1"),
+                    "The tail should follow the values");
+    free_batch(&batch);
+
+    return 0;
+}
+
+/**
+ * Create the client error from a server error sent for the batch.
+ *
+ * @return True if the client error has the code, the state and the message
+ */
+static bool error_is(const DS_BATCH *batch, const char *server_msg, const char *expected)
+{
+    GWBUF *reply = modutil_create_mysql_err_msg(1, 0, 1406, "22001", server_msg);
+    GWBUF *error = ds_batch_create_error(batch, reply);
+    uint8_t data[1024];
+    size_t len = gwbuf_copy_data(error, 0, sizeof(data) - 1, data);
+    const size_t msg_offset = MYSQL_HEADER_LEN + 1 + 2 + 1 + 5;
+
+    data[len] = '\0';
+
+    bool rval = len > msg_offset &&
+                MYSQL_IS_ERROR_PACKET(data) &&
+                MYSQL_GET_ERRCODE(data) == 1406 &&
+                memcmp(data + MYSQL_HEADER_LEN + 4, "22001", 5) == 0 &&
+                strcmp((char*)data + msg_offset, expected) == 0;
+
+    if (!rval)
+    {
+        fprintf(stderr, "Expected '%s', got '%s'\n", expected,
+                len > msg_offset ? (char*)data + msg_offset : "");
+    }
+
+    gwbuf_free(reply);
+    gwbuf_free(error);
+    return rval;
+}
+
+static int test_error()
+{
+    DS_BATCH_STMT stmts[3];
+    DS_BATCH batch = {};
+    batch.stmts = stmts;
+
+    const char *statements[] =
+    {
+        "INSERT INTO t VALUES (1, 'a')",
+        "INSERT INTO t VALUES (2, 'b'), (3, 'cccccccccc')",
+        "INSERT INTO t VALUES (4, 'd')",
+        NULL
+    };
+
+    ss_info_dassert(fill_batch(&batch, 3, statements) == 3, "All statements should be merged");
+
+    ss_info_dassert(error_is(&batch, "Data too long for column 'b' at row 1",
+                             "Data too long for column 'b' at row 1 "
+                             "(insert 1 of 3 in a merged insert, values (1, 'a'))"),
+                    "Row 1 is in the first statement");
+    ss_info_dassert(error_is(&batch, "Data too long for column 'b' at row 3",
+                             "Data too long for column 'b' at row 3 "
+                             "(insert 2 of 3 in a merged insert, values (2, 'b'), (3, 'cccccccccc'))"),
+                    "Row 3 is in the second statement");
+    ss_info_dassert(error_is(&batch, "Data too long for column 'b' at row 4",
+                             "Data too long for column 'b' at row 4 "
+                             "(insert 3 of 3 in a merged insert, values (4, 'd'))"),
+                    "Row 4 is in the third statement");
+    ss_info_dassert(error_is(&batch, "Data too long for column 'b' at row 5",
+                             "Data too long for column 'b' at row 5 (in a merged insert of 3 statements)"),
+                    "An unknown row is attributed to the batch");
+    ss_info_dassert(error_is(&batch, "Table 't' is read only",
+                             "Table 't' is read only (in a merged insert of 3 statements)"),
+                    "An error without a row is attributed to the batch");
+
+    free_batch(&batch);
+
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    int rval = 0;
+
+    rval += test_parse();
+    rval += test_batch();
+    rval += test_error();
+
+    return rval;
+}
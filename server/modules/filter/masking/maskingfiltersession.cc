@@ -52,8 +52,20 @@ int MaskingFilterSession::routeQuery(GWBUF* pPacket)
     {
     case MYSQL_COM_QUERY:
     case MYSQL_COM_STMT_EXECUTE:
-        m_res.reset(request.command(), m_filter.rules());
-        m_state = EXPECTING_RESPONSE;
+        {
+            SMaskingRules sRules = m_filter.rules();
+
+            if (account_rules(sRules).empty())
+            {
+                // No rule applies to the user, so there is nothing to mask.
+                m_state = IGNORING_RESPONSE;
+            }
+            else
+            {
+                m_res.reset(request.command(), sRules);
+                m_state = EXPECTING_RESPONSE;
+            }
+        }
         break;
 
     default:
@@ -63,6 +75,32 @@ int MaskingFilterSession::routeQuery(GWBUF* pPacket)
     return FilterSession::routeQuery(pPacket);
 }
 
+const MaskingRules::AccountRules& MaskingFilterSession::account_rules(const SMaskingRules& sRules)
+{
+    // Which rules apply to the user does not change during the session, so
+    // it needs to be resolved again only if the rules have been reloaded.
+    if (sRules != m_sRules)
+    {
+        const char *zUser = session_get_user(m_pSession);
+        const char *zHost = session_get_remote(m_pSession);
+
+        if (!zUser)
+        {
+            zUser = "";
+        }
+
+        if (!zHost)
+        {
+            zHost = "";
+        }
+
+        m_sRules = sRules;
+        m_account_rules = m_sRules->get_account_rules(zUser, zHost);
+    }
+
+    return m_account_rules;
+}
+
 int MaskingFilterSession::clientReply(GWBUF* pPacket)
 {
     ss_dassert(GWBUF_IS_CONTIGUOUS(pPacket));
@@ -152,20 +190,7 @@ void MaskingFilterSession::handle_field(GWBUF* pPacket)
     }
     else
     {
-        const char *zUser = session_get_user(m_pSession);
-        const char *zHost = session_get_remote(m_pSession);
-
-        if (!zUser)
-        {
-            zUser = "";
-        }
-
-        if (!zHost)
-        {
-            zHost = "";
-        }
-
-        const MaskingRules::Rule* pRule = m_res.rules()->get_rule_for(column_def, zUser, zHost);
+        const MaskingRules::Rule* pRule = m_account_rules.get_rule_for(column_def);
 
         if (m_res.append_type_and_rule(column_def.type(), pRule))
         {
@@ -212,6 +237,50 @@ void warn_of_type_mismatch(const MaskingRules::Rule& rule)
                 "that is not of string type.", rule.match().c_str());
 }
 
+/**
+ * Mask the values of a resultset row in place.
+ *
+ * @param row      A textual or binary resultset row.
+ * @param columns  The indexes of the columns to be masked, in ascending order.
+ * @param rules    The rule of each column, NULL for columns not to be masked.
+ * @param warn     Whether to warn if a masked column is not of string type.
+ */
+template<class Row>
+void mask_row(Row& row,
+              const std::vector<size_t>& columns,
+              const std::vector<const MaskingRules::Rule*>& rules,
+              bool warn)
+{
+    typename Row::iterator i = row.begin();
+    size_t index = 0;
+
+    // The values can only be reached by walking past the preceding ones,
+    // but the columns after the last masked one need not be walked at all.
+    for (std::vector<size_t>::const_iterator j = columns.begin(); j != columns.end(); ++j)
+    {
+        while (index < *j)
+        {
+            ++i;
+            ++index;
+        }
+
+        const MaskingRules::Rule* pRule = rules[index];
+        ss_dassert(pRule);
+
+        typename Row::Value value = *i;
+
+        if (value.is_string())
+        {
+            LEncString s = value.as_string();
+            pRule->rewrite(s);
+        }
+        else if (warn)
+        {
+            warn_of_type_mismatch(*pRule);
+        }
+    }
+}
+
 }
 
 void MaskingFilterSession::handle_row(GWBUF* pPacket)
@@ -267,33 +336,15 @@ void MaskingFilterSession::handle_large_payload()
 
 void MaskingFilterSession::mask_values(ComPacket& response)
 {
+    bool warn = (m_filter.config().warn_type_mismatch() == Config::WARN_ALWAYS);
+
     switch (m_res.command())
     {
     case MYSQL_COM_QUERY:
         {
             ComQueryResponse::TextResultsetRow row(response, m_res.types());
 
-            ComQueryResponse::TextResultsetRow::iterator i = row.begin();
-            while (i != row.end())
-            {
-                const MaskingRules::Rule* pRule = m_res.get_rule();
-
-                if (pRule)
-                {
-                    ComQueryResponse::TextResultsetRow::Value value = *i;
-
-                    if (value.is_string())
-                    {
-                        LEncString s = value.as_string();
-                        pRule->rewrite(s);
-                    }
-                    else if (m_filter.config().warn_type_mismatch() == Config::WARN_ALWAYS)
-                    {
-                        warn_of_type_mismatch(*pRule);
-                    }
-                }
-                ++i;
-            }
+            mask_row(row, m_res.masked_columns(), m_res.rules_for_columns(), warn);
         }
         break;
 
@@ -301,27 +352,7 @@ void MaskingFilterSession::mask_values(ComPacket& response)
         {
             ComQueryResponse::BinaryResultsetRow row(response, m_res.types());
 
-            ComQueryResponse::BinaryResultsetRow::iterator i = row.begin();
-            while (i != row.end())
-            {
-                const MaskingRules::Rule* pRule = m_res.get_rule();
-
-                if (pRule)
-                {
-                    ComQueryResponse::BinaryResultsetRow::Value value = *i;
-
-                    if (value.is_string())
-                    {
-                        LEncString s = value.as_string();
-                        pRule->rewrite(s);
-                    }
-                    else if (m_filter.config().warn_type_mismatch() == Config::WARN_ALWAYS)
-                    {
-                        warn_of_type_mismatch(*pRule);
-                    }
-                }
-                ++i;
-            }
+            mask_row(row, m_res.masked_columns(), m_res.rules_for_columns(), warn);
         }
         break;
 
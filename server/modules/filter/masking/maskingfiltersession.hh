@@ -64,13 +64,14 @@ private:
 private:
     typedef std::tr1::shared_ptr<MaskingRules> SMaskingRules;
 
+    const MaskingRules::AccountRules& account_rules(const SMaskingRules& sRules);
+
     class ResponseState
     {
     public:
         ResponseState()
             : m_command(0)
             , m_nTotal_fields(0)
-            , m_index(0)
             , m_multi_result(false)
             , m_some_rule_matches(false)
         {}
@@ -90,7 +91,7 @@ private:
             m_nTotal_fields = 0;
             m_types.clear();
             m_rules.clear();
-            m_index = 0;
+            m_masked.clear();
             m_multi_result = true;
         }
 
@@ -126,14 +127,15 @@ private:
 
         bool append_type_and_rule(enum_field_types type, const MaskingRules::Rule* pRule)
         {
-            m_types.push_back(type);
-            m_rules.push_back(pRule);
-
             if (pRule)
             {
+                m_masked.push_back(m_rules.size());
                 m_some_rule_matches = true;
             }
 
+            m_types.push_back(type);
+            m_rules.push_back(pRule);
+
             return m_rules.size() == m_nTotal_fields;
         }
 
@@ -142,15 +144,15 @@ private:
             return m_types;
         }
 
-        const MaskingRules::Rule* get_rule()
+        const std::vector<const MaskingRules::Rule*>& rules_for_columns() const
         {
             ss_dassert(m_nTotal_fields == m_rules.size());
-            ss_dassert(m_index < m_rules.size());
-            const MaskingRules::Rule* pRule = m_rules[m_index++];
-            // The rules will be used repeatedly for each row. Hence, once we hit
-            // the end, we need to continue from the start.
-            m_index = m_index % m_rules.size();
-            return pRule;
+            return m_rules;
+        }
+
+        const std::vector<size_t>& masked_columns() const
+        {
+            return m_masked;
         }
 
     private:
@@ -159,12 +161,14 @@ private:
         uint32_t                               m_nTotal_fields;     /*<! The total number of fields. */
         std::vector<enum_field_types>          m_types;             /*<! The column types. */
         std::vector<const MaskingRules::Rule*> m_rules;             /*<! The rules applied for columns. */
-        size_t                                 m_index;             /*<! Index to the current rule.*/
+        std::vector<size_t>                    m_masked;            /*<! Indexes of columns with a rule. */
         bool                                   m_multi_result;      /*<! Are we processing multi-results. */
         bool                                   m_some_rule_matches; /*<! At least one rule matches. */
     };
 
-    const MaskingFilter& m_filter;
-    state_t              m_state;
-    ResponseState        m_res;
+    const MaskingFilter&       m_filter;
+    state_t                    m_state;
+    ResponseState              m_res;
+    SMaskingRules              m_sRules;        /*<! The rules m_account_rules refers to. */
+    MaskingRules::AccountRules m_account_rules; /*<! The rules applying to the session user. */
 };
@@ -167,7 +167,7 @@ public:
             {
                 Closer<pcre2_match_data*> data(pData);
 
-                rv = (pcre2_match(m_pCode, (PCRE2_SPTR)zHost, 0, 0, 0, pData, NULL) >= 0);
+                rv = (pcre2_match(m_pCode, (PCRE2_SPTR)zHost, PCRE2_ZERO_TERMINATED, 0, 0, pData, NULL) >= 0);
             }
         }
 
@@ -665,40 +665,42 @@ bool MaskingRules::Rule::matches(const ComQueryResponse::ColumnDef& column_def,
                                  const char* zUser,
                                  const char* zHost) const
 {
-    bool match =
-        (m_column == column_def.org_name()) &&
-        (m_table.empty() || (m_table == column_def.org_table())) &&
-        (m_database.empty() || (m_database == column_def.schema()));
+    return matches_column(column_def) && matches_account(zUser, zHost);
+}
 
-    if (match)
-    {
-        // If the column matched, then we need to check whether the rule applies
-        // to the user and host.
+bool MaskingRules::Rule::matches_column(const ComQueryResponse::ColumnDef& column_def) const
+{
+    return
+        column_def.org_name().eq(m_column) &&
+        (m_table.empty() || column_def.org_table().eq(m_table)) &&
+        (m_database.empty() || column_def.schema().eq(m_database));
+}
 
-        AccountMatcher matcher(zUser, zHost);
+bool MaskingRules::Rule::matches_account(const char* zUser, const char* zHost) const
+{
+    bool match = true;
 
-        if (m_applies_to.size() != 0)
-        {
-            match = false;
+    AccountMatcher matcher(zUser, zHost);
 
-            vector<SAccount>::const_iterator i = std::find_if(m_applies_to.begin(),
-                                                              m_applies_to.end(),
-                                                              matcher);
+    if (m_applies_to.size() != 0)
+    {
+        vector<SAccount>::const_iterator i = std::find_if(m_applies_to.begin(),
+                                                          m_applies_to.end(),
+                                                          matcher);
 
-            match = (i != m_applies_to.end());
-        }
+        match = (i != m_applies_to.end());
+    }
 
-        if (match && (m_exempted.size() != 0))
-        {
-            // If it is still a match, we need to check whether the user/host is
-            // exempted.
+    if (match && (m_exempted.size() != 0))
+    {
+        // If it is still a match, we need to check whether the user/host is
+        // exempted.
 
-            vector<SAccount>::const_iterator i = std::find_if(m_exempted.begin(),
-                                                              m_exempted.end(),
-                                                              matcher);
+        vector<SAccount>::const_iterator i = std::find_if(m_exempted.begin(),
+                                                          m_exempted.end(),
+                                                          matcher);
 
-            match = (i == m_exempted.end());
-        }
+        match = (i == m_exempted.end());
     }
 
     return match;
@@ -758,6 +760,11 @@ MaskingRules::MaskingRules(json_t* pRoot, const std::vector<SRule>& rules)
     , m_rules(rules)
 {
     json_incref(m_pRoot);
+
+    for (size_t i = 0; i < m_rules.size(); ++i)
+    {
+        m_index[m_rules[i]->column()].push_back(i);
+    }
 }
 
 MaskingRules::~MaskingRules()
@@ -886,3 +893,71 @@ const MaskingRules::Rule* MaskingRules::get_rule_for(const ComQueryResponse::Col
 
     return pRule;
 }
+
+MaskingRules::AccountRules MaskingRules::get_account_rules(const char* zUser, const char* zHost) const
+{
+    AccountRules account_rules;
+
+    account_rules.m_pRules = this;
+    account_rules.m_applies.reserve(m_rules.size());
+
+    for (vector<SRule>::const_iterator i = m_rules.begin(); i != m_rules.end(); ++i)
+    {
+        bool applies = (*i)->matches_account(zUser, zHost);
+
+        account_rules.m_applies.push_back(applies);
+
+        if (applies)
+        {
+            account_rules.m_empty = false;
+        }
+    }
+
+    return account_rules;
+}
+
+const MaskingRules::Rule* MaskingRules::get_rule_for(const ComQueryResponse::ColumnDef& column_def,
+                                                     const vector<bool>& applies) const
+{
+    ss_dassert(applies.size() == m_rules.size());
+
+    const Rule* pRule = NULL;
+
+    RuleIndex::const_iterator i = m_index.find(column_def.org_name().to_string());
+
+    if (i != m_index.end())
+    {
+        const vector<size_t>& indexes = i->second;
+
+        // The indexes are in the order the rules appear in the rules file,
+        // so the first one that matches is the one to use.
+        for (vector<size_t>::const_iterator j = indexes.begin(); !pRule && (j != indexes.end()); ++j)
+        {
+            size_t index = *j;
+
+            if (applies[index] && m_rules[index]->matches_column(column_def))
+            {
+                pRule = m_rules[index].get();
+            }
+        }
+    }
+
+    return pRule;
+}
+
+//
+// MaskingRules::AccountRules
+//
+
+const MaskingRules::Rule* MaskingRules::AccountRules::get_rule_for(const ComQueryResponse::ColumnDef& column_def) const
+{
+    const Rule* pRule = NULL;
+
+    if (!m_empty)
+    {
+        ss_dassert(m_pRules);
+        pRule = m_pRules->get_rule_for(column_def, m_applies);
+    }
+
+    return pRule;
+}
@@ -15,6 +15,7 @@
 #include <maxscale/cppdefs.hh>
 #include <memory>
 #include <tr1/memory>
+#include <tr1/unordered_map>
 #include <string>
 #include <vector>
 #include <jansson.h>
@@ -142,6 +143,27 @@ public:
                      const char* zUser,
                      const char* zHost) const;
 
+        /**
+         * Establish whether a rule matches a column definition, irrespective
+         * of the current user/host.
+         *
+         * @param column_def  A column definition.
+         *
+         * @return True, if the rule matches.
+         */
+        bool matches_column(const ComQueryResponse::ColumnDef& column_def) const;
+
+        /**
+         * Establish whether a rule applies to a user/host, irrespective
+         * of the column.
+         *
+         * @param zUser  The current user.
+         * @param zHost  The current host.
+         *
+         * @return True, if the rule applies to the user/host.
+         */
+        bool matches_account(const char* zUser, const char* zHost) const;
+
         void rewrite(LEncString& s) const;
 
     private:
@@ -158,6 +180,59 @@ public:
         std::vector<SAccount> m_exempted;
     };
 
+    /**
+     * @class AccountRules
+     *
+     * The rules of a @c MaskingRules object that apply to a particular
+     * user/host. Whether a rule applies to an account does not change
+     * during a session, so it can be resolved once and the accounts need
+     * not be considered when columns are subsequently looked up.
+     */
+    class AccountRules
+    {
+    public:
+        AccountRules()
+            : m_pRules(NULL)
+            , m_empty(true)
+        {}
+
+        /**
+         * @return The rules object these account rules were created from.
+         */
+        const MaskingRules* rules() const
+        {
+            return m_pRules;
+        }
+
+        /**
+         * @return True, if no rule applies to the account.
+         */
+        bool empty() const
+        {
+            return m_empty;
+        }
+
+        /**
+         * Return the rule object that matches a column definition.
+         *
+         * @param column_def  A column definition.
+         *
+         * @return A rule object that matches the column definition and
+         *         applies to the account, or NULL if no such rule exists.
+         *
+         * @attention The returned object remains valid only as long as the
+         *            @c MaskingRules object remains valid.
+         */
+        const Rule* get_rule_for(const ComQueryResponse::ColumnDef& column_def) const;
+
+    private:
+        friend class MaskingRules;
+
+        const MaskingRules* m_pRules;  /*<! The rules this object refers to. */
+        std::vector<bool>   m_applies; /*<! Whether the rule at an index applies. */
+        bool                m_empty;   /*<! True, if no rule applies. */
+    };
+
     ~MaskingRules();
 
     /**
@@ -205,16 +280,41 @@ public:
                              const char* zUser,
                              const char* zHost) const;
 
+    /**
+     * Resolve the rules that apply to a user/host.
+     *
+     * @param zUser  The current user.
+     * @param zHost  The current host.
+     *
+     * @return The rules that apply to the user/host.
+     *
+     * @attention The returned object remains valid only as long as the
+     *            @c MaskingRules object remains valid.
+     */
+    AccountRules get_account_rules(const char* zUser, const char* zHost) const;
+
     typedef std::tr1::shared_ptr<Rule> SRule;
 
 private:
     MaskingRules(json_t* pRoot, const std::vector<SRule>& rules);
 
+    const Rule* get_rule_for(const ComQueryResponse::ColumnDef& column_def,
+                             const std::vector<bool>& applies) const;
+
 private:
     MaskingRules(const MaskingRules&);
     MaskingRules& operator = (const MaskingRules&);
 
 private:
+    /**
+     * Maps a column name to the indexes of the rules targeting that column,
+     * in the order the rules appear in the rules file. The database and
+     * table, either of which may be a wildcard, are checked against the
+     * few rules found.
+     */
+    typedef std::tr1::unordered_map<std::string, std::vector<size_t> > RuleIndex;
+
     json_t*            m_pRoot;
     std::vector<SRule> m_rules;
+    RuleIndex          m_index;
 };
@@ -0,0 +1,285 @@
+/*
+ * Copyright (c) 2016 MariaDB Corporation Ab
+ *
+ * Use of this software is governed by the Business Source License included
+ * in the LICENSE.TXT file and at www.mariadb.com/bsl11.
+ *
+ * Change Date: 2019-07-01
+ *
+ * On the date above, in accordance with the Business Source License, use
+ * of this software will be governed by version 2 or later of the General
+ * Public License.
+ */
+
+#include "maskingrules.hh"
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <maxscale/buffer.h>
+#include <maxscale/log_manager.h>
+
+using namespace std;
+
+namespace
+{
+
+char USAGE[] = "usage: maskingrules_profile -n count -r rules -c columns\n";
+
+const char ZUSER[] = "alice";
+const char ZHOST[] = "client.example.com";
+
+double seconds_between(const timespec& later, const timespec& earlier)
+{
+    return (later.tv_sec - earlier.tv_sec) + (later.tv_nsec - earlier.tv_nsec) / 1000000000.0;
+}
+
+/**
+ * Create rules targeting the columns c0, c1, ... Every other rule targets
+ * a specific table, and all rules apply to a handful of accounts.
+ *
+ * @param nRules  The number of rules.
+ *
+ * @return The rules as json.
+ */
+string create_rules(int nRules)
+{
+    stringstream ss;
+
+    ss << "{ \"rules\": [";
+
+    for (int i = 0; i < nRules; ++i)
+    {
+        ss << (i == 0 ? "" : ",")
+           << "{ \"replace\": { \"column\": \"c" << i << "\"";
+
+        if (i % 2 == 0)
+        {
+            ss << ", \"table\": \"t\", \"database\": \"db\"";
+        }
+
+        ss << " }, \"with\": { \"fill\": \"X\" }, "
+           << "\"applies_to\": [ \"'bob'@'%'\", \"'" << ZUSER << "'@'%.example.com'\" ], "
+           << "\"exempted\": [ \"'admin'\" ] }";
+    }
+
+    ss << "] }";
+
+    return ss.str();
+}
+
+uint8_t* add_lenenc_string(uint8_t* pData, const string& s)
+{
+    ss_dassert(s.length() < 251);
+    *pData++ = s.length();
+    memcpy(pData, s.data(), s.length());
+    return pData + s.length();
+}
+
+/**
+ * Create a column definition packet.
+ *
+ * @param column  The name of the column.
+ *
+ * @return A column definition packet of column db.t.column.
+ */
+GWBUF* create_column_def(const string& column)
+{
+    uint8_t payload[512];
+    uint8_t* pData = payload;
+
+    pData = add_lenenc_string(pData, "def");
+    pData = add_lenenc_string(pData, "db");
+    pData = add_lenenc_string(pData, "t");
+    pData = add_lenenc_string(pData, "t");
+    pData = add_lenenc_string(pData, column);
+    pData = add_lenenc_string(pData, column);
+    *pData++ = 0x0c;                 // Length of the fixed length fields.
+    *pData++ = 0x21;                 // Character set (2 bytes).
+    *pData++ = 0x00;
+    memset(pData, 0, 4);             // Column length.
+    pData += 4;
+    *pData++ = MYSQL_TYPE_VAR_STRING;
+    memset(pData, 0, 2 + 1 + 2);     // Flags, decimals and filler.
+    pData += 2 + 1 + 2;
+
+    size_t payload_len = pData - payload;
+
+    GWBUF* pPacket = gwbuf_alloc(MYSQL_HEADER_LEN + payload_len);
+    ss_dassert(pPacket);
+
+    uint8_t* pHeader = GWBUF_DATA(pPacket);
+    gw_mysql_set_byte3(pHeader, payload_len);
+    pHeader[3] = 2;
+    memcpy(pHeader + MYSQL_HEADER_LEN, payload, payload_len);
+
+    return pPacket;
+}
+
+/**
+ * Resolve the rules of the columns @c count times, as if each time a
+ * resultset with these columns were returned, by checking the account
+ * of every rule for every column.
+ *
+ * @return The number of columns a rule was found for.
+ */
+int profile_per_column(const MaskingRules& rules, const vector<GWBUF*>& columns, int count)
+{
+    int nFound = 0;
+
+    for (int i = 0; i < count; ++i)
+    {
+        for (vector<GWBUF*>::const_iterator j = columns.begin(); j != columns.end(); ++j)
+        {
+            ComQueryResponse::ColumnDef column_def(*j);
+
+            if (rules.get_rule_for(column_def, ZUSER, ZHOST))
+            {
+                ++nFound;
+            }
+        }
+    }
+
+    return nFound;
+}
+
+/**
+ * Resolve the rules of the columns @c count times, using the rules of the
+ * account resolved once, as a session does.
+ *
+ * @return The number of columns a rule was found for.
+ */
+int profile_per_session(const MaskingRules& rules, const vector<GWBUF*>& columns, int count)
+{
+    int nFound = 0;
+
+    MaskingRules::AccountRules account_rules = rules.get_account_rules(ZUSER, ZHOST);
+
+    for (int i = 0; i < count; ++i)
+    {
+        for (vector<GWBUF*>::const_iterator j = columns.begin(); j != columns.end(); ++j)
+        {
+            ComQueryResponse::ColumnDef column_def(*j);
+
+            if (account_rules.get_rule_for(column_def))
+            {
+                ++nFound;
+            }
+        }
+    }
+
+    return nFound;
+}
+
+int profile(const char* zName,
+            int (*pProfile)(const MaskingRules&, const vector<GWBUF*>&, int),
+            const MaskingRules& rules,
+            const vector<GWBUF*>& columns,
+            int count)
+{
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC_RAW, &start);
+
+    int nFound = pProfile(rules, columns, count);
+
+    struct timespec finish;
+    clock_gettime(CLOCK_MONOTONIC_RAW, &finish);
+
+    double secs = seconds_between(finish, start);
+
+    cout << setw(12) << left << zName
+         << "Time: " << fixed << setprecision(6) << secs << "s, "
+         << setprecision(0) << (secs > 0 ? count / secs : 0) << " resultsets/s" << endl;
+
+    return nFound;
+}
+
+}
+
+int main(int argc, char* argv[])
+{
+    int rc = EXIT_SUCCESS;
+
+    int nCount = 0;
+    int nRules = 0;
+    int nColumns = 0;
+
+    int c;
+    while ((c = getopt(argc, argv, "n:r:c:")) != -1)
+    {
+        switch (c)
+        {
+        case 'n':
+            nCount = atoi(optarg);
+            break;
+
+        case 'r':
+            nRules = atoi(optarg);
+            break;
+
+        case 'c':
+            nColumns = atoi(optarg);
+            break;
+
+        default:
+            rc = EXIT_FAILURE;
+        }
+    }
+
+    if ((rc == EXIT_SUCCESS) && (nCount > 0) && (nRules > 0) && (nColumns > 0))
+    {
+        rc = EXIT_FAILURE;
+
+        if (mxs_log_init(NULL, ".", MXS_LOG_TARGET_DEFAULT))
+        {
+            auto_ptr<MaskingRules> sRules = MaskingRules::parse(create_rules(nRules).c_str());
+
+            if (sRules.get())
+            {
+                vector<GWBUF*> columns;
+
+                for (int i = 0; i < nColumns; ++i)
+                {
+                    stringstream ss;
+                    // Every other column is not targeted by any rule.
+                    ss << "c" << (i % 2 == 0 ? i : nRules + i);
+                    columns.push_back(create_column_def(ss.str()));
+                }
+
+                int nPer_column = profile("Per column", profile_per_column, *sRules, columns, nCount);
+                int nPer_session = profile("Per session", profile_per_session, *sRules, columns, nCount);
+
+                if (nPer_column == nPer_session)
+                {
+                    cout << "Masked columns: " << nPer_session / nCount << endl;
+                    rc = EXIT_SUCCESS;
+                }
+                else
+                {
+                    cerr << "error: Resolving per column found " << nPer_column
+                         << " rules but per session " << nPer_session << "." << endl;
+                }
+
+                for (vector<GWBUF*>::iterator i = columns.begin(); i != columns.end(); ++i)
+                {
+                    gwbuf_free(*i);
+                }
+            }
+            else
+            {
+                cerr << "error: Could not create the rules." << endl;
+            }
+
+            mxs_log_finish();
+        }
+        else
+        {
+            cerr << "error: Could not initialize log." << endl;
+        }
+    }
+    else
+    {
+        cout << USAGE << endl;
+    }
+
+    return rc;
+}
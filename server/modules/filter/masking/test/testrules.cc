@@ -172,6 +172,25 @@ struct expected_account
 
 const size_t nExpected_accounts = (sizeof(expected_accounts) / sizeof(expected_accounts[0]));
 
+struct account_rules_test
+{
+    const char* zUser;
+    const char* zHost;
+    bool        applies;
+} account_rules_tests[] =
+{
+    { "alice", "host",       true },
+    { "alice", "other",      false },
+    { "bob",   "1.2.3.4",    true },
+    { "cecil", "1.123.45.2", true },
+    { "cecil", "1.2.3.4",    false },
+    { "david", "1.2.3.4",    true },
+    { "eric",  "host",       true },
+    { "admin", "host",       false },
+};
+
+const size_t nAccount_rules_tests = (sizeof(account_rules_tests) / sizeof(account_rules_tests[0]));
+
 class MaskingRulesTester
 {
 public:
@@ -238,6 +257,30 @@ public:
 
         return rc;
     }
+
+    static int test_account_rules()
+    {
+        int rc = EXIT_SUCCESS;
+
+        auto_ptr<MaskingRules> sRules = MaskingRules::parse(valid_users);
+        ss_dassert(sRules.get());
+
+        for (size_t i = 0; i < nAccount_rules_tests; ++i)
+        {
+            const account_rules_test& test = account_rules_tests[i];
+
+            MaskingRules::AccountRules account_rules = sRules->get_account_rules(test.zUser, test.zHost);
+
+            if (account_rules.empty() == test.applies)
+            {
+                cout << test.zUser << "@" << test.zHost << ": Expected the rule "
+                     << (test.applies ? "" : "not ") << "to apply." << endl;
+                rc = EXIT_FAILURE;
+            }
+        }
+
+        return rc;
+    }
 };
 
 int main()
@@ -248,6 +291,7 @@ int main()
     {
         rc = (MaskingRulesTester::test_parsing() == EXIT_FAILURE) ? EXIT_FAILURE : EXIT_SUCCESS;
         rc = (MaskingRulesTester::test_account_handling() == EXIT_FAILURE) ? EXIT_FAILURE : EXIT_SUCCESS;
+        rc = (MaskingRulesTester::test_account_rules() == EXIT_FAILURE) ? EXIT_FAILURE : EXIT_SUCCESS;
     }
 
     return rc;
@@ -20,7 +20,7 @@
 #include <maxscale/modutil.h>
 #include <maxscale/log_manager.h>
 #include <string.h>
-#include <regex.h>
+#include <maxscale/pcre2.h>
 #include <maxscale/hint.h>
 #include <maxscale/alloc.h>
 #include <maxscale/utils.h>
@@ -69,7 +69,7 @@ typedef struct
     char *user; /* User name to restrict matches */
     char *match; /* Regular expression to match */
     char *server; /* Server to route to */
-    regex_t re; /* Compiled regex text */
+    pcre2_code *re; /* Compiled regex text */
 } REGEXHINT_INSTANCE;
 
 static bool validate_ip_address(const char *);
@@ -92,9 +92,9 @@ typedef struct
 
 static const MXS_ENUM_VALUE option_values[] =
 {
-    {"ignorecase", REG_ICASE},
+    {"ignorecase", PCRE2_CASELESS},
     {"case", 0},
-    {"extended", REG_EXTENDED},
+    {"extended", PCRE2_EXTENDED},
     {NULL}
 };
 
@@ -192,9 +192,8 @@ createInstance(const char *name, char **options, MXS_CONFIG_PARAMETER *params)
         bool error = false;
         int cflags = config_get_enum(params, "options", option_values);
 
-        if (regcomp(&my_instance->re, my_instance->match, cflags))
+        if ((my_instance->re = mxs_pcre2_compile(my_instance->match, cflags)) == NULL)
         {
-            MXS_ERROR("Invalid regular expression '%s'.", my_instance->match);
             MXS_FREE(my_instance->match);
             my_instance->match = NULL;
             error = true;
@@ -310,13 +309,13 @@ routeQuery(MXS_FILTER *instance, MXS_FILTER_SESSION *session, GWBUF *queue)
     REGEXHINT_INSTANCE *my_instance = (REGEXHINT_INSTANCE *) instance;
     REGEXHINT_SESSION *my_session = (REGEXHINT_SESSION *) session;
     char *sql;
-    regmatch_t limits[] = {{0, 0}};
+    int len;
 
     if (modutil_is_SQL(queue) && my_session->active)
     {
-        if (modutil_extract_SQL(queue, &sql, &limits[0].rm_eo))
+        if (modutil_extract_SQL(queue, &sql, &len))
         {
-            if (regexec(&my_instance->re, sql, 0, limits, REG_STARTEND) == 0)
+            if (mxs_pcre2_match(my_instance->re, sql, len) == MXS_PCRE2_MATCH)
             {
                 queue->hint = hint_create_route(queue->hint,
                                                 HINT_ROUTE_TO_NAMED_SERVER,
@@ -599,7 +598,7 @@ static void free_instance(REGEXHINT_INSTANCE *instance)
 {
     if (instance->match)
     {
-        regfree(&instance->re);
+        mxs_pcre2_release(instance->re);
         MXS_FREE(instance->match);
     }
 
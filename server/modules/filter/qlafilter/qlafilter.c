@@ -26,6 +26,10 @@
  * file to which the queries are logged. A serial number is appended to this
  * name in order that each session logs to a different file.
  *
+ * If the async parameter is enabled, the worker threads do not write to the
+ * files themselves. Instead, they push compact log records into per-thread
+ * queues from which a background thread formats and writes them in batches.
+ *
  * Date         Who             Description
  * 03/06/2014   Mark Riddoch    Initial implementation
  * 11/06/2014   Mark Riddoch    Addition of source and match parameters
@@ -37,8 +41,13 @@
 #define MXS_MODULE_NAME "qlafilter"
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <fcntl.h>
 #include <errno.h>
+#include <limits.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include <zlib.h>
 #include <maxscale/filter.h>
 #include <maxscale/modinfo.h>
 #include <maxscale/modutil.h>
@@ -46,11 +55,13 @@
 #include <maxscale/log_manager.h>
 #include <time.h>
 #include <sys/time.h>
-#include <regex.h>
+#include <maxscale/pcre2.h>
 #include <string.h>
 #include <maxscale/atomic.h>
 #include <maxscale/alloc.h>
+#include <maxscale/poll.h>
 #include <maxscale/service.h>
+#include <maxscale/thread.h>
 
 /** Date string buffer size */
 #define QLA_DATE_BUFFER_SIZE 20
@@ -72,6 +83,86 @@ enum log_options
 /** Default values for logged data */
 #define LOG_DATA_DEFAULT "date,user,query"
 
+/** What to do when the asynchronous queue of a thread is full */
+enum async_overflow
+{
+    ASYNC_OVERFLOW_DROP,
+    ASYNC_OVERFLOW_BLOCK
+};
+
+/** How long the writer sleeps when there is nothing to write, in milliseconds */
+#define QLA_WRITER_IDLE_SLEEP 5
+
+/** Size of the writer's formatting buffer */
+#define QLA_WRITER_BUFFER_SIZE (64 * 1024)
+
+/** Types of asynchronous log records */
+enum qla_record_type
+{
+    QLA_RECORD_PAD,     /**< Unused space at the end of the queue */
+    QLA_RECORD_ENTRY,   /**< A log entry */
+    QLA_RECORD_CLOSE    /**< The session that owns the file was closed */
+};
+
+/**
+ * A log file written by the asynchronous writer. Session files are closed
+ * by the writer once it processes the close record of the session which
+ * guarantees that all entries of the session have been written.
+ */
+typedef struct qla_file
+{
+    FILE    *fp;         /* The log file, only the header is written with stdio */
+    char    *filename;   /* The file name */
+    uint32_t data_flags; /* What data is written to the file */
+    uint64_t size;       /* Bytes written since the file was opened */
+    int      n_rotated;  /* How many times the file has been rotated */
+} QLA_FILE;
+
+/**
+ * The header of an asynchronous log record. The header is followed by the
+ * service name, the user name, the client address and the SQL, none of which
+ * are null-terminated. Records are aligned to eight bytes.
+ */
+typedef struct qla_record
+{
+    uint32_t  length;      /* Length of the record, including the header */
+    uint32_t  type;        /* One of qla_record_type */
+    QLA_FILE *file;        /* The file the entry is written to */
+    time_t    time;        /* When the query was received */
+    size_t    ses_id;      /* The session ID */
+    uint16_t  service_len; /* Length of the service name */
+    uint16_t  user_len;    /* Length of the user name */
+    uint16_t  remote_len;  /* Length of the client address */
+    uint32_t  sql_len;     /* Length of the SQL */
+} QLA_RECORD;
+
+#define QLA_ALIGN(n) (((n) + 7) & ~(size_t)7)
+
+#define QLA_CACHE_LINE 64
+
+/**
+ * A single-producer, single-consumer queue of log records. Only the worker
+ * thread that owns the queue moves the head and only the writer moves the
+ * tail. The offsets grow monotonically and are masked to get the position.
+ *
+ * The fields written by the owner and the tail written by the writer are on
+ * separate cache lines so that the two threads do not invalidate each other's
+ * line on every record.
+ */
+typedef struct qla_queue
+{
+    /** Written by the owner */
+    uint8_t *data;       /* The records */
+    uint64_t head;       /* Where the next record is written */
+    uint64_t n_queued;   /* Number of queued entries */
+    uint64_t n_dropped;  /* Number of dropped entries */
+    uint64_t n_blocked;  /* Number of times the owner waited for space */
+    char     owner_pad[QLA_CACHE_LINE - sizeof(uint8_t*) - 4 * sizeof(uint64_t)];
+    /** Written by the writer */
+    uint64_t tail;       /* Where the next record is read */
+    char     writer_pad[QLA_CACHE_LINE - sizeof(uint64_t)];
+} __attribute__((aligned(QLA_CACHE_LINE))) QLA_QUEUE;
+
 /*
  * The filter entry points
  */
@@ -100,9 +191,9 @@ typedef struct
     char *source; /* The source of the client connection to filter on */
     char *user_name; /* The user name to filter on */
     char *match; /* Optional text to match against */
-    regex_t re; /* Compiled regex text */
+    pcre2_code *re; /* Compiled regex text */
     char *nomatch; /* Optional text to match against for exclusion */
-    regex_t nore; /* Compiled regex nomatch text */
+    pcre2_code *nore; /* Compiled regex nomatch text */
     uint32_t log_mode_flags; /* Log file mode settings */
     uint32_t log_file_data_flags; /* What data is saved to the files */
     FILE *unified_fp; /* Unified log file. The pointer needs to be shared here
@@ -110,6 +201,19 @@ typedef struct
     bool flush_writes; /* Flush log file after every write? */
     bool append;    /* Open files in append-mode? */
     bool write_warning_given; /* To make sure some warning are only given once */
+    bool async;     /* Write the log files in a background thread? */
+    enum async_overflow overflow; /* What to do when a queue is full */
+    uint64_t rotate_size; /* Rotate the files when they grow this large, 0 for never */
+    bool compress;  /* Compress rotated files? */
+    QLA_FILE *unified_file; /* The unified log file in asynchronous mode */
+    QLA_QUEUE *queues; /* Per-thread record queues */
+    int n_queues;   /* Number of queues */
+    size_t queue_size; /* Size of each queue in bytes, a power of two */
+    THREAD writer;  /* The background writer */
+    bool writer_running; /* Whether the writer has been started */
+    bool writer_shutdown; /* Tells the writer to write all records and exit */
+    uint64_t n_written; /* Entries written by the writer */
+    uint64_t n_writes; /* Number of writev calls made by the writer */
 } QLA_INSTANCE;
 
 /**
@@ -130,17 +234,25 @@ typedef struct
     char *service;    /* The service name this filter is attached to. Not owned. */
     size_t ses_id;    /* The session this filter serves */
     const char *user; /* The client */
+    QLA_FILE *file;   /* The session-specific log file in asynchronous mode */
 } QLA_SESSION;
 
 static FILE* open_log_file(uint32_t, QLA_INSTANCE *, const char *);
 static int write_log_entry(uint32_t, FILE*, QLA_INSTANCE*, QLA_SESSION*, const char*,
                            const char*, size_t);
+static QLA_FILE* qla_file_open(QLA_INSTANCE *instance, const char *filename, uint32_t data_flags);
+static void qla_file_close(QLA_FILE *file);
+static bool qla_async_start(QLA_INSTANCE *instance, uint64_t queue_size);
+static void qla_async_stop(QLA_INSTANCE *instance);
+static void qla_async_push(QLA_INSTANCE *instance, QLA_SESSION *session, QLA_FILE *file,
+                           uint32_t type, time_t now, const char *sql, size_t sql_len);
+static void destroyInstance(MXS_FILTER *instance);
 
 static const MXS_ENUM_VALUE option_values[] =
 {
-    {"ignorecase", REG_ICASE},
+    {"ignorecase", PCRE2_CASELESS},
     {"case",       0},
-    {"extended",   REG_EXTENDED},
+    {"extended",   PCRE2_EXTENDED},
     {NULL}
 };
 
@@ -151,6 +263,13 @@ static const MXS_ENUM_VALUE log_type_values[] =
     {NULL}
 };
 
+static const MXS_ENUM_VALUE async_overflow_values[] =
+{
+    {"drop",  ASYNC_OVERFLOW_DROP},
+    {"block", ASYNC_OVERFLOW_BLOCK},
+    {NULL}
+};
+
 static const MXS_ENUM_VALUE log_data_values[] =
 {
     {"service", LOG_DATA_SERVICE},
@@ -183,7 +302,7 @@ MXS_MODULE* MXS_CREATE_MODULE()
         NULL, // No client reply
         diagnostic,
         getCapabilities,
-        NULL, // No destroyInstance
+        destroyInstance,
     };
 
     static MXS_MODULE info =
@@ -252,6 +371,33 @@ MXS_MODULE* MXS_CREATE_MODULE()
                 MXS_MODULE_PARAM_BOOL,
                 "false"
             },
+            {
+                "async",
+                MXS_MODULE_PARAM_BOOL,
+                "false"
+            },
+            {
+                "async_queue_size",
+                MXS_MODULE_PARAM_SIZE,
+                "1Mi"
+            },
+            {
+                "async_overflow",
+                MXS_MODULE_PARAM_ENUM,
+                "drop",
+                MXS_MODULE_OPT_NONE,
+                async_overflow_values
+            },
+            {
+                "rotate_size",
+                MXS_MODULE_PARAM_SIZE,
+                "0"
+            },
+            {
+                "compress",
+                MXS_MODULE_PARAM_BOOL,
+                "false"
+            },
             {MXS_END_MODULE_PARAMS}
         }
     };
@@ -289,11 +435,25 @@ createInstance(const char *name, char **options, MXS_CONFIG_PARAMETER *params)
         my_instance->user_name = config_copy_string(params, "user");
         my_instance->log_file_data_flags = config_get_enum(params, "log_data", log_data_values);
         my_instance->log_mode_flags = config_get_enum(params, "log_type", log_type_values);
+        my_instance->async = config_get_bool(params, "async");
+        my_instance->overflow = config_get_enum(params, "async_overflow", async_overflow_values);
+        my_instance->rotate_size = config_get_size(params, "rotate_size");
+        my_instance->compress = config_get_bool(params, "compress");
+        my_instance->unified_file = NULL;
+        my_instance->re = NULL;
+        my_instance->nore = NULL;
+        my_instance->queues = NULL;
+        my_instance->n_queues = 0;
+        my_instance->writer_running = false;
+        my_instance->writer_shutdown = false;
+        my_instance->n_written = 0;
+        my_instance->n_writes = 0;
         bool error = false;
 
         int cflags = config_get_enum(params, "options", option_values);
 
-        if (my_instance->match && regcomp(&my_instance->re, my_instance->match, cflags))
+        if (my_instance->match &&
+            (my_instance->re = mxs_pcre2_compile(my_instance->match, cflags)) == NULL)
         {
             MXS_ERROR("Invalid regular expression '%s' for the 'match' "
                       "parameter.", my_instance->match);
@@ -302,7 +462,8 @@ createInstance(const char *name, char **options, MXS_CONFIG_PARAMETER *params)
             error = true;
         }
 
-        if (my_instance->nomatch && regcomp(&my_instance->nore, my_instance->nomatch, cflags))
+        if (my_instance->nomatch &&
+            (my_instance->nore = mxs_pcre2_compile(my_instance->nomatch, cflags)) == NULL)
         {
             MXS_ERROR("Invalid regular expression '%s' for the 'nomatch'"
                       " parameter.", my_instance->nomatch);
@@ -322,8 +483,18 @@ createInstance(const char *name, char **options, MXS_CONFIG_PARAMETER *params)
             {
                 snprintf(filename, namelen, "%s.unified", my_instance->filebase);
                 // Open the file. It is only closed at program exit
-                my_instance->unified_fp = open_log_file(my_instance->log_file_data_flags,
-                                                        my_instance, filename);
+                if (my_instance->async)
+                {
+                    my_instance->unified_file = qla_file_open(my_instance, filename,
+                                                              my_instance->log_file_data_flags);
+                    my_instance->unified_fp = my_instance->unified_file ?
+                                              my_instance->unified_file->fp : NULL;
+                }
+                else
+                {
+                    my_instance->unified_fp = open_log_file(my_instance->log_file_data_flags,
+                                                            my_instance, filename);
+                }
 
                 if (my_instance->unified_fp == NULL)
                 {
@@ -342,20 +513,23 @@ createInstance(const char *name, char **options, MXS_CONFIG_PARAMETER *params)
             }
         }
 
-        if (error)
+        if (!error && my_instance->async &&
+            !qla_async_start(my_instance, config_get_size(params, "async_queue_size")))
         {
-            if (my_instance->match)
-            {
-                MXS_FREE(my_instance->match);
-                regfree(&my_instance->re);
-            }
+            error = true;
+        }
 
-            if (my_instance->nomatch)
+        if (error)
+        {
+            MXS_FREE(my_instance->match);
+            mxs_pcre2_release(my_instance->re);
+            MXS_FREE(my_instance->nomatch);
+            mxs_pcre2_release(my_instance->nore);
+            if (my_instance->unified_file != NULL)
             {
-                MXS_FREE(my_instance->nomatch);
-                regfree(&my_instance->nore);
+                qla_file_close(my_instance->unified_file);
             }
-            if (my_instance->unified_fp != NULL)
+            else if (my_instance->unified_fp != NULL)
             {
                 fclose(my_instance->unified_fp);
             }
@@ -423,7 +597,16 @@ newSession(MXS_FILTER *instance, MXS_SESSION *session)
         {
             uint32_t data_flags = (my_instance->log_file_data_flags &
                                    ~LOG_DATA_SESSION); // No point printing "Session"
-            my_session->fp = open_log_file(data_flags, my_instance, my_session->filename);
+
+            if (my_instance->async)
+            {
+                my_session->file = qla_file_open(my_instance, my_session->filename, data_flags);
+                my_session->fp = my_session->file ? my_session->file->fp : NULL;
+            }
+            else
+            {
+                my_session->fp = open_log_file(data_flags, my_instance, my_session->filename);
+            }
 
             if (my_session->fp == NULL)
             {
@@ -452,9 +635,17 @@ newSession(MXS_FILTER *instance, MXS_SESSION *session)
 static void
 closeSession(MXS_FILTER *instance, MXS_FILTER_SESSION *session)
 {
+    QLA_INSTANCE *my_instance = (QLA_INSTANCE *) instance;
     QLA_SESSION *my_session = (QLA_SESSION *) session;
 
-    if (my_session->active && my_session->fp)
+    if (my_session->file)
+    {
+        /** The writer closes the file once it has written the queued entries */
+        qla_async_push(my_instance, my_session, my_session->file, QLA_RECORD_CLOSE, 0, NULL, 0);
+        my_session->file = NULL;
+        my_session->fp = NULL;
+    }
+    else if (my_session->active && my_session->fp)
     {
         fclose(my_session->fp);
     }
@@ -510,17 +701,37 @@ routeQuery(MXS_FILTER *instance, MXS_FILTER_SESSION *session, GWBUF *queue)
     char *sql;
     struct tm t;
     struct timeval tv;
-    regmatch_t limits[] = {{0, 0}};
+    int length;
 
     if (my_session->active)
     {
-        if (modutil_extract_SQL(queue, &sql, &limits[0].rm_eo))
+        if (modutil_extract_SQL(queue, &sql, &length))
         {
-            if ((my_instance->match == NULL ||
-                 regexec(&my_instance->re, sql, 0, limits, REG_STARTEND) == 0) &&
-                (my_instance->nomatch == NULL ||
-                 regexec(&my_instance->nore, sql, 0, limits, REG_STARTEND) != 0))
+            if ((my_instance->re == NULL ||
+                 mxs_pcre2_match(my_instance->re, sql, length) == MXS_PCRE2_MATCH) &&
+                (my_instance->nore == NULL ||
+                 mxs_pcre2_match(my_instance->nore, sql, length) != MXS_PCRE2_MATCH))
             {
+                if (my_instance->async)
+                {
+                    /** The writer formats the entries */
+                    time_t now = time(NULL);
+
+                    if (my_session->file)
+                    {
+                        qla_async_push(my_instance, my_session, my_session->file,
+                                       QLA_RECORD_ENTRY, now, sql, length);
+                    }
+                    if (my_instance->unified_file)
+                    {
+                        qla_async_push(my_instance, my_session, my_instance->unified_file,
+                                       QLA_RECORD_ENTRY, now, sql, length);
+                    }
+
+                    return my_session->down.routeQuery(my_session->down.instance,
+                                                       my_session->down.session, queue);
+                }
+
                 char buffer[QLA_DATE_BUFFER_SIZE];
                 gettimeofday(&tv, NULL);
                 localtime_r(&tv.tv_sec, &t);
@@ -530,7 +741,6 @@ routeQuery(MXS_FILTER *instance, MXS_FILTER_SESSION *session, GWBUF *queue)
                  * Loop over all the possible log file modes and write to
                  * the enabled files.
                  */
-                int length = limits[0].rm_eo;
                 bool write_error = false;
                 if (my_instance->log_mode_flags & CONFIG_FILE_SESSION)
                 {
@@ -611,6 +821,42 @@ diagnostic(MXS_FILTER *instance, MXS_FILTER_SESSION *fsession, DCB *dcb)
         dcb_printf(dcb, "\t\tExclude queries that match     %s\n",
                    my_instance->nomatch);
     }
+    if (my_instance->async && my_session == NULL)
+    {
+        uint64_t n_queued = 0;
+        uint64_t n_dropped = 0;
+        uint64_t n_blocked = 0;
+
+        for (int i = 0; i < my_instance->n_queues; i++)
+        {
+            n_queued += my_instance->queues[i].n_queued;
+            n_dropped += my_instance->queues[i].n_dropped;
+            n_blocked += my_instance->queues[i].n_blocked;
+        }
+
+        dcb_printf(dcb, "\t\tAsynchronous entries queued       %lu\n", n_queued);
+        dcb_printf(dcb, "\t\tAsynchronous entries written      %lu\n", my_instance->n_written);
+        dcb_printf(dcb, "\t\tAsynchronous entries dropped      %lu\n", n_dropped);
+        dcb_printf(dcb, "\t\tTimes a full queue was waited on  %lu\n", n_blocked);
+        dcb_printf(dcb, "\t\tNumber of batched writes          %lu\n", my_instance->n_writes);
+    }
+}
+
+/**
+ * Destroy the filter instance
+ *
+ * Stops the asynchronous writer after it has written all queued entries.
+ *
+ * @param instance The filter instance
+ */
+static void destroyInstance(MXS_FILTER *instance)
+{
+    QLA_INSTANCE *my_instance = (QLA_INSTANCE *) instance;
+
+    if (my_instance->async)
+    {
+        qla_async_stop(my_instance);
+    }
 }
 
 /**
@@ -863,3 +1109,631 @@ static int write_log_entry(uint32_t data_flags, FILE *logfile, QLA_INSTANCE *ins
         return rval;
     }
 }
+
+/**
+ * Open a log file for the asynchronous writer
+ *
+ * @param instance   Filter instance
+ * @param filename   File to open
+ * @param data_flags What data is written to the file
+ * @return The opened file or NULL on error
+ */
+static QLA_FILE* qla_file_open(QLA_INSTANCE *instance, const char *filename, uint32_t data_flags)
+{
+    QLA_FILE *file = MXS_MALLOC(sizeof(QLA_FILE));
+    char *name = MXS_STRDUP(filename);
+
+    if (file && name)
+    {
+        file->filename = name;
+        file->data_flags = data_flags;
+        file->size = 0;
+        file->n_rotated = 0;
+
+        /** The entries are written directly to the file descriptor so the
+         * header must not be left in the stdio buffer */
+        if ((file->fp = open_log_file(data_flags, instance, filename)) && fflush(file->fp) == 0)
+        {
+            return file;
+        }
+
+        if (file->fp)
+        {
+            fclose(file->fp);
+        }
+    }
+
+    MXS_FREE(name);
+    MXS_FREE(file);
+    return NULL;
+}
+
+/**
+ * Close an asynchronous log file
+ *
+ * @param file File to close
+ */
+static void qla_file_close(QLA_FILE *file)
+{
+    if (file->fp)
+    {
+        fclose(file->fp);
+    }
+
+    MXS_FREE(file->filename);
+    MXS_FREE(file);
+}
+
+/**
+ * Compress a file with gzip and remove the original
+ *
+ * @param filename File to compress
+ */
+static void compress_file(const char *filename)
+{
+    char gzname[strlen(filename) + sizeof(".gz")];
+    sprintf(gzname, "%s.gz", filename);
+
+    FILE *in = fopen(filename, "r");
+    gzFile out = in ? gzopen(gzname, "wb") : NULL;
+    bool ok = in && out;
+
+    if (ok)
+    {
+        char buffer[QLA_WRITER_BUFFER_SIZE];
+        size_t n;
+
+        while (ok && (n = fread(buffer, 1, sizeof(buffer), in)) > 0)
+        {
+            ok = gzwrite(out, buffer, n) == (int)n;
+        }
+
+        ok = ok && !ferror(in);
+    }
+
+    if (in)
+    {
+        fclose(in);
+    }
+
+    if (out && gzclose(out) != Z_OK)
+    {
+        ok = false;
+    }
+
+    if (ok)
+    {
+        unlink(filename);
+    }
+    else
+    {
+        MXS_ERROR("Failed to compress rotated query log '%s'.", filename);
+        unlink(gzname);
+    }
+}
+
+/**
+ * Rotate an asynchronous log file
+ *
+ * The current file is renamed by appending a sequence number to its name,
+ * optionally compressed, and a new file is opened in its place.
+ *
+ * @param instance Filter instance
+ * @param file     File to rotate
+ */
+static void qla_file_rotate(QLA_INSTANCE *instance, QLA_FILE *file)
+{
+    char rotated[strlen(file->filename) + 12];
+    sprintf(rotated, "%s.%d", file->filename, ++file->n_rotated);
+
+    fclose(file->fp);
+    file->fp = NULL;
+    file->size = 0;
+
+    if (rename(file->filename, rotated) == 0)
+    {
+        if (instance->compress)
+        {
+            compress_file(rotated);
+        }
+    }
+    else
+    {
+        char errbuf[MXS_STRERROR_BUFLEN];
+        MXS_ERROR("Failed to rotate query log '%s': %d, %s", file->filename,
+                  errno, strerror_r(errno, errbuf, sizeof(errbuf)));
+    }
+
+    if ((file->fp = open_log_file(file->data_flags, instance, file->filename)) == NULL ||
+        fflush(file->fp) != 0)
+    {
+        MXS_ERROR("Failed to reopen query log '%s' after rotation, entries "
+                  "written to it are discarded.", file->filename);
+    }
+}
+
+/**
+ * Queue a record for the asynchronous writer
+ *
+ * The record is added to the queue of the calling polling thread. If the
+ * queue is full, entries are either dropped or the thread waits until the
+ * writer has made room for it. Close records are never dropped.
+ *
+ * @param instance Filter instance
+ * @param session  Filter session
+ * @param file     The file the record is for
+ * @param type     Record type
+ * @param now      When the query was received
+ * @param sql      The SQL, not null-terminated
+ * @param sql_len  Length of the SQL
+ */
+static void qla_async_push(QLA_INSTANCE *instance, QLA_SESSION *session, QLA_FILE *file,
+                           uint32_t type, time_t now, const char *sql, size_t sql_len)
+{
+    int thread_id = poll_get_thread_id();
+
+    if (thread_id < 0 || thread_id >= instance->n_queues)
+    {
+        /** Only polling threads have a queue */
+        if (type == QLA_RECORD_CLOSE)
+        {
+            MXS_ERROR("qla-filter '%s': Session closed outside of a polling thread, "
+                      "its log file is left open.", instance->name);
+        }
+        return;
+    }
+
+    QLA_QUEUE *queue = &instance->queues[thread_id];
+    size_t service_len = 0;
+    size_t user_len = 0;
+    size_t remote_len = 0;
+
+    if (type == QLA_RECORD_ENTRY)
+    {
+        /** Only copy the data that ends up in the file */
+        if (file->data_flags & LOG_DATA_SERVICE)
+        {
+            service_len = MXS_MIN(strlen(session->service), UINT16_MAX);
+        }
+        if (file->data_flags & LOG_DATA_USER)
+        {
+            user_len = MXS_MIN(strlen(session->user), UINT16_MAX);
+            remote_len = MXS_MIN(strlen(session->remote), UINT16_MAX);
+        }
+        if (file->data_flags & LOG_DATA_QUERY)
+        {
+            /** Very long statements are truncated so that they never fill
+             * the whole queue */
+            sql_len = MXS_MIN(sql_len, instance->queue_size / 4);
+        }
+        else
+        {
+            sql_len = 0;
+        }
+    }
+
+    size_t length = QLA_ALIGN(sizeof(QLA_RECORD) + service_len + user_len + remote_len + sql_len);
+
+    if (length > instance->queue_size / 2)
+    {
+        queue->n_dropped++;
+        return;
+    }
+    uint64_t head = queue->head;
+    size_t pos = head & (instance->queue_size - 1);
+    size_t contiguous = instance->queue_size - pos;
+    size_t needed = length <= contiguous ? length : contiguous + length;
+    bool waited = false;
+
+    while (instance->queue_size - (head - __atomic_load_n(&queue->tail, __ATOMIC_ACQUIRE)) < needed)
+    {
+        if (type == QLA_RECORD_ENTRY && instance->overflow == ASYNC_OVERFLOW_DROP)
+        {
+            queue->n_dropped++;
+            return;
+        }
+
+        if (!waited)
+        {
+            queue->n_blocked++;
+            waited = true;
+        }
+
+        thread_millisleep(1);
+    }
+
+    if (length > contiguous)
+    {
+        /** Records are never split, skip to the start of the queue */
+        QLA_RECORD *pad = (QLA_RECORD*)(queue->data + pos);
+        pad->length = contiguous;
+        pad->type = QLA_RECORD_PAD;
+        head += contiguous;
+        pos = 0;
+    }
+
+    QLA_RECORD *record = (QLA_RECORD*)(queue->data + pos);
+    record->length = length;
+    record->type = type;
+    record->file = file;
+    record->time = now;
+    record->ses_id = session->ses_id;
+    record->service_len = service_len;
+    record->user_len = user_len;
+    record->remote_len = remote_len;
+    record->sql_len = sql_len;
+
+    char *ptr = (char*)(record + 1);
+    memcpy(ptr, session->service, service_len);
+    ptr += service_len;
+    memcpy(ptr, session->user, user_len);
+    ptr += user_len;
+    memcpy(ptr, session->remote, remote_len);
+    ptr += remote_len;
+
+    if (sql_len)
+    {
+        memcpy(ptr, sql, sql_len);
+    }
+
+    if (type == QLA_RECORD_ENTRY)
+    {
+        queue->n_queued++;
+    }
+
+    /** Publish the record to the writer */
+    __atomic_store_n(&queue->head, head + length, __ATOMIC_RELEASE);
+}
+
+/**
+ * The state of one batch of the writer
+ */
+typedef struct qla_batch
+{
+    QLA_FILE    *file;                           /* The file the batch is for */
+    struct iovec iov[IOV_MAX];                   /* Data to write */
+    int          n_iov;                          /* Used elements of iov */
+    size_t       n_bytes;                        /* Bytes in iov */
+    int          n_entries;                      /* Entries in the batch */
+    char         buffer[QLA_WRITER_BUFFER_SIZE]; /* Formatted entry prefixes */
+    size_t       used;                           /* Used bytes of buffer */
+    time_t       date_time;                      /* Time of the cached date */
+    char         date[QLA_DATE_BUFFER_SIZE];     /* Cached date string */
+} QLA_BATCH;
+
+/**
+ * Write the batch to its file
+ *
+ * @param instance Filter instance
+ * @param batch    Batch to write
+ */
+static void qla_batch_flush(QLA_INSTANCE *instance, QLA_BATCH *batch)
+{
+    QLA_FILE *file = batch->file;
+    struct iovec *iov = batch->iov;
+    int n_iov = batch->n_iov;
+    bool error = file->fp == NULL;
+
+    while (n_iov > 0 && !error)
+    {
+        ssize_t written = writev(fileno(file->fp), iov, n_iov);
+        instance->n_writes++;
+
+        if (written < 0)
+        {
+            if (errno != EINTR)
+            {
+                error = true;
+            }
+            continue;
+        }
+
+        file->size += written;
+
+        /** Skip the parts that were written, a partial write can end in
+         * the middle of an element */
+        while (n_iov > 0 && (size_t)written >= iov->iov_len)
+        {
+            written -= iov->iov_len;
+            iov++;
+            n_iov--;
+        }
+
+        if (n_iov > 0)
+        {
+            iov->iov_base = (char*)iov->iov_base + written;
+            iov->iov_len -= written;
+        }
+    }
+
+    if (error && !instance->write_warning_given)
+    {
+        MXS_ERROR("qla-filter '%s': Log file write failed. "
+                  "Suppressing further similar warnings.",
+                  instance->name);
+        instance->write_warning_given = true;
+    }
+
+    instance->n_written += batch->n_entries;
+
+    if (instance->rotate_size && file->size >= instance->rotate_size)
+    {
+        qla_file_rotate(instance, file);
+    }
+
+    batch->n_iov = 0;
+    batch->n_bytes = 0;
+    batch->n_entries = 0;
+    batch->used = 0;
+}
+
+/**
+ * Add an entry to the batch
+ *
+ * The prefix of the entry is formatted into the batch buffer and the SQL is
+ * written directly from the queue.
+ *
+ * @param instance Filter instance
+ * @param batch    The current batch
+ * @param record   The record to add
+ */
+static void qla_batch_add(QLA_INSTANCE *instance, QLA_BATCH *batch, QLA_RECORD *record)
+{
+    size_t max_prefix = record->service_len + record->user_len + record->remote_len +
+                        QLA_DATE_BUFFER_SIZE + 40;
+
+    if (batch->file && (batch->file != record->file ||
+                        batch->n_iov + 3 > IOV_MAX ||
+                        batch->used + max_prefix > sizeof(batch->buffer)))
+    {
+        qla_batch_flush(instance, batch);
+    }
+
+    batch->file = record->file;
+
+    uint32_t data_flags = record->file->data_flags;
+    const char *service = (const char*)(record + 1);
+    const char *user = service + record->service_len;
+    const char *remote = user + record->user_len;
+    const char *sql = remote + record->remote_len;
+    char *start = batch->buffer + batch->used;
+    char *ptr = start;
+
+    if (data_flags & LOG_DATA_SERVICE)
+    {
+        ptr += sprintf(ptr, "%.*s,", (int)record->service_len, service);
+    }
+    if (data_flags & LOG_DATA_SESSION)
+    {
+        ptr += sprintf(ptr, "%lu,", record->ses_id);
+    }
+    if (data_flags & LOG_DATA_DATE)
+    {
+        if (record->time != batch->date_time || batch->date[0] == '\0')
+        {
+            struct tm t;
+            localtime_r(&record->time, &t);
+            strftime(batch->date, sizeof(batch->date), "%F %T", &t);
+            batch->date_time = record->time;
+        }
+
+        ptr += sprintf(ptr, "%s,", batch->date);
+    }
+    if (data_flags & LOG_DATA_USER)
+    {
+        ptr += sprintf(ptr, "%.*s@%.*s,", (int)record->user_len, user,
+                       (int)record->remote_len, remote);
+    }
+
+    if (data_flags & LOG_DATA_QUERY)
+    {
+        static char newline[] = "\n";
+        batch->iov[batch->n_iov].iov_base = start;
+        batch->iov[batch->n_iov++].iov_len = ptr - start;
+        batch->iov[batch->n_iov].iov_base = (void*)sql;
+        batch->iov[batch->n_iov++].iov_len = record->sql_len;
+        batch->iov[batch->n_iov].iov_base = newline;
+        batch->iov[batch->n_iov++].iov_len = 1;
+    }
+    else if (ptr > start)
+    {
+        // Overwrite the last ','
+        *(ptr - 1) = '\n';
+        batch->iov[batch->n_iov].iov_base = start;
+        batch->iov[batch->n_iov++].iov_len = ptr - start;
+    }
+
+    batch->used += ptr - start;
+    batch->n_entries++;
+}
+
+/**
+ * Write the queued records of one thread
+ *
+ * @param instance Filter instance
+ * @param queue    The queue to process
+ * @param batch    Batch buffer to use
+ * @return Number of processed records
+ */
+static int qla_writer_process_queue(QLA_INSTANCE *instance, QLA_QUEUE *queue, QLA_BATCH *batch)
+{
+    uint64_t head = __atomic_load_n(&queue->head, __ATOMIC_ACQUIRE);
+    uint64_t tail = queue->tail;
+    int n_records = 0;
+
+    batch->file = NULL;
+
+    while (tail < head)
+    {
+        QLA_RECORD *record = (QLA_RECORD*)(queue->data + (tail & (instance->queue_size - 1)));
+
+        if (record->type == QLA_RECORD_ENTRY)
+        {
+            qla_batch_add(instance, batch, record);
+        }
+        else if (record->type == QLA_RECORD_CLOSE)
+        {
+            if (batch->file)
+            {
+                qla_batch_flush(instance, batch);
+                batch->file = NULL;
+            }
+
+            qla_file_close(record->file);
+        }
+
+        tail += record->length;
+        n_records++;
+    }
+
+    if (batch->file)
+    {
+        qla_batch_flush(instance, batch);
+    }
+
+    /** The SQL is written directly from the queue so the space can only be
+     * released after the batch is written */
+    __atomic_store_n(&queue->tail, tail, __ATOMIC_RELEASE);
+
+    return n_records;
+}
+
+/**
+ * The main loop of the asynchronous writer
+ *
+ * @param data The filter instance
+ */
+static void qla_writer_main(void *data)
+{
+    QLA_INSTANCE *instance = (QLA_INSTANCE*)data;
+    QLA_BATCH *batch = MXS_CALLOC(1, sizeof(QLA_BATCH));
+    bool shutdown = false;
+
+    if (batch == NULL)
+    {
+        return;
+    }
+
+    while (true)
+    {
+        int n_records = 0;
+
+        for (int i = 0; i < instance->n_queues; i++)
+        {
+            n_records += qla_writer_process_queue(instance, &instance->queues[i], batch);
+        }
+
+        if (n_records == 0)
+        {
+            if (shutdown)
+            {
+                break;
+            }
+
+            /** Make one more pass after the shutdown was requested so that
+             * everything queued before it gets written */
+            shutdown = __atomic_load_n(&instance->writer_shutdown, __ATOMIC_ACQUIRE);
+
+            if (!shutdown)
+            {
+                thread_millisleep(QLA_WRITER_IDLE_SLEEP);
+            }
+        }
+    }
+
+    MXS_FREE(batch);
+}
+
+/**
+ * Allocate the queues and start the asynchronous writer
+ *
+ * @param instance   Filter instance
+ * @param queue_size Requested size of each queue
+ * @return True if the writer was started
+ */
+static bool qla_async_start(QLA_INSTANCE *instance, uint64_t queue_size)
+{
+    /** The queue positions are masked so the size must be a power of two */
+    size_t size = 4096;
+
+    while (size < queue_size)
+    {
+        size <<= 1;
+    }
+
+    instance->queue_size = size;
+    instance->n_queues = config_threadcount();
+    instance->queues = NULL;
+
+    /** The queues must be aligned to a cache line for the padding to work */
+    size_t queues_size = instance->n_queues * sizeof(QLA_QUEUE);
+    bool ok = posix_memalign((void**)&instance->queues, QLA_CACHE_LINE, queues_size) == 0;
+
+    if (ok)
+    {
+        memset(instance->queues, 0, queues_size);
+    }
+    else
+    {
+        instance->queues = NULL;
+        MXS_OOM();
+    }
+
+    for (int i = 0; ok && i < instance->n_queues; i++)
+    {
+        /** Records are aligned to eight bytes */
+        if ((instance->queues[i].data = MXS_MALLOC(size)) == NULL)
+        {
+            ok = false;
+        }
+    }
+
+    if (ok && thread_start(&instance->writer, qla_writer_main, instance) == NULL)
+    {
+        MXS_ERROR("Failed to start the asynchronous writer of qla-filter '%s'.", instance->name);
+        ok = false;
+    }
+
+    if (!ok)
+    {
+        for (int i = 0; instance->queues && i < instance->n_queues; i++)
+        {
+            MXS_FREE(instance->queues[i].data);
+        }
+
+        MXS_FREE(instance->queues);
+        instance->queues = NULL;
+        instance->n_queues = 0;
+    }
+
+    instance->writer_running = ok;
+    return ok;
+}
+
+/**
+ * Stop the asynchronous writer
+ *
+ * Waits until all queued entries are written and then closes the unified
+ * log file. The worker threads must no longer route queries through the
+ * filter.
+ *
+ * @param instance Filter instance
+ */
+static void qla_async_stop(QLA_INSTANCE *instance)
+{
+    /** A filter can be shared by multiple services */
+    if (instance->writer_running)
+    {
+        instance->writer_running = false;
+        __atomic_store_n(&instance->writer_shutdown, true, __ATOMIC_RELEASE);
+        thread_wait(instance->writer);
+
+        /** The writer has written everything, so the unified file can be closed */
+        if (instance->unified_file)
+        {
+            qla_file_close(instance->unified_file);
+            instance->unified_file = NULL;
+            instance->unified_fp = NULL;
+        }
+    }
+}
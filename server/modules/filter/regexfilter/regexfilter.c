@@ -51,8 +51,8 @@ static int routeQuery(MXS_FILTER *instance, MXS_FILTER_SESSION *fsession, GWBUF
 static void diagnostic(MXS_FILTER *instance, MXS_FILTER_SESSION *fsession, DCB *dcb);
 static uint64_t getCapabilities(MXS_FILTER* instance);
 
-static char *regex_replace(const char *sql, pcre2_code *re, pcre2_match_data *study,
-                           const char *replace);
+/** The maximum number of match and replace pairs */
+#define REGEX_MAX_RULES 10
 
 /**
  * Instance structure
@@ -61,10 +61,10 @@ typedef struct
 {
     char *source; /*< Source address to restrict matches */
     char *user; /*< User name to restrict matches */
-    char *match; /*< Regular expression to match */
-    char *replace; /*< Replacement text */
-    pcre2_code *re; /*< Compiled regex text */
-    pcre2_match_data *match_data; /*< Matching data used by the compiled regex */
+    char *match[REGEX_MAX_RULES]; /*< Regular expressions to match */
+    char *replace[REGEX_MAX_RULES]; /*< Replacement texts */
+    MXS_REWRITE_RULE rules[REGEX_MAX_RULES]; /*< Compiled rules */
+    int n_rules; /*< Number of rules */
     FILE* logfile; /*< Log file */
     bool log_trace; /*< Whether messages should be printed to tracelog */
 } REGEX_INSTANCE;
@@ -81,8 +81,9 @@ typedef struct
     int active; /* Is filter active */
 } REGEX_SESSION;
 
-void log_match(REGEX_INSTANCE* inst, char* re, char* old, char* new);
-void log_nomatch(REGEX_INSTANCE* inst, char* re, char* old);
+void log_match(REGEX_INSTANCE* inst, const char* re, const char* old, int old_len,
+               const char* new, int new_len);
+void log_nomatch(REGEX_INSTANCE* inst, const char* re, const char* old, int old_len);
 
 static const MXS_ENUM_VALUE option_values[] =
 {
@@ -131,6 +132,24 @@ MXS_MODULE* MXS_CREATE_MODULE()
         {
             {"match", MXS_MODULE_PARAM_STRING, NULL, MXS_MODULE_OPT_REQUIRED},
             {"replace", MXS_MODULE_PARAM_STRING, NULL, MXS_MODULE_OPT_REQUIRED},
+            {"match2", MXS_MODULE_PARAM_STRING},
+            {"replace2", MXS_MODULE_PARAM_STRING},
+            {"match3", MXS_MODULE_PARAM_STRING},
+            {"replace3", MXS_MODULE_PARAM_STRING},
+            {"match4", MXS_MODULE_PARAM_STRING},
+            {"replace4", MXS_MODULE_PARAM_STRING},
+            {"match5", MXS_MODULE_PARAM_STRING},
+            {"replace5", MXS_MODULE_PARAM_STRING},
+            {"match6", MXS_MODULE_PARAM_STRING},
+            {"replace6", MXS_MODULE_PARAM_STRING},
+            {"match7", MXS_MODULE_PARAM_STRING},
+            {"replace7", MXS_MODULE_PARAM_STRING},
+            {"match8", MXS_MODULE_PARAM_STRING},
+            {"replace8", MXS_MODULE_PARAM_STRING},
+            {"match9", MXS_MODULE_PARAM_STRING},
+            {"replace9", MXS_MODULE_PARAM_STRING},
+            {"match10", MXS_MODULE_PARAM_STRING},
+            {"replace10", MXS_MODULE_PARAM_STRING},
             {"source", MXS_MODULE_PARAM_STRING},
             {"user", MXS_MODULE_PARAM_STRING},
             {"log_trace", MXS_MODULE_PARAM_BOOL, "false"},
@@ -151,24 +170,87 @@ void free_instance(REGEX_INSTANCE *instance)
 {
     if (instance)
     {
-        if (instance->re)
+        for (int i = 0; i < instance->n_rules; i++)
         {
-            pcre2_code_free(instance->re);
+            mxs_pcre2_release(instance->rules[i].re);
+            MXS_FREE(instance->match[i]);
+            MXS_FREE(instance->replace[i]);
         }
 
-        if (instance->match_data)
-        {
-            pcre2_match_data_free(instance->match_data);
-        }
-
-        MXS_FREE(instance->match);
-        MXS_FREE(instance->replace);
         MXS_FREE(instance->source);
         MXS_FREE(instance->user);
         MXS_FREE(instance);
     }
 }
 
+/**
+ * Compile the match and replace pairs of the filter
+ *
+ * The first pair is defined with the @c match and @c replace parameters and
+ * the following ones with @c match2 and @c replace2 up to @c match10 and
+ * @c replace10. The rules are applied in this order.
+ *
+ * @param instance Filter instance
+ * @param params   Filter parameters
+ * @param cflags   PCRE2 compilation options
+ *
+ * @return True if all rules were compiled
+ */
+static bool create_rules(REGEX_INSTANCE *instance, MXS_CONFIG_PARAMETER *params, int cflags)
+{
+    bool rval = true;
+
+    for (int i = 0; i < REGEX_MAX_RULES && rval; i++)
+    {
+        char match[20];
+        char replace[20];
+
+        if (i == 0)
+        {
+            strcpy(match, "match");
+            strcpy(replace, "replace");
+        }
+        else
+        {
+            snprintf(match, sizeof(match), "match%d", i + 1);
+            snprintf(replace, sizeof(replace), "replace%d", i + 1);
+        }
+
+        const char *match_value = config_get_string(params, match);
+        const char *replace_value = config_get_string(params, replace);
+
+        if (*match_value == '\0' && *replace_value == '\0')
+        {
+            continue;
+        }
+        else if (*match_value == '\0' || config_get_param(params, replace) == NULL)
+        {
+            MXS_ERROR("Both '%s' and '%s' must be defined.", match, replace);
+            rval = false;
+        }
+        else
+        {
+            int n = instance->n_rules;
+            pcre2_code *re = mxs_pcre2_compile(match_value, cflags);
+
+            if (re)
+            {
+                instance->match[n] = MXS_STRDUP_A(match_value);
+                instance->replace[n] = MXS_STRDUP_A(replace_value);
+                instance->rules[n].re = re;
+                instance->rules[n].replace = instance->replace[n];
+                instance->n_rules++;
+            }
+            else
+            {
+                rval = false;
+            }
+        }
+    }
+
+    return rval;
+}
+
 /**
  * Create an instance of the filter for a particular service
  * within MaxScale.
@@ -186,8 +268,6 @@ createInstance(const char *name, char **options, MXS_CONFIG_PARAMETER *params)
 
     if (my_instance)
     {
-        my_instance->match = MXS_STRDUP_A(config_get_string(params, "match"));
-        my_instance->replace = MXS_STRDUP_A(config_get_string(params, "replace"));
         my_instance->source = config_copy_string(params, "source");
         my_instance->user = config_copy_string(params, "user");
         my_instance->log_trace = config_get_bool(params, "log_trace");
@@ -207,30 +287,10 @@ createInstance(const char *name, char **options, MXS_CONFIG_PARAMETER *params)
             fflush(my_instance->logfile);
         }
 
-        int errnumber;
-        PCRE2_SIZE erroffset;
         int cflags = config_get_enum(params, "options", option_values);
 
-        if ((my_instance->re = pcre2_compile((PCRE2_SPTR) my_instance->match,
-                                             PCRE2_ZERO_TERMINATED,
-                                             cflags,
-                                             &errnumber,
-                                             &erroffset,
-                                             NULL)) == NULL)
-        {
-            char errbuffer[1024];
-            pcre2_get_error_message(errnumber, (PCRE2_UCHAR*) & errbuffer, sizeof(errbuffer));
-            MXS_ERROR("Compiling regular expression '%s' failed at %lu: %s",
-                      my_instance->match, erroffset, errbuffer);
-            free_instance(my_instance);
-            return NULL;
-        }
-
-        if ((my_instance->match_data =
-                 pcre2_match_data_create_from_pattern(my_instance->re, NULL)) == NULL)
+        if (!create_rules(my_instance, params, cflags))
         {
-            MXS_ERROR("Failure to create PCRE2 matching data. "
-                      "This is most likely caused by a lack of available memory.");
             free_instance(my_instance);
             return NULL;
         }
@@ -331,36 +391,53 @@ routeQuery(MXS_FILTER *instance, MXS_FILTER_SESSION *session, GWBUF *queue)
 {
     REGEX_INSTANCE *my_instance = (REGEX_INSTANCE *) instance;
     REGEX_SESSION *my_session = (REGEX_SESSION *) session;
-    char *sql, *newsql;
 
     if (my_session->active && modutil_is_SQL(queue))
     {
-        if ((sql = modutil_get_SQL(queue)) != NULL)
+        bool matched[REGEX_MAX_RULES];
+        GWBUF *rewritten = modutil_rewrite_SQL(queue, my_instance->rules,
+                                               my_instance->n_rules, matched);
+        bool logging = my_instance->logfile || my_instance->log_trace;
+        char *sql;
+        int len;
+
+        if (rewritten)
         {
-            newsql = regex_replace(sql,
-                                   my_instance->re,
-                                   my_instance->match_data,
-                                   my_instance->replace);
-            if (newsql)
+            char *newsql;
+            int newlen;
+
+            if (logging && modutil_extract_SQL(queue, &sql, &len) &&
+                modutil_extract_SQL(rewritten, &newsql, &newlen))
             {
-                queue = modutil_replace_SQL(queue, newsql);
-                queue = gwbuf_make_contiguous(queue);
                 spinlock_acquire(&my_session->lock);
-                log_match(my_instance, my_instance->match, sql, newsql);
+                for (int i = 0; i < my_instance->n_rules; i++)
+                {
+                    if (matched[i])
+                    {
+                        log_match(my_instance, my_instance->match[i], sql, len, newsql, newlen);
+                    }
+                }
                 spinlock_release(&my_session->lock);
-                MXS_FREE(newsql);
-                my_session->replacements++;
             }
-            else
+
+            gwbuf_free(queue);
+            queue = rewritten;
+            my_session->replacements++;
+        }
+        else
+        {
+            if (logging && modutil_extract_SQL(queue, &sql, &len))
             {
                 spinlock_acquire(&my_session->lock);
-                log_nomatch(my_instance, my_instance->match, sql);
+                for (int i = 0; i < my_instance->n_rules; i++)
+                {
+                    log_nomatch(my_instance, my_instance->match[i], sql, len);
+                }
                 spinlock_release(&my_session->lock);
-                my_session->no_change++;
             }
-            MXS_FREE(sql);
-        }
 
+            my_session->no_change++;
+        }
     }
     return my_session->down.routeQuery(my_session->down.instance,
                                        my_session->down.session, queue);
@@ -383,8 +460,11 @@ diagnostic(MXS_FILTER *instance, MXS_FILTER_SESSION *fsession, DCB *dcb)
     REGEX_INSTANCE *my_instance = (REGEX_INSTANCE *) instance;
     REGEX_SESSION *my_session = (REGEX_SESSION *) fsession;
 
-    dcb_printf(dcb, "\t\tSearch and replace:            s/%s/%s/\n",
-               my_instance->match, my_instance->replace);
+    for (int i = 0; i < my_instance->n_rules; i++)
+    {
+        dcb_printf(dcb, "\t\tSearch and replace:            s/%s/%s/\n",
+                   my_instance->match[i], my_instance->replace[i]);
+    }
     if (my_session)
     {
         dcb_printf(dcb, "\t\tNo. of queries unaltered by filter:    %d\n",
@@ -406,66 +486,27 @@ diagnostic(MXS_FILTER *instance, MXS_FILTER_SESSION *fsession, DCB *dcb)
     }
 }
 
-/**
- * Perform a regular expression match and substitution on the SQL
- *
- * @param   sql The original SQL text
- * @param   re  The compiled regular expression
- * @param   match_data The PCRE2 matching data buffer
- * @param   replace The replacement text
- * @return  The replaced text or NULL if no replacement was done.
- */
-static char *
-regex_replace(const char *sql, pcre2_code *re, pcre2_match_data *match_data, const char *replace)
-{
-    char *result = NULL;
-    size_t result_size;
-
-    /** This should never fail with rc == 0 because we used pcre2_match_data_create_from_pattern() */
-    if (pcre2_match(re, (PCRE2_SPTR) sql, PCRE2_ZERO_TERMINATED, 0, 0, match_data, NULL) > 0)
-    {
-        result_size = strlen(sql) + strlen(replace);
-        result = MXS_MALLOC(result_size);
-
-        size_t result_size_tmp = result_size;
-        while (result &&
-               pcre2_substitute(re, (PCRE2_SPTR) sql, PCRE2_ZERO_TERMINATED, 0,
-                                PCRE2_SUBSTITUTE_GLOBAL, match_data, NULL,
-                                (PCRE2_SPTR) replace, PCRE2_ZERO_TERMINATED,
-                                (PCRE2_UCHAR*) result, (PCRE2_SIZE*) & result_size_tmp) == PCRE2_ERROR_NOMEMORY)
-        {
-            result_size_tmp = 1.5 * result_size;
-            char *tmp;
-            if ((tmp = MXS_REALLOC(result, result_size_tmp)) == NULL)
-            {
-                MXS_FREE(result);
-                result = NULL;
-            }
-            result = tmp;
-            result_size = result_size_tmp;
-        }
-    }
-    return result;
-}
-
 /**
  * Log a matching query to either MaxScale's trace log or a separate log file.
  * The old SQL and the new SQL statements are printed in the log.
  * @param inst Regex filter instance
  * @param re Regular expression
  * @param old Old SQL statement
+ * @param old_len Length of the old SQL statement
  * @param new New SQL statement
+ * @param new_len Length of the new SQL statement
  */
-void log_match(REGEX_INSTANCE* inst, char* re, char* old, char* new)
+void log_match(REGEX_INSTANCE* inst, const char* re, const char* old, int old_len,
+               const char* new, int new_len)
 {
     if (inst->logfile)
     {
-        fprintf(inst->logfile, "Matched %s: [%s] -> [%s]\n", re, old, new);
+        fprintf(inst->logfile, "Matched %s: [%.*s] -> [%.*s]\n", re, old_len, old, new_len, new);
         fflush(inst->logfile);
     }
     if (inst->log_trace)
     {
-        MXS_INFO("Match %s: [%s] -> [%s]", re, old, new);
+        MXS_INFO("Match %s: [%.*s] -> [%.*s]", re, old_len, old, new_len, new);
     }
 }
 
@@ -474,17 +515,18 @@ void log_match(REGEX_INSTANCE* inst, char* re, char* old, char* new)
  * @param inst Regex filter instance
  * @param re Regular expression
  * @param old SQL statement
+ * @param old_len Length of the SQL statement
  */
-void log_nomatch(REGEX_INSTANCE* inst, char* re, char* old)
+void log_nomatch(REGEX_INSTANCE* inst, const char* re, const char* old, int old_len)
 {
     if (inst->logfile)
     {
-        fprintf(inst->logfile, "No match %s: [%s]\n", re, old);
+        fprintf(inst->logfile, "No match %s: [%.*s]\n", re, old_len, old);
         fflush(inst->logfile);
     }
     if (inst->log_trace)
     {
-        MXS_INFO("No match %s: [%s]", re, old);
+        MXS_INFO("No match %s: [%.*s]", re, old_len, old);
     }
 }
 
@@ -29,6 +29,12 @@
  *          of the request (optional)
  * user     A user name to match against. If present only requests that
  *          originate from this user will be duplciated (optional)
+ * async    Queue the duplicates and send them to the branch one at a time
+ *          without waiting for the branch in the main path (optional)
+ * async_max_queued  Maximum number of queued statements per session
+ * async_max_bytes   Maximum size of the queued statements per session
+ * sample_sessions   Percentage of sessions that are duplicated
+ * sample_statements Percentage of statements that are duplicated
  *
  * Revision History
  * ================
@@ -60,6 +66,9 @@
 #include <maxscale/protocol/mysql.h>
 #include <maxscale/housekeeper.h>
 #include <maxscale/alloc.h>
+#include <maxscale/atomic.h>
+#include <maxscale/random_jkiss.h>
+#include <maxscale/timer.h>
 
 #define MYSQL_COM_QUIT                  0x01
 #define MYSQL_COM_INITDB                0x02
@@ -122,8 +131,32 @@ typedef struct
     regex_t re; /* Compiled regex text */
     char *nomatch; /* Optional text to match against for exclusion */
     regex_t nore; /* Compiled regex nomatch text */
+    bool async; /* Queue the duplicates instead of routing them immediately */
+    int async_max_queued; /* Maximum number of queued statements per session */
+    uint64_t async_max_bytes; /* Maximum size of queued statements per session */
+    int sample_sessions; /* Percentage of sessions to duplicate */
+    int sample_statements; /* Percentage of statements to duplicate */
+    struct
+    {
+        int sessions; /* Number of sessions that were duplicated */
+        int sessions_skipped; /* Number of sessions left out by sampling */
+        int duplicated; /* Number of statements sent to the branch */
+        int skipped; /* Number of statements left out by sampling */
+        int dropped; /* Number of statements dropped due to a full queue */
+        int failed; /* Number of sessions where the branch fell too far behind */
+    } stats;
 } TEE_INSTANCE;
 
+/**
+ * A duplicated statement waiting to be sent to the branch in asynchronous mode
+ */
+typedef struct tee_queued
+{
+    GWBUF *buffer; /* The cloned packet */
+    bool continuation; /* The rest of a statement that did not fit into one packet */
+    struct tee_queued *next;
+} TEE_QUEUED;
+
 /**
  * The session structure for this TEE filter.
  * This stores the downstream filter information, such that the
@@ -156,6 +189,23 @@ typedef struct
     GWBUF* queue;
     SPINLOCK tee_lock;
     DCB* client_dcb;
+    bool sampled_out; /* The session was left out by sampling */
+    bool large_packet; /* The previous packet from the client had the maximum size */
+    bool cloned; /* The previous packet from the client was duplicated */
+    int n_dropped; /* Number of statements dropped due to a full queue */
+
+    /** Asynchronous mode */
+    TEE_QUEUED *async_head; /* Statements waiting to be sent to the branch */
+    TEE_QUEUED *async_tail;
+    int async_queued; /* Number of queued statements */
+    uint64_t async_bytes; /* Size of the queued statements */
+    bool async_busy; /* The branch has not yet replied to the latest statement */
+    bool async_dropping; /* The statement being queued was dropped */
+    bool async_infile_sent; /* The whole LOAD DATA LOCAL INFILE file was sent */
+    bool async_failed; /* Duplication stopped for the rest of the session */
+    MXS_REPLY_TRACKER async_reply; /* Progress of the branch reply */
+    MXS_UPSTREAM branch_tail; /* The original reply path of the branch session */
+    MXS_TIMER async_timer; /* Used to send the next statement outside of the reply path */
 
 #ifdef SS_DEBUG
     long d_id;
@@ -187,6 +237,12 @@ int route_single_query(TEE_INSTANCE* my_instance,
                        GWBUF* clone);
 int reset_session_state(TEE_SESSION* my_session, GWBUF* buffer);
 void create_orphan(MXS_SESSION* ses);
+static void tee_async_push(TEE_INSTANCE *my_instance, TEE_SESSION *my_session, GWBUF *clone,
+                           bool continuation, bool required);
+static void tee_async_drain(TEE_SESSION *my_session);
+static void tee_async_discard(TEE_SESSION *my_session);
+static void tee_async_timeout(MXS_TIMER *timer, void *data);
+static int tee_branch_reply(void *instance, void *session, GWBUF *reply);
 
 static void
 orphan_free(void* data)
@@ -344,6 +400,11 @@ MXS_MODULE* MXS_CREATE_MODULE()
                 MXS_MODULE_OPT_NONE,
                 option_values
             },
+            {"async", MXS_MODULE_PARAM_BOOL, "false"},
+            {"async_max_queued", MXS_MODULE_PARAM_COUNT, "100"},
+            {"async_max_bytes", MXS_MODULE_PARAM_SIZE, "1Mi"},
+            {"sample_sessions", MXS_MODULE_PARAM_COUNT, "100"},
+            {"sample_statements", MXS_MODULE_PARAM_COUNT, "100"},
             {MXS_END_MODULE_PARAMS}
         }
     };
@@ -373,6 +434,34 @@ createInstance(const char *name, char **options, MXS_CONFIG_PARAMETER *params)
         my_instance->userName = config_copy_string(params, "user");
         my_instance->match = config_copy_string(params, "match");
         my_instance->nomatch = config_copy_string(params, "exclude");
+        my_instance->async = config_get_bool(params, "async");
+        my_instance->async_max_queued = config_get_integer(params, "async_max_queued");
+        my_instance->async_max_bytes = config_get_size(params, "async_max_bytes");
+        my_instance->sample_sessions = config_get_integer(params, "sample_sessions");
+        my_instance->sample_statements = config_get_integer(params, "sample_statements");
+
+        if (my_instance->sample_sessions > 100 || my_instance->sample_statements > 100)
+        {
+            MXS_ERROR("The sample_sessions and sample_statements parameters "
+                      "must be percentages between 0 and 100.");
+            MXS_FREE(my_instance->match);
+            MXS_FREE(my_instance->nomatch);
+            MXS_FREE(my_instance->source);
+            MXS_FREE(my_instance->userName);
+            MXS_FREE(my_instance);
+            return NULL;
+        }
+
+        if (my_instance->async && my_instance->async_max_queued == 0)
+        {
+            MXS_ERROR("The async_max_queued parameter must be at least 1.");
+            MXS_FREE(my_instance->match);
+            MXS_FREE(my_instance->nomatch);
+            MXS_FREE(my_instance->source);
+            MXS_FREE(my_instance->userName);
+            MXS_FREE(my_instance);
+            return NULL;
+        }
 
         int cflags = config_get_enum(params, "options", option_values);
 
@@ -475,6 +564,17 @@ newSession(MXS_FILTER *instance, MXS_SESSION *session)
             MXS_WARNING("Tee filter is not active.");
         }
 
+        if (my_session->active && my_instance->sample_sessions < 100)
+        {
+            if ((int)(random_jkiss() % 100) >= my_instance->sample_sessions)
+            {
+                /** Not sampled, the branch session is never created */
+                my_session->active = 0;
+                my_session->sampled_out = true;
+                atomic_add(&my_instance->stats.sessions_skipped, 1);
+            }
+        }
+
         if (my_session->active)
         {
             DCB* dcb;
@@ -505,6 +605,18 @@ newSession(MXS_FILTER *instance, MXS_SESSION *session)
 
             my_session->branch_session = ses;
             my_session->branch_dcb = dcb;
+            atomic_add(&my_instance->stats.sessions, 1);
+
+            if (my_instance->async)
+            {
+                /** Replies from the branch tell when the next queued
+                 * statement can be sent */
+                mxs_timer_init(&my_session->async_timer, tee_async_timeout, my_session);
+                my_session->branch_tail = ses->tail;
+                ses->tail.instance = (void*)my_instance;
+                ses->tail.session = (void*)my_session;
+                ses->tail.clientReply = tee_branch_reply;
+            }
         }
     }
 retblock:
@@ -537,6 +649,14 @@ closeSession(MXS_FILTER *instance, MXS_FILTER_SESSION *session)
         {
             CHK_SESSION(bsession);
 
+            if (my_session->instance->async)
+            {
+                /** The branch session can outlive this session */
+                mxs_timer_stop(&my_session->async_timer);
+                tee_async_discard(my_session);
+                bsession->tail = my_session->branch_tail;
+            }
+
             if (bsession->state != SESSION_STATE_STOPPING)
             {
                 bsession->state = SESSION_STATE_STOPPING;
@@ -614,6 +734,7 @@ freeSession(MXS_FILTER *instance, MXS_FILTER_SESSION *session)
     {
         gwbuf_free(my_session->tee_replybuf);
     }
+    tee_async_discard(my_session);
     MXS_FREE(session);
 
     orphan_free(NULL);
@@ -674,9 +795,59 @@ routeQuery(MXS_FILTER *instance, MXS_FILTER_SESSION *session, GWBUF *queue)
 {
     TEE_INSTANCE *my_instance = (TEE_INSTANCE *) instance;
     TEE_SESSION *my_session = (TEE_SESSION *) session;
-    GWBUF *clone = clone_query(my_instance, my_session, queue);
 
-    return route_single_query(my_instance, my_session, queue, clone);
+    if (my_session->sampled_out)
+    {
+        /** Only the main service is used by sessions left out by sampling */
+        return my_session->down.routeQuery(my_session->down.instance,
+                                           my_session->down.session,
+                                           queue);
+    }
+
+    if (!my_instance->async)
+    {
+        GWBUF *clone = clone_query(my_instance, my_session, queue);
+        return route_single_query(my_instance, my_session, queue, clone);
+    }
+
+    bool continuation = my_session->large_packet;
+    GWBUF *clone = NULL;
+
+    my_session->large_packet = GWBUF_LENGTH(queue) >= MYSQL_HEADER_LEN &&
+                               gw_mysql_get_byte3(GWBUF_DATA(queue)) == GW_MYSQL_MAX_PACKET_LEN;
+
+    if (!my_session->active)
+    {
+        return my_session->down.routeQuery(my_session->down.instance,
+                                           my_session->down.session,
+                                           queue);
+    }
+
+    if (continuation)
+    {
+        /** The rest of a large statement follows the first part */
+        if (my_session->cloned)
+        {
+            clone = gwbuf_clone(queue);
+        }
+    }
+    else
+    {
+        clone = clone_query(my_instance, my_session, queue);
+        my_session->cloned = clone != NULL;
+    }
+
+    /** The main path never waits for the branch */
+    int rval = my_session->down.routeQuery(my_session->down.instance,
+                                           my_session->down.session,
+                                           queue);
+    if (clone)
+    {
+        tee_async_push(my_instance, my_session, clone, continuation,
+                       !continuation && packet_is_required(clone));
+    }
+
+    return rval;
 }
 
 /**
@@ -739,12 +910,49 @@ diagnostic(MXS_FILTER *instance, MXS_FILTER_SESSION *fsession, DCB *dcb)
         dcb_printf(dcb, "\t\tExclude queries that match		%s\n",
                    my_instance->nomatch);
     }
+    if (my_instance->async)
+    {
+        dcb_printf(dcb, "\t\tAsynchronous queue limit		%d statements, %lu bytes\n",
+                   my_instance->async_max_queued, my_instance->async_max_bytes);
+    }
+    if (my_instance->sample_sessions < 100 || my_instance->sample_statements < 100)
+    {
+        dcb_printf(dcb, "\t\tSampled sessions			%d%%\n",
+                   my_instance->sample_sessions);
+        dcb_printf(dcb, "\t\tSampled statements		%d%%\n",
+                   my_instance->sample_statements);
+    }
     if (my_session)
     {
         dcb_printf(dcb, "\t\tNo. of statements duplicated:	%d.\n",
                    my_session->n_duped);
         dcb_printf(dcb, "\t\tNo. of statements rejected:	%d.\n",
                    my_session->n_rejected);
+        if (my_instance->async)
+        {
+            dcb_printf(dcb, "\t\tNo. of statements dropped:	%d.\n",
+                       my_session->n_dropped);
+            dcb_printf(dcb, "\t\tNo. of statements queued:	%d.\n",
+                       my_session->async_queued);
+        }
+    }
+    else
+    {
+        dcb_printf(dcb, "\t\tSessions duplicated:		%d\n",
+                   my_instance->stats.sessions);
+        dcb_printf(dcb, "\t\tSessions left out by sampling:	%d\n",
+                   my_instance->stats.sessions_skipped);
+        dcb_printf(dcb, "\t\tStatements duplicated:		%d\n",
+                   my_instance->stats.duplicated);
+        dcb_printf(dcb, "\t\tStatements left out by sampling:	%d\n",
+                   my_instance->stats.skipped);
+        if (my_instance->async)
+        {
+            dcb_printf(dcb, "\t\tStatements dropped:		%d\n",
+                       my_instance->stats.dropped);
+            dcb_printf(dcb, "\t\tSessions where the branch fell behind:	%d\n",
+                       my_instance->stats.failed);
+        }
     }
 }
 
@@ -840,7 +1048,16 @@ GWBUF* clone_query(TEE_INSTANCE* my_instance, TEE_SESSION* my_session, GWBUF* bu
 {
     GWBUF* clone = NULL;
 
-    if ((!my_instance->match && !my_instance->nomatch) || packet_is_required(buffer))
+    if (packet_is_required(buffer))
+    {
+        clone = gwbuf_clone(buffer);
+    }
+    else if (my_instance->sample_statements < 100 &&
+             (int)(random_jkiss() % 100) >= my_instance->sample_statements)
+    {
+        atomic_add(&my_instance->stats.skipped, 1);
+    }
+    else if (!my_instance->match && !my_instance->nomatch)
     {
         clone = gwbuf_clone(buffer);
     }
@@ -887,6 +1104,7 @@ int route_single_query(TEE_INSTANCE* my_instance, TEE_SESSION* my_session, GWBUF
         if (clone)
         {
             my_session->n_duped++;
+            atomic_add(&my_instance->stats.duplicated, 1);
 
             if (my_session->branch_session->state == SESSION_STATE_ROUTER_READY)
             {
@@ -960,3 +1178,217 @@ void create_orphan(MXS_SESSION* ses)
         spinlock_release(&orphanLock);
     }
 }
+
+/**
+ * Queue a duplicated statement for the branch session. If the queue is full,
+ * the statement is dropped unless it is required to keep the branch session
+ * consistent. If a required statement does not fit even into twice the
+ * configured limit, the branch has fallen too far behind and duplication is
+ * stopped for the rest of the session.
+ *
+ * @param my_instance  Tee instance
+ * @param my_session   Tee session
+ * @param clone        The duplicated packet, freed or queued by this function
+ * @param continuation The packet is the rest of a statement
+ * @param required     The statement must not be dropped
+ */
+static void tee_async_push(TEE_INSTANCE *my_instance, TEE_SESSION *my_session, GWBUF *clone,
+                           bool continuation, bool required)
+{
+    size_t len = gwbuf_length(clone);
+    bool full = my_session->async_queued >= my_instance->async_max_queued ||
+                my_session->async_bytes + len > my_instance->async_max_bytes;
+
+    if (my_session->async_failed || (continuation && my_session->async_dropping))
+    {
+        gwbuf_free(clone);
+        return;
+    }
+
+    if (full && !continuation)
+    {
+        if (!required)
+        {
+            my_session->async_dropping = true;
+            my_session->n_dropped++;
+            atomic_add(&my_instance->stats.dropped, 1);
+            gwbuf_free(clone);
+            return;
+        }
+        else if (my_session->async_queued >= my_instance->async_max_queued * 2)
+        {
+            MXS_INFO("Branch session of tee filter fell behind by %d statements, "
+                     "no longer duplicating statements of the session.",
+                     my_session->async_queued);
+            my_session->async_failed = true;
+            atomic_add(&my_instance->stats.failed, 1);
+            tee_async_discard(my_session);
+            gwbuf_free(clone);
+            return;
+        }
+    }
+
+    TEE_QUEUED *item = MXS_MALLOC(sizeof(TEE_QUEUED));
+
+    if (item == NULL)
+    {
+        gwbuf_free(clone);
+        return;
+    }
+
+    item->buffer = clone;
+    item->continuation = continuation;
+    item->next = NULL;
+
+    if (my_session->async_tail)
+    {
+        my_session->async_tail->next = item;
+    }
+    else
+    {
+        my_session->async_head = item;
+    }
+
+    my_session->async_tail = item;
+    my_session->async_queued++;
+    my_session->async_bytes += len;
+    my_session->async_dropping = false;
+
+    tee_async_drain(my_session);
+}
+
+/**
+ * Send queued statements to the branch session until one is found that has
+ * to wait for the reply of the previous one. Parts of large statements and
+ * the contents of a LOAD DATA LOCAL INFILE file are sent without waiting.
+ *
+ * @param my_session Tee session
+ */
+static void tee_async_drain(TEE_SESSION *my_session)
+{
+    TEE_INSTANCE *my_instance = my_session->instance;
+
+    while (my_session->async_head && !my_session->async_failed)
+    {
+        TEE_QUEUED *item = my_session->async_head;
+        MXS_REPLY_TRACKER *reply = &my_session->async_reply;
+        bool infile_data = false;
+
+        if (my_session->async_busy && !item->continuation)
+        {
+            if (reply->local_infile && !my_session->async_infile_sent)
+            {
+                infile_data = true;
+            }
+            else
+            {
+                break;
+            }
+        }
+
+        if (my_session->branch_session->state != SESSION_STATE_ROUTER_READY)
+        {
+            MXS_INFO("Closed tee filter session: Child session in invalid state.");
+            my_session->async_failed = true;
+            tee_async_discard(my_session);
+            break;
+        }
+
+        my_session->async_head = item->next;
+
+        if (my_session->async_head == NULL)
+        {
+            my_session->async_tail = NULL;
+        }
+
+        GWBUF *buffer = item->buffer;
+        bool continuation = item->continuation;
+        MXS_FREE(item);
+        my_session->async_queued--;
+        my_session->async_bytes -= gwbuf_length(buffer);
+
+        if (infile_data)
+        {
+            /** An empty packet ends the file */
+            if (gw_mysql_get_byte3(GWBUF_DATA(buffer)) == 0)
+            {
+                my_session->async_infile_sent = true;
+            }
+        }
+        else if (!continuation)
+        {
+            uint8_t command = GWBUF_DATA(buffer)[MYSQL_HEADER_LEN];
+            modutil_reply_tracker_init(reply, command);
+            my_session->async_busy = modutil_command_has_reply(command);
+            my_session->async_infile_sent = false;
+            my_session->n_duped++;
+            atomic_add(&my_instance->stats.duplicated, 1);
+        }
+
+        if (!MXS_SESSION_ROUTE_QUERY(my_session->branch_session, buffer))
+        {
+            MXS_INFO("Closed tee filter session: Routing to child session failed.");
+            my_session->async_failed = true;
+            tee_async_discard(my_session);
+        }
+    }
+}
+
+/**
+ * Free all queued statements
+ *
+ * @param my_session Tee session
+ */
+static void tee_async_discard(TEE_SESSION *my_session)
+{
+    while (my_session->async_head)
+    {
+        TEE_QUEUED *item = my_session->async_head;
+        my_session->async_head = item->next;
+        gwbuf_free(item->buffer);
+        MXS_FREE(item);
+    }
+
+    my_session->async_tail = NULL;
+    my_session->async_queued = 0;
+    my_session->async_bytes = 0;
+}
+
+/**
+ * Timer callback that sends the next queued statements. The timer is used so
+ * that the branch is not routed to from inside its own reply processing.
+ */
+static void tee_async_timeout(MXS_TIMER *timer, void *data)
+{
+    tee_async_drain((TEE_SESSION*)data);
+}
+
+/**
+ * The reply path of the branch session in asynchronous mode. The reply is
+ * tracked to find out when the branch is ready for the next statement and
+ * then passed on to where the branch session would have sent it.
+ *
+ * @param instance The tee instance
+ * @param session  The tee session
+ * @param reply    Reply from the branch service
+ *
+ * @return The return value of the original reply handler
+ */
+static int tee_branch_reply(void *instance, void *session, GWBUF *reply)
+{
+    TEE_SESSION *my_session = (TEE_SESSION*)session;
+
+    if (my_session->async_busy && modutil_reply_tracker_process(&my_session->async_reply, reply))
+    {
+        my_session->async_busy = false;
+
+        if (my_session->async_head && !mxs_timer_start(&my_session->async_timer, 0, 0))
+        {
+            tee_async_drain(my_session);
+        }
+    }
+
+    return my_session->branch_tail.clientReply(my_session->branch_tail.instance,
+                                               my_session->branch_tail.session,
+                                               reply);
+}
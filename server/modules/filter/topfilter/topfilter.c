@@ -43,7 +43,7 @@
 #include <string.h>
 #include <time.h>
 #include <sys/time.h>
-#include <regex.h>
+#include <maxscale/pcre2.h>
 #include <maxscale/atomic.h>
 #include <maxscale/alloc.h>
 
@@ -77,9 +77,9 @@ typedef struct
     char *source; /* The source of the client connection */
     char *user; /* A user name to filter on */
     char *match; /* Optional text to match against */
-    regex_t re; /* Compiled regex text */
+    pcre2_code *re; /* Compiled regex text */
     char *exclude; /* Optional text to match against for exclusion */
-    regex_t exre; /* Compiled regex nomatch text */
+    pcre2_code *exre; /* Compiled regex nomatch text */
 } TOPN_INSTANCE;
 
 /**
@@ -119,9 +119,9 @@ typedef struct
 
 static const MXS_ENUM_VALUE option_values[] =
 {
-    {"ignorecase", REG_ICASE},
+    {"ignorecase", PCRE2_CASELESS},
     {"case",       0},
-    {"extended",   REG_EXTENDED},
+    {"extended",   PCRE2_EXTENDED},
     {NULL}
 };
 
@@ -207,44 +207,35 @@ createInstance(const char *name, char **options, MXS_CONFIG_PARAMETER *params)
         my_instance->user = config_copy_string(params, "user");
         my_instance->filebase = MXS_STRDUP_A(config_get_string(params, "filebase"));
 
+        my_instance->re = NULL;
+        my_instance->exre = NULL;
+
         int cflags = config_get_enum(params, "options", option_values);
         bool error = false;
 
         if (my_instance->match &&
-            regcomp(&my_instance->re, my_instance->match, cflags))
+            (my_instance->re = mxs_pcre2_compile(my_instance->match, cflags)) == NULL)
         {
             MXS_ERROR("Invalid regular expression '%s'"
                       " for the 'match' parameter.",
                       my_instance->match);
-            regfree(&my_instance->re);
-            MXS_FREE(my_instance->match);
-            my_instance->match = NULL;
             error = true;
         }
         if (my_instance->exclude &&
-            regcomp(&my_instance->exre, my_instance->exclude, cflags))
+            (my_instance->exre = mxs_pcre2_compile(my_instance->exclude, cflags)) == NULL)
         {
             MXS_ERROR("Invalid regular expression '%s'"
-                      " for the 'nomatch' parameter.\n",
+                      " for the 'nomatch' parameter.",
                       my_instance->exclude);
-            regfree(&my_instance->exre);
-            MXS_FREE(my_instance->exclude);
-            my_instance->exclude = NULL;
             error = true;
         }
 
         if (error)
         {
-            if (my_instance->exclude)
-            {
-                regfree(&my_instance->exre);
-                MXS_FREE(my_instance->exclude);
-            }
-            if (my_instance->match)
-            {
-                regfree(&my_instance->re);
-                MXS_FREE(my_instance->match);
-            }
+            mxs_pcre2_release(my_instance->exre);
+            MXS_FREE(my_instance->exclude);
+            mxs_pcre2_release(my_instance->re);
+            MXS_FREE(my_instance->match);
             MXS_FREE(my_instance->filebase);
             MXS_FREE(my_instance->source);
             MXS_FREE(my_instance->user);
@@ -472,10 +463,10 @@ routeQuery(MXS_FILTER *instance, MXS_FILTER_SESSION *session, GWBUF *queue)
     {
         if ((ptr = modutil_get_SQL(queue)) != NULL)
         {
-            if ((my_instance->match == NULL ||
-                 regexec(&my_instance->re, ptr, 0, NULL, 0) == 0) &&
-                (my_instance->exclude == NULL ||
-                 regexec(&my_instance->exre, ptr, 0, NULL, 0) != 0))
+            if ((my_instance->re == NULL ||
+                 mxs_pcre2_match(my_instance->re, ptr, PCRE2_ZERO_TERMINATED) == MXS_PCRE2_MATCH) &&
+                (my_instance->exre == NULL ||
+                 mxs_pcre2_match(my_instance->exre, ptr, PCRE2_ZERO_TERMINATED) != MXS_PCRE2_MATCH))
             {
                 my_session->n_statements++;
                 if (my_session->current)
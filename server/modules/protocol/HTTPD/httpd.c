@@ -40,6 +40,7 @@
 #include <maxscale/protocol.h>
 #include <maxscale/modinfo.h>
 #include <maxscale/log_manager.h>
+#include <maxscale/metrics.h>
 #include <maxscale/resultset.h>
 
 #define ISspace(x) isspace((int)(x))
@@ -54,7 +55,7 @@ static int httpd_accept(DCB *dcb);
 static int httpd_close(DCB *dcb);
 static int httpd_listen(DCB *dcb, char *config);
 static int httpd_get_line(int sock, char *buf, int size);
-static void httpd_send_headers(DCB *dcb, int final, bool auth_ok);
+static void httpd_send_headers(DCB *dcb, int final, bool auth_ok, const char *content_type);
 static char *httpd_default_auth();
 
 /**
@@ -256,8 +257,12 @@ static int httpd_read_event(DCB* dcb)
      * Now begins the server reply
      */
 
+    /** The metrics are in the Prometheus text format, everything else is JSON */
+    const char *content_type = strcmp(url, "/metrics") == 0 ?
+                               MXS_METRICS_CONTENT_TYPE : "application/json";
+
     /* send all the basic headers and close with \r\n */
-    httpd_send_headers(dcb, 1, auth_ok);
+    httpd_send_headers(dcb, 1, auth_ok, content_type);
 
 #if 0
     /**
@@ -456,7 +461,7 @@ static int httpd_get_line(int sock, char *buf, int size)
 /**
  * HTTPD send basic headers with 200 OK
  */
-static void httpd_send_headers(DCB *dcb, int final, bool auth_ok)
+static void httpd_send_headers(DCB *dcb, int final, bool auth_ok, const char *content_type)
 {
     char date[64] = "";
     const char *fmt = "%a, %d %b %Y %H:%M:%S GMT";
@@ -472,8 +477,8 @@ static void httpd_send_headers(DCB *dcb, int final, bool auth_ok)
                "Server: %s\r\n"
                "Connection: close\r\n"
                "WWW-Authenticate: Basic realm=\"MaxInfo\"\r\n"
-               "Content-Type: application/json\r\n",
-               response, date, HTTP_SERVER_STRING);
+               "Content-Type: %s\r\n",
+               response, date, HTTP_SERVER_STRING, content_type);
 
     /* close the headers */
     if (final)
@@ -358,8 +358,8 @@ static void handle_error_response(DCB *dcb, GWBUF *buffer)
              errcode == ER_DBACCESS_DENIED_ERROR ||
              errcode == ER_ACCESS_DENIED_NO_PASSWORD_ERROR)
     {
-        // Authentication failed, reload users
-        service_refresh_users(dcb->service);
+        // Authentication failed, reload users in the background
+        service_refresh_users_async(dcb->service);
     }
 }
 
@@ -506,7 +506,13 @@ gw_read_backend_event(DCB *dcb)
                 proto->protocol_auth_state = handle_server_response(dcb, readbuf);
             }
 
-            if (proto->protocol_auth_state == MXS_AUTH_STATE_COMPLETE)
+            if (proto->protocol_auth_state == MXS_AUTH_STATE_COMPLETE &&
+                (dcb->flags & DCBF_WARMUP))
+            {
+                /** A connection opened for the persistent pool is ready */
+                dcb_close(dcb);
+            }
+            else if (proto->protocol_auth_state == MXS_AUTH_STATE_COMPLETE)
             {
                 /** Authentication completed successfully */
                 GWBUF *localq = dcb->delayq;
@@ -548,6 +554,14 @@ gw_reply_on_error(DCB *dcb, mxs_auth_state_t state)
     MXS_SESSION *session = dcb->session;
     CHK_SESSION(session);
 
+    if (dcb->flags & DCBF_WARMUP)
+    {
+        /** The router does not know about connections opened for the pool */
+        dcb->dcb_errhandle_called = true;
+        dcb_close(dcb);
+        return;
+    }
+
     GWBUF* errbuf = mysql_create_custom_error(1, 0, "Authentication with backend "
                                               "failed. Session will be closed.");
 
@@ -1170,6 +1184,14 @@ static int gw_error_backend_event(DCB *dcb)
     mxs_session_state_t ses_state;
 
     CHK_DCB(dcb);
+
+    if (dcb->flags & DCBF_WARMUP)
+    {
+        dcb->dcb_errhandle_called = true;
+        dcb_close(dcb);
+        return 1;
+    }
+
     session = dcb->session;
     CHK_SESSION(session);
     if (SESSION_STATE_DUMMY == session->state)
@@ -1285,6 +1307,14 @@ static int gw_backend_hangup(DCB *dcb)
         dcb->dcb_errhandle_called = true;
         goto retblock;
     }
+
+    if (dcb->flags & DCBF_WARMUP)
+    {
+        dcb->dcb_errhandle_called = true;
+        dcb_close(dcb);
+        goto retblock;
+    }
+
     session = dcb->session;
 
     if (session == NULL)
@@ -1594,20 +1624,13 @@ static int gw_change_user(DCB *backend,
 
     if (auth_ret != 0)
     {
-        if (service_refresh_users(backend->session->client_dcb->service) == 0)
-        {
-            /* Try authentication again with new repository data */
-            /* Note: if no auth client authentication will fail */
-            *current_session->db = 0;
-
-            auth_ret = dcb->authfunc.reauthenticate(dcb, username,
-                                                    auth_token, auth_token_len,
-                                                    client_protocol->scramble,
-                                                    sizeof(client_protocol->scramble),
-                                                    client_sha1, sizeof(client_sha1));
-
-            strcpy(current_session->db, current_database);
-        }
+        /**
+         * The users might be out of date. Refreshing them is done in the
+         * background so that the other sessions of this thread are not blocked,
+         * which means that this attempt fails but the next one will use the
+         * new users.
+         */
+        service_refresh_users_async(backend->session->client_dcb->service);
     }
 
     MXS_FREE(auth_token);
@@ -61,6 +61,7 @@
 #include <maxscale/query_classifier.h>
 #include <maxscale/authenticator.h>
 #include <maxscale/session.h>
+#include <maxscale/histogram.h>
 
 static int process_init(void);
 static void process_finish(void);
@@ -420,9 +421,41 @@ int MySQLSendHandshake(DCB* dcb)
  */
 int gw_MySQLWrite_client(DCB *dcb, GWBUF *queue)
 {
+    MXS_SESSION *session = dcb->session;
+
+    if (session && session->stats.query_start && session->service)
+    {
+        /** The first write after a request is the start of the reply */
+        mxs_histogram_record(session->service->stats.query_latency,
+                             mxs_histogram_now() - session->stats.query_start,
+                             dcb->thread.id);
+        session->stats.query_start = 0;
+    }
+
     return dcb_write(dcb, queue);
 }
 
+/**
+ * @brief Start measuring the latency of a client request
+ *
+ * If an earlier request is still waiting for its reply, the latency is
+ * measured from the earlier request.
+ *
+ * @param session Client session
+ * @param cmd     The command byte of the request
+ */
+static inline void start_query_latency(MXS_SESSION *session, uint8_t cmd)
+{
+    /** These commands do not generate a reply */
+    if (session->stats.query_start == 0 &&
+        cmd != MYSQL_COM_STMT_SEND_LONG_DATA &&
+        cmd != MYSQL_COM_STMT_CLOSE &&
+        cmd != MYSQL_COM_QUIT)
+    {
+        session->stats.query_start = mxs_histogram_now();
+    }
+}
+
 /**
  * @brief Client read event triggered by EPOLLIN
  *
@@ -1013,6 +1046,9 @@ gw_read_finish_processing(DCB *dcb, GWBUF *read_buffer, uint64_t capabilities)
         /** Feed whole packet to router, which will free it
          *  and return 1 for success, 0 for failure
          */
+        uint8_t cmd = (uint8_t)MYSQL_COM_QUERY;
+        gwbuf_copy_data(read_buffer, MYSQL_HEADER_LEN, 1, &cmd);
+        start_query_latency(session, cmd);
         return_code = MXS_SESSION_ROUTE_QUERY(session, read_buffer) ? 0 : 1;
     }
     /* else return_code is still 0 from when it was originally set */
@@ -1500,8 +1536,9 @@ static int route_by_statement(MXS_SESSION* session, uint64_t capabilities, GWBUF
              * Empty packets are treated as COM_QUERY packets by default. */
             uint8_t cmd = (uint8_t)MYSQL_COM_QUERY;
             gwbuf_copy_data(packetbuf, MYSQL_HEADER_LEN, 1, &cmd);
-            MySQLProtocol *proto = (MySQLProtocol*)dcb->protocol;
+            MySQLProtocol *proto = (MySQLProtocol*)session->client_dcb->protocol;
             proto->current_command = cmd;
+            start_query_latency(session, cmd);
 
             if (rcap_type_required(capabilities, RCAP_TYPE_CONTIGUOUS_INPUT))
             {
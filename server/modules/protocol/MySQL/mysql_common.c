@@ -1303,6 +1303,15 @@ create_capabilities(MySQLProtocol *conn, bool db_specified, bool compress)
 
     final_capabilities |= (int)GW_MYSQL_CAPABILITIES_PLUGIN_AUTH;
 
+    if (conn->owner_dcb->session &&
+        rcap_type_required(service_get_capabilities(conn->owner_dcb->session->service),
+                           RCAP_TYPE_SESSION_STATE_TRACKING))
+    {
+        /** The router wants to see the session state changes, e.g. the GTID
+         * of the latest transaction, in the OK packets */
+        final_capabilities |= (uint32_t)GW_MYSQL_CAPABILITIES_SESSION_TRACK;
+    }
+
     return final_capabilities;
 }
 
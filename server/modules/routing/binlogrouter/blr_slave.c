@@ -3672,7 +3672,7 @@ blr_start_slave(ROUTER_INSTANCE* router, ROUTER_SLAVE* slave)
                router->current_pos, router->binlog_position);
 
     /* Try reloading new users and update cached credentials */
-    service_refresh_users(router->service);
+    service_refresh_users_async(router->service);
 
     return blr_slave_send_ok(router, slave);
 }
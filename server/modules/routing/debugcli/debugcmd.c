@@ -61,6 +61,7 @@
 #include "../../../core/maxscale/monitor.h"
 #include "../../../core/maxscale/poll.h"
 #include "../../../core/maxscale/session.h"
+#include "../../../core/maxscale/timer.h"
 
 #define MAXARGS 12
 
@@ -282,6 +283,12 @@ struct subcommand showoptions[] =
         "Usage: show threads",
         {0}
     },
+    {
+        "timers", 0, 0, dShowTimers,
+        "Show the timer wheel statistics of the worker threads",
+        "Usage: show timers",
+        {0}
+    },
     {
         "users", 0, 0, telnetdShowUsers,
         "Show enabled Linux accounts",
@@ -1486,6 +1493,7 @@ struct subcommand alteroptions[] =
         "ssl_cert_verify_depth Certificate verification depth\n"
         "persistpoolmax        Persisted connection pool size\n"
         "persistmaxtime        Persisted connection maximum idle time\n"
+        "persistpoolwarm       Persisted connections kept ready per user\n"
         "\n"
         "To configure SSL for a newly created server, the 'ssl', 'ssl_cert',\n"
         "'ssl_key' and 'ssl_ca_cert' parameters must be given at the same time.\n"
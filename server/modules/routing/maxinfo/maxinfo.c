@@ -44,6 +44,7 @@
 #include <maxscale/dcb.h>
 #include <maxscale/maxscale.h>
 #include <maxscale/log_manager.h>
+#include <maxscale/metrics.h>
 #include <maxscale/resultset.h>
 #include <maxscale/version.h>
 #include <maxscale/resultset.h>
@@ -708,6 +709,12 @@ handle_url(INFO_INSTANCE *instance, INFO_SESSION *session, GWBUF *queue)
     RESULTSET *set;
 
     uri = (char *)GWBUF_DATA(queue);
+
+    if (strcmp(uri, "/metrics") == 0)
+    {
+        mxs_metrics_print_prometheus(session->dcb);
+    }
+
     for (i = 0; supported_uri[i].uri; i++)
     {
         if (strcmp(uri, supported_uri[i].uri) == 0)
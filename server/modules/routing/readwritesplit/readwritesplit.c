@@ -19,6 +19,7 @@
 #include <string.h>
 #include <stdlib.h>
 #include <stdint.h>
+#include <limits.h>
 
 #include <maxscale/router.h>
 #include "rwsplit_internal.h"
@@ -197,6 +198,17 @@ MXS_MODULE *MXS_CREATE_MODULE()
             {"strict_multi_stmt",  MXS_MODULE_PARAM_BOOL, "true"},
             {"strict_sp_calls",  MXS_MODULE_PARAM_BOOL, "false"},
             {"master_accept_reads", MXS_MODULE_PARAM_BOOL, "false"},
+            {"causal_reads", MXS_MODULE_PARAM_BOOL, "false"},
+            {"causal_reads_timeout", MXS_MODULE_PARAM_COUNT, "10"},
+            {"transaction_replay", MXS_MODULE_PARAM_BOOL, "false"},
+            {"transaction_replay_max_size", MXS_MODULE_PARAM_SIZE, "1Mi"},
+            {"transaction_replay_timeout", MXS_MODULE_PARAM_COUNT, "10"},
+            {"optimistic_trx", MXS_MODULE_PARAM_BOOL, "false"},
+            {"client_high_water", MXS_MODULE_PARAM_SIZE, "16Mi"},
+            {"client_low_water", MXS_MODULE_PARAM_SIZE, "4Mi"},
+            {"pipelining", MXS_MODULE_PARAM_BOOL, "false"},
+            {"single_flight", MXS_MODULE_PARAM_BOOL, "false"},
+            {"single_flight_timeout", MXS_MODULE_PARAM_COUNT, "1000"},
             {MXS_END_MODULE_PARAMS}
         }
     };
@@ -280,6 +292,17 @@ static MXS_ROUTER *createInstance(SERVICE *service, char **options)
     router->rwsplit_config.disable_sescmd_history = config_get_bool(params, "disable_sescmd_history");
     router->rwsplit_config.max_sescmd_history = config_get_integer(params, "max_sescmd_history");
     router->rwsplit_config.master_accept_reads = config_get_bool(params, "master_accept_reads");
+    router->rwsplit_config.causal_reads = config_get_bool(params, "causal_reads");
+    router->rwsplit_config.causal_reads_timeout = config_get_integer(params, "causal_reads_timeout");
+    router->rwsplit_config.transaction_replay = config_get_bool(params, "transaction_replay");
+    router->rwsplit_config.trx_max_size = config_get_size(params, "transaction_replay_max_size");
+    router->rwsplit_config.trx_replay_timeout = config_get_integer(params, "transaction_replay_timeout");
+    router->rwsplit_config.optimistic_trx = config_get_bool(params, "optimistic_trx");
+    router->rwsplit_config.client_high_water = config_get_size(params, "client_high_water");
+    router->rwsplit_config.client_low_water = config_get_size(params, "client_low_water");
+    router->rwsplit_config.pipelining = config_get_bool(params, "pipelining");
+    router->rwsplit_config.single_flight = config_get_bool(params, "single_flight");
+    router->rwsplit_config.single_flight_timeout = config_get_integer(params, "single_flight_timeout");
 
     if (!handle_max_slaves(router, config_get_string(params, "max_slave_connections")) ||
         (options && !rwsplit_process_router_options(router, options)))
@@ -288,6 +311,24 @@ static MXS_ROUTER *createInstance(SERVICE *service, char **options)
         return NULL;
     }
 
+    if (router->rwsplit_config.client_high_water > INT_MAX)
+    {
+        router->rwsplit_config.client_high_water = INT_MAX;
+    }
+
+    if (router->rwsplit_config.client_low_water >= router->rwsplit_config.client_high_water)
+    {
+        MXS_WARNING("The value of 'client_low_water' must be lower than the value of "
+                    "'client_high_water', using half of 'client_high_water'.");
+        router->rwsplit_config.client_low_water = router->rwsplit_config.client_high_water / 2;
+    }
+
+    if (router->rwsplit_config.optimistic_trx)
+    {
+        /** Optimistic transactions are moved to the master by replaying them */
+        router->rwsplit_config.transaction_replay = true;
+    }
+
     /** These options cancel each other out */
     if (router->rwsplit_config.disable_sescmd_history &&
         router->rwsplit_config.max_sescmd_history > 0)
@@ -295,6 +336,12 @@ static MXS_ROUTER *createInstance(SERVICE *service, char **options)
         router->rwsplit_config.max_sescmd_history = 0;
     }
 
+    if ((router->flights = MXS_CALLOC(config_threadcount(), sizeof(*router->flights))) == NULL)
+    {
+        free_rwsplit_instance(router);
+        return NULL;
+    }
+
     return (MXS_ROUTER *)router;
 }
 
@@ -334,6 +381,7 @@ static MXS_ROUTER_SESSION *newSession(MXS_ROUTER *router_inst, MXS_SESSION *sess
     client_rses->have_tmp_tables = false;
     client_rses->forced_node = NULL;
     memcpy(&client_rses->rses_config, &router->rwsplit_config, sizeof(client_rses->rses_config));
+    rwsplit_trx_init(client_rses);
 
     int router_nservers = router->service->n_dbref;
     const int min_nservers = 1; /*< hard-coded for now */
@@ -388,6 +436,14 @@ static MXS_ROUTER_SESSION *newSession(MXS_ROUTER *router_inst, MXS_SESSION *sess
         client_rses->rses_config.max_slave_connections = n_conn;
     }
 
+    if (client_rses->rses_config.client_high_water)
+    {
+        /** The core pauses reading from the servers while the client can't
+         * keep up with the results */
+        session->client_dcb->high_water = client_rses->rses_config.client_high_water;
+        session->client_dcb->low_water = client_rses->rses_config.client_low_water;
+    }
+
     router->stats.n_sessions += 1;
 
     return (void *)client_rses;
@@ -417,6 +473,8 @@ static void closeSession(MXS_ROUTER *instance, MXS_ROUTER_SESSION *router_sessio
          * of every API function to quickly stop the processing of closed sessions.
          */
         router_cli_ses->rses_closed = true;
+        rwsplit_trx_close(router_cli_ses);
+        rwsplit_flight_leave((ROUTER_INSTANCE *)instance, router_cli_ses);
 
         for (int i = 0; i < router_cli_ses->rses_nbackends; i++)
         {
@@ -500,6 +558,16 @@ static void freeSession(MXS_ROUTER *router_instance, MXS_ROUTER_SESSION *router_
         }
     }
 
+    if (router_cli_ses->rses_ps)
+    {
+        hashtable_free(router_cli_ses->rses_ps);
+    }
+
+    gwbuf_free(router_cli_ses->rses_causal_query);
+    gwbuf_free(router_cli_ses->rses_pipeline_queue);
+    MXS_FREE(router_cli_ses->rses_gtid);
+    rwsplit_trx_free(router_cli_ses);
+
     MXS_FREE(router_cli_ses->rses_backend_ref);
     MXS_FREE(router_cli_ses);
     return;
@@ -521,6 +589,7 @@ void close_failed_bref(backend_ref_t *bref, bool fatal)
     bref_clear_state(bref, BREF_QUERY_ACTIVE);
     bref_clear_state(bref, BREF_IN_USE);
     bref_set_state(bref, BREF_CLOSED);
+    rwsplit_pipeline_reset(bref);
 
     if (fatal)
     {
@@ -537,6 +606,13 @@ void close_failed_bref(backend_ref_t *bref, bool fatal)
         gwbuf_free(bref->bref_pending_cmd);
         bref->bref_pending_cmd = NULL;
     }
+
+    if (bref->bref_sescmd_cur.scmd_cur_rses)
+    {
+        /** The statements are prepared again if the backend is reconnected */
+        rwsplit_ps_forget_backend(bref->bref_sescmd_cur.scmd_cur_rses, bref);
+        rwsplit_causal_forget_backend(bref->bref_sescmd_cur.scmd_cur_rses, bref);
+    }
 }
 
 /**
@@ -564,10 +640,24 @@ static int routeQuery(MXS_ROUTER *instance, MXS_ROUTER_SESSION *router_session,
     {
         closed_session_reply(querybuf);
     }
+    else if (rses->rses_trx.replaying)
+    {
+        /** Routed in order once the transaction has been replayed */
+        rses->rses_trx.pending = gwbuf_append(rses->rses_trx.pending, querybuf);
+        querybuf = NULL;
+        rval = 1;
+    }
     else
     {
         live_session_reply(&querybuf, rses);
-        if (route_single_stmt(inst, rses, querybuf))
+
+        if (rwsplit_pipeline_hold(rses, querybuf))
+        {
+            /** Routed in order once the earlier replies have arrived */
+            querybuf = NULL;
+            rval = 1;
+        }
+        else if (route_single_stmt(inst, rses, querybuf))
         {
             rval = 1;
         }
@@ -616,6 +706,28 @@ static void diagnostics(MXS_ROUTER *instance, DCB *dcb)
                router->rwsplit_config.max_sescmd_history);
     dcb_printf(dcb, "\tmaster_accept_reads:       %s\n",
                router->rwsplit_config.master_accept_reads ? "true" : "false");
+    dcb_printf(dcb, "\tcausal_reads:              %s\n",
+               router->rwsplit_config.causal_reads ? "true" : "false");
+    dcb_printf(dcb, "\tcausal_reads_timeout:      %d\n",
+               router->rwsplit_config.causal_reads_timeout);
+    dcb_printf(dcb, "\ttransaction_replay:        %s\n",
+               router->rwsplit_config.transaction_replay ? "true" : "false");
+    dcb_printf(dcb, "\ttransaction_replay_max_size: %" PRIu64 "\n",
+               router->rwsplit_config.trx_max_size);
+    dcb_printf(dcb, "\ttransaction_replay_timeout: %d\n",
+               router->rwsplit_config.trx_replay_timeout);
+    dcb_printf(dcb, "\toptimistic_trx:            %s\n",
+               router->rwsplit_config.optimistic_trx ? "true" : "false");
+    dcb_printf(dcb, "\tclient_high_water:         %" PRIu64 "\n",
+               router->rwsplit_config.client_high_water);
+    dcb_printf(dcb, "\tclient_low_water:          %" PRIu64 "\n",
+               router->rwsplit_config.client_low_water);
+    dcb_printf(dcb, "\tpipelining:                %s\n",
+               router->rwsplit_config.pipelining ? "true" : "false");
+    dcb_printf(dcb, "\tsingle_flight:             %s\n",
+               router->rwsplit_config.single_flight ? "true" : "false");
+    dcb_printf(dcb, "\tsingle_flight_timeout:     %d\n",
+               router->rwsplit_config.single_flight_timeout);
     dcb_printf(dcb, "\n");
 
     if (router->stats.n_queries > 0)
@@ -637,6 +749,10 @@ static void diagnostics(MXS_ROUTER *instance, DCB *dcb)
                router->stats.n_slave, slave_pct);
     dcb_printf(dcb, "\tNumber of queries forwarded to all:   	%" PRIu64 " (%.2f%%)\n",
                router->stats.n_all, all_pct);
+    dcb_printf(dcb, "\tNumber of queries pipelined:          	%" PRIu64 "\n",
+               router->stats.n_pipelined);
+    dcb_printf(dcb, "\tNumber of reads with a shared result: 	%" PRIu64 "\n",
+               router->stats.n_shared);
 
     if ((weightby = serviceGetWeightingParameter(router->service)) != NULL)
     {
@@ -700,10 +816,16 @@ static void clientReply(MXS_ROUTER *instance,
     backend_ref_t *bref = get_bref_from_dcb(router_cli_ses, backend_dcb);
     CHK_BACKEND_REF(bref);
     sescmd_cursor_t *scur = &bref->bref_sescmd_cur;
+    bool sescmd_reply = sescmd_cursor_is_active(scur);
 
     /** Statement was successfully executed, free the stored statement */
     session_clear_stmt(backend_dcb->session);
 
+    if (router_cli_ses->rses_config.causal_reads && bref == router_cli_ses->rses_master_ref)
+    {
+        rwsplit_causal_store_gtid(router_cli_ses, writebuf);
+    }
+
     /**
      * Active cursor means that reply is from session command
      * execution.
@@ -750,9 +872,41 @@ static void clientReply(MXS_ROUTER *instance,
      */
     else if (BREF_IS_QUERY_ACTIVE(bref))
     {
-        bref_clear_state(bref, BREF_QUERY_ACTIVE);
-        /** Set response status as replied */
-        bref_clear_state(bref, BREF_WAITING_RESULT);
+        /** The reply is streamed to the client as it arrives. The query is
+         * done once the ends of the replies to all the commands sent to the
+         * backend have been seen. The server waits for the client after
+         * requesting a LOAD DATA LOCAL INFILE file. */
+        bool done = rwsplit_pipeline_process_reply(bref, writebuf);
+
+        if (done)
+        {
+            bref_clear_state(bref, BREF_QUERY_ACTIVE);
+            /** Set response status as replied */
+            bref_clear_state(bref, BREF_WAITING_RESULT);
+        }
+
+        /** Sessions waiting for the same read get a copy of the reply */
+        rwsplit_flight_reply(router_inst, router_cli_ses, writebuf, done);
+    }
+
+    if (writebuf != NULL && (BREF_IS_WAITING_GTID(bref) || BREF_IS_CAUSAL_REPLY(bref)))
+    {
+        writebuf = rwsplit_causal_process_reply(router_inst, router_cli_ses, bref, writebuf);
+    }
+
+    if (writebuf != NULL && !sescmd_reply)
+    {
+        if (bref->bref_discard_reply)
+        {
+            /** Reply to a ROLLBACK that the client did not send */
+            bref->bref_discard_reply = false;
+            gwbuf_free(writebuf);
+            writebuf = NULL;
+        }
+        else if (router_cli_ses->rses_trx.current)
+        {
+            writebuf = rwsplit_trx_process_reply(router_inst, router_cli_ses, bref, writebuf);
+        }
     }
 
     if (writebuf != NULL && client_dcb != NULL)
@@ -791,6 +945,7 @@ static void clientReply(MXS_ROUTER *instance,
             /**
              * Add one query response waiter to backend reference
              */
+            bref_track_reply(router_cli_ses, bref, bref->bref_pending_cmd);
             bref_set_state(bref, BREF_QUERY_ACTIVE);
             bref_set_state(bref, BREF_WAITING_RESULT);
         }
@@ -811,6 +966,8 @@ static void clientReply(MXS_ROUTER *instance,
         gwbuf_free(bref->bref_pending_cmd);
         bref->bref_pending_cmd = NULL;
     }
+
+    rwsplit_pipeline_route_held(router_inst, router_cli_ses);
 }
 
 
@@ -825,7 +982,22 @@ static void clientReply(MXS_ROUTER *instance,
  */
 static uint64_t getCapabilities(MXS_ROUTER* instance)
 {
-    return RCAP_TYPE_STMT_INPUT | RCAP_TYPE_TRANSACTION_TRACKING;
+    ROUTER_INSTANCE *router = (ROUTER_INSTANCE *)instance;
+    uint64_t rval = RCAP_TYPE_STMT_INPUT | RCAP_TYPE_TRANSACTION_TRACKING;
+
+    if (router->rwsplit_config.causal_reads)
+    {
+        /** The GTID of the latest write is read from the OK packets */
+        rval |= RCAP_TYPE_SESSION_STATE_TRACKING;
+    }
+
+    if (router->rwsplit_config.transaction_replay)
+    {
+        /** The results are checksummed one packet at a time */
+        rval |= RCAP_TYPE_CONTIGUOUS_OUTPUT;
+    }
+
+    return rval;
 }
 
 /*
@@ -1199,6 +1371,50 @@ static bool rwsplit_process_router_options(ROUTER_INSTANCE *router,
             {
                 router->rwsplit_config.retry_failed_reads = config_truth_value(value);
             }
+            else if (strcmp(options[i], "causal_reads") == 0)
+            {
+                router->rwsplit_config.causal_reads = config_truth_value(value);
+            }
+            else if (strcmp(options[i], "causal_reads_timeout") == 0)
+            {
+                router->rwsplit_config.causal_reads_timeout = atoi(value);
+            }
+            else if (strcmp(options[i], "transaction_replay") == 0)
+            {
+                router->rwsplit_config.transaction_replay = config_truth_value(value);
+            }
+            else if (strcmp(options[i], "transaction_replay_max_size") == 0)
+            {
+                router->rwsplit_config.trx_max_size = strtoull(value, NULL, 10);
+            }
+            else if (strcmp(options[i], "transaction_replay_timeout") == 0)
+            {
+                router->rwsplit_config.trx_replay_timeout = atoi(value);
+            }
+            else if (strcmp(options[i], "optimistic_trx") == 0)
+            {
+                router->rwsplit_config.optimistic_trx = config_truth_value(value);
+            }
+            else if (strcmp(options[i], "client_high_water") == 0)
+            {
+                router->rwsplit_config.client_high_water = strtoull(value, NULL, 10);
+            }
+            else if (strcmp(options[i], "client_low_water") == 0)
+            {
+                router->rwsplit_config.client_low_water = strtoull(value, NULL, 10);
+            }
+            else if (strcmp(options[i], "pipelining") == 0)
+            {
+                router->rwsplit_config.pipelining = config_truth_value(value);
+            }
+            else if (strcmp(options[i], "single_flight") == 0)
+            {
+                router->rwsplit_config.single_flight = config_truth_value(value);
+            }
+            else if (strcmp(options[i], "single_flight_timeout") == 0)
+            {
+                router->rwsplit_config.single_flight_timeout = atoi(value);
+            }
             else if (strcmp(options[i], "master_failure_mode") == 0)
             {
                 if (strcasecmp(value, "fail_instantly") == 0)
@@ -1301,11 +1517,34 @@ static void handleError(MXS_ROUTER *instance,
         {
         case ERRACT_NEW_CONNECTION:
             {
+                if (bref && bref->bref_n_replies > 1)
+                {
+                    /** Only the latest statement is stored for a retry */
+                    MXS_ERROR("Server '%s' failed with %d pipelined statements waiting "
+                              "for a reply, closing session.",
+                              bref->ref->server->unique_name, bref->bref_n_replies);
+                    CHK_BACKEND_REF(bref);
+                    RW_CHK_DCB(bref, problem_dcb);
+                    dcb_close(problem_dcb);
+                    RW_CLOSE_BREF(bref);
+                    close_failed_bref(bref, false);
+                    *succp = false;
+                }
+                else if (bref && rwsplit_trx_can_replay(rses, bref))
+                {
+                    /** The open transaction is replayed on another server */
+                    CHK_BACKEND_REF(bref);
+                    RW_CHK_DCB(bref, problem_dcb);
+                    dcb_close(problem_dcb);
+                    RW_CLOSE_BREF(bref);
+                    close_failed_bref(bref, false);
+                    *succp = rwsplit_trx_replay(inst, rses);
+                }
                 /**
                  * If master has lost its Master status error can't be
                  * handled so that session could continue.
                  */
-                if (rses->rses_master_ref && rses->rses_master_ref->bref_dcb == problem_dcb)
+                else if (rses->rses_master_ref && rses->rses_master_ref->bref_dcb == problem_dcb)
                 {
                     SERVER *srv = rses->rses_master_ref->ref->server;
                     bool can_continue = false;
@@ -1392,6 +1631,11 @@ static void handleError(MXS_ROUTER *instance,
                               "session, not closing it. DCB is in state '%s'",
                               remote, STRDCBSTATE(problem_dcb->state));
                 }
+
+                if (*succp)
+                {
+                    rwsplit_pipeline_route_held(inst, rses);
+                }
                 break;
             }
 
@@ -1673,6 +1917,7 @@ static void free_rwsplit_instance(ROUTER_INSTANCE *router)
 {
     if (router)
     {
+        MXS_FREE(router->flights);
         MXS_FREE(router);
     }
 }
@@ -1718,6 +1963,7 @@ static bool create_backends(ROUTER_CLIENT_SES *rses, backend_ref_t** dest, int*
             backend_ref[i].bref_sescmd_cur.scmd_cur_ptr_property =
                 &rses->rses_properties[RSES_PROP_TYPE_SESCMD];
             backend_ref[i].bref_sescmd_cur.scmd_cur_cmd = NULL;
+            backend_ref[i].bref_sescmd_cur.scmd_cur_sent = -1;
             i++;
         }
     }
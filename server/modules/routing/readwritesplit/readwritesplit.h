@@ -30,11 +30,15 @@
 #include <maxscale/cdefs.h>
 
 #include <math.h>
+#include <openssl/sha.h>
 
 #include <maxscale/dcb.h>
 #include <maxscale/hashtable.h>
+#include <maxscale/modutil.h>
+#include <maxscale/query_classifier.h>
 #include <maxscale/router.h>
 #include <maxscale/service.h>
+#include <maxscale/timer.h>
 
 MXS_BEGIN_DECLS
 
@@ -44,7 +48,9 @@ typedef enum bref_state
     BREF_WAITING_RESULT   = 0x02, /*< for session commands only */
     BREF_QUERY_ACTIVE     = 0x04, /*< for other queries */
     BREF_CLOSED           = 0x08,
-    BREF_FATAL_FAILURE    = 0x10 /*< Backend references that should be dropped */
+    BREF_FATAL_FAILURE    = 0x10, /*< Backend references that should be dropped */
+    BREF_WAITING_GTID     = 0x20, /*< Causal read is waiting for the GTID */
+    BREF_CAUSAL_REPLY     = 0x40  /*< Reply to a causal read is renumbered */
 } bref_state_t;
 
 #define BREF_IS_NOT_USED(s)         ((s)->bref_state & ~BREF_IN_USE)
@@ -53,6 +59,11 @@ typedef enum bref_state
 #define BREF_IS_QUERY_ACTIVE(s)     ((s)->bref_state & BREF_QUERY_ACTIVE)
 #define BREF_IS_CLOSED(s)           ((s)->bref_state & BREF_CLOSED)
 #define BREF_HAS_FAILED(s)          ((s)->bref_state & BREF_FATAL_FAILURE)
+#define BREF_IS_WAITING_GTID(s)     ((s)->bref_state & BREF_WAITING_GTID)
+#define BREF_IS_CAUSAL_REPLY(s)     ((s)->bref_state & BREF_CAUSAL_REPLY)
+
+/** Maximum number of commands with outstanding replies on one backend */
+#define RWSPLIT_MAX_PIPELINE 64
 
 typedef enum backend_type_t
 {
@@ -191,6 +202,8 @@ typedef struct mysql_sescmd_st
                                    *  LOCAL_INFILE. Slave servers are compared to this
                                    *  when they return session command replies.*/
     int      position; /*< Position of this command */
+    int*     my_sescmd_early_replies; /*< Replies of the backends that replied before
+                                       *  the master, indexed by backend, -1 if none */
 #if defined(SS_DEBUG)
     skygw_chk_t        my_sescmd_chk_tail;
 #endif
@@ -229,6 +242,7 @@ typedef struct sescmd_cursor_st
     mysql_sescmd_t*    scmd_cur_cmd;          /*< pointer to current session command */
     bool               scmd_cur_active;       /*< true if command is being executed */
     int                position; /*< Position of this cursor */
+    int                scmd_cur_sent; /*< Position of the last command written */
 #if defined(SS_DEBUG)
     skygw_chk_t        scmd_cur_chk_tail;
 #endif
@@ -252,6 +266,13 @@ typedef struct backend_ref_st
     GWBUF*          bref_pending_cmd; /**< For stmt which can't be routed due active sescmd execution */
     unsigned char   reply_cmd;  /**< The reply the backend server sent to a session command.
                                  * Used to detect slaves that fail to execute session command. */
+    GWBUF*          bref_causal_reply; /**< Start of the reply to a causal read */
+    uint8_t         bref_causal_seq; /**< Next sequence number of the causal read reply */
+    bool            bref_discard_reply; /**< The reply is not sent to the client */
+    MXS_REPLY_TRACKER bref_reply; /**< Tracks the reply to the oldest command */
+    uint8_t         bref_reply_cmds[RWSPLIT_MAX_PIPELINE]; /**< Commands waiting for a reply */
+    int             bref_reply_first; /**< Index of the oldest command */
+    int             bref_n_replies; /**< Number of commands waiting for a reply */
 #if defined(SS_DEBUG)
     skygw_chk_t     bref_chk_tail;
 #endif
@@ -276,29 +297,74 @@ typedef struct rwsplit_config_st
     enum failure_mode master_failure_mode; /**< Master server failure handling mode.
                                                * @see enum failure_mode */
     bool              retry_failed_reads; /**< Retry failed reads on other servers */
+    bool              causal_reads; /**< Make slave reads wait for the latest write */
+    int               causal_reads_timeout; /**< Seconds to wait for the GTID on a slave */
+    bool              transaction_replay; /**< Replay transactions on server failure */
+    uint64_t          trx_max_size; /**< Maximum size of a replayable transaction */
+    int               trx_replay_timeout; /**< Seconds to wait for a replacement server */
+    bool              optimistic_trx; /**< Start transactions on slaves */
+    uint64_t          client_high_water; /**< Stop reading from servers when the client
+                                          * has this many bytes of unsent data */
+    uint64_t          client_low_water; /**< Continue reading once the unsent data drops
+                                         * below this */
+    bool              pipelining; /**< Send statements without waiting for earlier replies */
+    bool              single_flight; /**< Share the results of identical concurrent reads */
+    int               single_flight_timeout; /**< Milliseconds to wait for a shared result */
 } rwsplit_config_t;
 
-#if defined(PREP_STMT_CACHING)
-
-typedef struct prep_stmt_st
+/**
+ * A binary protocol prepared statement that is prepared on all backends
+ */
+typedef struct rwsplit_ps_st
 {
-#if defined(SS_DEBUG)
-    skygw_chk_t       pstmt_chk_top;
-#endif
+    uint32_t        ps_id;          /*< Statement ID known by the client */
+    qc_query_type_t ps_type;        /*< Type of the prepared statement */
+    uint32_t*       ps_backend_ids; /*< Statement ID of each backend, 0 if the
+                                     *  statement is not prepared there */
+    int             ps_last;        /*< Index of the backend that executed the
+                                     *  statement most recently, -1 if none */
+    bool            ps_long_data;   /*< COM_STMT_SEND_LONG_DATA was sent and
+                                     *  the next execution must use the same
+                                     *  backend */
+    uint16_t        ps_n_params;    /*< Number of parameters */
+    uint8_t*        ps_types;       /*< Parameter types of the latest execution
+                                     *  that sent them, NULL if none did */
+    bool*           ps_types_sent;  /*< Whether each backend has the types */
+    int             ps_nbackends;   /*< Number of backends */
+} rwsplit_ps_t;
 
-    union id
-    {
-        int   seq;
-        char* name;
-    } pstmt_id;
-    prep_stmt_state_t pstmt_state;
-    prep_stmt_type_t  pstmt_type;
-#if defined(SS_DEBUG)
-    skygw_chk_t       pstmt_chk_tail;
-#endif
-} prep_stmt_t;
+/**
+ * A statement of the transaction that is recorded for replay
+ */
+typedef struct rwsplit_trx_stmt
+{
+    GWBUF*                   stmt;     /*< The statement */
+    uint8_t                  checksum[SHA_DIGEST_LENGTH]; /*< Checksum of the result */
+    struct rwsplit_trx_stmt* next;
+} rwsplit_trx_stmt_t;
 
-#endif /*< PREP_STMT_CACHING */
+/**
+ * The open transaction of a session
+ */
+typedef struct rwsplit_trx
+{
+    rwsplit_trx_stmt_t* head;         /*< First statement of the transaction */
+    rwsplit_trx_stmt_t* tail;         /*< Last statement of the transaction */
+    uint64_t            size;         /*< Total size of the statements */
+    bool                active;       /*< A transaction is being recorded */
+    bool                replayable;   /*< The transaction can be replayed */
+    bool                ending;       /*< COMMIT or ROLLBACK was routed */
+    bool                optimistic;   /*< The transaction is executed on a slave */
+    backend_ref_t*      target;       /*< Backend that executes the transaction */
+    rwsplit_trx_stmt_t* current;      /*< Statement whose result is being read */
+    bool                current_sent; /*< Part of the current result was sent to the client */
+    MXS_REPLY_TRACKER   tracker;      /*< Tracks the result of the current statement */
+    SHA_CTX             sha;          /*< Checksum of the current result */
+    bool                replaying;    /*< The transaction is being replayed */
+    GWBUF*              pending;      /*< Statement routed after the replay */
+    uint64_t            deadline;     /*< When to stop waiting for a replacement server */
+    MXS_TIMER           timer;        /*< Retries the replay */
+} rwsplit_trx_t;
 
 /**
  * The client session structure used within this router.
@@ -321,9 +387,15 @@ struct router_client_session
     DCB*             client_dcb;
     int              pos_generator;
     backend_ref_t    *forced_node; /*< Current server where all queries should be sent */
-#if defined(PREP_STMT_CACHING)
-    HASHTABLE*       rses_prep_stmt[2];
-#endif
+    HASHTABLE*       rses_ps;      /*< Prepared statements by client statement ID */
+    char*            rses_gtid;    /*< GTID of the latest write, NULL if none */
+    bool             rses_gtid_is_set; /*< Whether rses_gtid is a MySQL GTID set */
+    GWBUF*           rses_causal_query; /*< Causal read waiting for the GTID */
+    rwsplit_trx_t    rses_trx;     /*< The open transaction */
+    GWBUF*           rses_pipeline_queue; /*< Statements waiting for earlier replies */
+    struct rwsplit_flight *rses_flight; /*< The shared read the session waits for or executes */
+    uint64_t         rses_sescmd_hash; /*< Hash of the executed session commands */
+    bool             rses_flight_expired; /*< The wait for a shared read timed out */
     struct router_instance *router;   /*< The router instance */
     struct router_client_session *next;
 #if defined(SS_DEBUG)
@@ -341,6 +413,8 @@ typedef struct
     uint64_t n_master;   /*< Number of stmts sent to master */
     uint64_t n_slave;    /*< Number of stmts sent to slave */
     uint64_t n_all;      /*< Number of stmts sent to all */
+    uint64_t n_pipelined; /*< Number of stmts sent before earlier replies arrived */
+    uint64_t n_shared;   /*< Number of reads answered with the result of another session */
 } ROUTER_STATS;
 
 /**
@@ -353,6 +427,7 @@ typedef struct router_instance
     int                     rwsplit_version; /*< version number for router's config */
     ROUTER_STATS            stats;       /*< Statistics for this router */
     bool                    available_slaves; /*< The router has some slaves avialable */
+    struct rwsplit_flight** flights;     /*< Shared reads in progress, one list per thread */
 } ROUTER_INSTANCE;
 
 #define BACKEND_TYPE(b) (SERVER_IS_MASTER((b)->backend_server) ? BE_MASTER :    \
@@ -0,0 +1,427 @@
+/*
+ * Copyright (c) 2016 MariaDB Corporation Ab
+ *
+ * Use of this software is governed by the Business Source License included
+ * in the LICENSE.TXT file and at www.mariadb.com/bsl11.
+ *
+ * Change Date: 2019-07-01
+ *
+ * On the date above, in accordance with the Business Source License, use
+ * of this software will be governed by version 2 or later of the General
+ * Public License.
+ */
+
+#include "readwritesplit.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+#include <maxscale/alloc.h>
+#include <maxscale/modutil.h>
+#include <maxscale/mysql_utils.h>
+#include <maxscale/router.h>
+#include <maxscale/protocol/mysql.h>
+#include "rwsplit_internal.h"
+
+/**
+ * @file rwsplit_causal_reads.c   Causal reads in the read write split router.
+ *
+ * The backend connections are created with session state tracking enabled
+ * and the GTID of the latest write is read from the OK packets sent by the
+ * master. Reads that are routed to slaves are prefixed with a statement that
+ * waits until the slave has replicated the GTID. If the wait times out, the
+ * prefix statement fails and the read is routed to the master instead.
+ */
+
+/** Session state change types, see the MySQL protocol documentation */
+#define SESSION_TRACK_SYSTEM_VARIABLES 0x00
+#define SESSION_TRACK_GTIDS            0x03
+
+/** Server status flag signaling that the OK packet has session state changes */
+#define RWSPLIT_SERVER_SESSION_STATE_CHANGED 0x4000
+
+/** The system variable that holds the GTID of the latest transaction in MariaDB */
+#define RWSPLIT_LAST_GTID "last_gtid"
+
+/**
+ * The prefix that waits for the GTID. The subquery in the ELSE branch
+ * returns more than one row which causes the statement, and with it the
+ * whole multi-statement query, to fail if the wait times out.
+ */
+static const char causal_wait_fmt[] =
+    "SET @maxscale_secret_variable=(SELECT CASE WHEN %s('%s', %d) = 0 "
+    "THEN 1 ELSE (SELECT 1 FROM INFORMATION_SCHEMA.ENGINES) END);";
+
+/**
+ * Check that a length-encoded value at @c ptr fits before @c end
+ */
+static inline bool leint_fits(const uint8_t *ptr, const uint8_t *end)
+{
+    return ptr < end && ptr + mxs_leint_bytes(ptr) <= end;
+}
+
+/**
+ * Consume a length-encoded string and check that it fits before @c end
+ */
+static bool lestr_consume(uint8_t **ptr, const uint8_t *end, uint8_t **str, size_t *len)
+{
+    if (!leint_fits(*ptr, end))
+    {
+        return false;
+    }
+
+    uint64_t size = mxs_leint_consume(ptr);
+
+    if (size > (uint64_t)(end - *ptr))
+    {
+        return false;
+    }
+
+    *str = *ptr;
+    *len = size;
+    *ptr += size;
+    return true;
+}
+
+static void store_gtid(ROUTER_CLIENT_SES *rses, const uint8_t *gtid, size_t len, bool is_set)
+{
+    char *value = MXS_MALLOC(len + 1);
+
+    if (value)
+    {
+        memcpy(value, gtid, len);
+        value[len] = '\0';
+        MXS_FREE(rses->rses_gtid);
+        rses->rses_gtid = value;
+        rses->rses_gtid_is_set = is_set;
+        MXS_DEBUG("Latest GTID of the session is '%s'.", value);
+    }
+}
+
+/**
+ * @brief Read the GTID of the latest write from an OK packet
+ *
+ * MariaDB reports the GTID as the value of the @c last_gtid system variable
+ * and MySQL as a GTID set.
+ *
+ * @param rses  Router session
+ * @param reply Reply from the master
+ */
+void rwsplit_causal_store_gtid(ROUTER_CLIENT_SES *rses, GWBUF *reply)
+{
+    uint8_t *data = GWBUF_DATA(reply);
+
+    if (GWBUF_LENGTH(reply) <= MYSQL_HEADER_LEN ||
+        MYSQL_GET_COMMAND(data) != MYSQL_REPLY_OK ||
+        GWBUF_LENGTH(reply) < MYSQL_GET_PAYLOAD_LEN(data) + MYSQL_HEADER_LEN)
+    {
+        /** Not an OK packet or one that was split across buffers */
+        return;
+    }
+
+    uint8_t *end = data + MYSQL_HEADER_LEN + MYSQL_GET_PAYLOAD_LEN(data);
+    uint8_t *ptr = data + MYSQL_HEADER_LEN + 1;
+
+    /** Affected rows and last insert ID */
+    for (int i = 0; i < 2; i++)
+    {
+        if (!leint_fits(ptr, end))
+        {
+            return;
+        }
+        ptr += mxs_leint_bytes(ptr);
+    }
+
+    if (end - ptr < 4)
+    {
+        return;
+    }
+
+    uint16_t status = gw_mysql_get_byte2(ptr);
+    ptr += 4; // Status and warnings
+
+    uint8_t *str;
+    size_t len;
+
+    if ((status & RWSPLIT_SERVER_SESSION_STATE_CHANGED) == 0 ||
+        !lestr_consume(&ptr, end, &str, &len) || // Info
+        !lestr_consume(&ptr, end, &str, &len))   // Session state changes
+    {
+        return;
+    }
+
+    uint8_t *changes_end = str + len;
+    ptr = str;
+
+    while (ptr < changes_end)
+    {
+        uint8_t type = *ptr++;
+        uint8_t *entry;
+        size_t entry_len;
+
+        if (!lestr_consume(&ptr, changes_end, &entry, &entry_len))
+        {
+            break;
+        }
+
+        uint8_t *entry_end = entry + entry_len;
+
+        if (type == SESSION_TRACK_SYSTEM_VARIABLES)
+        {
+            uint8_t *name, *value;
+            size_t name_len, value_len;
+
+            if (lestr_consume(&entry, entry_end, &name, &name_len) &&
+                lestr_consume(&entry, entry_end, &value, &value_len) &&
+                name_len == sizeof(RWSPLIT_LAST_GTID) - 1 &&
+                memcmp(name, RWSPLIT_LAST_GTID, name_len) == 0 && value_len > 0)
+            {
+                store_gtid(rses, value, value_len, false);
+            }
+        }
+        else if (type == SESSION_TRACK_GTIDS && entry_len > 1)
+        {
+            uint8_t *value;
+            size_t value_len;
+
+            entry++; // Encoding specification
+
+            if (lestr_consume(&entry, entry_end, &value, &value_len) && value_len > 0)
+            {
+                store_gtid(rses, value, value_len, true);
+            }
+        }
+    }
+}
+
+/**
+ * The function that waits for the GTID of the session
+ */
+static inline const char *causal_wait_func(ROUTER_CLIENT_SES *rses)
+{
+    return rses->rses_gtid_is_set ? "WAIT_FOR_EXECUTED_GTID_SET" : "MASTER_GTID_WAIT";
+}
+
+/**
+ * @brief Check whether a read can be routed to a slave
+ *
+ * The wait for the latest GTID is done as a multi-statement query so it can
+ * only be added to single packet text protocol queries. Other reads must be
+ * routed to the master when the session has a GTID to wait for.
+ *
+ * @param rses     Router session
+ * @param querybuf Contiguous buffer with the query
+ *
+ * @return True if the read does not need to wait or the wait can be added to it
+ */
+bool rwsplit_causal_can_route_to_slave(ROUTER_CLIENT_SES *rses, GWBUF *querybuf)
+{
+    if (!rses->rses_config.causal_reads || rses->rses_gtid == NULL)
+    {
+        return true;
+    }
+
+    MySQLProtocol *proto = (MySQLProtocol *)rses->client_dcb->protocol;
+    uint8_t *data = GWBUF_DATA(querybuf);
+    size_t payload_len = MYSQL_GET_PAYLOAD_LEN(data);
+    int prefix_len = snprintf(NULL, 0, causal_wait_fmt, causal_wait_func(rses), rses->rses_gtid,
+                              rses->rses_config.causal_reads_timeout);
+
+    return MYSQL_GET_COMMAND(data) == MYSQL_COM_QUERY &&
+           (proto->client_capabilities & GW_MYSQL_CAPABILITIES_MULTI_STATEMENTS) &&
+           payload_len + MYSQL_HEADER_LEN == GWBUF_LENGTH(querybuf) &&
+           payload_len + prefix_len < GW_MYSQL_MAX_PACKET_LEN;
+}
+
+/**
+ * @brief Add a wait for the latest GTID to a read routed to a slave
+ *
+ * @param rses     Router session
+ * @param bref     The slave the read is routed to
+ * @param querybuf Contiguous buffer with the query
+ *
+ * @return A new buffer with the wait prepended to the query or NULL if the
+ *         read does not need to wait
+ */
+GWBUF *rwsplit_causal_add_wait(ROUTER_CLIENT_SES *rses, backend_ref_t *bref, GWBUF *querybuf)
+{
+    if (!rses->rses_config.causal_reads || rses->rses_gtid == NULL ||
+        bref == rses->rses_master_ref || !rwsplit_causal_can_route_to_slave(rses, querybuf))
+    {
+        /** Reads that can't wait are routed to the master, see
+         * rwsplit_causal_can_route_to_slave */
+        return NULL;
+    }
+
+    const char *func = causal_wait_func(rses);
+    int timeout = rses->rses_config.causal_reads_timeout;
+    int prefix_len = snprintf(NULL, 0, causal_wait_fmt, func, rses->rses_gtid, timeout);
+    size_t sql_len = GWBUF_LENGTH(querybuf) - MYSQL_HEADER_LEN - 1;
+    size_t payload_len = 1 + prefix_len + sql_len;
+    GWBUF *buf = gwbuf_alloc(MYSQL_HEADER_LEN + payload_len);
+
+    if (buf)
+    {
+        uint8_t *data = GWBUF_DATA(buf);
+        gw_mysql_set_byte3(data, payload_len);
+        data[3] = 0;
+        data[4] = MYSQL_COM_QUERY;
+
+        /** snprintf needs room for the terminating null that is then
+         * overwritten by the query */
+        char prefix[prefix_len + 1];
+        snprintf(prefix, sizeof(prefix), causal_wait_fmt, func, rses->rses_gtid, timeout);
+        memcpy(data + MYSQL_HEADER_LEN + 1, prefix, prefix_len);
+        memcpy(data + MYSQL_HEADER_LEN + 1 + prefix_len,
+               GWBUF_DATA(querybuf) + MYSQL_HEADER_LEN + 1, sql_len);
+
+        gwbuf_set_type(buf, GWBUF_TYPE_MYSQL);
+
+        gwbuf_free(rses->rses_causal_query);
+        rses->rses_causal_query = gwbuf_clone(querybuf);
+        bref_set_state(bref, BREF_WAITING_GTID);
+
+        MXS_INFO("Causal read on '%s' waits for GTID '%s'.",
+                 bref->ref->server->unique_name, rses->rses_gtid);
+    }
+
+    return buf;
+}
+
+/**
+ * @brief Renumber the packets of the reply to a causal read
+ *
+ * The client did not see the result of the wait so the sequence numbers of
+ * the packets that follow it are rewritten to start from one. Incomplete
+ * packets are kept until the rest of them arrives.
+ *
+ * @param bref  The slave that replied
+ * @param reply The reply
+ *
+ * @return The complete packets of the reply or NULL if there are none
+ */
+static GWBUF *causal_renumber_reply(backend_ref_t *bref, GWBUF *reply)
+{
+    bref->bref_causal_reply = gwbuf_append(bref->bref_causal_reply, reply);
+    GWBUF *complete = gwbuf_make_contiguous(modutil_get_complete_packets(&bref->bref_causal_reply));
+
+    if (complete)
+    {
+        uint8_t *data = GWBUF_DATA(complete);
+        uint8_t *end = data + GWBUF_LENGTH(complete);
+
+        while (data < end)
+        {
+            data[3] = bref->bref_causal_seq++;
+            data += MYSQL_GET_PAYLOAD_LEN(data) + MYSQL_HEADER_LEN;
+        }
+    }
+
+    if (!BREF_IS_QUERY_ACTIVE(bref) && bref->bref_causal_reply == NULL)
+    {
+        /** The whole reply has been forwarded */
+        bref_clear_state(bref, BREF_CAUSAL_REPLY);
+    }
+
+    return complete;
+}
+
+/**
+ * @brief Process the reply to a causal read
+ *
+ * The result of the wait is removed from the reply and the rest of it is
+ * renumbered. If the wait failed, the rest of the reply is discarded and the
+ * original query is routed to the master.
+ *
+ * @param inst  Router instance
+ * @param rses  Router session
+ * @param bref  The slave that replied
+ * @param reply The reply
+ *
+ * @return The part of the reply that is sent to the client or NULL if there
+ *         is nothing to send yet
+ */
+GWBUF *rwsplit_causal_process_reply(ROUTER_INSTANCE *inst, ROUTER_CLIENT_SES *rses,
+                                    backend_ref_t *bref, GWBUF *reply)
+{
+    if (BREF_IS_CAUSAL_REPLY(bref))
+    {
+        return causal_renumber_reply(bref, reply);
+    }
+
+    bref->bref_causal_reply = gwbuf_append(bref->bref_causal_reply, reply);
+    GWBUF *result = modutil_get_next_MySQL_packet(&bref->bref_causal_reply);
+
+    if (result == NULL)
+    {
+        /** The result of the wait is not yet complete */
+        return NULL;
+    }
+
+    reply = bref->bref_causal_reply;
+    bref->bref_causal_reply = NULL;
+    bref_clear_state(bref, BREF_WAITING_GTID);
+
+    GWBUF *query = rses->rses_causal_query;
+    rses->rses_causal_query = NULL;
+
+    uint8_t cmd;
+    gwbuf_copy_data(result, MYSQL_HEADER_LEN, 1, &cmd);
+    gwbuf_free(result);
+
+    if (cmd == MYSQL_REPLY_OK)
+    {
+        bref->bref_causal_seq = 1;
+        bref_set_state(bref, BREF_CAUSAL_REPLY);
+        reply = causal_renumber_reply(bref, reply);
+    }
+    else
+    {
+        /** There is nothing after the failed statement of the multi-statement
+         * query but the reply is discarded in case there is */
+        gwbuf_free(reply);
+        reply = NULL;
+
+        MXS_INFO("Causal read on '%s' timed out, routing it to the master.",
+                 bref->ref->server->unique_name);
+
+        DCB *target_dcb = NULL;
+
+        if (query == NULL ||
+            !handle_master_is_target(inst, rses, &target_dcb) || target_dcb == NULL ||
+            !handle_got_target(inst, rses, query, target_dcb, false))
+        {
+            MXS_ERROR("Failed to route causal read to the master.");
+            reply = modutil_create_mysql_err_msg(1, 0, 1927, "08S01",
+                                                 "Causal read timed out and the master "
+                                                 "is not available");
+        }
+    }
+
+    gwbuf_free(query);
+
+    return reply;
+}
+
+/**
+ * @brief Forget the causal read that was sent to a backend
+ *
+ * @param rses Router session
+ * @param bref The backend that failed
+ */
+void rwsplit_causal_forget_backend(ROUTER_CLIENT_SES *rses, backend_ref_t *bref)
+{
+    if (BREF_IS_WAITING_GTID(bref))
+    {
+        bref_clear_state(bref, BREF_WAITING_GTID);
+        gwbuf_free(rses->rses_causal_query);
+        rses->rses_causal_query = NULL;
+    }
+
+    bref_clear_state(bref, BREF_CAUSAL_REPLY);
+
+    gwbuf_free(bref->bref_causal_reply);
+    bref->bref_causal_reply = NULL;
+}
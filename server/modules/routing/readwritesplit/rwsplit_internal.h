@@ -133,6 +133,71 @@ bool select_connect_backend_servers(backend_ref_t **p_master_ref,
                                     MXS_SESSION *session,
                                     ROUTER_INSTANCE *router,
                                     bool active_session);
+backend_ref_t *select_connect_master(ROUTER_CLIENT_SES *rses);
+
+/*
+ * The following are implemented in rwsplit_causal_reads.c
+ */
+void rwsplit_causal_store_gtid(ROUTER_CLIENT_SES *rses, GWBUF *reply);
+bool rwsplit_causal_can_route_to_slave(ROUTER_CLIENT_SES *rses, GWBUF *querybuf);
+GWBUF *rwsplit_causal_add_wait(ROUTER_CLIENT_SES *rses, backend_ref_t *bref, GWBUF *querybuf);
+GWBUF *rwsplit_causal_process_reply(ROUTER_INSTANCE *inst, ROUTER_CLIENT_SES *rses,
+                                    backend_ref_t *bref, GWBUF *reply);
+void rwsplit_causal_forget_backend(ROUTER_CLIENT_SES *rses, backend_ref_t *bref);
+
+/*
+ * The following are implemented in rwsplit_prep_stmt.c
+ */
+bool rwsplit_ps_add(ROUTER_CLIENT_SES *rses, int position, qc_query_type_t type);
+rwsplit_ps_t *rwsplit_ps_lookup(ROUTER_CLIENT_SES *rses, GWBUF *querybuf, int packet_type);
+bool rwsplit_ps_route(ROUTER_INSTANCE *inst, ROUTER_CLIENT_SES *rses, GWBUF *querybuf,
+                      int packet_type, rwsplit_ps_t *ps);
+void rwsplit_ps_store_reply(ROUTER_CLIENT_SES *rses, backend_ref_t *bref,
+                            int position, GWBUF *reply);
+void rwsplit_ps_client_reply(ROUTER_CLIENT_SES *rses, int position, GWBUF *reply);
+void rwsplit_ps_forget_backend(ROUTER_CLIENT_SES *rses, backend_ref_t *bref);
+
+/*
+ * The following are implemented in rwsplit_ps_exec.c
+ */
+GWBUF *rwsplit_ps_exec_types(rwsplit_ps_t *ps, int backend, GWBUF *exec);
+
+/*
+ * The following are implemented in rwsplit_trx.c
+ */
+void rwsplit_trx_init(ROUTER_CLIENT_SES *rses);
+void rwsplit_trx_close(ROUTER_CLIENT_SES *rses);
+void rwsplit_trx_free(ROUTER_CLIENT_SES *rses);
+void rwsplit_trx_begin(ROUTER_CLIENT_SES *rses, qc_query_type_t qtype);
+bool rwsplit_trx_is_optimistic_stmt(ROUTER_CLIENT_SES *rses, GWBUF *querybuf,
+                                    int packet_type, qc_query_type_t qtype);
+bool rwsplit_trx_migrate(ROUTER_INSTANCE *inst, ROUTER_CLIENT_SES *rses, GWBUF *querybuf);
+void rwsplit_trx_record(ROUTER_CLIENT_SES *rses, backend_ref_t *bref, GWBUF *querybuf);
+GWBUF *rwsplit_trx_process_reply(ROUTER_INSTANCE *inst, ROUTER_CLIENT_SES *rses,
+                                 backend_ref_t *bref, GWBUF *reply);
+bool rwsplit_trx_can_replay(ROUTER_CLIENT_SES *rses, backend_ref_t *bref);
+bool rwsplit_trx_replay(ROUTER_INSTANCE *inst, ROUTER_CLIENT_SES *rses);
+
+/*
+ * The following are implemented in rwsplit_pipeline.c
+ */
+void bref_track_reply(ROUTER_CLIENT_SES *rses, backend_ref_t *bref, GWBUF *query);
+bool rwsplit_pipeline_process_reply(backend_ref_t *bref, GWBUF *reply);
+void rwsplit_pipeline_reset(backend_ref_t *bref);
+bool rwsplit_pipeline_hold(ROUTER_CLIENT_SES *rses, GWBUF *querybuf);
+void rwsplit_pipeline_redirect(ROUTER_CLIENT_SES *rses, route_target_t route_target,
+                               DCB **target_dcb);
+void rwsplit_pipeline_route_held(ROUTER_INSTANCE *inst, ROUTER_CLIENT_SES *rses);
+
+/*
+ * The following are implemented in rwsplit_single_flight.c
+ */
+void rwsplit_flight_add_sescmd(ROUTER_CLIENT_SES *rses, GWBUF *querybuf);
+bool rwsplit_flight_sql_is_shareable(GWBUF *querybuf);
+bool rwsplit_flight_join(ROUTER_INSTANCE *inst, ROUTER_CLIENT_SES *rses,
+                         GWBUF *querybuf, qc_query_type_t qtype);
+void rwsplit_flight_reply(ROUTER_INSTANCE *inst, ROUTER_CLIENT_SES *rses, GWBUF *reply, bool done);
+void rwsplit_flight_leave(ROUTER_INSTANCE *inst, ROUTER_CLIENT_SES *rses);
 
 /*
  * The following are implemented in rwsplit_tmp_table_multi.c
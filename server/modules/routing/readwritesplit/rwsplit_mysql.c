@@ -39,6 +39,8 @@
 
 #define RWSPLIT_TRACE_MSG_LEN 1000
 
+static bool write_sescmd(DCB *dcb, mysql_sescmd_t *scmd);
+
 /**
  * @file rwsplit_mysql.c   Functions within the read-write split router that
  * are specific to MySQL. The aim is to either remove these into a separate
@@ -379,29 +381,26 @@ void check_session_command_reply(GWBUF *writebuf, sescmd_cursor_t *scur, backend
 }
 
 /**
- * @brief If session command cursor is passive, sends the command to backend for
- * execution.
+ * @brief Send the session commands that the backend has not yet received
+ *
+ * All the session commands from the current position of the cursor onwards
+ * are written to the backend without waiting for the replies to the earlier
+ * ones. The protocol module splits the replies by command. The commands after
+ * a COM_CHANGE_USER are sent once it has been replied to.
  *
- * Returns true if command was sent or added successfully to the queue.
- * Returns false if command sending failed or if there are no pending session
- *  commands.
+ * Returns true if the commands were sent or added successfully to the queue.
+ * Returns false if command sending failed.
  *
  * Router session must be locked.
  *
  * @param backend_ref   Router session backend database data
  * @return bool - true for success, false for failure
  */
-/*
- * Uses MySQL specific values in the large switch statement, although it
- * may be possible to generalize them.
- */
 bool execute_sescmd_in_backend(backend_ref_t *backend_ref)
 {
     DCB *dcb;
     bool succp;
-    int rc = 0;
     sescmd_cursor_t *scur;
-    GWBUF *buf;
     if (backend_ref == NULL)
     {
         MXS_ERROR("[%s] Error: NULL parameter.", __FUNCTION__);
@@ -437,12 +436,56 @@ bool execute_sescmd_in_backend(backend_ref_t *backend_ref)
         sescmd_cursor_set_active(scur, true);
     }
 
-    switch (scur->scmd_cur_cmd->my_sescmd_packet_type)
+    succp = true;
+
+    for (rses_property_t *prop = *scur->scmd_cur_ptr_property; prop && succp;
+         prop = prop->rses_prop_next)
+    {
+        mysql_sescmd_t *scmd = &prop->rses_prop_data.sescmd;
+
+        if (scmd->position > scur->scmd_cur_sent)
+        {
+            succp = write_sescmd(dcb, scmd);
+            scur->scmd_cur_sent = scmd->position;
+        }
+
+        if (scmd->my_sescmd_packet_type == MYSQL_COM_CHANGE_USER)
+        {
+            /** The reply is handled by the authentication code */
+            break;
+        }
+    }
+
+return_succp:
+    return succp;
+}
+
+/*
+ * End of functions called from other router modules; start of functions that
+ * are internal to this module
+ */
+
+/**
+ * @brief Write one session command to a backend
+ *
+ * Uses MySQL specific values in the large switch statement, although it
+ * may be possible to generalize them.
+ *
+ * @param dcb  Backend DCB
+ * @param scmd The session command
+ * @return True if the command was written or queued
+ */
+static bool write_sescmd(DCB *dcb, mysql_sescmd_t *scmd)
+{
+    GWBUF *buf;
+    int rc = 0;
+
+    switch (scmd->my_sescmd_packet_type)
     {
     case MYSQL_COM_CHANGE_USER:
         /** This makes it possible to handle replies correctly */
-        gwbuf_set_type(scur->scmd_cur_cmd->my_sescmd_buf, GWBUF_TYPE_SESCMD);
-        buf = sescmd_cursor_clone_querybuf(scur);
+        gwbuf_set_type(scmd->my_sescmd_buf, GWBUF_TYPE_SESCMD);
+        buf = gwbuf_clone(scmd->my_sescmd_buf);
         rc = dcb->func.auth(dcb, NULL, dcb->session, buf);
         break;
 
@@ -457,7 +500,7 @@ bool execute_sescmd_in_backend(backend_ref_t *backend_ref)
 
             data = dcb->session->client_dcb->data;
             *data->db = 0;
-            tmpbuf = scur->scmd_cur_cmd->my_sescmd_buf;
+            tmpbuf = scmd->my_sescmd_buf;
             qlen = MYSQL_GET_PAYLOAD_LEN((unsigned char *) GWBUF_DATA(tmpbuf));
             if (qlen)
             {
@@ -481,29 +524,15 @@ bool execute_sescmd_in_backend(backend_ref_t *backend_ref)
          * MySQL command to protocol
          */
 
-        gwbuf_set_type(scur->scmd_cur_cmd->my_sescmd_buf, GWBUF_TYPE_SESCMD);
-        buf = sescmd_cursor_clone_querybuf(scur);
+        gwbuf_set_type(scmd->my_sescmd_buf, GWBUF_TYPE_SESCMD);
+        buf = gwbuf_clone(scmd->my_sescmd_buf);
         rc = dcb->func.write(dcb, buf);
         break;
     }
 
-    if (rc == 1)
-    {
-        succp = true;
-    }
-    else
-    {
-        succp = false;
-    }
-return_succp:
-    return succp;
+    return rc == 1;
 }
 
-/*
- * End of functions called from other router modules; start of functions that
- * are internal to this module
- */
-
 /**
  * Get client DCB pointer of the router client session.
  * This routine must be protected by Router client session lock.
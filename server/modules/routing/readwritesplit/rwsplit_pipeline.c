@@ -0,0 +1,353 @@
+/*
+ * Copyright (c) 2016 MariaDB Corporation Ab
+ *
+ * Use of this software is governed by the Business Source License included
+ * in the LICENSE.TXT file and at www.mariadb.com/bsl11.
+ *
+ * Change Date: 2019-07-01
+ *
+ * On the date above, in accordance with the Business Source License, use
+ * of this software will be governed by version 2 or later of the General
+ * Public License.
+ */
+
+#include "readwritesplit.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+#include <maxscale/atomic.h>
+#include <maxscale/modutil.h>
+#include <maxscale/poll.h>
+#include <maxscale/router.h>
+#include <maxscale/protocol/mysql.h>
+#include "rwsplit_internal.h"
+
+/**
+ * @file rwsplit_pipeline.c   Reply accounting and pipelining in the read
+ * write split router.
+ *
+ * The commands written to a backend are queued in the backend reference and
+ * the replies are matched to them in order by counting the reply packets.
+ * Without the pipelining option, commands are routed as they arrive.
+ *
+ * With the pipelining option, a command that the backend with outstanding
+ * replies can execute is sent to it without waiting. Reads are sent to the
+ * busy backend whether it is a slave or the master and writes are sent if
+ * the busy backend is the master. Other commands are held until the earlier
+ * replies have arrived so that the replies are sent to the client in the
+ * order the commands were sent.
+ *
+ * Consecutive session commands are always sent without waiting as the reply
+ * to each of them comes from the master. The statements after them wait
+ * until the master has replied to all of them.
+ */
+
+/**
+ * Check whether the backend is waiting for LOAD DATA LOCAL INFILE data
+ */
+static inline bool bref_waiting_infile(backend_ref_t *bref)
+{
+    return bref->bref_n_replies > 0 && bref->bref_reply.local_infile;
+}
+
+/**
+ * @brief Start tracking the replies to commands written to a backend
+ *
+ * @param rses  Router session
+ * @param bref  The backend the commands were written to
+ * @param query One or more complete packets
+ */
+void bref_track_reply(ROUTER_CLIENT_SES *rses, backend_ref_t *bref, GWBUF *query)
+{
+    size_t total = gwbuf_length(query);
+    size_t offset = 0;
+    bool continuation = false;
+
+    while (offset + MYSQL_HEADER_LEN <= total)
+    {
+        uint8_t header[MYSQL_HEADER_LEN + 1];
+        size_t n = gwbuf_copy_data(query, offset, sizeof(header), header);
+        size_t len = gw_mysql_get_byte3(header);
+        offset += MYSQL_HEADER_LEN + len;
+
+        /** The LOAD DATA LOCAL INFILE data and the empty packet that ends it
+         * are answered as a part of the LOAD DATA query. The rest of a large
+         * packet is not a new command. */
+        if (!continuation && n > MYSQL_HEADER_LEN && !bref_waiting_infile(bref) &&
+            modutil_command_has_reply(header[MYSQL_HEADER_LEN]))
+        {
+            ss_dassert(bref->bref_n_replies < RWSPLIT_MAX_PIPELINE);
+            uint8_t cmd = header[MYSQL_HEADER_LEN];
+            int pos = (bref->bref_reply_first + bref->bref_n_replies) % RWSPLIT_MAX_PIPELINE;
+            bref->bref_reply_cmds[pos] = cmd;
+
+            if (bref->bref_n_replies++ == 0)
+            {
+                modutil_reply_tracker_init(&bref->bref_reply, cmd);
+            }
+            else
+            {
+                atomic_add_uint64(&rses->router->stats.n_pipelined, 1);
+            }
+        }
+
+        continuation = len == GW_MYSQL_MAX_PACKET_LEN;
+    }
+}
+
+/**
+ * @brief Match a part of the replies of a backend to the commands
+ *
+ * @param bref  The backend that replied
+ * @param reply Part of the replies
+ *
+ * @return True if the backend has no more replies to send, or if it is
+ *         waiting for LOAD DATA LOCAL INFILE data from the client
+ */
+bool rwsplit_pipeline_process_reply(backend_ref_t *bref, GWBUF *reply)
+{
+    size_t total = gwbuf_length(reply);
+    size_t offset = 0;
+
+    while (bref->bref_n_replies > 0 &&
+           modutil_reply_tracker_consume(&bref->bref_reply, reply, &offset))
+    {
+        bref->bref_reply_first = (bref->bref_reply_first + 1) % RWSPLIT_MAX_PIPELINE;
+
+        if (--bref->bref_n_replies > 0)
+        {
+            modutil_reply_tracker_next(&bref->bref_reply,
+                                       bref->bref_reply_cmds[bref->bref_reply_first]);
+        }
+
+        if (offset >= total)
+        {
+            break;
+        }
+    }
+
+    return bref->bref_n_replies == 0 || bref_waiting_infile(bref);
+}
+
+/**
+ * @brief Forget the replies a backend was expected to send
+ *
+ * @param bref The backend that failed
+ */
+void rwsplit_pipeline_reset(backend_ref_t *bref)
+{
+    bref->bref_n_replies = 0;
+    bref->bref_reply_first = 0;
+}
+
+/**
+ * Find the backend that has outstanding replies
+ *
+ * @return The backend or NULL if no backend is busy
+ */
+static backend_ref_t *pipeline_busy_bref(ROUTER_CLIENT_SES *rses)
+{
+    for (int i = 0; i < rses->rses_nbackends; i++)
+    {
+        backend_ref_t *bref = &rses->rses_backend_ref[i];
+
+        if (BREF_IS_IN_USE(bref) && bref->bref_n_replies > 0)
+        {
+            return bref;
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ * Check whether the master has not yet replied to all session commands
+ */
+static bool pipeline_sescmd_active(ROUTER_CLIENT_SES *rses)
+{
+    backend_ref_t *master = rses->rses_master_ref;
+
+    return master && BREF_IS_IN_USE(master) && sescmd_cursor_is_active(&master->bref_sescmd_cur);
+}
+
+/**
+ * Find out where a command would be routed
+ *
+ * @return False if the command is routed based on where an earlier command
+ *         was routed and the target can't be known beforehand
+ */
+static bool pipeline_route_target(ROUTER_CLIENT_SES *rses, GWBUF *querybuf,
+                                  route_target_t *route_target)
+{
+    bool non_empty_packet;
+    int packet_type = determine_packet_type(querybuf, &non_empty_packet);
+
+    if (!non_empty_packet || rwsplit_ps_lookup(rses, querybuf, packet_type))
+    {
+        /** Prepared statements are routed based on where they are prepared */
+        return false;
+    }
+
+    qc_query_type_t qtype = determine_query_type(querybuf, packet_type, non_empty_packet);
+    *route_target = get_route_target(rses, qtype, querybuf->hint);
+    return true;
+}
+
+/**
+ * Check whether a command has to wait for the outstanding replies
+ *
+ * @param rses     Router session
+ * @param querybuf Contiguous buffer with one command
+ *
+ * @return True if the command must wait
+ */
+static bool pipeline_must_wait(ROUTER_CLIENT_SES *rses, GWBUF *querybuf)
+{
+    backend_ref_t *busy = pipeline_busy_bref(rses);
+    route_target_t route_target;
+
+    if (rses->rses_flight)
+    {
+        /** The result of a shared read must not be mixed with other replies */
+        return true;
+    }
+
+    if (!rses->rses_config.pipelining)
+    {
+        return false;
+    }
+
+    if (busy == NULL)
+    {
+        /** Session commands are pipelined after the earlier ones. Other
+         * commands wait until the master has replied to them. */
+        return pipeline_sescmd_active(rses) &&
+               (!pipeline_route_target(rses, querybuf, &route_target) ||
+                !TARGET_IS_ALL(route_target));
+    }
+
+    if (bref_waiting_infile(busy))
+    {
+        return false;
+    }
+
+    /** Causal reads and transaction replay look at the start of each reply
+     * and a reply to a hidden ROLLBACK is not sent to the client */
+    if (rses->rses_config.causal_reads ||
+        busy->bref_n_replies >= RWSPLIT_MAX_PIPELINE || busy->bref_discard_reply ||
+        sescmd_cursor_is_active(&busy->bref_sescmd_cur) || pipeline_sescmd_active(rses) ||
+        rses->rses_trx.current || rses->rses_trx.optimistic ||
+        (rses->forced_node && rses->forced_node != busy) ||
+        !pipeline_route_target(rses, querybuf, &route_target))
+    {
+        return true;
+    }
+
+    if (TARGET_IS_ALL(route_target) || TARGET_IS_NAMED_SERVER(route_target) ||
+        TARGET_IS_RLAG_MAX(route_target))
+    {
+        return true;
+    }
+
+    return !TARGET_IS_SLAVE(route_target) && busy != rses->rses_master_ref;
+}
+
+/**
+ * @brief Hold a command until the earlier replies have arrived
+ *
+ * @param rses     Router session
+ * @param querybuf Contiguous buffer with one command
+ *
+ * @return True if the command was taken, false if it can be routed now
+ */
+bool rwsplit_pipeline_hold(ROUTER_CLIENT_SES *rses, GWBUF *querybuf)
+{
+    if (rses->rses_pipeline_queue == NULL && !pipeline_must_wait(rses, querybuf))
+    {
+        return false;
+    }
+
+    rses->rses_pipeline_queue = gwbuf_append(rses->rses_pipeline_queue, querybuf);
+    return true;
+}
+
+/**
+ * @brief Send a read to the backend with outstanding replies
+ *
+ * @param rses         Router session
+ * @param route_target The target type of the read
+ * @param target_dcb   The target chosen for the read, replaced with the
+ *                     DCB of the busy backend
+ */
+void rwsplit_pipeline_redirect(ROUTER_CLIENT_SES *rses, route_target_t route_target,
+                               DCB **target_dcb)
+{
+    backend_ref_t *busy;
+
+    if (rses->rses_config.pipelining && TARGET_IS_SLAVE(route_target) &&
+        (busy = pipeline_busy_bref(rses)) && busy->bref_dcb != *target_dcb)
+    {
+        MXS_INFO("Pipelining read to '%s'.", busy->ref->server->unique_name);
+        *target_dcb = busy->bref_dcb;
+    }
+}
+
+/**
+ * Take the first held command from the queue
+ *
+ * Each command is held in its own contiguous buffer so the buffer is taken
+ * as a whole, along with the routing hints attached to it.
+ */
+static GWBUF *pipeline_take_first(GWBUF **queue)
+{
+    GWBUF *packet = *queue;
+
+    if (packet)
+    {
+        *queue = packet->next;
+
+        if (*queue)
+        {
+            (*queue)->tail = packet->tail;
+        }
+
+        packet->next = NULL;
+        packet->tail = packet;
+    }
+
+    return packet;
+}
+
+/**
+ * @brief Route the held commands that no longer need to wait
+ *
+ * @param inst Router instance
+ * @param rses Router session
+ */
+void rwsplit_pipeline_route_held(ROUTER_INSTANCE *inst, ROUTER_CLIENT_SES *rses)
+{
+    GWBUF *packet;
+
+    while (!rses->rses_closed && !rses->rses_trx.replaying &&
+           (packet = pipeline_take_first(&rses->rses_pipeline_queue)))
+    {
+        if (pipeline_must_wait(rses, packet))
+        {
+            rses->rses_pipeline_queue = gwbuf_append(packet, rses->rses_pipeline_queue);
+            break;
+        }
+
+        bool routed = route_single_stmt(inst, rses, packet);
+        gwbuf_free(packet);
+
+        if (!routed)
+        {
+            MXS_ERROR("Failed to route a held statement.");
+            poll_fake_hangup_event(rses->client_dcb);
+            break;
+        }
+    }
+}
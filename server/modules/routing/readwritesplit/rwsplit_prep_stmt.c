@@ -0,0 +1,588 @@
+/*
+ * Copyright (c) 2016 MariaDB Corporation Ab
+ *
+ * Use of this software is governed by the Business Source License included
+ * in the LICENSE.TXT file and at www.mariadb.com/bsl11.
+ *
+ * Change Date: 2019-07-01
+ *
+ * On the date above, in accordance with the Business Source License, use
+ * of this software will be governed by version 2 or later of the General
+ * Public License.
+ */
+
+#include "readwritesplit.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+#include <maxscale/alloc.h>
+#include <maxscale/router.h>
+#include <maxscale/protocol/mysql.h>
+#include "rwsplit_internal.h"
+
+/**
+ * @file rwsplit_prep_stmt.c   Binary protocol prepared statements in the
+ * read write split router.
+ *
+ * A COM_STMT_PREPARE is executed as a session command on all backends. The
+ * client is given a statement ID generated by the router and the ID that
+ * each backend returns is stored when its reply arrives. The statement ID
+ * of the commands that use the prepared statement is rewritten in place
+ * to the ID of the backend that the command is routed to. This allows the
+ * executions of read-only statements to be routed to slaves. An execution
+ * routed to a backend that hasn't seen the parameter types gets them added,
+ * see rwsplit_ps_exec.c.
+ */
+
+/** Offset of the statement ID in the commands and in COM_STMT_PREPARE_OK */
+#define RWSPLIT_PS_ID_OFFSET (MYSQL_HEADER_LEN + 1)
+
+/** Offset of the number of parameters in COM_STMT_PREPARE_OK */
+#define RWSPLIT_PS_N_PARAMS_OFFSET (RWSPLIT_PS_ID_OFFSET + 4 + 2)
+
+/** Initial size of the prepared statement hashtable */
+#define RWSPLIT_PS_HASHTABLE_SIZE 31
+
+static int ps_hashfun(const void *key)
+{
+    return *(const uint32_t *)key;
+}
+
+static int ps_cmpfun(const void *v1, const void *v2)
+{
+    uint32_t i1 = *(const uint32_t *)v1;
+    uint32_t i2 = *(const uint32_t *)v2;
+
+    return i1 == i2 ? 0 : (i1 < i2 ? -1 : 1);
+}
+
+static void ps_free(void *data)
+{
+    rwsplit_ps_t *ps = (rwsplit_ps_t *)data;
+
+    if (ps)
+    {
+        MXS_FREE(ps->ps_backend_ids);
+        MXS_FREE(ps->ps_types);
+        MXS_FREE(ps->ps_types_sent);
+        MXS_FREE(ps);
+    }
+}
+
+static inline uint32_t ps_get_id(GWBUF *buf)
+{
+    return gw_mysql_get_byte4(GWBUF_DATA(buf) + RWSPLIT_PS_ID_OFFSET);
+}
+
+static inline void ps_set_id(GWBUF *buf, uint32_t id)
+{
+    gw_mysql_set_byte4(GWBUF_DATA(buf) + RWSPLIT_PS_ID_OFFSET, id);
+}
+
+static inline int bref_index(ROUTER_CLIENT_SES *rses, backend_ref_t *bref)
+{
+    return bref - rses->rses_backend_ref;
+}
+
+static inline bool ps_is_prepared_in(ROUTER_CLIENT_SES *rses, rwsplit_ps_t *ps, int i)
+{
+    return i >= 0 && BREF_IS_IN_USE(&rses->rses_backend_ref[i]) && ps->ps_backend_ids[i] != 0;
+}
+
+/**
+ * Find the backend where commands that depend on earlier commands are
+ * routed. The master is preferred, otherwise any backend where the
+ * statement is prepared is used.
+ *
+ * @param rses Router session
+ * @param ps   Prepared statement
+ *
+ * @return The backend or NULL if the statement isn't prepared anywhere
+ */
+static backend_ref_t *ps_home_bref(ROUTER_CLIENT_SES *rses, rwsplit_ps_t *ps)
+{
+    backend_ref_t *master = rses->rses_master_ref;
+
+    if (master && ps_is_prepared_in(rses, ps, bref_index(rses, master)))
+    {
+        return master;
+    }
+
+    for (int i = 0; i < rses->rses_nbackends; i++)
+    {
+        if (ps_is_prepared_in(rses, ps, i))
+        {
+            return &rses->rses_backend_ref[i];
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ * Find a backend that has the parameter types of a prepared statement. The
+ * backend of the latest execution is preferred.
+ *
+ * @param rses Router session
+ * @param ps   Prepared statement
+ *
+ * @return The backend or NULL if no backend that is in use has the types
+ */
+static backend_ref_t *ps_types_bref(ROUTER_CLIENT_SES *rses, rwsplit_ps_t *ps)
+{
+    if (ps_is_prepared_in(rses, ps, ps->ps_last) && ps->ps_types_sent[ps->ps_last])
+    {
+        return &rses->rses_backend_ref[ps->ps_last];
+    }
+
+    for (int i = 0; i < rses->rses_nbackends; i++)
+    {
+        if (ps_is_prepared_in(rses, ps, i) && ps->ps_types_sent[i])
+        {
+            return &rses->rses_backend_ref[i];
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ * Tell the client that a prepared statement can't be executed because
+ * it isn't prepared in the master
+ *
+ * @param rses Router session
+ * @param ps   Prepared statement
+ *
+ * @return True if the error was sent
+ */
+static bool ps_send_not_prepared_error(ROUTER_CLIENT_SES *rses, rwsplit_ps_t *ps)
+{
+    char errmsg[128];
+    snprintf(errmsg, sizeof(errmsg), "Prepared statement %u is not prepared in the master",
+             ps->ps_id);
+    MXS_ERROR("%s.", errmsg);
+
+    /** 1243 is ER_UNKNOWN_STMT_HANDLER */
+    GWBUF *err = modutil_create_mysql_err_msg(1, 0, 1243, "HY000", errmsg);
+
+    return err && rses->client_dcb->func.write(rses->client_dcb, err);
+}
+
+/**
+ * Send a COM_STMT_CLOSE for a backend's statement ID
+ *
+ * @param bref Backend reference
+ * @param id   The statement ID of the backend
+ */
+static void ps_close_in_backend(backend_ref_t *bref, uint32_t id)
+{
+    uint8_t packet[MYSQL_HEADER_LEN + 5];
+
+    gw_mysql_set_byte3(packet, 5);
+    packet[3] = 0;
+    packet[4] = MYSQL_COM_STMT_CLOSE;
+    gw_mysql_set_byte4(packet + RWSPLIT_PS_ID_OFFSET, id);
+
+    GWBUF *buf = gwbuf_alloc_and_load(sizeof(packet), packet);
+
+    if (buf)
+    {
+        bref->bref_dcb->func.write(bref->bref_dcb, buf);
+    }
+}
+
+/**
+ * Close the statement in all backends and forget it
+ *
+ * @param rses     Router session
+ * @param ps       Prepared statement, freed by this function
+ * @param querybuf The COM_STMT_CLOSE sent by the client or NULL
+ *
+ * @return Number of backends where the statement was closed
+ */
+static int ps_close(ROUTER_CLIENT_SES *rses, rwsplit_ps_t *ps, GWBUF *querybuf)
+{
+    int nclosed = 0;
+
+    for (int i = 0; i < rses->rses_nbackends; i++)
+    {
+        if (ps_is_prepared_in(rses, ps, i))
+        {
+            backend_ref_t *bref = &rses->rses_backend_ref[i];
+
+            if (querybuf)
+            {
+                /** Each backend gets its own copy as the ID is different */
+                GWBUF *buf = gwbuf_alloc_and_load(GWBUF_LENGTH(querybuf), GWBUF_DATA(querybuf));
+
+                if (buf)
+                {
+                    ps_set_id(buf, ps->ps_backend_ids[i]);
+                    bref->bref_dcb->func.write(bref->bref_dcb, buf);
+                }
+            }
+            else
+            {
+                ps_close_in_backend(bref, ps->ps_backend_ids[i]);
+            }
+
+            nclosed++;
+        }
+    }
+
+    uint32_t id = ps->ps_id;
+    hashtable_delete(rses->rses_ps, &id);
+
+    return nclosed;
+}
+
+/**
+ * @brief Store a new prepared statement
+ *
+ * Called when a COM_STMT_PREPARE is added to the session command history.
+ * The client statement ID is derived from the position of the command.
+ *
+ * @param rses     Router session
+ * @param position Position of the session command
+ * @param type     Type of the prepared statement
+ *
+ * @return True if the statement was stored
+ */
+bool rwsplit_ps_add(ROUTER_CLIENT_SES *rses, int position, qc_query_type_t type)
+{
+    if (rses->rses_ps == NULL)
+    {
+        rses->rses_ps = hashtable_alloc(RWSPLIT_PS_HASHTABLE_SIZE, ps_hashfun, ps_cmpfun);
+
+        if (rses->rses_ps == NULL)
+        {
+            return false;
+        }
+
+        /** The key is stored in the value so only the value is freed */
+        hashtable_memory_fns(rses->rses_ps, NULL, NULL, NULL, ps_free);
+    }
+
+    rwsplit_ps_t *ps = (rwsplit_ps_t *)MXS_CALLOC(1, sizeof(rwsplit_ps_t));
+    uint32_t *ids = (uint32_t *)MXS_CALLOC(rses->rses_nbackends, sizeof(uint32_t));
+    bool *types_sent = (bool *)MXS_CALLOC(rses->rses_nbackends, sizeof(bool));
+
+    if (ps == NULL || ids == NULL || types_sent == NULL)
+    {
+        MXS_FREE(ps);
+        MXS_FREE(ids);
+        MXS_FREE(types_sent);
+        return false;
+    }
+
+    ps->ps_id = (uint32_t)position + 1;
+    ps->ps_type = type & ~QUERY_TYPE_PREPARE_STMT;
+    ps->ps_backend_ids = ids;
+    ps->ps_last = -1;
+    ps->ps_long_data = false;
+    ps->ps_types_sent = types_sent;
+    ps->ps_nbackends = rses->rses_nbackends;
+
+    if (hashtable_add(rses->rses_ps, &ps->ps_id, ps) == 0)
+    {
+        ps_free(ps);
+        return false;
+    }
+
+    return true;
+}
+
+/**
+ * @brief Find the prepared statement a command refers to
+ *
+ * @param rses        Router session
+ * @param querybuf    Contiguous buffer with the command
+ * @param packet_type Command type
+ *
+ * @return The prepared statement or NULL if the command doesn't refer to a
+ *         statement prepared by the router
+ */
+rwsplit_ps_t *rwsplit_ps_lookup(ROUTER_CLIENT_SES *rses, GWBUF *querybuf, int packet_type)
+{
+    rwsplit_ps_t *ps = NULL;
+
+    if (rses->rses_ps &&
+        GWBUF_LENGTH(querybuf) >= RWSPLIT_PS_ID_OFFSET + 4 &&
+        (packet_type == MYSQL_COM_STMT_EXECUTE ||
+         packet_type == MYSQL_COM_STMT_FETCH ||
+         packet_type == MYSQL_COM_STMT_SEND_LONG_DATA ||
+         packet_type == MYSQL_COM_STMT_RESET ||
+         packet_type == MYSQL_COM_STMT_CLOSE))
+    {
+        uint32_t id = ps_get_id(querybuf);
+        ps = (rwsplit_ps_t *)hashtable_fetch(rses->rses_ps, &id);
+    }
+
+    return ps;
+}
+
+/**
+ * @brief Route a command that refers to a prepared statement
+ *
+ * COM_STMT_EXECUTE is routed according to the type of the prepared statement.
+ * COM_STMT_FETCH follows the latest execution. COM_STMT_SEND_LONG_DATA is sent
+ * to the master, or to another backend if there is no master, and the next
+ * execution is routed to the same backend. COM_STMT_CLOSE is sent to all
+ * backends.
+ *
+ * @param inst        Router instance
+ * @param rses        Router session
+ * @param querybuf    Contiguous buffer with the command
+ * @param packet_type Command type
+ * @param ps          The prepared statement
+ *
+ * @return True if routing succeeded
+ */
+bool rwsplit_ps_route(ROUTER_INSTANCE *inst, ROUTER_CLIENT_SES *rses, GWBUF *querybuf,
+                      int packet_type, rwsplit_ps_t *ps)
+{
+    backend_ref_t *bref = NULL;
+    bool succp = false;
+
+    if (packet_type == MYSQL_COM_STMT_CLOSE)
+    {
+        MXS_INFO("Closing prepared statement %u in all backends.", ps->ps_id);
+        return ps_close(rses, ps, querybuf) > 0;
+    }
+    else if (packet_type == MYSQL_COM_STMT_SEND_LONG_DATA)
+    {
+        if ((bref = ps_home_bref(rses, ps)))
+        {
+            /** This is a one-way message, no reply is expected */
+            ps_set_id(querybuf, ps->ps_backend_ids[bref_index(rses, bref)]);
+            ps->ps_long_data = true;
+            ps->ps_last = bref_index(rses, bref);
+            succp = bref->bref_dcb->func.write(bref->bref_dcb, gwbuf_clone(querybuf)) == 1;
+        }
+    }
+    else
+    {
+        if (packet_type == MYSQL_COM_STMT_EXECUTE && !ps->ps_long_data)
+        {
+            qc_query_type_t qtype = ps->ps_type | QUERY_TYPE_EXEC_STMT;
+
+            if (rses->have_tmp_tables)
+            {
+                /** The statement might read a temporary table */
+                qtype |= QUERY_TYPE_MASTER_READ;
+            }
+
+            if (MXS_LOG_PRIORITY_IS_ENABLED(LOG_INFO))
+            {
+                log_transaction_status(rses, querybuf, qtype);
+            }
+
+            route_target_t route_target = get_route_target(rses, qtype, querybuf->hint);
+            DCB *target_dcb = NULL;
+            bool master_only = false;
+
+            if (TARGET_IS_NAMED_SERVER(route_target) || TARGET_IS_RLAG_MAX(route_target))
+            {
+                succp = handle_hinted_target(rses, querybuf, route_target, &target_dcb);
+            }
+            else if (TARGET_IS_SLAVE(route_target) &&
+                     !(rses->rses_config.causal_reads && rses->rses_gtid))
+            {
+                /** Causal reads can only wait for the GTID in text
+                 * protocol queries, executions go to the master */
+                succp = handle_slave_is_target(inst, rses, &target_dcb);
+            }
+            else
+            {
+                /** Executions that would be routed to all servers, e.g.
+                 * prepared SET statements, are only executed on the master */
+                succp = handle_master_is_target(inst, rses, &target_dcb);
+                master_only = true;
+            }
+
+            if (!succp || target_dcb == NULL)
+            {
+                /** Either routing failed or an error was sent to the client */
+                return succp;
+            }
+
+            bref = get_bref_from_dcb(rses, target_dcb);
+
+            if (!ps_is_prepared_in(rses, ps, bref_index(rses, bref)))
+            {
+                MXS_INFO("Prepared statement %u is not prepared in '%s'.",
+                         ps->ps_id, bref->ref->server->unique_name);
+
+                if (master_only)
+                {
+                    /** Writes and executions inside transactions must not
+                     * end up on a slave */
+                    return ps_send_not_prepared_error(rses, ps);
+                }
+
+                bref = ps_home_bref(rses, ps);
+            }
+        }
+        else if (packet_type == MYSQL_COM_STMT_EXECUTE ||
+                 (packet_type == MYSQL_COM_STMT_RESET && ps->ps_long_data) ||
+                 !ps_is_prepared_in(rses, ps, ps->ps_last))
+        {
+            bref = ps_home_bref(rses, ps);
+        }
+        else
+        {
+            /** COM_STMT_FETCH and COM_STMT_RESET follow the latest execution */
+            bref = &rses->rses_backend_ref[ps->ps_last];
+        }
+
+        GWBUF *buf = querybuf;
+
+        if (bref && packet_type == MYSQL_COM_STMT_EXECUTE &&
+            (buf = rwsplit_ps_exec_types(ps, bref_index(rses, bref), querybuf)) == NULL)
+        {
+            /** The types could not be added, use a backend that has them */
+            bref = ps_types_bref(rses, ps);
+            buf = querybuf;
+        }
+
+        if (bref)
+        {
+            int i = bref_index(rses, bref);
+
+            ps_set_id(buf, ps->ps_backend_ids[i]);
+
+            if (packet_type == MYSQL_COM_STMT_EXECUTE || packet_type == MYSQL_COM_STMT_RESET)
+            {
+                ps->ps_long_data = false;
+            }
+
+            ps->ps_last = i;
+
+            /** The rewritten statement can't be retried on another server */
+            succp = handle_got_target(inst, rses, buf, bref->bref_dcb, false);
+        }
+
+        if (buf != querybuf)
+        {
+            gwbuf_free(buf);
+        }
+    }
+
+    if (bref == NULL)
+    {
+        MXS_ERROR("Prepared statement %u is not prepared in any of the backends "
+                  "that are in use.", ps->ps_id);
+    }
+
+    return succp;
+}
+
+/**
+ * @brief Store the statement ID from a backend's reply to COM_STMT_PREPARE
+ *
+ * If the statement was already closed by the client, it is closed in
+ * the backend.
+ *
+ * @param rses     Router session
+ * @param bref     Backend that replied
+ * @param position Position of the session command
+ * @param reply    The reply, the first packet must be contiguous
+ */
+void rwsplit_ps_store_reply(ROUTER_CLIENT_SES *rses, backend_ref_t *bref,
+                            int position, GWBUF *reply)
+{
+    if (GWBUF_LENGTH(reply) >= RWSPLIT_PS_ID_OFFSET + 4 &&
+        MYSQL_GET_COMMAND(GWBUF_DATA(reply)) == MYSQL_REPLY_OK)
+    {
+        uint32_t id = (uint32_t)position + 1;
+        uint32_t backend_id = ps_get_id(reply);
+        rwsplit_ps_t *ps = rses->rses_ps ? (rwsplit_ps_t *)hashtable_fetch(rses->rses_ps, &id) : NULL;
+
+        if (ps)
+        {
+            ps->ps_backend_ids[bref_index(rses, bref)] = backend_id;
+
+            if (GWBUF_LENGTH(reply) >= RWSPLIT_PS_N_PARAMS_OFFSET + 2)
+            {
+                ps->ps_n_params = gw_mysql_get_byte2(GWBUF_DATA(reply) + RWSPLIT_PS_N_PARAMS_OFFSET);
+            }
+        }
+        else if (BREF_IS_IN_USE(bref))
+        {
+            MXS_INFO("Prepared statement %u was closed, closing it in '%s'.",
+                     id, bref->ref->server->unique_name);
+            ps_close_in_backend(bref, backend_id);
+        }
+    }
+}
+
+/**
+ * @brief Process the COM_STMT_PREPARE reply that is sent to the client
+ *
+ * The statement ID in the reply is replaced with the ID generated by the
+ * router. If the preparation failed, the statement is forgotten.
+ *
+ * @param rses     Router session
+ * @param position Position of the session command
+ * @param reply    The reply, the first packet must be contiguous
+ */
+void rwsplit_ps_client_reply(ROUTER_CLIENT_SES *rses, int position, GWBUF *reply)
+{
+    uint32_t id = (uint32_t)position + 1;
+    rwsplit_ps_t *ps = rses->rses_ps ? (rwsplit_ps_t *)hashtable_fetch(rses->rses_ps, &id) : NULL;
+
+    if (ps)
+    {
+        if (GWBUF_LENGTH(reply) >= RWSPLIT_PS_ID_OFFSET + 4 &&
+            MYSQL_GET_COMMAND(GWBUF_DATA(reply)) == MYSQL_REPLY_OK)
+        {
+            ps_set_id(reply, ps->ps_id);
+        }
+        else
+        {
+            /** The client never sees this statement */
+            ps_close(rses, ps, NULL);
+        }
+    }
+}
+
+/**
+ * @brief Forget the statement IDs of a backend
+ *
+ * Called when a backend is taken out of use. If it is later reconnected,
+ * the statements are prepared again when the session command history is
+ * executed.
+ *
+ * @param rses Router session
+ * @param bref Backend reference
+ */
+void rwsplit_ps_forget_backend(ROUTER_CLIENT_SES *rses, backend_ref_t *bref)
+{
+    if (rses->rses_ps)
+    {
+        HASHITERATOR *iter = hashtable_iterator(rses->rses_ps);
+
+        if (iter)
+        {
+            int i = bref_index(rses, bref);
+            void *key;
+
+            while ((key = hashtable_next(iter)))
+            {
+                rwsplit_ps_t *ps = (rwsplit_ps_t *)hashtable_fetch(rses->rses_ps, key);
+                ps->ps_backend_ids[i] = 0;
+                ps->ps_types_sent[i] = false;
+
+                if (ps->ps_last == i)
+                {
+                    ps->ps_last = -1;
+                }
+            }
+
+            hashtable_iterator_free(iter);
+        }
+    }
+}
@@ -0,0 +1,107 @@
+/*
+ * Copyright (c) 2016 MariaDB Corporation Ab
+ *
+ * Use of this software is governed by the Business Source License included
+ * in the LICENSE.TXT file and at www.mariadb.com/bsl11.
+ *
+ * Change Date: 2019-07-01
+ *
+ * On the date above, in accordance with the Business Source License, use
+ * of this software will be governed by version 2 or later of the General
+ * Public License.
+ */
+
+#include "readwritesplit.h"
+
+#include <string.h>
+
+#include <maxscale/alloc.h>
+#include <maxscale/protocol/mysql.h>
+#include "rwsplit_internal.h"
+
+/**
+ * @file rwsplit_ps_exec.c   Parameter types of COM_STMT_EXECUTE in the
+ * read write split router.
+ *
+ * Clients send the parameter types of a prepared statement only with the
+ * first execution and when the types change. The server remembers them for
+ * the later executions that have the new-params-bound flag cleared. Since
+ * the executions are load balanced, an execution may be routed to a backend
+ * that has not seen the types. The router keeps the latest types and adds
+ * them to such an execution.
+ */
+
+/** Offset of the NULL bitmap in COM_STMT_EXECUTE: the command byte, the
+ * statement ID, the flags and the iteration count come before it */
+#define RWSPLIT_EXEC_NULL_BITMAP_OFFSET (MYSQL_HEADER_LEN + 1 + 4 + 1 + 4)
+
+/**
+ * @brief Make sure a backend knows the parameter types of an execution
+ *
+ * An execution that sends the types stores them and only the target backend
+ * is then known to have them. An execution without the types gets the stored
+ * types added if the target backend hasn't seen them.
+ *
+ * @param ps      Prepared statement
+ * @param backend Index of the backend the execution is routed to
+ * @param exec    Contiguous COM_STMT_EXECUTE
+ *
+ * @return @c exec if it can be sent as it is, a new buffer with the types
+ *         added or NULL if the types could not be added
+ */
+GWBUF *rwsplit_ps_exec_types(rwsplit_ps_t *ps, int backend, GWBUF *exec)
+{
+    if (ps->ps_n_params == 0)
+    {
+        return exec;
+    }
+
+    uint8_t *data = GWBUF_DATA(exec);
+    size_t len = GWBUF_LENGTH(exec);
+    size_t bound = RWSPLIT_EXEC_NULL_BITMAP_OFFSET + (ps->ps_n_params + 7) / 8;
+    size_t types_len = 2 * ps->ps_n_params;
+
+    if (len <= bound)
+    {
+        /** Malformed, the backend will report the error */
+        return exec;
+    }
+
+    if (data[bound])
+    {
+        if (len >= bound + 1 + types_len &&
+            (ps->ps_types || (ps->ps_types = (uint8_t *)MXS_MALLOC(types_len))))
+        {
+            memcpy(ps->ps_types, data + bound + 1, types_len);
+            memset(ps->ps_types_sent, 0, ps->ps_nbackends * sizeof(bool));
+            ps->ps_types_sent[backend] = true;
+        }
+
+        return exec;
+    }
+
+    if (ps->ps_types == NULL || ps->ps_types_sent[backend])
+    {
+        return exec;
+    }
+
+    uint32_t payload = MYSQL_GET_PAYLOAD_LEN(data);
+    GWBUF *rval = NULL;
+
+    if (payload + MYSQL_HEADER_LEN == len && payload + types_len < GW_MYSQL_MAX_PACKET_LEN &&
+        (rval = gwbuf_alloc(len + types_len)))
+    {
+        uint8_t *ptr = GWBUF_DATA(rval);
+
+        memcpy(ptr, data, bound);
+        gw_mysql_set_byte3(ptr, payload + types_len);
+        ptr[bound] = 1;
+        memcpy(ptr + bound + 1, ps->ps_types, types_len);
+        memcpy(ptr + bound + 1 + types_len, data + bound + 1, len - bound - 1);
+        gwbuf_set_type(rval, GWBUF_TYPE(exec));
+
+        ps->ps_types_sent[backend] = true;
+    }
+
+    return rval;
+}
@@ -73,6 +73,23 @@ bool route_single_stmt(ROUTER_INSTANCE *inst, ROUTER_CLIENT_SES *rses,
 
     if (non_empty_packet)
     {
+        rwsplit_trx_begin(rses, qtype);
+
+        if (rses->rses_trx.optimistic &&
+            !rwsplit_trx_is_optimistic_stmt(rses, querybuf, packet_type, qtype))
+        {
+            /** The statement is routed after the transaction is moved to the master */
+            return rwsplit_trx_migrate(inst, rses, querybuf);
+        }
+
+        rwsplit_ps_t *ps = rwsplit_ps_lookup(rses, querybuf, packet_type);
+
+        if (ps)
+        {
+            /** The command refers to a statement prepared in all servers */
+            return rwsplit_ps_route(inst, rses, querybuf, packet_type, ps);
+        }
+
         handle_multi_temp_and_load(rses, querybuf, packet_type, (int *)&qtype);
 
         if (MXS_LOG_PRIORITY_IS_ENABLED(LOG_INFO))
@@ -114,6 +131,15 @@ bool route_single_stmt(ROUTER_INSTANCE *inst, ROUTER_CLIENT_SES *rses,
     {
         /* Now we have a lock on the router session */
         bool store_stmt = false;
+
+        if (TARGET_IS_SLAVE(route_target) && !TARGET_IS_NAMED_SERVER(route_target) &&
+            !TARGET_IS_RLAG_MAX(route_target) && !rwsplit_causal_can_route_to_slave(rses, querybuf))
+        {
+            /** A slave would not wait for the latest GTID before the read */
+            MXS_INFO("Causal read can't wait for the GTID on a slave, routing it to the master.");
+            route_target = TARGET_MASTER;
+        }
+
         /**
          * There is a hint which either names the target backend or
          * hint which sets maximum allowed replication lag for the
@@ -126,8 +152,23 @@ bool route_single_stmt(ROUTER_INSTANCE *inst, ROUTER_CLIENT_SES *rses,
         }
         else if (TARGET_IS_SLAVE(route_target))
         {
+            if (rwsplit_flight_join(inst, rses, querybuf, qtype))
+            {
+                /** The result of an identical read is shared with this session */
+                return true;
+            }
+
             succp = handle_slave_is_target(inst, rses, &target_dcb);
             store_stmt = rses->rses_config.retry_failed_reads;
+
+            if (succp)
+            {
+                rwsplit_pipeline_redirect(rses, route_target, &target_dcb);
+            }
+            else
+            {
+                rwsplit_flight_leave(inst, rses);
+            }
         }
         else if (TARGET_IS_MASTER(route_target))
         {
@@ -146,7 +187,21 @@ bool route_single_stmt(ROUTER_INSTANCE *inst, ROUTER_CLIENT_SES *rses,
         if (target_dcb && succp) /*< Have DCB of the target backend */
         {
             ss_dassert(!store_stmt || TARGET_IS_SLAVE(route_target));
-            handle_got_target(inst, rses, querybuf, target_dcb, store_stmt);
+            GWBUF *causal_buf = NULL;
+
+            if (TARGET_IS_SLAVE(route_target) &&
+                (causal_buf = rwsplit_causal_add_wait(rses, get_bref_from_dcb(rses, target_dcb),
+                                                      querybuf)))
+            {
+                /** A causal read can't be retried on another slave as it
+                 * would not wait for the GTID there */
+                handle_got_target(inst, rses, causal_buf, target_dcb, false);
+                gwbuf_free(causal_buf);
+            }
+            else
+            {
+                handle_got_target(inst, rses, querybuf, target_dcb, store_stmt);
+            }
         }
     }
 
@@ -299,7 +354,15 @@ bool route_session_write(ROUTER_CLIENT_SES *router_cli_ses,
         return false;
     }
 
-    mysql_sescmd_init(prop, querybuf, packet_type, router_cli_ses);
+    mysql_sescmd_t *sescmd = mysql_sescmd_init(prop, querybuf, packet_type, router_cli_ses);
+
+    if (packet_type == MYSQL_COM_STMT_PREPARE &&
+        !rwsplit_ps_add(router_cli_ses, sescmd->position, qtype))
+    {
+        MXS_ERROR("Failed to store prepared statement.");
+        rses_property_done(prop);
+        return false;
+    }
 
     /** Add sescmd property to router client session */
     if (rses_property_add(router_cli_ses, prop) != 0)
@@ -308,6 +371,8 @@ bool route_session_write(ROUTER_CLIENT_SES *router_cli_ses,
         return false;
     }
 
+    rwsplit_flight_add_sescmd(router_cli_ses, querybuf);
+
     for (i = 0; i < router_cli_ses->rses_nbackends; i++)
     {
         if (BREF_IS_IN_USE((&backend_ref[i])))
@@ -334,29 +399,27 @@ bool route_session_write(ROUTER_CLIENT_SES *router_cli_ses,
             bref_set_state(get_bref_from_dcb(router_cli_ses, backend_ref[i].bref_dcb),
                            BREF_WAITING_RESULT);
             /**
-             * Start execution if cursor is not already executing or this is the
-             * master server. Otherwise, cursor will execute pending commands
-             * when it completes the previous command.
+             * If the cursor is already executing, the command is pipelined
+             * after the earlier ones. Only the master's reply is waited for
+             * before the reply is sent to the client, the replies of the
+             * slaves are compared to it as they arrive.
              */
-            if (sescmd_cursor_is_active(scur) && &backend_ref[i] != router_cli_ses->rses_master_ref)
+            if (sescmd_cursor_is_active(scur))
             {
-                nsucc += 1;
                 MXS_INFO("Backend [%s]:%d already executing sescmd.",
                          backend_ref[i].ref->server->name,
                          backend_ref[i].ref->server->port);
             }
+
+            if (execute_sescmd_in_backend(&backend_ref[i]))
+            {
+                nsucc += 1;
+            }
             else
             {
-                if (execute_sescmd_in_backend(&backend_ref[i]))
-                {
-                    nsucc += 1;
-                }
-                else
-                {
-                    MXS_ERROR("Failed to execute session command in [%s]:%d",
-                              backend_ref[i].ref->server->name,
-                              backend_ref[i].ref->server->port);
-                }
+                MXS_ERROR("Failed to execute session command in [%s]:%d",
+                          backend_ref[i].ref->server->name,
+                          backend_ref[i].ref->server->port);
             }
         }
     }
@@ -474,7 +537,7 @@ bool rwsplit_get_dcb(DCB **p_dcb, ROUTER_CLIENT_SES *rses, backend_type_t btype,
 
     /** Check whether using rses->forced_node as target SLAVE */
     if (rses->forced_node &&
-        session_trx_is_read_only(rses->client_dcb->session))
+        (session_trx_is_read_only(rses->client_dcb->session) || rses->rses_trx.optimistic))
     {
         *p_dcb = rses->forced_node->bref_dcb;
         succp = true;
@@ -709,7 +772,9 @@ route_target_t get_route_target(ROUTER_CLIENT_SES *rses,
               qc_query_is_type(qtype, QUERY_TYPE_GSYSVAR_WRITE) ||
               /** enable or disable autocommit are always routed to all */
               qc_query_is_type(qtype, QUERY_TYPE_ENABLE_AUTOCOMMIT) ||
-              qc_query_is_type(qtype, QUERY_TYPE_DISABLE_AUTOCOMMIT)))
+              qc_query_is_type(qtype, QUERY_TYPE_DISABLE_AUTOCOMMIT) ||
+              /** binary protocol prepared statements are prepared in all servers */
+              qc_query_is_type(qtype, QUERY_TYPE_PREPARE_STMT)))
     {
         /**
          * This is problematic query because it would be routed to all
@@ -722,9 +787,8 @@ route_target_t get_route_target(ROUTER_CLIENT_SES *rses,
          * They can be safely routed to all backends since the execution
          * is done later.
          *
-         * With prepared statement caching the task of routing
-         * the execution of the prepared statements to the right server would be
-         * an easy one. Currently this is not supported.
+         * The executions of binary protocol prepared statements are routed
+         * according to the type of the statement, see rwsplit_prep_stmt.c.
          */
         if (qc_query_is_type(qtype, QUERY_TYPE_READ) &&
             !(qc_query_is_type(qtype, QUERY_TYPE_PREPARE_STMT) ||
@@ -777,9 +841,10 @@ route_target_t get_route_target(ROUTER_CLIENT_SES *rses,
             target = TARGET_MASTER;
         }
     }
-    else if (session_trx_is_read_only(rses->client_dcb->session))
+    else if (session_trx_is_read_only(rses->client_dcb->session) || rses->rses_trx.optimistic)
     {
-        /* Force TARGET_SLAVE for READ ONLY tranaction (active or ending) */
+        /* Force TARGET_SLAVE for READ ONLY tranaction (active or ending) and
+         * for optimistic transactions that have only read so far */
         target = TARGET_SLAVE;
     }
     else
@@ -1217,12 +1282,18 @@ handle_got_target(ROUTER_INSTANCE *inst, ROUTER_CLIENT_SES *rses,
 
     bref = get_bref_from_dcb(rses, target_dcb);
 
+    if (rses->rses_trx.optimistic && bref == rses->rses_master_ref)
+    {
+        /** No slave was available, the transaction is a normal one */
+        rses->rses_trx.optimistic = false;
+    }
+
     /**
      * If the transaction is READ ONLY set forced_node to bref
      * That SLAVE backend will be used until COMMIT is seen
      */
     if (!rses->forced_node &&
-        session_trx_is_read_only(rses->client_dcb->session))
+        (session_trx_is_read_only(rses->client_dcb->session) || rses->rses_trx.optimistic))
     {
         rses->forced_node = bref;
         MXS_DEBUG("Setting forced_node SLAVE to %s within an opened READ ONLY transaction\n",
@@ -1244,6 +1315,7 @@ handle_got_target(ROUTER_INSTANCE *inst, ROUTER_CLIENT_SES *rses,
     if (sescmd_cursor_is_active(scur) && bref != rses->rses_master_ref)
     {
         bref->bref_pending_cmd = gwbuf_append(bref->bref_pending_cmd, gwbuf_clone(querybuf));
+        rwsplit_trx_record(rses, bref, querybuf);
         return true;
     }
 
@@ -1261,6 +1333,7 @@ handle_got_target(ROUTER_INSTANCE *inst, ROUTER_CLIENT_SES *rses,
          * Add one query response waiter to backend reference
          */
         bref = get_bref_from_dcb(rses, target_dcb);
+        bref_track_reply(rses, bref, querybuf);
         bref_set_state(bref, BREF_QUERY_ACTIVE);
         bref_set_state(bref, BREF_WAITING_RESULT);
 
@@ -1268,12 +1341,14 @@ handle_got_target(ROUTER_INSTANCE *inst, ROUTER_CLIENT_SES *rses,
          * If a READ ONLYtransaction is ending set forced_node to NULL
          */
         if (rses->forced_node &&
-            session_trx_is_read_only(rses->client_dcb->session) &&
+            (session_trx_is_read_only(rses->client_dcb->session) || rses->rses_trx.optimistic) &&
             session_trx_is_ending(rses->client_dcb->session))
         {
             MXS_DEBUG("An opened READ ONLY transaction ends: forced_node is set to NULL");
             rses->forced_node = NULL;
         }
+
+        rwsplit_trx_record(rses, bref, querybuf);
         return true;
     }
     else
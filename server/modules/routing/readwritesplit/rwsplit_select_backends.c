@@ -463,6 +463,46 @@ static bool connect_server(backend_ref_t *bref, MXS_SESSION *session, bool execu
     return rval;
 }
 
+/**
+ * @brief Select a new master for an existing session
+ *
+ * If the current master of the cluster is already used as a slave, it is
+ * taken into use as the master. Otherwise a new connection is created and
+ * the session command history is executed in it.
+ *
+ * @param rses Router session
+ *
+ * @return The backend reference of the master or NULL if no master is available
+ */
+backend_ref_t *select_connect_master(ROUTER_CLIENT_SES *rses)
+{
+    SERVER_REF *master = get_root_master(rses->rses_backend_ref, rses->rses_nbackends);
+
+    if (master == NULL || !SERVER_IS_MASTER(master->server))
+    {
+        return NULL;
+    }
+
+    for (int i = 0; i < rses->rses_nbackends; i++)
+    {
+        backend_ref_t *bref = &rses->rses_backend_ref[i];
+
+        if (bref->ref == master &&
+            (BREF_IS_IN_USE(bref) ||
+             /** Without the history the session state would be lost */
+             ((!rses->rses_config.disable_sescmd_history || rses->rses_nsescmd == 0) &&
+              bref_valid_for_connect(bref) &&
+              connect_server(bref, rses->client_dcb->session, true))))
+        {
+            MXS_INFO("Using '%s' as the new master.", bref->ref->server->unique_name);
+            rses->rses_master_ref = bref;
+            return bref;
+        }
+    }
+
+    return NULL;
+}
+
 /**
  * @brief Log server connections
  *
@@ -19,6 +19,7 @@
 #include <stdlib.h>
 #include <stdint.h>
 
+#include <maxscale/alloc.h>
 #include <maxscale/router.h>
 #include "rwsplit_internal.h"
 
@@ -39,6 +40,8 @@ static bool sescmd_cursor_history_empty(sescmd_cursor_t *scur);
 static void sescmd_cursor_reset(sescmd_cursor_t *scur);
 static bool sescmd_cursor_next(sescmd_cursor_t *scur);
 static rses_property_t *mysql_sescmd_get_property(mysql_sescmd_t *scmd);
+static void sescmd_store_early_reply(ROUTER_CLIENT_SES *ses, mysql_sescmd_t *scmd,
+                                     backend_ref_t *bref);
 
 /*
  * The following functions, all to do with the handling of session commands,
@@ -92,6 +95,7 @@ mysql_sescmd_t *mysql_sescmd_init(rses_property_t *rses_prop,
     sescmd->my_sescmd_buf = sescmd_buf;
     sescmd->my_sescmd_packet_type = packet_type;
     sescmd->position = atomic_add(&rses->pos_generator, 1);
+    sescmd->my_sescmd_early_replies = NULL;
 
     return sescmd;
 }
@@ -105,6 +109,7 @@ void mysql_sescmd_done(mysql_sescmd_t *sescmd)
     }
     CHK_RSES_PROP(sescmd->my_sescmd_prop);
     gwbuf_free(sescmd->my_sescmd_buf);
+    MXS_FREE(sescmd->my_sescmd_early_replies);
     memset(sescmd, 0, sizeof(mysql_sescmd_t));
 }
 
@@ -145,6 +150,13 @@ GWBUF *sescmd_cursor_process_replies(GWBUF *replybuf,
     {
         bref->reply_cmd = *((unsigned char *)replybuf->start + 4);
         scur->position = scmd->position;
+
+        if (scmd->my_sescmd_packet_type == MYSQL_COM_STMT_PREPARE)
+        {
+            /** Each backend has its own ID for the prepared statement */
+            rwsplit_ps_store_reply(ses, bref, scmd->position, replybuf);
+        }
+
         /** Faster backend has already responded to client : discard */
         if (scmd->my_sescmd_is_replied)
         {
@@ -198,12 +210,17 @@ GWBUF *sescmd_cursor_process_replies(GWBUF *replybuf,
             MXS_INFO("Server '%s' responded to a session command, sending the response "
                      "to the client.", bref->ref->server->unique_name);
 
-            for (int i = 0; i < ses->rses_nbackends; i++)
+            if (scmd->my_sescmd_packet_type == MYSQL_COM_STMT_PREPARE)
             {
-                if (!BREF_IS_WAITING_RESULT(&ses->rses_backend_ref[i]))
+                rwsplit_ps_client_reply(ses, scmd->position, replybuf);
+            }
+
+            for (int i = 0; scmd->my_sescmd_early_replies && i < ses->rses_nbackends; i++)
+            {
+                if (scmd->my_sescmd_early_replies[i] != -1)
                 {
                     /** This backend has already received a response */
-                    if (ses->rses_backend_ref[i].reply_cmd != scmd->reply_cmd &&
+                    if (scmd->my_sescmd_early_replies[i] != scmd->reply_cmd &&
                         !BREF_IS_CLOSED(&ses->rses_backend_ref[i]) &&
                         BREF_IS_IN_USE(&ses->rses_backend_ref[i]))
                     {
@@ -220,7 +237,7 @@ GWBUF *sescmd_cursor_process_replies(GWBUF *replybuf,
                                  "master's result. Master: %d Slave: %d",
                                  ses->rses_backend_ref[i].ref->server->name,
                                  ses->rses_backend_ref[i].ref->server->port,
-                                 bref->reply_cmd, ses->rses_backend_ref[i].reply_cmd);
+                                 scmd->reply_cmd, scmd->my_sescmd_early_replies[i]);
                     }
                 }
             }
@@ -238,6 +255,9 @@ GWBUF *sescmd_cursor_process_replies(GWBUF *replybuf,
                           serv->unique_name, serv->name, serv->port);
             }
 
+            /** The reply is compared to the master's reply once it arrives */
+            sescmd_store_early_reply(ses, scmd, bref);
+
             gwbuf_free(replybuf);
             replybuf = NULL;
         }
@@ -386,6 +406,7 @@ static void sescmd_cursor_reset(sescmd_cursor_t *scur)
 
     CHK_RSES_PROP((*scur->scmd_cur_ptr_property));
     scur->scmd_cur_active = false;
+    scur->scmd_cur_sent = -1;
     scur->scmd_cur_cmd = &(*scur->scmd_cur_ptr_property)->rses_prop_data.sescmd;
 }
 
@@ -465,3 +486,29 @@ static rses_property_t *mysql_sescmd_get_property(mysql_sescmd_t *scmd)
     CHK_MYSQL_SESCMD(scmd);
     return scmd->my_sescmd_prop;
 }
+
+/**
+ * Store the reply of a backend that replied to a session command before the
+ * master did. Several session commands can be waiting for a reply at the same
+ * time so the reply is stored in the command instead of the backend.
+ */
+static void sescmd_store_early_reply(ROUTER_CLIENT_SES *ses, mysql_sescmd_t *scmd,
+                                     backend_ref_t *bref)
+{
+    if (scmd->my_sescmd_early_replies == NULL)
+    {
+        scmd->my_sescmd_early_replies = MXS_MALLOC(ses->rses_nbackends * sizeof(int));
+
+        if (scmd->my_sescmd_early_replies == NULL)
+        {
+            return;
+        }
+
+        for (int i = 0; i < ses->rses_nbackends; i++)
+        {
+            scmd->my_sescmd_early_replies[i] = -1;
+        }
+    }
+
+    scmd->my_sescmd_early_replies[bref - ses->rses_backend_ref] = bref->reply_cmd;
+}
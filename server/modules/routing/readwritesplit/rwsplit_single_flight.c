@@ -0,0 +1,608 @@
+/*
+ * Copyright (c) 2016 MariaDB Corporation Ab
+ *
+ * Use of this software is governed by the Business Source License included
+ * in the LICENSE.TXT file and at www.mariadb.com/bsl11.
+ *
+ * Change Date: 2019-07-01
+ *
+ * On the date above, in accordance with the Business Source License, use
+ * of this software will be governed by version 2 or later of the General
+ * Public License.
+ */
+
+#include "readwritesplit.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+#include <maxscale/alloc.h>
+#include <maxscale/atomic.h>
+#include <maxscale/modutil.h>
+#include <maxscale/poll.h>
+#include <maxscale/router.h>
+#include <maxscale/timer.h>
+#include <maxscale/protocol/mysql.h>
+#include <maxscale/query_classifier.h>
+#include "rwsplit_internal.h"
+
+/**
+ * @file rwsplit_single_flight.c   Sharing the results of identical reads in the
+ * read write split router.
+ *
+ * When a read is routed to a slave while an identical read of another session
+ * is being executed, the read is not routed. Instead, the session waits for the
+ * result of the other session and receives a copy of it. Two reads are
+ * identical if the SQL, the user, the default database and the executed
+ * session commands are the same.
+ *
+ * DCBs are only used by the thread that owns them so only the reads executed
+ * by the sessions of the same thread are shared. The lists of reads in
+ * progress are thread specific and need no locking.
+ *
+ * A session that has waited longer than the configured time before the result
+ * starts to arrive routes the read itself. Each waiting session has a timer
+ * of the thread that fires when the time is up.
+ *
+ * Reads that call functions whose result depends on the session or the time,
+ * or that have side effects such as GET_LOCK(), are never shared.
+ */
+
+/** Functions that make the result of a read specific to the session that
+ * executes it, sorted for bsearch() */
+static const char *flight_session_functions[] =
+{
+    "benchmark",
+    "connection_id",
+    "curdate",
+    "current_date",
+    "current_role",
+    "current_time",
+    "current_timestamp",
+    "current_user",
+    "curtime",
+    "database",
+    "found_rows",
+    "get_lock",
+    "is_free_lock",
+    "is_used_lock",
+    "last_insert_id",
+    "lastval",
+    "load_file",
+    "localtime",
+    "localtimestamp",
+    "master_gtid_wait",
+    "master_pos_wait",
+    "nextval",
+    "now",
+    "rand",
+    "release_all_locks",
+    "release_lock",
+    "row_count",
+    "schema",
+    "session_user",
+    "setval",
+    "sleep",
+    "sysdate",
+    "system_user",
+    "unix_timestamp",
+    "user",
+    "utc_date",
+    "utc_time",
+    "utc_timestamp",
+    "uuid",
+    "uuid_short",
+};
+
+/** Functions that can be used without parentheses and are reported as fields,
+ * sorted for bsearch() */
+static const char *flight_session_variables[] =
+{
+    "current_date",
+    "current_role",
+    "current_time",
+    "current_timestamp",
+    "current_user",
+    "localtime",
+    "localtimestamp",
+    "utc_date",
+    "utc_time",
+    "utc_timestamp",
+};
+
+#define FLIGHT_N_SESSION_FUNCTIONS (sizeof(flight_session_functions) / sizeof(flight_session_functions[0]))
+#define FLIGHT_N_SESSION_VARIABLES (sizeof(flight_session_variables) / sizeof(flight_session_variables[0]))
+
+typedef struct rwsplit_flight_waiter
+{
+    ROUTER_CLIENT_SES            *rses;     /*< The waiting session */
+    GWBUF                        *query;    /*< The read of the session */
+    ROUTER_INSTANCE              *inst;     /*< Router instance */
+    struct rwsplit_flight        *flight;   /*< The shared read */
+    MXS_TIMER                     timer;    /*< Timer for the wait */
+    struct rwsplit_flight_waiter *next;
+} rwsplit_flight_waiter_t;
+
+typedef struct rwsplit_flight
+{
+    uint64_t                 hash;        /*< Hash of the key */
+    uint64_t                 sescmd_hash; /*< Session commands of the leader */
+    char                    *user;        /*< User of the leader */
+    char                    *db;          /*< Default database of the leader */
+    GWBUF                   *query;       /*< The read */
+    ROUTER_CLIENT_SES       *leader;      /*< The session that executes the read */
+    bool                     started;     /*< Part of the result has been sent */
+    rwsplit_flight_waiter_t *waiters;     /*< Sessions waiting for the result */
+    struct rwsplit_flight   *next;
+} rwsplit_flight_t;
+
+/** FNV-1a */
+#define FLIGHT_HASH_INIT  UINT64_C(14695981039346656037)
+#define FLIGHT_HASH_PRIME UINT64_C(1099511628211)
+
+static uint64_t flight_hash(uint64_t hash, const uint8_t *data, size_t len)
+{
+    for (size_t i = 0; i < len; i++)
+    {
+        hash ^= data[i];
+        hash *= FLIGHT_HASH_PRIME;
+    }
+
+    return hash;
+}
+
+static uint64_t flight_hash_str(uint64_t hash, const char *str)
+{
+    /** The terminating null separates the fields */
+    return flight_hash(hash, (const uint8_t*)str, strlen(str) + 1);
+}
+
+static inline const char *flight_user(ROUTER_CLIENT_SES *rses)
+{
+    return rses->client_dcb->user ? rses->client_dcb->user : "";
+}
+
+static inline const char *flight_db(ROUTER_CLIENT_SES *rses)
+{
+    MYSQL_session *data = (MYSQL_session*)rses->client_dcb->data;
+    return data ? data->db : "";
+}
+
+/**
+ * @brief Add a session command to the hash of the executed session commands
+ *
+ * @param rses     Router session
+ * @param querybuf The session command
+ */
+void rwsplit_flight_add_sescmd(ROUTER_CLIENT_SES *rses, GWBUF *querybuf)
+{
+    if (rses->rses_sescmd_hash == 0)
+    {
+        rses->rses_sescmd_hash = FLIGHT_HASH_INIT;
+    }
+
+    for (GWBUF *buf = querybuf; buf; buf = buf->next)
+    {
+        rses->rses_sescmd_hash = flight_hash(rses->rses_sescmd_hash,
+                                             GWBUF_DATA(buf), GWBUF_LENGTH(buf));
+    }
+}
+
+static int flight_compare_name(const void *key, const void *elem)
+{
+    return strcasecmp((const char *)key, *(const char **)elem);
+}
+
+static bool flight_uses_name(const char *name, const char **names, size_t n_names)
+{
+    return name && bsearch(name, names, n_names, sizeof(const char *), flight_compare_name) != NULL;
+}
+
+/**
+ * @brief Check whether the SQL of a read allows sharing its result
+ *
+ * @param querybuf The read
+ *
+ * @return False if the read calls a function whose result depends on the
+ *         session or the time, or that has side effects
+ */
+bool rwsplit_flight_sql_is_shareable(GWBUF *querybuf)
+{
+    const QC_FUNCTION_INFO *functions;
+    size_t n_functions;
+
+    qc_get_function_info(querybuf, &functions, &n_functions);
+
+    for (size_t i = 0; i < n_functions; i++)
+    {
+        if (flight_uses_name(functions[i].name, flight_session_functions, FLIGHT_N_SESSION_FUNCTIONS))
+        {
+            return false;
+        }
+    }
+
+    const QC_FIELD_INFO *fields;
+    size_t n_fields;
+
+    qc_get_field_info(querybuf, &fields, &n_fields);
+
+    for (size_t i = 0; i < n_fields; i++)
+    {
+        if (fields[i].table == NULL &&
+            flight_uses_name(fields[i].column, flight_session_variables, FLIGHT_N_SESSION_VARIABLES))
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/**
+ * Check whether the result of a read can be shared
+ */
+static bool flight_is_shareable(ROUTER_CLIENT_SES *rses, GWBUF *querybuf, qc_query_type_t qtype)
+{
+    uint8_t *data = GWBUF_DATA(querybuf);
+
+    if (!rses->rses_config.single_flight || rses->rses_config.causal_reads ||
+        rses->rses_flight || rses->rses_flight_expired || rses->rses_pipeline_queue ||
+        rses->have_tmp_tables || rses->rses_load_active || querybuf->hint ||
+        GWBUF_LENGTH(querybuf) <= MYSQL_HEADER_LEN ||
+        MYSQL_GET_COMMAND(data) != MYSQL_COM_QUERY ||
+        MYSQL_GET_PAYLOAD_LEN(data) + MYSQL_HEADER_LEN != GWBUF_LENGTH(querybuf) ||
+        !qc_query_is_type(qtype, QUERY_TYPE_READ) ||
+        qc_query_is_type(qtype, QUERY_TYPE_USERVAR_READ) ||
+        qc_query_is_type(qtype, QUERY_TYPE_SYSVAR_READ) ||
+        session_trx_is_active(rses->client_dcb->session) ||
+        !rwsplit_flight_sql_is_shareable(querybuf))
+    {
+        return false;
+    }
+
+    /** The reply of the leader must not be mixed with other replies */
+    for (int i = 0; i < rses->rses_nbackends; i++)
+    {
+        if (rses->rses_backend_ref[i].bref_n_replies > 0)
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static bool flight_matches(rwsplit_flight_t *flight, uint64_t hash,
+                           ROUTER_CLIENT_SES *rses, GWBUF *querybuf)
+{
+    return flight->hash == hash && !flight->started &&
+           flight->sescmd_hash == rses->rses_sescmd_hash &&
+           GWBUF_LENGTH(flight->query) == GWBUF_LENGTH(querybuf) &&
+           memcmp(GWBUF_DATA(flight->query), GWBUF_DATA(querybuf), GWBUF_LENGTH(querybuf)) == 0 &&
+           strcmp(flight->user, flight_user(rses)) == 0 &&
+           strcmp(flight->db, flight_db(rses)) == 0;
+}
+
+static void flight_unlink(ROUTER_INSTANCE *inst, ROUTER_CLIENT_SES *rses, rwsplit_flight_t *flight)
+{
+    rwsplit_flight_t **prev = &inst->flights[rses->client_dcb->thread.id];
+
+    while (*prev && *prev != flight)
+    {
+        prev = &(*prev)->next;
+    }
+
+    if (*prev)
+    {
+        *prev = flight->next;
+    }
+}
+
+static void flight_waiter_free(rwsplit_flight_waiter_t *waiter)
+{
+    mxs_timer_stop(&waiter->timer);
+    gwbuf_free(waiter->query);
+    MXS_FREE(waiter);
+}
+
+static void flight_free(rwsplit_flight_t *flight)
+{
+    gwbuf_free(flight->query);
+    MXS_FREE(flight->user);
+    MXS_FREE(flight->db);
+    MXS_FREE(flight);
+}
+
+/**
+ * @brief Route the read of a waiter that stopped waiting
+ *
+ * @param inst    Router instance
+ * @param waiter  The waiter, freed by this function
+ * @param expired Whether the wait timed out, in which case the read is not
+ *                shared again
+ */
+static void flight_release(ROUTER_INSTANCE *inst, rwsplit_flight_waiter_t *waiter, bool expired)
+{
+    ROUTER_CLIENT_SES *rses = waiter->rses;
+    rses->rses_flight = NULL;
+
+    if (!rses->rses_closed)
+    {
+        rses->rses_flight_expired = expired;
+        bool routed = route_single_stmt(inst, rses, waiter->query);
+        rses->rses_flight_expired = false;
+
+        if (routed)
+        {
+            rwsplit_pipeline_route_held(inst, rses);
+        }
+        else
+        {
+            MXS_ERROR("Failed to route a read that was waiting for a shared result.");
+            poll_fake_hangup_event(rses->client_dcb);
+        }
+    }
+
+    flight_waiter_free(waiter);
+}
+
+/**
+ * Route the read of a waiter whose result did not start to arrive in time
+ */
+static void flight_timeout(MXS_TIMER *timer, void *data)
+{
+    rwsplit_flight_waiter_t *waiter = (rwsplit_flight_waiter_t*)data;
+    rwsplit_flight_t *flight = waiter->flight;
+
+    if (flight->started)
+    {
+        /** The waiter already received a part of the result */
+        return;
+    }
+
+    rwsplit_flight_waiter_t **prev = &flight->waiters;
+
+    while (*prev != waiter)
+    {
+        prev = &(*prev)->next;
+    }
+
+    *prev = waiter->next;
+    MXS_INFO("Wait for a shared result timed out, routing the read.");
+    flight_release(waiter->inst, waiter, true);
+}
+
+/**
+ * @brief Share the result of an identical read of another session
+ *
+ * If no identical read is in progress, the session becomes the one that
+ * executes the read and shares the result.
+ *
+ * @param inst     Router instance
+ * @param rses     Router session
+ * @param querybuf Contiguous buffer with the read
+ * @param qtype    Type of the read
+ *
+ * @return True if the session waits for the result of another session, false
+ *         if the read must be routed
+ */
+bool rwsplit_flight_join(ROUTER_INSTANCE *inst, ROUTER_CLIENT_SES *rses,
+                         GWBUF *querybuf, qc_query_type_t qtype)
+{
+    if (!flight_is_shareable(rses, querybuf, qtype))
+    {
+        return false;
+    }
+
+    uint64_t hash = flight_hash(FLIGHT_HASH_INIT, GWBUF_DATA(querybuf), GWBUF_LENGTH(querybuf));
+    hash = flight_hash_str(hash, flight_user(rses));
+    hash = flight_hash_str(hash, flight_db(rses));
+    hash = flight_hash(hash, (uint8_t*)&rses->rses_sescmd_hash, sizeof(rses->rses_sescmd_hash));
+
+    rwsplit_flight_t **list = &inst->flights[rses->client_dcb->thread.id];
+    rwsplit_flight_t *flight = *list;
+
+    while (flight && !flight_matches(flight, hash, rses, querybuf))
+    {
+        flight = flight->next;
+    }
+
+    if (flight)
+    {
+        rwsplit_flight_waiter_t *waiter = MXS_MALLOC(sizeof(*waiter));
+        GWBUF *query = gwbuf_clone(querybuf);
+
+        if (waiter && query)
+        {
+            waiter->rses = rses;
+            waiter->query = query;
+            waiter->inst = inst;
+            waiter->flight = flight;
+            mxs_timer_init(&waiter->timer, flight_timeout, waiter);
+        }
+
+        if (waiter && query &&
+            mxs_timer_start(&waiter->timer, rses->rses_config.single_flight_timeout, 0))
+        {
+            waiter->next = flight->waiters;
+            flight->waiters = waiter;
+            rses->rses_flight = flight;
+            MXS_INFO("Waiting for the result of an identical read of another session.");
+            return true;
+        }
+
+        MXS_FREE(waiter);
+        gwbuf_free(query);
+        return false;
+    }
+
+    if ((flight = MXS_CALLOC(1, sizeof(*flight))))
+    {
+        flight->user = MXS_STRDUP(flight_user(rses));
+        flight->db = MXS_STRDUP(flight_db(rses));
+        flight->query = gwbuf_clone(querybuf);
+
+        if (flight->user && flight->db && flight->query)
+        {
+            flight->hash = hash;
+            flight->sescmd_hash = rses->rses_sescmd_hash;
+            flight->leader = rses;
+            flight->next = *list;
+            *list = flight;
+            rses->rses_flight = flight;
+        }
+        else
+        {
+            flight_free(flight);
+        }
+    }
+
+    return false;
+}
+
+/**
+ * Copy a reply for a waiter
+ */
+static GWBUF *flight_copy_reply(ROUTER_CLIENT_SES *rses, GWBUF *reply)
+{
+    if (rses->client_dcb->session->service->n_filters == 0)
+    {
+        return gwbuf_clone(reply);
+    }
+
+    /** Filters can modify the reply in place */
+    size_t len = gwbuf_length(reply);
+    GWBUF *copy = gwbuf_alloc(len);
+
+    if (copy)
+    {
+        gwbuf_copy_data(reply, 0, len, GWBUF_DATA(copy));
+        gwbuf_set_type(copy, reply->gwbuf_type);
+    }
+
+    return copy;
+}
+
+/**
+ * @brief Send a part of the result of a shared read to the waiters
+ *
+ * @param inst  Router instance
+ * @param rses  Router session that executes the read
+ * @param reply Part of the result
+ * @param done  Whether this is the end of the result
+ */
+void rwsplit_flight_reply(ROUTER_INSTANCE *inst, ROUTER_CLIENT_SES *rses, GWBUF *reply, bool done)
+{
+    rwsplit_flight_t *flight = rses->rses_flight;
+
+    if (flight == NULL || flight->leader != rses)
+    {
+        return;
+    }
+
+    if (reply)
+    {
+        flight->started = true;
+
+        for (rwsplit_flight_waiter_t *waiter = flight->waiters; waiter; waiter = waiter->next)
+        {
+            MXS_SESSION *session = waiter->rses->client_dcb->session;
+            GWBUF *copy;
+
+            if (!waiter->rses->rses_closed && session->state == SESSION_STATE_ROUTER_READY &&
+                (copy = flight_copy_reply(waiter->rses, reply)))
+            {
+                MXS_SESSION_ROUTE_REPLY(session, copy);
+            }
+        }
+    }
+
+    if (done)
+    {
+        flight_unlink(inst, rses, flight);
+        rses->rses_flight = NULL;
+
+        while (flight->waiters)
+        {
+            rwsplit_flight_waiter_t *waiter = flight->waiters;
+            flight->waiters = waiter->next;
+            waiter->rses->rses_flight = NULL;
+            atomic_add_uint64(&inst->stats.n_shared, 1);
+
+            if (!waiter->rses->rses_closed)
+            {
+                rwsplit_pipeline_route_held(inst, waiter->rses);
+            }
+
+            flight_waiter_free(waiter);
+        }
+
+        flight_free(flight);
+    }
+}
+
+/**
+ * @brief Stop executing or waiting for a shared read
+ *
+ * If the session executes the read, the waiters route the read themselves.
+ * If part of the result was already sent, the waiters are closed.
+ *
+ * @param inst Router instance
+ * @param rses Router session
+ */
+void rwsplit_flight_leave(ROUTER_INSTANCE *inst, ROUTER_CLIENT_SES *rses)
+{
+    rwsplit_flight_t *flight = rses->rses_flight;
+
+    if (flight == NULL)
+    {
+        return;
+    }
+
+    rses->rses_flight = NULL;
+
+    if (flight->leader == rses)
+    {
+        flight_unlink(inst, rses, flight);
+
+        while (flight->waiters)
+        {
+            rwsplit_flight_waiter_t *waiter = flight->waiters;
+            flight->waiters = waiter->next;
+
+            if (flight->started)
+            {
+                MXS_ERROR("Session executing a shared read was closed while sending the "
+                          "result, closing the sessions that received a part of it.");
+                waiter->rses->rses_flight = NULL;
+                poll_fake_hangup_event(waiter->rses->client_dcb);
+                flight_waiter_free(waiter);
+            }
+            else
+            {
+                flight_release(inst, waiter, false);
+            }
+        }
+
+        flight_free(flight);
+    }
+    else
+    {
+        rwsplit_flight_waiter_t **prev = &flight->waiters;
+
+        while (*prev && (*prev)->rses != rses)
+        {
+            prev = &(*prev)->next;
+        }
+
+        if (*prev)
+        {
+            rwsplit_flight_waiter_t *waiter = *prev;
+            *prev = waiter->next;
+            flight_waiter_free(waiter);
+        }
+    }
+}
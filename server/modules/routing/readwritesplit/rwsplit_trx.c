@@ -0,0 +1,728 @@
+/*
+ * Copyright (c) 2016 MariaDB Corporation Ab
+ *
+ * Use of this software is governed by the Business Source License included
+ * in the LICENSE.TXT file and at www.mariadb.com/bsl11.
+ *
+ * Change Date: 2019-07-01
+ *
+ * On the date above, in accordance with the Business Source License, use
+ * of this software will be governed by version 2 or later of the General
+ * Public License.
+ */
+
+#include "readwritesplit.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+#include <maxscale/alloc.h>
+#include <maxscale/modutil.h>
+#include <maxscale/mysql_utils.h>
+#include <maxscale/poll.h>
+#include <maxscale/router.h>
+#include <maxscale/protocol/mysql.h>
+#include "rwsplit_internal.h"
+
+/**
+ * @file rwsplit_trx.c   Transaction replay in the read write split router.
+ *
+ * The statements of the open transaction are recorded along with a checksum
+ * of their results. If the server that executes the transaction fails, the
+ * transaction is executed again on a replacement server. The replay succeeds
+ * if the results of the replayed statements match the original results, after
+ * which the statement that was interrupted by the failure is routed normally.
+ *
+ * Optimistic transactions are started on a slave and moved to the master by
+ * replaying them there when the first statement that a slave can't execute
+ * is routed.
+ */
+
+/** How often a replacement server is looked for, in milliseconds */
+#define RWSPLIT_TRX_RETRY_INTERVAL 1000
+
+static bool trx_replay_try(ROUTER_INSTANCE *inst, ROUTER_CLIENT_SES *rses);
+
+static void trx_free_stmts(rwsplit_trx_t *trx)
+{
+    rwsplit_trx_stmt_t *stmt = trx->head;
+
+    while (stmt)
+    {
+        rwsplit_trx_stmt_t *next = stmt->next;
+        gwbuf_free(stmt->stmt);
+        MXS_FREE(stmt);
+        stmt = next;
+    }
+
+    trx->head = NULL;
+    trx->tail = NULL;
+    trx->current = NULL;
+    trx->size = 0;
+}
+
+/**
+ * Forget the transaction
+ */
+static void trx_reset(ROUTER_CLIENT_SES *rses)
+{
+    rwsplit_trx_t *trx = &rses->rses_trx;
+
+    if (trx->optimistic && rses->forced_node == trx->target)
+    {
+        rses->forced_node = NULL;
+    }
+
+    trx_free_stmts(trx);
+    gwbuf_free(trx->pending);
+    trx->pending = NULL;
+    mxs_timer_stop(&trx->timer);
+
+    trx->active = false;
+    trx->replayable = false;
+    trx->ending = false;
+    trx->optimistic = false;
+    trx->target = NULL;
+    trx->current_sent = false;
+    trx->replaying = false;
+    trx->deadline = 0;
+}
+
+/**
+ * Replay failed, send an error to the client and close the session
+ */
+static void trx_replay_failed(ROUTER_CLIENT_SES *rses, const char *reason)
+{
+    MXS_ERROR("Transaction replay failed: %s", reason);
+
+    GWBUF *err = modutil_create_mysql_err_msg(1, 0, 1927, "08S01", "Transaction replay failed");
+
+    if (err)
+    {
+        rses->client_dcb->func.write(rses->client_dcb, err);
+    }
+
+    trx_reset(rses);
+    poll_fake_hangup_event(rses->client_dcb);
+}
+
+static void trx_replay_timer_cb(MXS_TIMER *timer, void *data)
+{
+    ROUTER_CLIENT_SES *rses = (ROUTER_CLIENT_SES *)data;
+
+    if (!rses->rses_closed && rses->rses_trx.replaying && !trx_replay_try(rses->router, rses))
+    {
+        trx_replay_failed(rses, "No replacement server was found in time");
+    }
+}
+
+/**
+ * Start a new statement of the transaction
+ */
+static void trx_start_stmt(rwsplit_trx_t *trx, rwsplit_trx_stmt_t *stmt)
+{
+    trx->current = stmt;
+    trx->current_sent = false;
+    modutil_reply_tracker_init(&trx->tracker, MYSQL_GET_COMMAND(GWBUF_DATA(stmt->stmt)));
+    SHA1_Init(&trx->sha);
+}
+
+/**
+ * Add the relevant parts of a reply to the checksum
+ *
+ * The OK packet that ends the reply is only partially included as the last
+ * insert ID and the status information can differ between servers. The EOF
+ * packets are left out for the same reason.
+ */
+static void trx_checksum_update(rwsplit_trx_t *trx, GWBUF *reply, bool complete)
+{
+    uint8_t *ptr = GWBUF_DATA(reply);
+    uint8_t *end = ptr + GWBUF_LENGTH(reply);
+
+    while (ptr < end)
+    {
+        if (end - ptr <= MYSQL_HEADER_LEN)
+        {
+            SHA1_Update(&trx->sha, ptr, end - ptr);
+            break;
+        }
+
+        uint32_t payload_len = MYSQL_GET_PAYLOAD_LEN(ptr);
+        uint8_t *payload = ptr + MYSQL_HEADER_LEN;
+        uint8_t *next = payload_len > (uint32_t)(end - payload) ? end : payload + payload_len;
+
+        if (next == payload)
+        {
+            // Empty packet, nothing to add
+        }
+        else if (*payload == MYSQL_REPLY_EOF && payload_len < 9)
+        {
+            SHA1_Update(&trx->sha, payload, 1);
+        }
+        else if (*payload == MYSQL_REPLY_OK && complete && next == end)
+        {
+            size_t len = 1;
+
+            if (next - payload > 1 && (size_t)(next - payload - 1) >= mxs_leint_bytes(payload + 1))
+            {
+                /** Affected rows */
+                len += mxs_leint_bytes(payload + 1);
+            }
+
+            SHA1_Update(&trx->sha, payload, len);
+        }
+        else
+        {
+            SHA1_Update(&trx->sha, payload, next - payload);
+        }
+
+        ptr = next;
+    }
+}
+
+/**
+ * Send a recorded statement to the transaction target
+ */
+static bool trx_send(ROUTER_INSTANCE *inst, ROUTER_CLIENT_SES *rses, rwsplit_trx_stmt_t *stmt)
+{
+    rwsplit_trx_t *trx = &rses->rses_trx;
+    backend_ref_t *bref = trx->target;
+
+    trx_start_stmt(trx, stmt);
+
+    if (sescmd_cursor_is_active(&bref->bref_sescmd_cur))
+    {
+        /** The session command history is still being executed */
+        bref->bref_pending_cmd = gwbuf_append(bref->bref_pending_cmd, gwbuf_clone(stmt->stmt));
+        return true;
+    }
+
+    if (bref->bref_dcb->func.write(bref->bref_dcb, gwbuf_clone(stmt->stmt)) == 1)
+    {
+        atomic_add_uint64(&inst->stats.n_queries, 1);
+        bref_track_reply(rses, bref, stmt->stmt);
+        bref_set_state(bref, BREF_QUERY_ACTIVE);
+        bref_set_state(bref, BREF_WAITING_RESULT);
+        return true;
+    }
+
+    return false;
+}
+
+/**
+ * Replay the next statement or, if all statements are replayed, route the
+ * statements that were received during the replay
+ */
+static void trx_replay_next(ROUTER_INSTANCE *inst, ROUTER_CLIENT_SES *rses, rwsplit_trx_stmt_t *next)
+{
+    rwsplit_trx_t *trx = &rses->rses_trx;
+
+    if (next)
+    {
+        if (!trx_send(inst, rses, next))
+        {
+            trx_replay_failed(rses, "Failed to write to the replacement server");
+        }
+        return;
+    }
+
+    MXS_INFO("Transaction replayed on '%s'.", trx->target->ref->server->unique_name);
+    trx->current = NULL;
+    trx->replaying = false;
+
+    GWBUF *packet;
+
+    /** A statement can start a new replay in which case the rest are routed after it */
+    while (!trx->replaying && (packet = modutil_get_next_MySQL_packet(&trx->pending)))
+    {
+        packet = gwbuf_make_contiguous(packet);
+
+        if (packet == NULL)
+        {
+            trx_replay_failed(rses, "Memory allocation failed");
+            break;
+        }
+
+        gwbuf_set_type(packet, GWBUF_TYPE_MYSQL);
+        bool routed = route_single_stmt(inst, rses, packet);
+        gwbuf_free(packet);
+
+        if (!routed)
+        {
+            MXS_ERROR("Failed to route a statement after the transaction replay.");
+            poll_fake_hangup_event(rses->client_dcb);
+            break;
+        }
+    }
+}
+
+/**
+ * Find a replacement server and start the replay. If none is available,
+ * the search is retried until the replay times out.
+ *
+ * @return False if the replay timed out or could not be started
+ */
+static bool trx_replay_try(ROUTER_INSTANCE *inst, ROUTER_CLIENT_SES *rses)
+{
+    rwsplit_trx_t *trx = &rses->rses_trx;
+    backend_ref_t *bref = NULL;
+
+    if (session_trx_is_read_only(rses->client_dcb->session))
+    {
+        DCB *dcb = NULL;
+        rses->forced_node = NULL;
+
+        if (rwsplit_get_dcb(&dcb, rses, BE_SLAVE, NULL, rses_get_max_replication_lag(rses)) && dcb)
+        {
+            bref = get_bref_from_dcb(rses, dcb);
+            rses->forced_node = bref;
+        }
+    }
+    else
+    {
+        backend_ref_t *old_master = rses->rses_master_ref;
+        bref = select_connect_master(rses);
+
+        if (bref && rses->forced_node && rses->forced_node == old_master)
+        {
+            /** The session was locked to the old master */
+            rses->forced_node = bref;
+        }
+    }
+
+    if (bref == NULL)
+    {
+        return mxs_timer_now() < trx->deadline &&
+               mxs_timer_start(&trx->timer, RWSPLIT_TRX_RETRY_INTERVAL, 0);
+    }
+
+    MXS_INFO("Replaying transaction on '%s'.", bref->ref->server->unique_name);
+    trx->target = bref;
+    trx_replay_next(inst, rses, trx->head);
+    return true;
+}
+
+/**
+ * @brief Prepare the transaction state of a new session
+ *
+ * @param rses Router session
+ */
+void rwsplit_trx_init(ROUTER_CLIENT_SES *rses)
+{
+    mxs_timer_init(&rses->rses_trx.timer, trx_replay_timer_cb, rses);
+}
+
+/**
+ * @brief Stop the replay of a closing session
+ *
+ * @param rses Router session
+ */
+void rwsplit_trx_close(ROUTER_CLIENT_SES *rses)
+{
+    mxs_timer_stop(&rses->rses_trx.timer);
+}
+
+/**
+ * @brief Free the recorded transaction
+ *
+ * @param rses Router session
+ */
+void rwsplit_trx_free(ROUTER_CLIENT_SES *rses)
+{
+    trx_free_stmts(&rses->rses_trx);
+    gwbuf_free(rses->rses_trx.pending);
+    rses->rses_trx.pending = NULL;
+}
+
+/**
+ * @brief Start an optimistic transaction
+ *
+ * A transaction started with a plain BEGIN or START TRANSACTION is executed
+ * on a slave until a statement that requires the master is routed.
+ *
+ * @param rses  Router session
+ * @param qtype Type of the statement being routed
+ */
+void rwsplit_trx_begin(ROUTER_CLIENT_SES *rses, qc_query_type_t qtype)
+{
+    rwsplit_trx_t *trx = &rses->rses_trx;
+
+    if (rses->rses_config.optimistic_trx && qc_query_is_type(qtype, QUERY_TYPE_BEGIN_TRX) &&
+        session_get_trx_state(rses->client_dcb->session) == SESSION_TRX_ACTIVE &&
+        rses->forced_node == NULL && !rses->have_tmp_tables && !rses->rses_load_active &&
+        !trx->replaying && (!trx->active || trx->ending))
+    {
+        trx->optimistic = true;
+    }
+}
+
+/**
+ * @brief Check whether a statement can be executed in an optimistic transaction
+ *
+ * @param rses        Router session
+ * @param querybuf    The statement
+ * @param packet_type Command of the statement
+ * @param qtype       Type of the statement
+ *
+ * @return True if the statement can be executed on a slave
+ */
+bool rwsplit_trx_is_optimistic_stmt(ROUTER_CLIENT_SES *rses, GWBUF *querybuf,
+                                    int packet_type, qc_query_type_t qtype)
+{
+    return packet_type == MYSQL_COM_QUERY && querybuf->hint == NULL &&
+           rses->rses_trx.size + GWBUF_LENGTH(querybuf) <= rses->rses_config.trx_max_size &&
+           !check_for_multi_stmt(querybuf, rses->client_dcb->protocol, packet_type) &&
+           !check_for_sp_call(querybuf, packet_type) &&
+           !qc_query_is_type(qtype, QUERY_TYPE_WRITE) &&
+           !qc_query_is_type(qtype, QUERY_TYPE_MASTER_READ) &&
+           !qc_query_is_type(qtype, QUERY_TYPE_SESSION_WRITE) &&
+           !qc_query_is_type(qtype, QUERY_TYPE_USERVAR_WRITE) &&
+           !qc_query_is_type(qtype, QUERY_TYPE_GSYSVAR_WRITE) &&
+           !qc_query_is_type(qtype, QUERY_TYPE_PREPARE_STMT) &&
+           !qc_query_is_type(qtype, QUERY_TYPE_PREPARE_NAMED_STMT) &&
+           !qc_query_is_type(qtype, QUERY_TYPE_CREATE_TMP_TABLE) &&
+           !qc_query_is_type(qtype, QUERY_TYPE_READ_TMP_TABLE) &&
+           (qc_query_is_type(qtype, QUERY_TYPE_READ) ||
+            qc_query_is_type(qtype, QUERY_TYPE_SHOW_TABLES) ||
+            qc_query_is_type(qtype, QUERY_TYPE_SYSVAR_READ) ||
+            qc_query_is_type(qtype, QUERY_TYPE_GSYSVAR_READ) ||
+            (qc_query_is_type(qtype, QUERY_TYPE_USERVAR_READ) &&
+             rses->rses_config.use_sql_variables_in == TYPE_ALL) ||
+            qc_query_is_type(qtype, QUERY_TYPE_BEGIN_TRX) ||
+            qc_query_is_type(qtype, QUERY_TYPE_COMMIT) ||
+            qc_query_is_type(qtype, QUERY_TYPE_ROLLBACK));
+}
+
+/**
+ * @brief Move an optimistic transaction to the master
+ *
+ * The transaction is rolled back on the slave and replayed on the master.
+ * The statement that triggered the move is routed once the replay is done.
+ *
+ * @param inst     Router instance
+ * @param rses     Router session
+ * @param querybuf The statement that the slave can't execute
+ *
+ * @return True if the transaction is being moved
+ */
+bool rwsplit_trx_migrate(ROUTER_INSTANCE *inst, ROUTER_CLIENT_SES *rses, GWBUF *querybuf)
+{
+    rwsplit_trx_t *trx = &rses->rses_trx;
+    backend_ref_t *bref = trx->target;
+
+    if (trx->current || !trx->replayable || bref == NULL)
+    {
+        MXS_ERROR("Optimistic transaction can't be moved to the master.");
+        trx_reset(rses);
+        return false;
+    }
+
+    MXS_INFO("Moving optimistic transaction from '%s' to the master.",
+             bref->ref->server->unique_name);
+
+    trx->optimistic = false;
+    rses->forced_node = NULL;
+
+    GWBUF *rollback = modutil_create_query("ROLLBACK");
+
+    if (rollback)
+    {
+        /** The client does not know about the rollback */
+        bref->bref_discard_reply = true;
+
+        if (sescmd_cursor_is_active(&bref->bref_sescmd_cur))
+        {
+            bref->bref_pending_cmd = gwbuf_append(bref->bref_pending_cmd, rollback);
+        }
+        else if (bref->bref_dcb->func.write(bref->bref_dcb, gwbuf_clone(rollback)) == 1)
+        {
+            bref_track_reply(rses, bref, rollback);
+            gwbuf_free(rollback);
+            bref_set_state(bref, BREF_QUERY_ACTIVE);
+            bref_set_state(bref, BREF_WAITING_RESULT);
+        }
+        else
+        {
+            gwbuf_free(rollback);
+            bref->bref_discard_reply = false;
+        }
+    }
+
+    trx->pending = gwbuf_append(gwbuf_clone(querybuf), trx->pending);
+    trx->pending = gwbuf_append(trx->pending, rses->rses_pipeline_queue);
+    rses->rses_pipeline_queue = NULL;
+    trx->replaying = true;
+    trx->deadline = mxs_timer_now() + rses->rses_config.trx_replay_timeout * 1000;
+
+    if (!trx_replay_try(inst, rses))
+    {
+        trx_reset(rses);
+        return false;
+    }
+
+    return true;
+}
+
+/**
+ * @brief Record a statement routed to a server
+ *
+ * @param rses     Router session
+ * @param bref     The server the statement was routed to
+ * @param querybuf The statement
+ */
+void rwsplit_trx_record(ROUTER_CLIENT_SES *rses, backend_ref_t *bref, GWBUF *querybuf)
+{
+    rwsplit_trx_t *trx = &rses->rses_trx;
+    MXS_SESSION *session = rses->client_dcb->session;
+
+    if (!rses->rses_config.transaction_replay || trx->replaying)
+    {
+        return;
+    }
+
+    if (!session_trx_is_active(session))
+    {
+        if (trx->active)
+        {
+            trx_reset(rses);
+        }
+        return;
+    }
+
+    if (trx->active && trx->ending)
+    {
+        /** The reply to the previous COMMIT was not seen */
+        trx_reset(rses);
+    }
+
+    if (!trx->active)
+    {
+        trx->active = true;
+        trx->replayable = true;
+        trx->target = bref;
+    }
+
+    if (bref != trx->target)
+    {
+        return;
+    }
+
+    if (session_trx_is_ending(session))
+    {
+        trx->ending = true;
+    }
+
+    trx->current = NULL;
+
+    if (!trx->replayable)
+    {
+        return;
+    }
+
+    size_t len = GWBUF_LENGTH(querybuf);
+    rwsplit_trx_stmt_t *stmt = NULL;
+
+    if (len <= MYSQL_HEADER_LEN || MYSQL_GET_COMMAND(GWBUF_DATA(querybuf)) != MYSQL_COM_QUERY ||
+        rses->rses_load_active || BREF_IS_WAITING_GTID(bref) ||
+        trx->size + len > rses->rses_config.trx_max_size ||
+        (stmt = MXS_MALLOC(sizeof(*stmt))) == NULL)
+    {
+        MXS_INFO("Transaction can no longer be replayed.");
+        trx_free_stmts(trx);
+        trx->replayable = false;
+        return;
+    }
+
+    stmt->stmt = gwbuf_clone(querybuf);
+    stmt->next = NULL;
+
+    if (trx->tail)
+    {
+        trx->tail->next = stmt;
+    }
+    else
+    {
+        trx->head = stmt;
+    }
+
+    trx->tail = stmt;
+    trx->size += len;
+    trx_start_stmt(trx, stmt);
+}
+
+/**
+ * @brief Process a reply from the transaction target
+ *
+ * The checksum of the result is calculated. During a replay the reply is
+ * compared to the original one and discarded.
+ *
+ * @param inst  Router instance
+ * @param rses  Router session
+ * @param bref  The server that replied
+ * @param reply The reply
+ *
+ * @return The reply that is sent to the client or NULL if nothing is sent
+ */
+GWBUF *rwsplit_trx_process_reply(ROUTER_INSTANCE *inst, ROUTER_CLIENT_SES *rses,
+                                 backend_ref_t *bref, GWBUF *reply)
+{
+    rwsplit_trx_t *trx = &rses->rses_trx;
+    rwsplit_trx_stmt_t *stmt = trx->current;
+
+    if (bref != trx->target || stmt == NULL)
+    {
+        return reply;
+    }
+
+    if ((reply = gwbuf_make_contiguous(reply)) == NULL)
+    {
+        if (trx->replaying)
+        {
+            trx_replay_failed(rses, "Memory allocation failed");
+        }
+        else
+        {
+            trx_free_stmts(trx);
+            trx->replayable = false;
+        }
+        return NULL;
+    }
+
+    bool complete = modutil_reply_tracker_process(&trx->tracker, reply);
+    trx_checksum_update(trx, reply, complete);
+
+    if (!complete)
+    {
+        if (trx->replaying)
+        {
+            gwbuf_free(reply);
+            return NULL;
+        }
+
+        trx->current_sent = true;
+        return reply;
+    }
+
+    uint8_t checksum[SHA_DIGEST_LENGTH];
+    SHA1_Final(checksum, &trx->sha);
+    trx->current = NULL;
+
+    if (trx->replaying)
+    {
+        gwbuf_free(reply);
+
+        if (memcmp(checksum, stmt->checksum, sizeof(checksum)) != 0)
+        {
+            trx_replay_failed(rses, "Checksum mismatch, the transaction results differ");
+        }
+        else
+        {
+            trx_replay_next(inst, rses, stmt->next);
+        }
+
+        return NULL;
+    }
+
+    memcpy(stmt->checksum, checksum, sizeof(checksum));
+
+    if (trx->ending)
+    {
+        trx_reset(rses);
+    }
+
+    return reply;
+}
+
+/**
+ * @brief Check whether the failure of a server can be handled with a replay
+ *
+ * A statement whose result was partially sent to the client can't be
+ * replayed. A COMMIT of a read-write transaction that was interrupted
+ * may have been executed and is not replayed either.
+ *
+ * @param rses Router session
+ * @param bref The failed server
+ *
+ * @return True if the transaction can be replayed
+ */
+bool rwsplit_trx_can_replay(ROUTER_CLIENT_SES *rses, backend_ref_t *bref)
+{
+    rwsplit_trx_t *trx = &rses->rses_trx;
+
+    return rses->rses_config.transaction_replay && trx->active && trx->replayable &&
+           bref == trx->target && !trx->current_sent &&
+           (!trx->ending || trx->current == NULL || trx->optimistic ||
+            session_trx_is_read_only(rses->client_dcb->session));
+}
+
+/**
+ * @brief Replay the transaction after the failure of its server
+ *
+ * The statement that was being executed is routed again after the replay.
+ *
+ * @param inst Router instance
+ * @param rses Router session
+ *
+ * @return True if the replay was started or is waiting for a server
+ */
+bool rwsplit_trx_replay(ROUTER_INSTANCE *inst, ROUTER_CLIENT_SES *rses)
+{
+    rwsplit_trx_t *trx = &rses->rses_trx;
+
+    if (trx->current && !trx->replaying)
+    {
+        /** The interrupted statement is routed after the replay */
+        rwsplit_trx_stmt_t *stmt = trx->current;
+        rwsplit_trx_stmt_t *prev = NULL;
+
+        for (rwsplit_trx_stmt_t *s = trx->head; s != stmt; s = s->next)
+        {
+            prev = s;
+        }
+
+        if (prev)
+        {
+            prev->next = NULL;
+        }
+        else
+        {
+            trx->head = NULL;
+        }
+
+        trx->tail = prev;
+        trx->size -= GWBUF_LENGTH(stmt->stmt);
+        trx->pending = gwbuf_append(stmt->stmt, trx->pending);
+        MXS_FREE(stmt);
+    }
+
+    if (rses->forced_node == trx->target && rses->forced_node != rses->rses_master_ref)
+    {
+        /** A new slave is picked for a read-only transaction */
+        rses->forced_node = NULL;
+    }
+
+    /** The statements that were held for the interrupted one follow it */
+    trx->pending = gwbuf_append(trx->pending, rses->rses_pipeline_queue);
+    rses->rses_pipeline_queue = NULL;
+    trx->current = NULL;
+    trx->optimistic = false;
+    trx->replaying = true;
+    trx->deadline = mxs_timer_now() + rses->rses_config.trx_replay_timeout * 1000;
+
+    if (trx->head == NULL)
+    {
+        /** Nothing was recorded yet, only the interrupted statement is routed */
+        trx->active = false;
+    }
+
+    if (!trx_replay_try(inst, rses))
+    {
+        MXS_ERROR("Failed to replay the transaction: no replacement server was available.");
+        trx_reset(rses);
+        return false;
+    }
+
+    return true;
+}
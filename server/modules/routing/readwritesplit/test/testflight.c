@@ -0,0 +1,118 @@
+/*
+ * Copyright (c) 2016 MariaDB Corporation Ab
+ *
+ * Use of this software is governed by the Business Source License included
+ * in the LICENSE.TXT file and at www.mariadb.com/bsl11.
+ *
+ * Change Date: 2019-07-01
+ *
+ * On the date above, in accordance with the Business Source License, use
+ * of this software will be governed by version 2 or later of the General
+ * Public License.
+ */
+
+// To ensure that ss_info_assert asserts also when builing in non-debug mode.
+#if !defined(SS_DEBUG)
+#define SS_DEBUG
+#endif
+#if defined(NDEBUG)
+#undef NDEBUG
+#endif
+
+#include "../readwritesplit.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <maxscale/log_manager.h>
+#include <maxscale/modutil.h>
+#include <maxscale/paths.h>
+#include <maxscale/query_classifier.h>
+
+#include "../rwsplit_internal.h"
+
+static const struct
+{
+    const char *sql;
+    bool        shareable;
+} test_cases[] =
+{
+    {"SELECT a FROM t WHERE id = 1", true},
+    {"SELECT COUNT(*) FROM t", true},
+    {"SELECT UPPER(name), a + 1 FROM t WHERE b IN (1, 2)", true},
+    /** Locks */
+    {"SELECT GET_LOCK('lock', 10)", false},
+    {"SELECT RELEASE_LOCK('lock')", false},
+    {"SELECT IS_USED_LOCK('lock')", false},
+    /** Results of the session */
+    {"SELECT CONNECTION_ID()", false},
+    {"SELECT FOUND_ROWS()", false},
+    {"SELECT LAST_INSERT_ID()", false},
+    {"SELECT @@last_insert_id", false},
+    /** Non-deterministic functions */
+    {"SELECT RAND()", false},
+    {"SELECT a FROM t ORDER BY rand() LIMIT 1", false},
+    {"SELECT UUID()", false},
+    {"SELECT NOW()", false},
+    {"SELECT a FROM t WHERE created < now() - INTERVAL 1 DAY", false},
+    {"SELECT CURRENT_TIMESTAMP", false},
+    {"SELECT SLEEP(1)", false},
+    {NULL}
+};
+
+static int test_shareable()
+{
+    int rval = 0;
+
+    for (int i = 0; test_cases[i].sql; i++)
+    {
+        GWBUF *buf = modutil_create_query(test_cases[i].sql);
+        qc_query_type_t qtype = qc_get_type_mask(buf);
+
+        /** The same checks of the statement as in flight_is_shareable() */
+        bool shareable = qc_query_is_type(qtype, QUERY_TYPE_READ) &&
+                         !qc_query_is_type(qtype, QUERY_TYPE_USERVAR_READ) &&
+                         !qc_query_is_type(qtype, QUERY_TYPE_SYSVAR_READ) &&
+                         rwsplit_flight_sql_is_shareable(buf);
+
+        if (shareable != test_cases[i].shareable)
+        {
+            fprintf(stderr, "'%s' should %sbe shared\n", test_cases[i].sql,
+                    test_cases[i].shareable ? "" : "not ");
+            rval++;
+        }
+
+        gwbuf_free(buf);
+    }
+
+    return rval;
+}
+
+int main(int argc, char **argv)
+{
+    int rval = EXIT_FAILURE;
+
+    set_datadir(strdup("/tmp"));
+    set_langdir(strdup("."));
+    set_process_datadir(strdup("/tmp"));
+
+    if (mxs_log_init(NULL, ".", MXS_LOG_TARGET_DEFAULT))
+    {
+        if (qc_setup("qc_sqlite", NULL) && qc_process_init(QC_INIT_BOTH))
+        {
+            rval = test_shareable();
+            qc_process_end(QC_INIT_BOTH);
+        }
+        else
+        {
+            fprintf(stderr, "error: Could not initialize qc_sqlite.\n");
+        }
+
+        mxs_log_finish();
+    }
+    else
+    {
+        fprintf(stderr, "error: Could not initialize log.\n");
+    }
+
+    return rval;
+}
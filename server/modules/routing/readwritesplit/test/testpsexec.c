@@ -0,0 +1,171 @@
+/*
+ * Copyright (c) 2016 MariaDB Corporation Ab
+ *
+ * Use of this software is governed by the Business Source License included
+ * in the LICENSE.TXT file and at www.mariadb.com/bsl11.
+ *
+ * Change Date: 2019-07-01
+ *
+ * On the date above, in accordance with the Business Source License, use
+ * of this software will be governed by version 2 or later of the General
+ * Public License.
+ */
+
+// To ensure that ss_info_assert asserts also when builing in non-debug mode.
+#if !defined(SS_DEBUG)
+#define SS_DEBUG
+#endif
+#if defined(NDEBUG)
+#undef NDEBUG
+#endif
+
+#include "../readwritesplit.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <maxscale/alloc.h>
+#include <maxscale/debug.h>
+
+#include "../rwsplit_internal.h"
+
+#define N_PARAMS   2
+#define N_BACKENDS 2
+
+/** Offset of the new-params-bound flag with two parameters */
+#define BOUND_OFFSET (MYSQL_HEADER_LEN + 1 + 4 + 1 + 4 + 1)
+
+static const uint8_t long_types[2 * N_PARAMS] = {MYSQL_TYPE_LONG, 0, MYSQL_TYPE_LONG, 0};
+static const uint8_t string_types[2 * N_PARAMS] = {MYSQL_TYPE_VAR_STRING, 0, MYSQL_TYPE_LONG, 0};
+static const uint8_t values[] = {1, 0, 0, 0, 2, 0, 0, 0};
+
+/**
+ * Create a COM_STMT_EXECUTE with two parameters
+ *
+ * @param types The parameter types or NULL if new-params-bound is not set
+ */
+static GWBUF *create_execute(const uint8_t *types)
+{
+    uint8_t packet[BOUND_OFFSET + 1 + 2 * N_PARAMS + sizeof(values)];
+    uint8_t *ptr = packet + MYSQL_HEADER_LEN;
+
+    *ptr++ = MYSQL_COM_STMT_EXECUTE;
+    gw_mysql_set_byte4(ptr, 1);
+    ptr += 4;
+    *ptr++ = 0;                 // Flags
+    gw_mysql_set_byte4(ptr, 1); // Iteration count
+    ptr += 4;
+    *ptr++ = 0;                 // NULL bitmap
+    *ptr++ = types ? 1 : 0;
+
+    if (types)
+    {
+        memcpy(ptr, types, 2 * N_PARAMS);
+        ptr += 2 * N_PARAMS;
+    }
+
+    memcpy(ptr, values, sizeof(values));
+    ptr += sizeof(values);
+
+    gw_mysql_set_byte3(packet, ptr - packet - MYSQL_HEADER_LEN);
+    packet[3] = 0;
+
+    return gwbuf_alloc_and_load(ptr - packet, packet);
+}
+
+/**
+ * Check that an execution carries the types and the values
+ */
+static bool has_types(GWBUF *exec, const uint8_t *types)
+{
+    uint8_t *data = GWBUF_DATA(exec);
+
+    return GWBUF_LENGTH(exec) == BOUND_OFFSET + 1 + 2 * N_PARAMS + sizeof(values) &&
+           MYSQL_GET_PAYLOAD_LEN(data) + MYSQL_HEADER_LEN == GWBUF_LENGTH(exec) &&
+           data[BOUND_OFFSET] == 1 &&
+           memcmp(data + BOUND_OFFSET + 1, types, 2 * N_PARAMS) == 0 &&
+           memcmp(data + BOUND_OFFSET + 1 + 2 * N_PARAMS, values, sizeof(values)) == 0;
+}
+
+/**
+ * Route an execution to a backend and check whether the types were added
+ *
+ * @param types  The types sent by the client or NULL
+ * @param added  The types that should be added or NULL if the execution
+ *               should be sent as it is
+ */
+static void test_exec(rwsplit_ps_t *ps, int backend, const uint8_t *types, const uint8_t *added)
+{
+    GWBUF *exec = create_execute(types);
+    GWBUF *sent = rwsplit_ps_exec_types(ps, backend, exec);
+
+    ss_info_dassert(sent, "Execution should be sent");
+
+    if (added)
+    {
+        ss_info_dassert(sent != exec, "Types should be added");
+        ss_info_dassert(has_types(sent, added), "Execution should have the types");
+        gwbuf_free(sent);
+    }
+    else
+    {
+        ss_info_dassert(sent == exec, "Execution should be sent as it is");
+    }
+
+    ss_info_dassert(ps->ps_types_sent[backend], "Backend should have the types");
+    gwbuf_free(exec);
+}
+
+static int test_types()
+{
+    bool types_sent[N_BACKENDS] = {};
+    rwsplit_ps_t ps = {};
+    ps.ps_n_params = N_PARAMS;
+    ps.ps_types_sent = types_sent;
+    ps.ps_nbackends = N_BACKENDS;
+
+    /** Only the first execution sends the types and the second one is
+     * routed to another backend */
+    test_exec(&ps, 0, long_types, NULL);
+    ss_info_dassert(!types_sent[1], "Second backend should not have the types");
+    test_exec(&ps, 1, NULL, long_types);
+    test_exec(&ps, 1, NULL, NULL);
+    test_exec(&ps, 0, NULL, NULL);
+
+    /** New types make the other backends stale */
+    test_exec(&ps, 1, string_types, NULL);
+    ss_info_dassert(!types_sent[0], "First backend should not have the new types");
+    test_exec(&ps, 0, NULL, string_types);
+
+    /** A reconnected backend gets the types again */
+    types_sent[1] = false;
+    test_exec(&ps, 1, NULL, string_types);
+
+    MXS_FREE(ps.ps_types);
+
+    return 0;
+}
+
+static int test_no_params()
+{
+    bool types_sent[N_BACKENDS] = {};
+    rwsplit_ps_t ps = {};
+    ps.ps_types_sent = types_sent;
+    ps.ps_nbackends = N_BACKENDS;
+
+    GWBUF *exec = create_execute(NULL);
+    ss_info_dassert(rwsplit_ps_exec_types(&ps, 1, exec) == exec,
+                    "Executions without parameters should be sent as they are");
+    gwbuf_free(exec);
+
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    int rval = 0;
+
+    rval += test_types();
+    rval += test_no_params();
+
+    return rval;
+}